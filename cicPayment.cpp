@@ -10,12 +10,13 @@
 
 #ifdef _PAYMENT_
 
-#include "cicClock.h"
-#include "ExportFs.h"
-#include "cicDC.h"
+#include "cicPaymentPort.h"
+#include "cicPaymentProfile.h"
+#include "cicPaymentJournal.h"
+#include "cicPaymentTransaction.h"
+#include "cicPaymentEmergency.h"
 #include "stdlib.h"
 #include "utils.h"
-#include "apduTask.h"
 #include "acse.h"
 #include "_objectMaps.h"
 #include "cicEventAlarmErrorState.h"
@@ -30,42 +31,49 @@
 /* Default (whenever a meter is newly installed) configuration of Import Account */
 static PaymentAccountCfg defaultImportAccountCfg = {
     .modeAndStatus              = { prepaymentMode, newAccount },       // 2 (creditMode may not change by consumer)
-    .clearanceThreshold         = 0,                                    // 7 (may not change by consumer)
     .creditRefList              = { &PaymentImportCreditLn },           // 9 (may not change by consumer)
     .chargeRefList              = { &PaymentActiveImportChargeLn },     // 10 (may not change by consumer)
     .creditChargeCfg            = { {&PaymentImportCreditLn, &PaymentActiveImportChargeLn, 0} },        // 11 (may not change by consumer)
     .tokenGatewayCfg            = { /*0*/ {PaymentImportCreditLn, 100} },     // 12 (may not change by consumer)
-    .accountActivationTime      = {0},                                  // 13 (may change by consumer or by soft)
-    .accountClosureTime         = {0},                                  // 14 (may change by consumer or by soft)
+    .accountActivationTime      = PAYMENT_TIME_NOT_SPECIFIED,           // 13 (may change by consumer or by soft)
+    .accountClosureTime         = PAYMENT_TIME_NOT_SPECIFIED,           // 14 (may change by consumer or by soft)
     .currency                   = { { 'M', 'D', 'L' }, -2, currencyUnitMonetary },                      // 15 (may not change by consumer)
-    .maxProvision               = 0,                                    // 18 (may be set by consumer)
-    .maxProvisionPeriod         = 0                                     // 19 (may be set by consumer)
+    .maxProvisionPeriod         = 0,                                    // 19 (may be set by consumer)
+    .clearanceThreshold         = 0,                                    // 7 (may not change by consumer)
+    .maxProvision               = 0                                     // 18 (may be set by consumer)
 };
 
 /* Default (whenever a meter is newly installed) configuration of Import Credit */
 static PaymentCreditCfg defaultImportCreditCfg = {
-    .creditType                 = tokenCredit,  // 3 (may not change by consumer)
-    .priority                   = 1,            // 4 (may not change by consumer)
+    .period                     = {0},          // 11 (may not change by consumer) (if credit_type = time_based_credit/consumption_based_credit then must be set by consumer)    
     .warningThreshold           = 0,            // 5 (may be set by consumer or may remain 0)
     .limit                      = 0,            // 6 (may be set by consumer or may remain 0)
-    .creditConfiguration        = 0,            // 7 (may not change by consumer)
     .presetCreditAmount         = 0,            // 9 (may not change by consumer)
     .creditAvailableThreshold   = 0,            // 10 (may not change by consumer)
-    .period                     = {0}           // 11 (may not change by consumer) (if credit_type = time_based_credit/consumption_based_credit then must be set by consumer)    
+    .creditType                 = tokenCredit,  // 3 (may not change by consumer)
+    .priority                   = 1,            // 4 (may not change by consumer)
+    .creditConfiguration        = 0             // 7 (may not change by consumer)
 };
 
 /* Default (whenever a meter is newly installed) configuration of Active TOU Import Charge */
 static PaymentChargeCfg defaultActiveImportChargeCfg = {
-    .chargeType                 = PaymentChargeConsumptionBased,        // 3 (may not change by consumer)
-    .priority                   = 1,                                    // 4 (may not change by consumer)
     .unitChargeActive           = {0},                                  // 5 (may be changed by soft)
-    .unitChargePassive          = { {-3, -2}, {Register, RegisterAsumLN, 3}, {{{0}, 184}} }, // 6 (may be set by consumer)      { {1, 2}, {Register, &RegisterAsumLN, 3}, {{{4, 5}, 6}, {{7, 8}, 9}} }
-    .unitChargeActivationTime   = {0},                                  // 7 (may be set by consumer)
+    .unitChargePassive          = { {-3, -2}, {RegisterAsumLN, Register, 3}, {{{0}, 184}} }, // 6 (may be set by consumer)      { {1, 2}, {Register, &RegisterAsumLN, 3}, {{{4, 5}, 6}, {{7, 8}, 9}} }
+    .unitChargeActivationTime   = PAYMENT_TIME_NOT_SPECIFIED,           // 7 (may be set by consumer)
+    .proportion                 = 0,                                    // 13 (may not change by consumer)    
     .period                     = 60,                                   // 8 (may be set by consumer)
-    .chargeConfiguration        = 0 | chargeContinuousCollection,       // 9 (may not change by consumer)
-    .proportion                 = 0                                     // 13 (may not change by consumer)    
+    .chargeType                 = PaymentChargeConsumptionBased,        // 3 (may not change by consumer)
+    .priority                   = 1,                                    // 4 (may not change by consumer)
+    .chargeConfiguration        = 0 | chargeContinuousCollection        // 9 (may not change by consumer)
 };
 
+#ifdef PAYMENT_HOST_BUILD
+/* Taken before the import objects change the configurations, every meter of the harness starts with them */
+static const PaymentAccountCfg hostImportAccountCfg = defaultImportAccountCfg;
+static const PaymentCreditCfg hostImportCreditCfg = defaultImportCreditCfg;
+static const PaymentChargeCfg hostActiveImportChargeCfg = defaultActiveImportChargeCfg;
+#endif // PAYMENT_HOST_BUILD
+
 static ftPaymentAccount ftImportAccount =
 {
     .ftAccountStatus            =       ftImportAccount_AccountStatus,
@@ -73,7 +81,8 @@ static ftPaymentAccount ftImportAccount =
     .ftAccountClosureTime       =       ftImportAccount_AccountClosureTime,
     .ftMaxProvision             =       ftImportAccount_MaxProvision,
     .ftMaxProvisionPeriod       =       ftImportAccount_MaxProvisionPeriod,
-    .ftCurrency                 =       ftImportAccount_Currency
+    .ftCurrency                 =       ftImportAccount_Currency,
+    .ftTimeFormat               =       ftImportAccount_TimeFormat
 };
 
 static ftPaymentCredit ftImportCredit =
@@ -89,13 +98,16 @@ static ftPaymentCharge ftActiveImportCharge =
     .ftTotalAmountPaid          =       ftActiveImportCharge_TotalAmountPaidQ,
     .ftUnitChargeActive         =       ftActiveImportCharge_UnitChargeActive,
     .ftUnitChargePassive        =       ftActiveImportCharge_UnitChargePassive,
+    .ftUnitChargeActiveElement  =       ftActiveImportCharge_UnitChargeActiveElement,
+    .ftUnitChargePassiveElement =       ftActiveImportCharge_UnitChargePassiveElement,
     .ftUnitChargeActivationTime =       ftActiveImportCharge_UnitChargeActivationTime,
     .ftPeriod                   =       ftActiveImportCharge_Period,
     .ftLastCollectionTime       =       ftActiveImportCharge_LastCollectionTimeQ,
     .ftLastCollectionAmount     =       ftActiveImportCharge_LastCollectionAmountQ,
     .ftTotalAmountRemaining     =       ftActiveImportCharge_TotalAmountRemainingQ,
     .ftLastMeasurementValue     =       ftActiveImportCharge_LastMeasurementValueQ,
-    .ftSumToCollect             =       ftActiveImportCharge_SumToCollectQ
+    .ftSumToCollect             =       ftActiveImportCharge_SumToCollectQ,
+    .ftTimeFormat               =       ftActiveImportCharge_TimeFormat
 };
 
 static ftPaymentTokenGateway ftTokenGatewayForImportAccount =
@@ -111,7 +123,8 @@ static ftPaymentTokenGateway ftTokenGatewayForImportAccount =
     .ftExpiresTimeSecReceivedWithStart  = ftImportTokenGateway_ExpiresTime,
     .ftExpiresTimeStatusReceivedWithStart = ftImportTokenGateway_ExpiresTimeStatus,
     .ftTimeOfStartSec           =       ftImportTokenGateway_TimeOfStart,
-    .ftTimeOfStartStatus        =       ftImportTokenGateway_TimeOfStartStatus
+    .ftTimeOfStartStatus        =       ftImportTokenGateway_TimeOfStartStatus,
+    .ftTokenIDHistory           =       ftImportTokenGateway_TokenIDHistory
 };
 
 //ftStartStopServiceFile ftStartStopService =
@@ -132,7 +145,7 @@ CIC_STS_TOKEN_GATEWAY_ADD_OBJECT( PaymentImportTokenGatewayLn, PaymentTokenGatew
 static PaymentCreditClass PaymentImportCredit( &PaymentImportCreditLn, &defaultImportCreditCfg, &ftImportCredit );
 static PaymentChargeClass PaymentActiveImportCharge( &PaymentActiveImportChargeLn, &defaultActiveImportChargeCfg, &ftActiveImportCharge );
 
-static PaymentTokenGatewayClass TokenGatewayForImportAccount( &PaymentImportTokenGatewayLn, &ftTokenGatewayForImportAccount );
+PaymentTokenGatewayClass TokenGatewayForImportAccount( &PaymentImportTokenGatewayLn, &ftTokenGatewayForImportAccount );
 #endif
 
 static PaymentCreditClass* importAccountCreditList[MAX_OBJECTS_IN_CREDIT_REF_LIST] =
@@ -151,6 +164,44 @@ CIC_STS_ACCOUNT_ADD_OBJECT( PaymentImportAccountLn, PaymentAccountClass, Payment
 static PaymentAccountClass PaymentImportAccount( &PaymentImportAccountLn, &defaultImportAccountCfg, importAccountCreditList, importAccountChargeList, &TokenGatewayForImportAccount, &ftImportAccount );
 #endif
 
+#ifdef PAYMENT_HOST_BUILD
+/*
+Objects of one more simulated meter with the default configuration and the files of the import objects,
+the harness keeps the files per meter. The maps of the objects keep the import objects, the created objects
+live until the end of the run.
+The objects of the meter are static and the constructors rely on the zeroed members, so the memory is zeroed as well.
+*/
+template <class T>
+static void* zeroedObject()
+{
+    void* memory = ::operator new( sizeof( T ) );
+    memset( memory, 0, sizeof( T ) );
+    return memory;
+}
+
+void PaymentCreateImportObjects( PaymentCreditClass** credit, PaymentChargeClass** charge, PaymentTokenGatewayClass** tokenGateway, PaymentAccountClass** account )
+{
+    PaymentCreditClass** creditList = new PaymentCreditClass*[MAX_OBJECTS_IN_CREDIT_REF_LIST]();
+    PaymentChargeClass** chargeList = new PaymentChargeClass*[MAX_OBJECTS_IN_CHARGE_REF_LIST]();
+    const cicObjectsMap dataObjects = DataObjectsMap;               // the constructors register the objects by their LN
+    const cicObjectsMap accountObjects = PaymentAccountObjectsMap;
+    const cicObjectsMap creditObjects = PaymentCreditObjectsMap;
+    const cicObjectsMap chargeObjects = PaymentChargeObjectsMap;
+
+    creditList[0] = new ( zeroedObject<PaymentCreditClass>() ) PaymentCreditClass( &PaymentImportCreditLn, new PaymentCreditCfg( hostImportCreditCfg ), &ftImportCredit );
+    chargeList[0] = new ( zeroedObject<PaymentChargeClass>() ) PaymentChargeClass( &PaymentActiveImportChargeLn, new PaymentChargeCfg( hostActiveImportChargeCfg ), &ftActiveImportCharge );
+    *tokenGateway = new ( zeroedObject<PaymentTokenGatewayClass>() ) PaymentTokenGatewayClass( &PaymentImportTokenGatewayLn, &ftTokenGatewayForImportAccount );
+    *account = new ( zeroedObject<PaymentAccountClass>() ) PaymentAccountClass( &PaymentImportAccountLn, new PaymentAccountCfg( hostImportAccountCfg ), creditList, chargeList, *tokenGateway, &ftImportAccount );
+    *credit = creditList[0];
+    *charge = chargeList[0];
+
+    DataObjectsMap = dataObjects;
+    PaymentAccountObjectsMap = accountObjects;
+    PaymentCreditObjectsMap = creditObjects;
+    PaymentChargeObjectsMap = chargeObjects;
+}
+#endif // PAYMENT_HOST_BUILD
+
 //#ifdef NEW_CONST_CLASS_MAP
 //CIC_DATA_ADD_OBJECT( StartStopServiceLn, StartStopServiceClass, StartStopService, (&StartStopServiceLn, &PaymentImportAccountClass, &ftStartStopService) );
 //#else
@@ -158,86 +209,220 @@ static PaymentAccountClass PaymentImportAccount( &PaymentImportAccountLn, &defau
 //#endif
 
 #ifdef NEW_CONST_CLASS_MAP
-CIC_DATA_ADD_OBJECT( OutTokenLn, OutTokenClass, OutTokenObject, (&OutTokenLn) );
-CIC_DATA_ADD_OBJECT( ActiveTransactionIDLn, ActiveTransactionIDClass, ActiveTransactionIDObject, (&ActiveTransactionIDLn) );
-CIC_REGISTER_ADD_OBJECT( TopUpsSumLn, TopUpsSumClass, TopUpsSumObject, (&TopUpsSumLn) );
-CIC_REGISTER_ADD_OBJECT( TotalAmountPaidLn, TotalAmountPaidClass, TotalAmountPaidObject, (&TotalAmountPaidLn) );
-CIC_REGISTER_ADD_OBJECT( ConsumedKWhFromStartLn, ConsumedKWhFromStartClass, ConsumedKWhFromStartObject, (&ConsumedKWhFromStartLn) );
-CIC_DATA_ADD_OBJECT( TokenIDLn, TokenIDClass, TokenIDObject, (&TokenIDLn) );
-CIC_DATA_ADD_OBJECT( ExpiresTimeLn, ExpiresTimeClass, ExpiresTimeObject, (&ExpiresTimeLn) );
+CIC_REGISTER_ADD_OBJECT( ConsumedKWhFromStartLn, ConsumedKWhFromStartClass, ConsumedKWhFromStartObject, (&ConsumedKWhFromStartLn, &RegisterAsumLN, ftConsumedKWhFromStart_KWhWhenStart) );
+CIC_DATA_ADD_OBJECT( OutTokenLn, OutTokenClass, OutTokenObject, (&OutTokenLn, &PaymentImportAccount, &ConsumedKWhFromStartObject, ftOutToken_Token) );
+CIC_DATA_ADD_OBJECT( ActiveTransactionIDLn, ActiveTransactionIDClass, ActiveTransactionIDObject, (&ActiveTransactionIDLn, &TokenGatewayForImportAccount) );
+CIC_REGISTER_ADD_OBJECT( TopUpsSumLn, TopUpsSumClass, TopUpsSumObject, (&TopUpsSumLn, &PaymentImportAccount) );
+CIC_REGISTER_ADD_OBJECT( TotalAmountPaidLn, TotalAmountPaidClass, TotalAmountPaidObject, (&TotalAmountPaidLn, &PaymentImportAccount) );
+CIC_DATA_ADD_OBJECT( TokenIDLn, TokenIDClass, TokenIDObject, (&TokenIDLn, &TokenGatewayForImportAccount) );
+CIC_DATA_ADD_OBJECT( ExpiresTimeLn, ExpiresTimeClass, ExpiresTimeObject, (&ExpiresTimeLn, &TokenGatewayForImportAccount) );
 #else
-static OutTokenClass OutTokenObject( &OutTokenLn );
-static ActiveTransactionIDClass ActiveTransactionIDObject( &ActiveTransactionIDLn );
-static TopUpsSumClass TopUpsSumObject( &TopUpsSumLn );
-static TotalAmountPaidClass TotalAmountPaidObject( &TotalAmountPaidLn );
-static ConsumedKWhFromStartClass ConsumedKWhFromStartObject( &ConsumedKWhFromStartLn );
-static TokenIDClass TokenIDObject( &TokenIDLn );
-static ExpiresTimeClass ExpiresTimeObject ( &ExpiresTimeLn );
+static ConsumedKWhFromStartClass ConsumedKWhFromStartObject( &ConsumedKWhFromStartLn, &RegisterAsumLN, ftConsumedKWhFromStart_KWhWhenStart );
+static OutTokenClass OutTokenObject( &OutTokenLn, &PaymentImportAccount, &ConsumedKWhFromStartObject, ftOutToken_Token );
+static ActiveTransactionIDClass ActiveTransactionIDObject( &ActiveTransactionIDLn, &TokenGatewayForImportAccount );
+static TopUpsSumClass TopUpsSumObject( &TopUpsSumLn, &PaymentImportAccount );
+static TotalAmountPaidClass TotalAmountPaidObject( &TotalAmountPaidLn, &PaymentImportAccount );
+static TokenIDClass TokenIDObject( &TokenIDLn, &TokenGatewayForImportAccount );
+static ExpiresTimeClass ExpiresTimeObject ( &ExpiresTimeLn, &TokenGatewayForImportAccount );
 #endif
 
 /************************************************************************************************/
 /*********************************** Assist Functions********************************************/
 /************************************************************************************************/
 
-static u32 getUTCSecondsWithCorrection( TDateTime dateTime )
+/* The clock is read once for the tick, see PaymentTickContext */
+void PaymentGetTickContext( PaymentTickContext* tick )
 {
-#warning: "10 years correction because in cicClock UTS seconds calculates from 1980 year"
-    dateTime.date.year_low += 10;
-    return GetSecondsUTC( &dateTime );
+    PaymentPortGetLocalTime( &tick->localTime );
+    tick->utcSeconds = PaymentTimeFromDateTime( &tick->localTime );
 }
 
-static u32 getCurrentUTCSecondsWithCorrection()
+/* 2 deadlines of the account, 1 of every charge and credit */
+static_assert( PAYMENT_DEADLINE_QUEUE_LEN >= 2 + MAX_OBJECTS_IN_CHARGE_REF_LIST + MAX_OBJECTS_IN_CREDIT_REF_LIST, "PAYMENT_DEADLINE_QUEUE_LEN is less than the deadlines of the account" );
+
+void PaymentIdlePass( bool newMinute, PaymentAccountClass* account )
+{
+    PaymentTickContext tick;
+    PaymentGetTickContext( &tick );
+    
+    if( account != NULL )
+    {
+        account->IdlePass( &tick, newMinute );
+    }
+    else
+    {
+        for( cicObjectsMap::iterator it = PaymentAccountObjectsMap.begin(); it != PaymentAccountObjectsMap.end(); ++it )
+            ((PaymentAccountClass*)it->second)->IdlePass( &tick, newMinute );
+    }
+    
+    if( newMinute )
+        PaymentDeadlineRun( tick.utcSeconds );
+}
+
+void PaymentRecover()
 {
-    TDateTime currDateTime;
-    GetLocalTime_APDU( &currDateTime );
-    return getUTCSecondsWithCorrection( currDateTime );
+#ifdef PAYMENT_TRANSACTION
+    PaymentTransactionRecover();                // the token interrupted by the power fail is finished before the files are read
+#endif // PAYMENT_TRANSACTION
+#ifdef PAYMENT_JOURNAL
+    PaymentJournalInit();                       // the counters from the journal must be in the files before they are read
+#endif // PAYMENT_JOURNAL
+#ifdef PAYMENT_EMERGENCY_FLUSH
+    PaymentEmergencyRecover();                  // the counters saved at the power fail
+#endif // PAYMENT_EMERGENCY_FLUSH
 }
 
-static void SecondsUTC_To_Local_DateTime_WithCorrection( DWORD seconds, TDateTime* dateTime )
+/* The times are kept in the files as the plain seconds, see PaymentTimeToRecord */
+static void writeTimeFile( u16 ftId, PaymentTime time )
 {
-#warning: "10 years correction because in cicClock UTS seconds calculates from 1980 year"
-    SecondsTo_Local_DateTime( seconds, dateTime );
-    dateTime->date.year_low -= 10;
+    u32 seconds = PaymentTimeToRecord( time );
+    PaymentFileWrite( ftId, &seconds );
+}
+
+static PaymentTime readTimeFile( u16 ftId )
+{
+    u32 seconds = 0;
+    if( PaymentFileRead( ftId, &seconds ) != eDTL_DoubleLongUnsigned )        // nothing was written in the file
+        return PAYMENT_TIME_NOT_SPECIFIED;
     
-    u16 year = dateTime->date.year_hi << 8 | dateTime->date.year_low;
-    dateTime->date.w_day = GetWeekDayFromDate( year, dateTime->date.month, dateTime->date.day );
+    return PaymentTimeFromRecord( seconds );
 }
 
-static bool cmpDateTimeStructs( const TDateTime* const DateTime1, const TDateTime* const DateTime2 )
+/* date-time of the COSEM attribute, the time is converted to TDateTime only for the encoding */
+static void encodeTime( uint8_t* buf, PaymentTime time )
 {
-    if( DateTime1->date.year_hi == DateTime2->date.year_hi &&
-        DateTime1->date.year_low == DateTime2->date.year_low &&
-        DateTime1->date.month == DateTime2->date.month &&
-        DateTime1->date.day == DateTime2->date.day &&
-        DateTime1->date.w_day == DateTime2->date.w_day &&
-        DateTime1->time.hour == DateTime2->time.hour &&
-        DateTime1->time.minute == DateTime2->time.minute &&
-        DateTime1->time.second == DateTime2->time.second )
-          return true;
-    return false;
+    TDateTime dateTime;
+    PaymentTimeToDateTime( time, &dateTime );
+    memcpy( buf, &dateTime, eDTL_DateTime );
+}
+
+/* The earliest time from which the deadlines are taken at the start and after the clock adjustment */
+static PaymentTime getDeadlineFrom( PaymentTime now )
+{
+    return ( now > PAYMENT_DEADLINE_GRACE_SEC ) ? now - PAYMENT_DEADLINE_GRACE_SEC : 0;
 }
 
-static bool cmpDateTimeWithCurrDateTime( const TDateTime* const time )
+/* Deadline of the not repeated event: the time if it is specified and not earlier than from */
+static PaymentTime getDeadlineUTC( PaymentTime time, PaymentTime from )
 {
-    TDateTime currDateTime;
-    GetLocalTime_APDU( &currDateTime );
+    return ( time == PAYMENT_TIME_NOT_SPECIFIED || time < from ) ? PAYMENT_DEADLINE_NONE : time;
+}
 
-    if( cmpDateTimeStructs( time, &currDateTime ) )                              // compare time with current time
-        return true;
+static u8 getDaysInMonth( u16 year, u8 month )
+{
+    static const u8 daysInMonth[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
     
-    return false;
+    if( month == 2 && ( ( year % 4 == 0 && year % 100 != 0 ) || year % 400 == 0 ) )
+        return 29;
+    
+    return daysInMonth[month - 1];
 }
 
-static bool cmpDateTimeWithNotSpecifiedDateTime( const TDateTime* const time )
+/*
+Comparison of the date with the wildcard date. 0xFD and 0xFE of the day are the second last and the last day of the month.
+The months of the begin and the end of the daylight saving (0xFD, 0xFE) are not resolved and match any month.
+*/
+static bool matchWildcardDate( const TDate* spec, const TDate* date )
 {
-    TDateTime notSpecifiedDateTime = { {0xff, 0xff, 0xff, 0xff, 0xff}, {0xff, 0xff, 0xff, 0xff}, 0xff, 0xff };
+    if( !( spec->year_hi == 0xff && spec->year_low == 0xff ) &&
+        ( spec->year_hi != date->year_hi || spec->year_low != date->year_low ) )
+        return false;
     
-    if( cmpDateTimeStructs( time, &notSpecifiedDateTime ) )                              // compare time with not specified time
-        return true;
+    if( spec->month != 0xff && spec->month != date->month )   // the months of DST (0xfd, 0xfe) are not known here and never match
+        return false;
+    
+    if( spec->day == 0xfe || spec->day == 0xfd )
+    {
+        u8 lastDay = getDaysInMonth( date->year_hi << 8 | date->year_low, date->month );
+        if( date->day != lastDay - ( 0xfe - spec->day ) )
+            return false;
+    }
+    else if( spec->day != 0xff && spec->day != date->day )
+        return false;
+    
+    if( spec->w_day != 0xff && spec->w_day != date->w_day )
+        return false;
+    
+    return true;
+}
+
+/* The first value of the field not less than from, limit if there is not such value */
+static u8 getFirstWildcardValue( u8 spec, u8 from, u8 limit )
+{
+    if( spec == 0xff )
+        return from;
+    
+    return ( spec >= from && spec < limit ) ? spec : limit;
+}
+
+/*
+The first time of the day matching the wildcard time and not earlier than from.
+The events are processed in IdleMinute, so the wildcard second is taken as 0.
+*/
+static bool getNextWildcardTime( const TTime* spec, const TTime* from, TTime* result )
+{
+    for( u8 hour = getFirstWildcardValue( spec->hour, from->hour, 24 ); hour < 24; hour = ( spec->hour == 0xff ) ? hour + 1 : 24 )
+    {
+        u8 fromMinute = ( hour == from->hour ) ? from->minute : 0;
+        for( u8 minute = getFirstWildcardValue( spec->minute, fromMinute, 60 ); minute < 60; minute = ( spec->minute == 0xff ) ? minute + 1 : 60 )
+        {
+            u8 fromSecond = ( hour == from->hour && minute == from->minute ) ? from->second : 0;
+            u8 second = ( spec->second == 0xff ) ? 0 : spec->second;
+            if( second >= fromSecond && second < 60 )
+            {
+                result->hour = hour;
+                result->minute = minute;
+                result->second = second;
+                result->hundredths = 0;
+                return true;
+            }
+        }
+    }
     
     return false;
 }
 
+/*
+Deadline of the repeated event: the first date-time matching the wildcard date-time not earlier than from.
+The days are searched by the calendar, 4 years cover the 29 of February on the given week day.
+*/
+static PaymentTime getNextWildcardUTC( const TDateTime* const spec, PaymentTime from )
+{
+    static const u16 PAYMENT_DEADLINE_SEARCH_DAYS = 366 * 4 + 1;
+    
+    if( PaymentDateTimeIsNotSpecified( spec ) || spec->date.month == 0xfd || spec->date.month == 0xfe )
+        return PAYMENT_DEADLINE_NONE;
+    
+    TDateTime candidate;
+    PaymentTimeToDateTime( from, &candidate );
+    TTime fromTime = candidate.time;
+    
+    for( u16 day = 0; day <= PAYMENT_DEADLINE_SEARCH_DAYS; ++day )
+    {
+        if( matchWildcardDate( &spec->date, &candidate.date ) &&
+            getNextWildcardTime( &spec->time, &fromTime, &candidate.time ) )
+            return PaymentTimeFromDateTime( &candidate );
+        
+        /* the next day from 00:00:00 */
+        memset( &fromTime, 0, sizeof( fromTime ) );
+        u16 year = candidate.date.year_hi << 8 | candidate.date.year_low;
+        if( ++candidate.date.day > getDaysInMonth( year, candidate.date.month ) )
+        {
+            candidate.date.day = 1;
+            if( ++candidate.date.month > 12 )
+            {
+                candidate.date.month = 1;
+                ++year;
+                candidate.date.year_hi = year >> 8;
+                candidate.date.year_low = year & 0xff;
+            }
+        }
+        candidate.date.w_day = GetWeekDayFromDate( year, candidate.date.month, candidate.date.day );
+    }
+    
+    return PAYMENT_DEADLINE_NONE;
+}
+
 /*
 Functions compare two logical names.
 Returns true if logical names are equal.
@@ -290,16 +475,6 @@ static bool cmpIndexWithZero( u8* index )
     return true;
 }
 
-static s8 findIndex( const chargeTableElementType* elementList, const u8* index )
-{
-    for( u8 i = 0; i < MAX_TARIFFS; ++i )
-    {
-        if( cmpIndex( elementList[i].index, index ) )
-          return i;                                     // return index in array elementList of "index" :)
-    }
-    return -1;                                          // "index" was not found
-}
-
 static s8 lenChargeTableElement( const chargeTableElementType* elementList )
 {
     s8 len = 0;
@@ -315,15 +490,6 @@ static s8 lenChargeTableElement( const chargeTableElementType* elementList )
     return len;
 }
 
-static s16 findChargePerUnit( const chargeTableElementType* elementList, const u8* index )
-{
-    s8 pos = findIndex( elementList, index );
-    if( pos == -1 )
-        return -32768;                                  // "index" was not found
-    
-    return elementList[pos].chargePerUnit;              // return charge_per_unit corresponding given "index"
-}
-
 static bool cmpOctetStrings( const BYTE* const str1, const BYTE* const str2, u32 len )
 {
     for( u32 i = 0; i < len; ++i )
@@ -334,48 +500,152 @@ static bool cmpOctetStrings( const BYTE* const str1, const BYTE* const str2, u32
     return true;
 }
 
-static void convertUnitChargeFromStructToMemoryBuffer( BYTE* dstBufUnitCharge, const PaymentChargeUnitCharge* const src )
+/* Number of the used elements of charge_table: the last not empty one and all before it */
+static u8 getUsedChargeTableElements( const PaymentChargeUnitCharge* const src )
+{
+    for( u8 i = MAX_TARIFFS; i > 0; --i )
+    {
+        if( !cmpIndexWithZero( (u8*)src->chargeTableElement[i - 1].index ) || src->chargeTableElement[i - 1].chargePerUnit != 0 )
+            return i;
+    }
+    return 0;
+}
+
+/*
+Mask of the elements which must be written when unit_charge is changed from oldSrc to newSrc.
+The elements after the used ones of oldSrc can hold old values in the file, so they are written always.
+*/
+static u8 getChangedChargeTableElements( const PaymentChargeUnitCharge* const oldSrc, const PaymentChargeUnitCharge* const newSrc )
 {
-    u8 posInBufUnitCharge = 0;
+    u8 usedInFile = getUsedChargeTableElements( oldSrc );
+    u8 used = getUsedChargeTableElements( newSrc );
+    u8 mask = 0;
     
-    dstBufUnitCharge[ posInBufUnitCharge++ ] = src->chargePerUnitScaling.commodityScale;
-    dstBufUnitCharge[ posInBufUnitCharge++ ] = src->chargePerUnitScaling.priceScale;
+    for( u8 i = 0; i < used; ++i )
+    {
+        if( i >= usedInFile ||
+            !cmpIndex( (u8*)oldSrc->chargeTableElement[i].index, (u8*)newSrc->chargeTableElement[i].index ) ||
+            oldSrc->chargeTableElement[i].chargePerUnit != newSrc->chargeTableElement[i].chargePerUnit )
+        {
+            mask |= ( 1 << i );
+        }
+    }
+    return mask;
+}
+
+static void encodeChargeTableElement( BYTE* dst, const chargeTableElementType* const src )
+{
+    memcpy( dst, src->index, MAX_INDEX_LEN );
+    AXDREncodeShort( &dst[MAX_INDEX_LEN], src->chargePerUnit );
+}
+
+/* CRC of the header without the crc field and of the used elements in the order of the index */
+static u32 calcUnitChargeCrc( const PaymentChargeUnitChargeRecord* const record, const BYTE* const elements )
+{
+    u32 crc = PaymentCrc32( record, sizeof( *record ) - sizeof( record->crc ) );
+    return PaymentCrc32Continue( crc, elements, record->lenChargeTableElement * LEN_STORED_CHARGE_TABLE_ELEMENT );
+}
+
+/* The elements of changedMask are written before the header, so the torn writing is found by the CRC */
+static void writeUnitCharge( u16 ftHeader, u16 ftElements, const PaymentChargeUnitCharge* const src, u8 changedMask )
+{
+    PaymentChargeUnitChargeRecord record;
+    memset( &record, 0, sizeof( record ) );                     // the padding of the unpacked build is in the CRC
+    record.version = PAYMENT_UNIT_CHARGE_VERSION;
+    record.lenChargeTableElement = getUsedChargeTableElements( src );
+    record.commodityScale = src->chargePerUnitScaling.commodityScale;
+    record.priceScale = src->chargePerUnitScaling.priceScale;
+    record.classId = src->commodityReference.classId;
+    memcpy( record.logicalName, &src->commodityReference.logicalName, 6 );
+    record.attributeIndex = src->commodityReference.attributeIndex;
     
-    AXDREncodeWord( &dstBufUnitCharge[ posInBufUnitCharge ], src->commodityReference.classId );
-    posInBufUnitCharge += eDTL_LongUnsigned;
-    memcpy( &dstBufUnitCharge[ posInBufUnitCharge ], &src->commodityReference.logicalName, 6 );
-    posInBufUnitCharge += 6;
-    dstBufUnitCharge[ posInBufUnitCharge++ ] = src->commodityReference.attributeIndex;
+    BYTE elements[MAX_TARIFFS][LEN_STORED_CHARGE_TABLE_ELEMENT];
+    for( u8 i = 0; i < record.lenChargeTableElement; ++i )
+    {
+        encodeChargeTableElement( elements[i], &src->chargeTableElement[i] );
+        if( changedMask & ( 1 << i ) )
+            PaymentFileIndexWrite( ftElements, i, &elements[i] );
+    }
+    
+    record.crc = calcUnitChargeCrc( &record, &elements[0][0] );
+    PaymentFileWrite( ftHeader, &record );
+}
+
+/* unit_charge of the firmware before the records: the whole structure in one buffer, see readUnitCharge */
+static const u8 LEN_LEGACY_UNIT_CHARGE = eDTL_Integer + eDTL_Integer + eDTL_LongUnsigned + 6 + eDTL_Integer + MAX_TARIFFS * LEN_STORED_CHARGE_TABLE_ELEMENT;
+
+static void decodeLegacyUnitCharge( const BYTE* const src, PaymentChargeUnitCharge* const dst )
+{
+    u8 pos = 0;
+    
+    dst->chargePerUnitScaling.commodityScale = src[pos++];
+    dst->chargePerUnitScaling.priceScale = src[pos++];
+    
+    AXDRDecodeWord( (BYTE*)&src[pos], &dst->commodityReference.classId );
+    pos += eDTL_LongUnsigned;
+    memcpy( &dst->commodityReference.logicalName, &src[pos], 6 );
+    pos += 6;
+    dst->commodityReference.attributeIndex = src[pos++];
     
     for( u8 i = 0; i < MAX_TARIFFS; ++i )
     {
-        memcpy( &dstBufUnitCharge[ posInBufUnitCharge ], &src->chargeTableElement[i].index, MAX_INDEX_LEN );
-        posInBufUnitCharge += MAX_INDEX_LEN;
-        AXDREncodeShort( &dstBufUnitCharge[ posInBufUnitCharge ], src->chargeTableElement[i].chargePerUnit );
-        posInBufUnitCharge += eDTL_Long;
+        memcpy( &dst->chargeTableElement[i].index, &src[pos], MAX_INDEX_LEN );
+        pos += MAX_INDEX_LEN;
+        AXDRDecodeShort( (BYTE*)&src[pos], &dst->chargeTableElement[i].chargePerUnit );
+        pos += eDTL_Long;
     }
 }
 
-static void convertUnitChargeFromMemoryBufferToStruct( const BYTE* const srcBufUnitCharge, PaymentChargeUnitCharge* const dst )
+/*
+The header file is told by its length: the record of the current format or the whole unit_charge
+of the firmware before the records, which is decoded and written again as the record and the elements.
+*/
+static bool readUnitCharge( u16 ftHeader, u16 ftElements, PaymentChargeUnitCharge* const dst )
 {
-    u8 posInBufUnitCharge = 0;
+    static_assert( LEN_LEGACY_UNIT_CHARGE > sizeof( PaymentChargeUnitChargeRecord ), "the formats of unit_charge are told by the length" );
     
-    dst->chargePerUnitScaling.commodityScale = srcBufUnitCharge[ posInBufUnitCharge++ ];
-    dst->chargePerUnitScaling.priceScale = srcBufUnitCharge[ posInBufUnitCharge++ ];
+    BYTE buf[LEN_LEGACY_UNIT_CHARGE];
+    u16 len = PaymentFileRead( ftHeader, &buf );
+    if( len == LEN_LEGACY_UNIT_CHARGE )
+    {
+        memset( dst, 0, sizeof( *dst ) );
+        decodeLegacyUnitCharge( buf, dst );
+        writeUnitCharge( ftHeader, ftElements, dst, 0xFF );
+        return true;
+    }
     
-    AXDRDecodeWord( (BYTE*)&srcBufUnitCharge[ posInBufUnitCharge ], &dst->commodityReference.classId );
-    posInBufUnitCharge += eDTL_LongUnsigned;
-    memcpy( &dst->commodityReference.logicalName, &srcBufUnitCharge[ posInBufUnitCharge ], 6 );
-    posInBufUnitCharge += 6;
-    dst->commodityReference.attributeIndex = srcBufUnitCharge[ posInBufUnitCharge++ ];
+    if( len != sizeof( PaymentChargeUnitChargeRecord ) )
+        return false;
     
-    for( u8 i = 0; i < MAX_TARIFFS; ++i )
+    PaymentChargeUnitChargeRecord record;
+    memcpy( &record, buf, sizeof( record ) );
+    if( record.version != PAYMENT_UNIT_CHARGE_VERSION || record.lenChargeTableElement > MAX_TARIFFS )
+        return false;
+    
+    BYTE elements[MAX_TARIFFS][LEN_STORED_CHARGE_TABLE_ELEMENT];
+    for( u8 i = 0; i < record.lenChargeTableElement; ++i )
+    {
+        if( PaymentFileIndexRead( ftElements, i, &elements[i] ) != LEN_STORED_CHARGE_TABLE_ELEMENT )
+            return false;
+    }
+    
+    if( record.crc != calcUnitChargeCrc( &record, &elements[0][0] ) )
+        return false;
+    
+    memset( dst, 0, sizeof( *dst ) );
+    dst->chargePerUnitScaling.commodityScale = record.commodityScale;
+    dst->chargePerUnitScaling.priceScale = record.priceScale;
+    dst->commodityReference.classId = record.classId;
+    memcpy( &dst->commodityReference.logicalName, record.logicalName, 6 );
+    dst->commodityReference.attributeIndex = record.attributeIndex;
+    
+    for( u8 i = 0; i < record.lenChargeTableElement; ++i )
     {
-        memcpy( &dst->chargeTableElement[i].index, &srcBufUnitCharge[ posInBufUnitCharge ], MAX_INDEX_LEN );
-        posInBufUnitCharge += MAX_INDEX_LEN;
-        AXDRDecodeShort( (BYTE*)&srcBufUnitCharge[ posInBufUnitCharge ], &dst->chargeTableElement[i].chargePerUnit );
-        posInBufUnitCharge += eDTL_Long;
+        memcpy( dst->chargeTableElement[i].index, elements[i], MAX_INDEX_LEN );
+        AXDRDecodeShort( &elements[i][MAX_INDEX_LEN], &dst->chargeTableElement[i].chargePerUnit );
     }
+    
+    return true;
 }
 
 /*
@@ -409,7 +679,7 @@ static s8 GetScalerOfValueFromRegister( const LOGICAL_NAME* const ln )
 {
     /* Read and save scaler of value from register */
     BYTE bufValueScaler[7] = {};
-    InternalGetRequest( RegisterClassID, ln, 3, NULL, bufValueScaler );
+    PaymentPortInternalGetRequest( RegisterClassID, ln, 3, bufValueScaler );
     if( bufValueScaler[0] != Success || bufValueScaler[1] != Structure || bufValueScaler[2] != 2 || bufValueScaler[3] != Integer || bufValueScaler[5] != Enum )
       return -128;                                                              // Error: scaler of value type from register is wrong
     
@@ -420,7 +690,7 @@ static u64 GetValueFromRegister( const LOGICAL_NAME* const ln )
 {
     /* Read and save value from register */
     BYTE bufValue[10] = {};
-    InternalGetRequest( RegisterClassID, ln, 2, NULL, bufValue );
+    PaymentPortInternalGetRequest( RegisterClassID, ln, 2, bufValue );
     if( bufValue[0] != Success || bufValue[1] != eDT_Long64Unsigned )
       return 0;                                                                 // Error: value type from register is wrong
     U64 value;
@@ -437,7 +707,7 @@ static u64 GetValueFromRegister( const LOGICAL_NAME* const ln )
 /******* Functions of PaymentAccountClass ****/
 /*********************************************/
 
-void PaymentAccountClass::ExecuteCollection( u8 chargeIndex )
+void PaymentAccountClass::ExecuteCollection( u8 chargeIndex, PaymentTime now )
 {
     if( currValues.currCreditInUse >= lenCreditList )   // If there is not credit in use
     {
@@ -460,7 +730,7 @@ void PaymentAccountClass::ExecuteCollection( u8 chargeIndex )
     
     creditList[currValues.currCreditInUse]->UpdateAmount( sumToCollect );
     
-    chargeList[chargeIndex]->ConfirmCollection();
+    chargeList[chargeIndex]->ConfirmCollection( now );
 }
 
 /* The functions returns:
@@ -672,6 +942,7 @@ bool PaymentAccountClass::InvokeHighestPriorityCreditToInUse()
             if( creditList[i]->InvokeCreditStatusToInUse() )
             {
                 currValues.currCreditInUse = i;
+                changeEvents |= paymentEventCreditInUse;
                 return true;
             }
         }
@@ -704,8 +975,8 @@ void PaymentAccountClass::UpdateCurrentCreditStatus()
     else
         currValues.currCreditStatus &= ~creditStatusLowCredit;
      
-    u8 indexNextPriorityCredit = FindIndexOfNextPriorityCredit();
-    eT_creditStatus nextPriorityCreditStatus = creditList[indexNextPriorityCredit]->GetCreditStatus();
+    u8 indexNextPriorityCredit = nextPriorityCredit;
+    eT_creditStatus nextPriorityCreditStatus = ( indexNextPriorityCredit < lenCreditList ) ? creditList[indexNextPriorityCredit]->GetCreditStatus() : EXHAUSTED;
     
     /* Bit 2. next_credit_enabled; Bit 3. next_credit_selectable; Bit 2. next_credit_selected;*/
     if( indexNextPriorityCredit >= lenCreditList )   /* If there are not next priority credit */
@@ -731,71 +1002,87 @@ void PaymentAccountClass::UpdateCurrentCreditStatus()
     /* Bit 5. selectable_credit_in_use */
     /* Set and Clear in the ManageCreditsStatuses function */
     
-    /* Bit 6. out_of_credit */
-    if( creditList[currValues.currCreditInUse]->GetCreditStatus() == EXHAUSTED &&
+    /* Bit 6. out_of_credit. No credit is in use after the disconnection */
+    bool creditInUseExhausted = ( currValues.currCreditInUse >= lenCreditList ) || creditList[currValues.currCreditInUse]->GetCreditStatus() == EXHAUSTED;
+    if( creditInUseExhausted &&
        (indexNextPriorityCredit >= lenCreditList || nextPriorityCreditStatus == SELECTABLE) )
         currValues.currCreditStatus |= creditStatusOutOfCredit;
     else
         currValues.currCreditStatus &= ~creditStatusOutOfCredit;
 }
 
-void PaymentAccountClass::UpdateAvailableCredit()
+/* The differences of the shares of the credit are added to available_credit and amount_to_clear */
+void PaymentAccountClass::UpdateCreditShares( u8 creditIndex )
 {
-    currValues.availableCredit = 0;
+    s32 share = creditList[creditIndex]->GetAvailableCreditShare();
+    currValues.availableCredit += share - availableCreditShare[creditIndex];
+    availableCreditShare[creditIndex] = share;
     
-    for( u8 i = 0; i < lenCreditList; ++i )
-    {
-        eT_creditStatus creditStatus = creditList[i]->GetCreditStatus();
-        if( creditStatus == SELECTED ||
-            creditStatus == IN_USE )
-        {
-            s32 currCreditAmount = creditList[i]->GetCurrentCreditAmount();
-            if( currCreditAmount > 0 )
-                currValues.availableCredit += currCreditAmount;
-        }
-    }
+    share = creditList[creditIndex]->GetAmountToClearShare();
+    creditsAmountToClear += share - amountToClearShare[creditIndex];
+    amountToClearShare[creditIndex] = share;
+}
+
+void PaymentAccountClass::UpdateChargeShare( u8 chargeIndex )
+{
+    s32 share = chargeList[chargeIndex]->GetAggregatedDebtShare( accountCfg->currency.scale );
+    currValues.aggregatedDebt += share - aggregatedDebtShare[chargeIndex];
+    aggregatedDebtShare[chargeIndex] = share;
 }
 
 void PaymentAccountClass::UpdateAmountToClear()
 {
+    currValues.amountToClear = creditsAmountToClear + accountCfg->clearanceThreshold * -1;
+}
+
+/* All shares are taken again after the events of all objects (see TakeChangeEvents) */
+void PaymentAccountClass::ResetAggregates()
+{
+    memset( availableCreditShare, 0, sizeof( availableCreditShare ) );
+    memset( amountToClearShare, 0, sizeof( amountToClearShare ) );
+    memset( aggregatedDebtShare, 0, sizeof( aggregatedDebtShare ) );
+    creditsAmountToClear = 0;
+    currValues.availableCredit = 0;
     currValues.amountToClear = 0;
-    
+    currValues.aggregatedDebt = 0;
+}
+
+#ifdef PAYMENT_AGGREGATES_CHECK
+void PaymentAccountClass::CheckAggregates()
+{
+    s32 availableCredit = 0;
+    s32 amountToClear = 0;
     for( u8 i = 0; i < lenCreditList; ++i )
     {
-        s32 currCreditAmount = creditList[i]->GetCurrentCreditAmount();
-        if( creditList[i]->GetCreditStatus() == EXHAUSTED &&
-            !(creditList[i]->GetRequiresCreditAmountToBePaidBack()) )
-        {            
-            if( currCreditAmount < 0 )
-                currValues.amountToClear += currCreditAmount;
-        }
-        else if( creditList[i]->GetRequiresCreditAmountToBePaidBack() )
-        {
-            currValues.amountToClear += currCreditAmount * -1;
-        }
+        availableCredit += creditList[i]->GetAvailableCreditShare();
+        amountToClear += creditList[i]->GetAmountToClearShare();
     }
-    currValues.amountToClear += accountCfg->clearanceThreshold * -1;
+    
+    s32 aggregatedDebt = 0;
+    for( u8 i = 0; i < lenChargeList; ++i )
+        aggregatedDebt += chargeList[i]->GetAggregatedDebtShare( accountCfg->currency.scale );
+    
+    if( availableCredit == currValues.availableCredit &&
+        amountToClear == creditsAmountToClear &&
+        aggregatedDebt == currValues.aggregatedDebt )
+        return;
+    
+    /* a share was changed without the change event */
+    ++aggregatesMismatches;
+    
+    ResetAggregates();
+    for( u8 i = 0; i < lenCreditList; ++i )
+        UpdateCreditShares( i );
+    for( u8 i = 0; i < lenChargeList; ++i )
+        UpdateChargeShare( i );
+    UpdateAmountToClear();
 }
 
-void PaymentAccountClass::UpdateAggregatedDebt()
+u32 PaymentAccountClass::GetAggregatesMismatches() const
 {
-    currValues.aggregatedDebt = 0;
-   
-    for( u8 i = 0; i < lenChargeList; ++i )
-    {
-        if( !(chargeList[i]->GetContinuousCollection()) )
-        {
-            s32 tmpTotalAmountRemaining = chargeList[i]->GetTotalAmountRemaining();
-            s8 scaleOfTmpTotalAmountRemainig = chargeList[i]->GetPriceScale();
-            
-            s8 commonScaler = scaleOfTmpTotalAmountRemainig - accountCfg->currency.scale;
-            
-            tmpTotalAmountRemaining = scaleValue( tmpTotalAmountRemaining, commonScaler );
-            
-            currValues.aggregatedDebt += tmpTotalAmountRemaining;
-        }
-    }
+    return aggregatesMismatches;
 }
+#endif // PAYMENT_AGGREGATES_CHECK
 
 void PaymentAccountClass::UpdateLowCreditThreshold()
 {
@@ -810,7 +1097,7 @@ void PaymentAccountClass::UpdateLowCreditThreshold()
 
 void PaymentAccountClass::UpdateNextCreditAvailableThreshold()
 {
-    u8 indexNextPriorityCredit = FindIndexOfNextPriorityCredit();
+    u8 indexNextPriorityCredit = nextPriorityCredit;
     if( indexNextPriorityCredit >= lenCreditList )   // if wasn't found next priority credit
     {
         currValues.nextCreditAvailableThreshold = -2147483648;  /* According to BlueBook->Account->next_credit_available_threshold */
@@ -823,7 +1110,7 @@ void PaymentAccountClass::UpdateNextCreditAvailableThreshold()
 
 void PaymentAccountClass::ManageCreditsStatuses()
 {
-    u8 nextPriorityCreditIndex = FindIndexOfNextPriorityCredit();
+    u8 nextPriorityCreditIndex = nextPriorityCredit;
     if( nextPriorityCreditIndex >= lenCreditList )                              // if wasn't found next priority credit
         return;
     
@@ -859,13 +1146,15 @@ void PaymentAccountClass::ManageCreditsStatuses()
             if( nextPriorityCreditStatus == SELECTED )
                 currValues.currCreditStatus |= creditStatusSelectableCreditInUse;       /* Set Bit 5. selectable_credit_in_use */
           
-            creditList[currValues.currCreditInUse]->InvokeCreditStatusToEnable();
+            if( currValues.currCreditInUse < lenCreditList )
+                creditList[currValues.currCreditInUse]->InvokeCreditStatusToEnable();
             currValues.currCreditInUse = nextPriorityCreditIndex;
+            changeEvents |= paymentEventCreditInUse;
             return;
         }
     }
     
-    if( creditList[currValues.currCreditInUse]->GetCreditStatus() == EXHAUSTED )  // I. enable->in_use
+    if( currValues.currCreditInUse >= lenCreditList || creditList[currValues.currCreditInUse]->GetCreditStatus() == EXHAUSTED )  // I. enable->in_use
     {
         eT_creditStatus nextPriorityCreditStatus = creditList[nextPriorityCreditIndex]->GetCreditStatus();
         if( creditList[nextPriorityCreditIndex]->InvokeCreditStatusToInUse() )
@@ -874,6 +1163,7 @@ void PaymentAccountClass::ManageCreditsStatuses()
                 currValues.currCreditStatus |= creditStatusSelectableCreditInUse;       /* Set Bit 5. selectable_credit_in_use */     
           
             currValues.currCreditInUse = nextPriorityCreditIndex;
+            changeEvents |= paymentEventCreditInUse;
             return;
         }
     }
@@ -931,19 +1221,52 @@ u8 PaymentAccountClass::FindIndexOfNextPriorityCredit() const
     
     return lenCreditList;          // wasn't found next priority credit
 }
+
+/*
+The function returns the events of the account, its credits and charges raised since the previous call
+and clears them. The shares of the objects which raised the events are updated in the running totals,
+the own events of the account update the shares of all objects.
+*/
+u8 PaymentAccountClass::TakeChangeEvents()
+{
+    const u8 ownEvents = changeEvents;
+    changeEvents = 0;
+    
+    u8 events = ownEvents;
+    for( u8 i = 0; i < lenCreditList; ++i )
+    {
+        u8 creditEvents = creditList[i]->TakeChangeEvents();
+        if( ( creditEvents | ownEvents ) & ( paymentEventCreditAmount | paymentEventCreditStatus | paymentEventCreditConfig ) )
+            UpdateCreditShares( i );
+        events |= creditEvents;
+    }
+    
+    for( u8 i = 0; i < lenChargeList; ++i )
+    {
+        u8 chargeEvents = chargeList[i]->TakeChangeEvents();
+        if( ( chargeEvents & ( paymentEventChargeAmount | paymentEventChargeConfig ) ) || ( ownEvents & paymentEventAccountConfig ) )
+            UpdateChargeShare( i );
+        events |= chargeEvents;
+    }
+    
+    return events;
+}
             
 void PaymentAccountClass::ActivateAccount( s32 data )                       // done
 {
     if( accountCfg->modeAndStatus.accountStatus == newAccount )
     {
         accountCfg->modeAndStatus.accountStatus = activeAccount;
-        FileWrite( ftFile->ftAccountStatus, &accountCfg->modeAndStatus.accountStatus );
+        PaymentFileWrite( ftFile->ftAccountStatus, &accountCfg->modeAndStatus.accountStatus );
         
-        GetLocalTime_APDU( &accountCfg->accountActivationTime );
-        DWORD seconds = PackTdateTime( &accountCfg->accountActivationTime );        
-        FileWrite( ftFile->ftAccountActivationTime, &seconds );
+        accountCfg->accountActivationTime = PaymentTimeNow();
+        writeTimeFile( ftFile->ftAccountActivationTime, accountCfg->accountActivationTime );
         
         ActivateLinkedCharges();
+        Flush();
+        changeEvents = paymentEventAll;
+        
+        ScheduleDeadlines( accountCfg->accountActivationTime );
     }
     return;
 }
@@ -953,13 +1276,15 @@ void PaymentAccountClass::CloseAccount( s32 data )                          // d
     if( accountCfg->modeAndStatus.accountStatus == activeAccount )
     {
       accountCfg->modeAndStatus.accountStatus = closedAccount;
-      FileWrite( ftFile->ftAccountStatus, &accountCfg->modeAndStatus.accountStatus );
+      PaymentFileWrite( ftFile->ftAccountStatus, &accountCfg->modeAndStatus.accountStatus );
       
-      GetLocalTime_APDU( &accountCfg->accountClosureTime );
-      DWORD seconds = PackTdateTime( &accountCfg->accountClosureTime );        
-      FileWrite( ftFile->ftAccountClosureTime, &seconds );
+      accountCfg->accountClosureTime = PaymentTimeNow();
+      writeTimeFile( ftFile->ftAccountClosureTime, accountCfg->accountClosureTime );
       
       CloseLinkedCharges();
+      Flush();
+      
+      ScheduleDeadlines( PAYMENT_DEADLINE_NONE );       // nothing is scheduled for the closed account
     }
     return;
 }
@@ -977,13 +1302,16 @@ void PaymentAccountClass::ResetAccount( s32 data )                          // d
         
         accountCfg->modeAndStatus.accountStatus = newAccount;
         currValues.currCreditInUse = lenCreditList;
-        currValues.availableCredit = 0;
-        currValues.amountToClear = 0;
-        currValues.aggregatedDebt = 0;
+        changeEvents = paymentEventAll;
+        ResetAggregates();
         currValues.lowCreditThreshold = 0;
         currValues.nextCreditAvailableThreshold = 0;
         
-        FileWrite( ftFile->ftAccountStatus, &accountCfg->modeAndStatus.accountStatus );
+        PaymentFileWrite( ftFile->ftAccountStatus, &accountCfg->modeAndStatus.accountStatus );
+        
+        PaymentTickContext tick;
+        PaymentGetTickContext( &tick );
+        ScheduleDeadlines( tick.utcSeconds );
     }
   
     return;
@@ -991,14 +1319,191 @@ void PaymentAccountClass::ResetAccount( s32 data )                          // d
 
 void PaymentAccountClass::TopUpCredits( s32 topUpSum )
 {
+    PAYMENT_PROFILE_BEGIN( topUpCredits );
     DistributeTopUpSumBetweenCredits( topUpSum );
     for( u8 i = 0; i < lenChargeList; ++i )
     {
       chargeList[i]->ExecutePaymentEventBasedCollection( topUpSum );
     }
+    Flush();
+    PAYMENT_PROFILE_END( topUpCredits, PaymentProfileTopUpCredits );
 }
 
+/*
+The function saves the state of the account, its credits and charges as the boot snapshot.
+It is called by EmergencyFlush() after the emergency record: the dirty counters of the snapshot are in the record,
+which is applied to the separate files at the start before the snapshot is read.
+The token interrupted by the power fail is not in the files yet, the snapshot is not saved then.
+*/
+void PaymentAccountClass::SaveBootSnapshot()
+{
+#ifdef PAYMENT_BOOT_SNAPSHOT
+#ifdef PAYMENT_TRANSACTION
+    if( PaymentTransactionIsOpen() )
+        return;
+#endif // PAYMENT_TRANSACTION
+    
+    PaymentAccountSnapshot snapshot;
+    memset( &snapshot, 0, sizeof( snapshot ) );
+    snapshot.accountStatus = accountCfg->modeAndStatus.accountStatus;
+    snapshot.accountActivationTime = accountCfg->accountActivationTime;
+    snapshot.accountClosureTime = accountCfg->accountClosureTime;
+    snapshot.currency = accountCfg->currency;
+    snapshot.maxProvision = accountCfg->maxProvision;
+    snapshot.maxProvisionPeriod = accountCfg->maxProvisionPeriod;
+    
+    PaymentSnapshotBegin();
+    PaymentSnapshotAdd( ftFile->ftAccountStatus, &snapshot, sizeof( snapshot ) );
+    for( u8 i = 0; i < lenCreditList; ++i )
+        creditList[i]->AddToSnapshot();
+    for( u8 i = 0; i < lenChargeList; ++i )
+        chargeList[i]->AddToSnapshot();
+    PaymentSnapshotCommit();
+#endif // PAYMENT_BOOT_SNAPSHOT
+}
+
+/* The credits, the charges and the account are read again from the files if the account takes the tokens of the gateway */
+bool PaymentAccountClass::ReloadIfLinked( const PaymentTokenGatewayClass* const _tokenGateway )
+{
+    if( tokenGateway != _tokenGateway )
+        return false;
+    
+    for( u8 i = 0; i < lenCreditList; ++i )
+        creditList[i]->Init();
+    for( u8 i = 0; i < lenChargeList; ++i )
+        chargeList[i]->Init();
+    Init();
+    return true;
+}
+
+bool PaymentAccountClass::RestoreFromSnapshot()
+{
+#ifdef PAYMENT_BOOT_SNAPSHOT
+    PaymentSnapshotLoad();
+    
+    PaymentAccountSnapshot snapshot;
+    if( !PaymentSnapshotGet( ftFile->ftAccountStatus, &snapshot, sizeof( snapshot ) ) )
+        return false;
+    
+    accountCfg->modeAndStatus.accountStatus = snapshot.accountStatus;
+    accountCfg->accountActivationTime = snapshot.accountActivationTime;
+    accountCfg->accountClosureTime = snapshot.accountClosureTime;
+    accountCfg->currency = snapshot.currency;
+    accountCfg->maxProvision = snapshot.maxProvision;
+    accountCfg->maxProvisionPeriod = snapshot.maxProvisionPeriod;
+    
+    for( u8 i = 0; i < lenChargeList; ++i )
+        chargeList[i]->SetIsLinkedAccountActive( (accountCfg->modeAndStatus.accountStatus == activeAccount) ? true : false );
+    
+    currValues.currCreditInUse = lenCreditList;
+    
+    return true;
+#else
+    return false;
+#endif // PAYMENT_BOOT_SNAPSHOT
+}
+
+/*
+The function saves the dirty counters of all credits and charges by one write to the emergency area.
+The counters stay dirty, if the power comes back they are written by the usual flush.
+*/
+#ifdef PAYMENT_EMERGENCY_FLUSH
+/* All counters of the credits and of the charges with all tariffs */
+static const u16 PAYMENT_EMERGENCY_CREDIT_LEN = sizeof( PaymentEmergencyCounterHeader ) + sizeof( s32 );
+static const u16 PAYMENT_EMERGENCY_CHARGE_LEN = 3 * ( sizeof( PaymentEmergencyCounterHeader ) + sizeof( s32 ) ) + MAX_TARIFFS * ( sizeof( PaymentEmergencyCounterHeader ) + sizeof( u64 ) );
+static_assert( PAYMENT_EMERGENCY_MAX_LEN >= sizeof( PaymentEmergencyHeader ) + MAX_OBJECTS_IN_CREDIT_REF_LIST * PAYMENT_EMERGENCY_CREDIT_LEN +
+               MAX_OBJECTS_IN_CHARGE_REF_LIST * PAYMENT_EMERGENCY_CHARGE_LEN + sizeof( u32 ), "PAYMENT_EMERGENCY_MAX_LEN is less than the counters of the account" );
+#endif // PAYMENT_EMERGENCY_FLUSH
+
+/*
+The record is written also when it is not complete: the saved counters are newer than the files.
+The boot snapshot is saved only with all dirty counters in the record.
+*/
+bool PaymentAccountClass::EmergencyFlush()
+{
+    bool complete = true;
+#ifdef PAYMENT_EMERGENCY_FLUSH
+    PAYMENT_PROFILE_BEGIN( emergencyFlush );
+    PaymentEmergencyBegin();
+    for( u8 i = 0; i < lenCreditList; ++i )
+        complete &= creditList[i]->AddDirtyToEmergency();
+    for( u8 i = 0; i < lenChargeList; ++i )
+        complete &= chargeList[i]->AddDirtyToEmergency();
+    PaymentEmergencyCommit();
+    if( complete )
+        SaveBootSnapshot();
+    PAYMENT_PROFILE_END( emergencyFlush, PaymentProfileEmergencyFlush );
+#endif // PAYMENT_EMERGENCY_FLUSH
+    return complete;
+}
+
+/* The counters of all credits and charges go to one record of the journal */
+#ifdef PAYMENT_JOURNAL
+static const u16 PAYMENT_JOURNAL_CREDIT_LEN = sizeof( PaymentJournalCounterHeader ) + sizeof( s32 );
+static const u16 PAYMENT_JOURNAL_CHARGE_LEN = 3 * ( sizeof( PaymentJournalCounterHeader ) + sizeof( s32 ) ) + MAX_TARIFFS * ( sizeof( PaymentJournalCounterHeader ) + sizeof( u64 ) );
+static_assert( PAYMENT_JOURNAL_RECORD_LEN >= sizeof( PaymentJournalHeader ) + MAX_OBJECTS_IN_CREDIT_REF_LIST * PAYMENT_JOURNAL_CREDIT_LEN +
+               MAX_OBJECTS_IN_CHARGE_REF_LIST * PAYMENT_JOURNAL_CHARGE_LEN + sizeof( u32 ), "PAYMENT_JOURNAL_RECORD_LEN is less than the counters of the account" );
+static_assert( PAYMENT_JOURNAL_COUNTERS >= MAX_OBJECTS_IN_CREDIT_REF_LIST + MAX_OBJECTS_IN_CHARGE_REF_LIST * ( 3 + MAX_TARIFFS ), "PAYMENT_JOURNAL_COUNTERS is less than the counters of the account" );
+#ifdef PAYMENT_WRITE_QUEUE
+static_assert( PAYMENT_JOURNAL_RECORD_LEN <= PAYMENT_WRITE_QUEUE_DATA_LEN, "PAYMENT_WRITE_QUEUE_DATA_LEN is less than the record of the journal" );
+#endif // PAYMENT_WRITE_QUEUE
+#endif // PAYMENT_JOURNAL
+
+void PaymentAccountClass::Flush()
+{
+    PAYMENT_JOURNAL_BEGIN();
+    for( u8 i = 0; i < lenCreditList; ++i )
+        creditList[i]->Flush();
+    
+    for( u8 i = 0; i < lenChargeList; ++i )
+        chargeList[i]->Flush();
+    PAYMENT_JOURNAL_COMMIT();
+    
+    secondsFromFlush = 0;
+}
+
+/* Events after which the values of the account are recomputed */
+static const uint8_t recomputeNextPriorityCredit        = paymentEventCreditStatus;
+static const uint8_t recomputeAmountToClear             = paymentEventCreditAmount | paymentEventCreditStatus | paymentEventCreditConfig | paymentEventAccountConfig;
+static const uint8_t recomputeLowCreditThreshold        = paymentEventCreditConfig | paymentEventCreditInUse;
+static const uint8_t recomputeNextCreditThreshold       = paymentEventCreditStatus | paymentEventCreditConfig;
+static const uint8_t recomputeCurrentCreditStatus       = paymentEventCreditAmount | paymentEventCreditStatus | paymentEventCreditConfig | paymentEventCreditInUse;
+static const uint8_t recomputeCreditsStatuses           = recomputeCurrentCreditStatus;
+static const uint8_t recomputeInvokeCredit              = paymentEventCreditStatus | paymentEventCreditConfig | paymentEventCreditInUse;
+
+/*
+The values of the account are recomputed only after the events of its credits and charges,
+so on the idle meter the tick only takes the events and checks the relay.
+available_credit, amount_to_clear and aggregated_debt are updated by the shares in TakeChangeEvents.
+When nothing changed the values and the credit statuses would be the same as in the previous tick.
+*/
 void PaymentAccountClass::IdleSecond()
+{
+    PaymentTickContext tick;
+    PaymentGetTickContext( &tick );
+    IdleSecond( &tick );
+}
+
+/* The credits and the charges raise their events before the account takes them */
+void PaymentAccountClass::IdlePass( const PaymentTickContext* tick, bool newMinute )
+{
+    for( u8 i = 0; i < lenCreditList; ++i )
+        creditList[i]->IdleSecond( tick );
+    for( u8 i = 0; i < lenChargeList; ++i )
+        chargeList[i]->IdleSecond( tick );
+    IdleSecond( tick );
+    
+    if( !newMinute )
+        return;
+    
+    for( u8 i = 0; i < lenCreditList; ++i )
+        creditList[i]->IdleMinute( tick );
+    for( u8 i = 0; i < lenChargeList; ++i )
+        chargeList[i]->IdleMinute( tick );
+    IdleMinute( tick );
+}
+
+void PaymentAccountClass::IdleSecond( const PaymentTickContext* tick )
 {
 //    if(  tokenGateway != nullptr )  // if there is linked token gateway object
 //    {
@@ -1015,119 +1520,200 @@ void PaymentAccountClass::IdleSecond()
   
     if( accountCfg->modeAndStatus.accountStatus == activeAccount )
     {
-        if( currValues.currCreditInUse >= lenCreditList )   // If there is not credit in use
+        PAYMENT_PROFILE_SCENARIO( GetProfileScenario() );
+        PAYMENT_PROFILE_BEGIN( idleSecond );
+
+        u8 events = TakeChangeEvents();
+        
+        PAYMENT_PROFILE_BEGIN( invokeCredit );
+        if( currValues.currCreditInUse >= lenCreditList && (events & recomputeInvokeCredit) )   // If there is not credit in use
         {
             InvokeHighestPriorityCreditToInUse();
         }
-        
+        PAYMENT_PROFILE_END( invokeCredit, PaymentProfileInvokeCredit );
+
+        PAYMENT_PROFILE_BEGIN( executeCollection );
         for( u8 i = 0; i < lenChargeList; ++i )
         {
             if( chargeList[i]->GetNewCollection() )
             {
-                ExecuteCollection( i );
+                ExecuteCollection( i, tick->utcSeconds );
             }
         }
+        PAYMENT_PROFILE_END( executeCollection, PaymentProfileExecuteCollection );
         
-        UpdateAvailableCredit();
-        UpdateAmountToClear();
-        UpdateAggregatedDebt();
-        UpdateLowCreditThreshold();
-        UpdateNextCreditAvailableThreshold();
-        UpdateCurrentCreditStatus();
-        
-        ManageCreditsStatuses();
-        
+        events |= TakeChangeEvents();           // the collections and the invoked credit are processed in the same tick
+
+        PAYMENT_PROFILE_BEGIN( updateValues );
+        if( events & recomputeNextPriorityCredit )
+            nextPriorityCredit = FindIndexOfNextPriorityCredit();
+        if( events & recomputeAmountToClear )
+            UpdateAmountToClear();
+#ifdef PAYMENT_AGGREGATES_CHECK
+        CheckAggregates();
+#endif // PAYMENT_AGGREGATES_CHECK
+        if( events & recomputeLowCreditThreshold )
+            UpdateLowCreditThreshold();
+        if( events & recomputeNextCreditThreshold )
+            UpdateNextCreditAvailableThreshold();
+        if( events & recomputeCurrentCreditStatus )
+            UpdateCurrentCreditStatus();
+        PAYMENT_PROFILE_END( updateValues, PaymentProfileUpdateAccountValues );
+
+        PAYMENT_PROFILE_BEGIN( manageCredits );
+        if( events & recomputeCreditsStatuses )
+            ManageCreditsStatuses();
+        PAYMENT_PROFILE_END( manageCredits, PaymentProfileManageCreditsStatuses );
+
         /* Described in Blue Book. Credit - warning_threshold */
 //        if( currValues.currCreditStatus & creditStatusLowCredit )
 //        {
 //          // вызвать предупреждени¤ дл¤ пользовател¤, что низкий кредит
 //        }
         
+        PAYMENT_PROFILE_BEGIN( relayControl );
         if( currValues.currCreditStatus & creditStatusOutOfCredit )
         {
             // OTKLIU4ITI OSNOVNOE RELE
             // esli ne "friendly hours" i td
-            if( cicDisconnectorControlBase.GetOutputState() )
+            if( PaymentPortGetRelayState() )
             {
-                cicDisconnectorControlBase.ActionLocalDisconnect();
+                PaymentPortDisconnectRelay();
 
                 currValues.currCreditInUse = lenCreditList;
+                changeEvents |= paymentEventCreditInUse;
+                Flush();
             }
         }
         else
         {
-            if( !cicDisconnectorControlBase.GetOutputState() )
+            if( !PaymentPortGetRelayState() )
             {
-                cicDisconnectorControlBase.ActionLocalReconnect();
+                PaymentPortReconnectRelay();
+                Flush();
             }
         }
+        PAYMENT_PROFILE_END( relayControl, PaymentProfileRelayControl );
+
+        PAYMENT_PROFILE_END( idleSecond, PaymentProfileAccountIdleSecond );
     }
+    
+    if( ++secondsFromFlush >= PAYMENT_FLUSH_PERIOD_SEC )
+        Flush();
+    
     return;
 }
 
+#ifdef PAYMENT_PROFILING
+/*
+The function returns the state of the account in which the current tick is measured.
+*/
+PaymentProfileScenario PaymentAccountClass::GetProfileScenario() const
+{
+    for( u8 i = 0; i < lenChargeList; ++i )
+    {
+        if( chargeList[i]->GetNewCollection() )
+            return PaymentProfileCollectionPending;
+    }
+
+    if( currValues.currCreditStatus & creditStatusOutOfCredit )
+        return PaymentProfileExhaustedCredit;
+
+    if( currValues.currCreditStatus & creditStatusLowCredit )
+        return PaymentProfileLowCredit;
+
+    return PaymentProfileSteadyState;
+}
+#endif // PAYMENT_PROFILING
+
 void PaymentAccountClass::IdleMinute()
+{
+    PaymentTickContext tick;
+    PaymentGetTickContext( &tick );
+    IdleMinute( &tick );
+}
+
+void PaymentAccountClass::IdleMinute( const PaymentTickContext* tick )
 {  
-    if( accountCfg->modeAndStatus.accountStatus == newAccount )
-    {
-        if( !cmpDateTimeWithNotSpecifiedDateTime( &accountCfg->accountActivationTime) )     // A definition with "not specified" notation in all fields of the attribute will not be acted upon.
-        {
-            if( cmpDateTimeWithCurrDateTime( &accountCfg->accountActivationTime ) )
-            {
-                ActivateAccount();
-            }
-        }
-    }   
-    else if( accountCfg->modeAndStatus.accountStatus == activeAccount )
+    PAYMENT_WRITE_STATS_IDLE_MINUTE( &tick->localTime );
+    
+    if( !deadlineScheduled )
     {
-        if( !cmpDateTimeWithNotSpecifiedDateTime( &accountCfg->accountClosureTime ) )       // A definition with "not specified" notation in all fields of the attribute will not be acted upon.
-        {        
-            if( cmpDateTimeWithCurrDateTime( &accountCfg->accountClosureTime ) )
-            {
-                CloseAccount();
-            }
-        }
+        deadlineScheduled = true;
+        ScheduleDeadlines( getDeadlineFrom( tick->utcSeconds ) );
     }
     
     return;
 }
 
+/*
+Deadlines of the account_activation_time of the new account and the account_closure_time of the active account.
+A definition with "not specified" notation in all fields of the attribute will not be acted upon.
+The closure time up to the activation (the previous order closed in the same second) does not close the active account.
+The deadline refused by the full queue is scheduled again in the next IdleMinute.
+*/
+void PaymentAccountClass::ScheduleDeadlines( PaymentTime from )
+{
+    PaymentTime activation = PAYMENT_DEADLINE_NONE;
+    if( accountCfg->modeAndStatus.accountStatus == newAccount )
+        activation = getDeadlineUTC( accountCfg->accountActivationTime, from );
+    if( !PaymentDeadlineSchedule( this, PaymentDeadlineAccountActivation, activation, DeadlineHandler ) )
+        deadlineScheduled = false;
+    
+    PaymentTime closure = PAYMENT_DEADLINE_NONE;
+    if( accountCfg->modeAndStatus.accountStatus == activeAccount )
+    {
+        PaymentTime afterActivation = accountCfg->accountActivationTime + 1;
+        if( accountCfg->accountActivationTime != PAYMENT_TIME_NOT_SPECIFIED && from < afterActivation )
+            from = afterActivation;
+        closure = getDeadlineUTC( accountCfg->accountClosureTime, from );
+    }
+    if( !PaymentDeadlineSchedule( this, PaymentDeadlineAccountClosure, closure, DeadlineHandler ) )
+        deadlineScheduled = false;
+}
+
+void PaymentAccountClass::DeadlineHandler( void* object, u8 kind, u8 reason, PaymentTime now )
+{
+    PaymentAccountClass* account = (PaymentAccountClass*)object;
+    
+    if( reason == PaymentDeadlineClockChanged )
+        account->ScheduleDeadlines( getDeadlineFrom( now ) );
+    else if( kind == PaymentDeadlineAccountActivation )
+        account->ActivateAccount();                     // the closure time is scheduled by the activation
+    else if( kind == PaymentDeadlineAccountClosure )
+        account->CloseAccount();
+}
+
 void PaymentAccountClass::Init()
 {
 //    FlashFormat();
 //    FramFormat();
   
-    if( FileRead( ftFile->ftAccountStatus, &accountCfg->modeAndStatus.accountStatus ) == 0 )
-    {
-        accountCfg->modeAndStatus.accountStatus = newAccount;
-    }
-    else
-    {
-        for( u8 i = 0; i < lenChargeList; ++i )
-            chargeList[i]->SetIsLinkedAccountActive( (accountCfg->modeAndStatus.accountStatus == activeAccount) ? true : false );
-    }
-  
-    DWORD seconds = 0;
-    if( FileRead( ftFile->ftAccountActivationTime, &seconds ) == eDTL_DoubleLongUnsigned ) /* if in the flash was written account_activation_time */
-    {
-        UnpackTDateTime( seconds, &accountCfg->accountActivationTime );
-    }   
-    else
-    {
-        accountCfg->accountActivationTime = { {0xff, 0xff, 0xff, 0xff, 0xff}, {0xff, 0xff, 0xff, 0xff}, 0xff, 0xff, {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff} };
-    }
+    const u16 ftTimes[] = { ftFile->ftAccountActivationTime, ftFile->ftAccountClosureTime };
+    PaymentTimeUpgradeRecords( ftFile->ftTimeFormat, ftTimes, sizeof( ftTimes ) / sizeof( ftTimes[0] ) );   // before the snapshot, the later writes are the seconds
+    
+    changeEvents = paymentEventAll;             // all values are computed in the first tick
+    ResetAggregates();
+    deadlineScheduled = false;                  // scheduled in the first IdleMinute
     
-    seconds = 0;
-    if( FileRead( ftFile->ftAccountClosureTime, &seconds ) == eDTL_DoubleLongUnsigned )   /* if in the flash was written account_closure_time */
+    if( RestoreFromSnapshot() )
+        return;
+  
+    if( PaymentFileRead( ftFile->ftAccountStatus, &accountCfg->modeAndStatus.accountStatus ) == 0 )
     {
-        UnpackTDateTime( seconds, &accountCfg->accountClosureTime );
-    }  
+        accountCfg->modeAndStatus.accountStatus = newAccount;
+    }
     else
     {
-        accountCfg->accountClosureTime = { {0xff, 0xff, 0xff, 0xff, 0xff}, {0xff, 0xff, 0xff, 0xff}, 0xff, 0xff, {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff} };
+        for( u8 i = 0; i < lenChargeList; ++i )
+            chargeList[i]->SetIsLinkedAccountActive( (accountCfg->modeAndStatus.accountStatus == activeAccount) ? true : false );
     }
+  
+    accountCfg->accountActivationTime = readTimeFile( ftFile->ftAccountActivationTime );
+    accountCfg->accountClosureTime = readTimeFile( ftFile->ftAccountClosureTime );
     
     BYTE bufFromFlashForCurrency[MAX_LEN_CURRENCY_NAME + eDTL_Integer + eDTL_Enum] = {};
-    if( FileRead(ftFile->ftCurrency, bufFromFlashForCurrency) == (MAX_LEN_CURRENCY_NAME + eDTL_Integer + eDTL_Enum) )
+    if( PaymentFileRead(ftFile->ftCurrency, &bufFromFlashForCurrency) == (MAX_LEN_CURRENCY_NAME + eDTL_Integer + eDTL_Enum) )
     {
         memcpy( &accountCfg->currency.name, &bufFromFlashForCurrency[0], MAX_LEN_CURRENCY_NAME );
         accountCfg->currency.scale = bufFromFlashForCurrency[3];
@@ -1135,13 +1721,13 @@ void PaymentAccountClass::Init()
     }
     
     u16 tmpMaxProvision = 0;
-    if( FileRead( ftFile->ftMaxProvision, &tmpMaxProvision ) != 0 )
+    if( PaymentFileRead( ftFile->ftMaxProvision, &tmpMaxProvision ) != 0 )
     {
         accountCfg->maxProvision = tmpMaxProvision;
     }
     
     s32 tmpMaxProvisionPeriod = 0;
-    if( FileRead( ftFile->ftMaxProvision, &tmpMaxProvisionPeriod ) != 0 )
+    if( PaymentFileRead( ftFile->ftMaxProvision, &tmpMaxProvisionPeriod ) != 0 )
     {
         accountCfg->maxProvisionPeriod = tmpMaxProvisionPeriod;
     }
@@ -1156,7 +1742,7 @@ PaymentAccountClass::PaymentAccountClass( const LOGICAL_NAME* const _ln,
                                          PaymentCreditClass* const _creditList[],
                                          PaymentChargeClass* const _chargeList[],
                                          PaymentTokenGatewayClass* const _tokenGateway,
-                                         const ftPaymentAccount* const _ftFile ) : ln( _ln ), accountCfg( _cfg ), tokenGateway( _tokenGateway ), ftFile( _ftFile ) {    
+                                         const ftPaymentAccount* const _ftFile ) : ln( _ln ), accountCfg( _cfg ), tokenGateway( _tokenGateway ), ftFile( _ftFile ), secondsFromFlush( 0 ), changeEvents( paymentEventAll ), nextPriorityCredit( 0 ), deadlineScheduled( false ) {    
 #ifndef NEW_CONST_CLASS_MAP
      //DataObjectsMap[(LOGICAL_NAME*)_ln] = this;                                      
      PaymentAccountObjectsMap[(LOGICAL_NAME*)_ln] = this;
@@ -1206,6 +1792,11 @@ PaymentAccountClass::PaymentAccountClass( const LOGICAL_NAME* const _ln,
         if( lenTokenGatewayCfgList == MAX_OBJECTS_IN_TOKEN_GATEWAY_CFG )
             break;
     }
+    
+    ResetAggregates();
+#ifdef PAYMENT_AGGREGATES_CHECK
+    aggregatesMismatches = 0;
+#endif // PAYMENT_AGGREGATES_CHECK
 }
 
 /*********************************************/
@@ -1224,6 +1815,7 @@ void PaymentCreditClass::ControlCreditStatus()
         if( currValues.currentCreditAmount <= creditCfg->limit )
         {
             currValues.creditStatus = EXHAUSTED;        // In use -> Exhausted (Table 29, D)
+            changeEvents |= paymentEventCreditStatus;
         }
     }
     else if( currValues.creditStatus == EXHAUSTED )
@@ -1231,27 +1823,17 @@ void PaymentCreditClass::ControlCreditStatus()
         if( currValues.currentCreditAmount > creditCfg->limit )
         {
             currValues.creditStatus = ENABLED;          // Exhausted -> Enabled (Table 29, E)
+            changeEvents |= paymentEventCreditStatus;
         }
     }
     
     return;
 }
 
-bool PaymentCreditClass::CheckPeriod()
-{
-    TDateTime currDateTime;    
-    GetLocalTime_APDU( &currDateTime );
-    
-    if( CmpDateTimeWc( &creditCfg->period, &currDateTime, 0, 0 ) )
-        return true;
-    
-    return false;
-}
-
 void PaymentCreditClass::UpdateAmount( s32 value )              // done
 {
     currValues.currentCreditAmount += value;
-    FileWrite( ftFile->ftCurrentCreditAmount, &currValues.currentCreditAmount );
+    MarkDirty( creditDirtyCurrentCreditAmount );
     
     ControlCreditStatus();
     
@@ -1262,7 +1844,7 @@ s32 PaymentCreditClass::SetAmountToValue( s32 newValue )        // done
 {
     s32 previousCreditAmount = currValues.currentCreditAmount;
     currValues.currentCreditAmount = newValue;
-    FileWrite( ftFile->ftCurrentCreditAmount, &currValues.currentCreditAmount );
+    MarkDirty( creditDirtyCurrentCreditAmount );
     
     return previousCreditAmount;
 }
@@ -1279,14 +1861,23 @@ void PaymentCreditClass::InvokeCredit( s32 data )           // done
         {
             currValues.creditStatus = SELECTED;                         // credit_status changes to SELECTED
         }
-        FileWrite( ftFile->ftCreditStatus, &currValues.creditStatus );
+        changeEvents |= paymentEventCreditStatus;
+        PaymentFileWrite( ftFile->ftCreditStatus, &currValues.creditStatus );
     }
     return;
 }
 
 void PaymentCreditClass::IdleSecond()
 {
+    IdleSecond( NULL );                         // the clock is not read, see below
+}
+
+/* The credit does not use the time in the second tick, the context is taken for the common interface of the objects and may be NULL */
+void PaymentCreditClass::IdleSecond( const PaymentTickContext* )
+{
+    PAYMENT_PROFILE_BEGIN( idleSecond );
     ControlCreditStatus();
+    PAYMENT_PROFILE_END( idleSecond, PaymentProfileCreditIdleSecond );
   
 //    if( currValues.creditStatus == IN_USE )
 //    {
@@ -1318,33 +1909,68 @@ void PaymentCreditClass::IdleSecond()
 
 void PaymentCreditClass::IdleMinute()
 {
-    /* Described in Blue Book. Credit - period*/
-    if( creditCfg->creditType == timeBasedCredit || creditCfg->creditType == consumptionBasedCredit )
+    PaymentTickContext tick;
+    PaymentGetTickContext( &tick );
+    IdleMinute( &tick );
+}
+
+void PaymentCreditClass::IdleMinute( const PaymentTickContext* tick )
+{
+    if( !deadlineScheduled )
     {
-        if( CheckPeriod() )
-            SetAmountToValue( creditCfg->presetCreditAmount );
+        deadlineScheduled = true;
+        SchedulePeriod( getDeadlineFrom( tick->utcSeconds ) );
     }
     
     return;
 }
 
+/* Described in Blue Book. Credit - period. The next date-time matching the period of the time or consumption based credit */
+void PaymentCreditClass::SchedulePeriod( PaymentTime from )
+{
+    PaymentTime due = PAYMENT_DEADLINE_NONE;
+    if( creditCfg->creditType == timeBasedCredit || creditCfg->creditType == consumptionBasedCredit )
+        due = getNextWildcardUTC( &creditCfg->period, from );
+    
+    if( !PaymentDeadlineSchedule( this, PaymentDeadlineCreditPeriod, due, DeadlineHandler ) )
+        deadlineScheduled = false;              // the queue is full, scheduled again in the next IdleMinute
+}
+
+void PaymentCreditClass::DeadlineHandler( void* object, u8 kind, u8 reason, PaymentTime now )
+{
+    PaymentCreditClass* credit = (PaymentCreditClass*)object;
+    
+    if( reason == PaymentDeadlineClockChanged )
+    {
+        credit->SchedulePeriod( getDeadlineFrom( now ) );
+    }
+    else if( kind == PaymentDeadlineCreditPeriod )
+    {
+        credit->SetAmountToValue( credit->creditCfg->presetCreditAmount );
+        credit->SchedulePeriod( now + 1 );
+    }
+}
+
 void PaymentCreditClass::Init()
 {
-    FileRead( ftFile->ftCurrentCreditAmount, &currValues.currentCreditAmount );    
+    if( RestoreFromSnapshot() )
+        return;
+    
+    PaymentCounterRead( ftFile->ftCurrentCreditAmount, &currValues.currentCreditAmount );    
     
     s32 tmpWarningThreshold = 0;
-    if( FileRead( ftFile->ftWarningThreshold, &tmpWarningThreshold ) != 0 )
+    if( PaymentFileRead( ftFile->ftWarningThreshold, &tmpWarningThreshold ) != 0 )
     {
         creditCfg->warningThreshold = tmpWarningThreshold;
     }
     
     s32 tmpLimit = 0;
-    if( FileRead( ftFile->ftLimit, &tmpLimit ) != 0 )
+    if( PaymentFileRead( ftFile->ftLimit, &tmpLimit ) != 0 )
     {
         creditCfg->limit = tmpLimit;
     }
     
-    if( FileRead( ftFile->ftCreditStatus, &currValues.creditStatus ) == 0 )     /* if credit_status wasn't save */
+    if( PaymentFileRead( ftFile->ftCreditStatus, &currValues.creditStatus ) == 0 )     /* if credit_status wasn't save */
     {
         if( currValues.currentCreditAmount > creditCfg->limit )
             currValues.creditStatus = ENABLED;
@@ -1357,7 +1983,7 @@ void PaymentCreditClass::Init()
 
 PaymentCreditClass::PaymentCreditClass( const LOGICAL_NAME* const _ln,
                                        PaymentCreditCfg* const cfg,
-                                       const ftPaymentCredit* const _ftFile ) : ln(_ln), creditCfg(cfg), ftFile( _ftFile )
+                                       const ftPaymentCredit* const _ftFile ) : ln(_ln), creditCfg(cfg), ftFile( _ftFile ), dirtyMask( 0 ), changeEvents( paymentEventAll ), deadlineScheduled( false )
 {
 #ifndef NEW_CONST_CLASS_MAP
     //DataObjectsMap[(LOGICAL_NAME*)_ln] = this; 
@@ -1372,17 +1998,16 @@ s32 PaymentChargeClass::UpdateTotalAmountPaid( s32 collectionValue )
 {   
     s32 previousTotalAmountPaid = currValues.totalAmountPaid;   
     currValues.totalAmountPaid += collectionValue;  
-    FileWrite( ftFile->ftTotalAmountPaid, &currValues.totalAmountPaid );   
+    MarkDirty( chargeDirtyTotalAmountPaid );
     
     return previousTotalAmountPaid;
 }
 
-void PaymentChargeClass::UpdateLastCollectionTime()
+void PaymentChargeClass::UpdateLastCollectionTime( PaymentTime now )
 {      
-    GetLocalTime_APDU( &currValues.lastCollectionTime );   
+    currValues.lastCollectionTime = now;
   
-    u32 seconds = PackTdateTime( &currValues.lastCollectionTime );
-    FileWrite( ftFile->ftLastCollectionTime, &seconds );
+    writeTimeFile( ftFile->ftLastCollectionTime, currValues.lastCollectionTime );
     
     return;
 }
@@ -1390,7 +2015,7 @@ void PaymentChargeClass::UpdateLastCollectionTime()
 void PaymentChargeClass::UpdateLastCollectionAmount( s32 sum )
 {
     currValues.lastCollectionAmount = sum;    
-    FileWrite( ftFile->ftLastCollectionAmount, &currValues.lastCollectionAmount );
+    PaymentFileWrite( ftFile->ftLastCollectionAmount, &currValues.lastCollectionAmount );
     
     return;
 }
@@ -1409,7 +2034,7 @@ s32 PaymentChargeClass::ReduceTotalAmountRemaining( s32 sum )
         currValues.totalAmountRemaining = 0;
     }
     
-    FileWrite( ftFile->ftTotalAmountRemaining, &currValues.totalAmountRemaining );
+    MarkDirty( chargeDirtyTotalAmountRemaining );
     
     return sum;
 }
@@ -1417,6 +2042,8 @@ s32 PaymentChargeClass::ReduceTotalAmountRemaining( s32 sum )
 
 void PaymentChargeClass::UpdateUnitCharge( chargeTableElementType* elements )           // done. mojno optimizirovati + dlina massiva, kotorii nado zapisati, budet izvestna 
 {
+    const PaymentChargeUnitCharge oldUnitCharge = chargeCfg->unitChargePassive;
+    
     for ( u8 i = 0; i < MAX_TARIFFS; ++i )
     {
         for( u8 j = 0; j < MAX_TARIFFS; ++j )
@@ -1438,22 +2065,19 @@ void PaymentChargeClass::UpdateUnitCharge( chargeTableElementType* elements )
         }
     }
     
-    /* save in the flash the passive_unit_charge */
-    const u8 lenBufUnitCharge = eDTL_Integer + eDTL_Integer + eDTL_LongUnsigned + 6 + eDTL_Integer + MAX_TARIFFS * ( MAX_INDEX_LEN + eDTL_Long );
-    BYTE bufUnitCharge[ lenBufUnitCharge ] = {};    
-    convertUnitChargeFromStructToMemoryBuffer( bufUnitCharge, &chargeCfg->unitChargePassive );
-    FileWrite( ftFile->ftUnitChargePassive, bufUnitCharge );
+    /* save in the flash the changed elements of passive_unit_charge */
+    writeUnitCharge( ftFile->ftUnitChargePassive, ftFile->ftUnitChargePassiveElement, &chargeCfg->unitChargePassive,
+                     getChangedChargeTableElements( &oldUnitCharge, &chargeCfg->unitChargePassive ) );
 }
 
 void PaymentChargeClass::ActivatePassiveUnitCharge( s32 data = 0 )      // done
 {
+    u8 changedMask = getChangedChargeTableElements( &chargeCfg->unitChargeActive, &chargeCfg->unitChargePassive );
     chargeCfg->unitChargeActive = chargeCfg->unitChargePassive;
+    changeEvents |= paymentEventChargeConfig;                                   // the scale of the price is used in aggregated_debt
     
-    /* save in the flash the active_unit_charge */
-    const u8 lenBufUnitCharge = eDTL_Integer + eDTL_Integer + eDTL_LongUnsigned + 6 + eDTL_Integer + MAX_TARIFFS * ( MAX_INDEX_LEN + eDTL_Long );
-    BYTE bufUnitCharge[ lenBufUnitCharge ] = {};    
-    convertUnitChargeFromStructToMemoryBuffer( bufUnitCharge, &chargeCfg->unitChargeActive );    
-    FileWrite( ftFile->ftUnitChargeActive, bufUnitCharge );
+    /* save in the flash the changed elements of active_unit_charge */
+    writeUnitCharge( ftFile->ftUnitChargeActive, ftFile->ftUnitChargeActiveElement, &chargeCfg->unitChargeActive, changedMask );
     
     return;
 }
@@ -1482,7 +2106,7 @@ s32 PaymentChargeClass::UpdateTotalAmountRemaining( s32 valueToAdd )    // done
     if( currValues.totalAmountRemaining < 0 )
         currValues.totalAmountRemaining = 0;
     
-    FileWrite( ftFile->ftTotalAmountRemaining, &currValues.totalAmountRemaining );
+    MarkDirty( chargeDirtyTotalAmountRemaining );
     
     return previousTotalAmountRemaining;
 }
@@ -1500,7 +2124,7 @@ s32 PaymentChargeClass::SetTotalAmountRemaining( s32 newValue )         // done
     s32 previousTotalAmountRemaining = currValues.totalAmountRemaining;
     currValues.totalAmountRemaining = newValue;
     
-    FileWrite( ftFile->ftTotalAmountRemaining, &currValues.totalAmountRemaining );
+    MarkDirty( chargeDirtyTotalAmountRemaining );
     
     return previousTotalAmountRemaining;
 }
@@ -1552,26 +2176,22 @@ s16 PaymentChargeClass::GetCurrentChargePerUnit() const
 /* 
 Function returns how much periods have passed till last collection time to current time.
 */
-u32 PaymentChargeClass::CalcPeriodPassed() const
+u32 PaymentChargeClass::CalcPeriodPassed( PaymentTime now ) const
 {
-    if( cmpDateTimeWithNotSpecifiedDateTime(&currValues.lastCollectionTime) )
+    if( currValues.lastCollectionTime == PAYMENT_TIME_NOT_SPECIFIED )
         return 0;
-      
-    TDateTime currDateTime;
-    GetLocalTime_APDU( &currDateTime );
     
-    s32 secondsPast = ClockCompareDateTime( &currDateTime, &currValues.lastCollectionTime );
-    if( secondsPast < 0 )                                                       // if clock wrong
+    if( now < currValues.lastCollectionTime )                                  // if clock wrong
         return 0;
     
-    return secondsPast / chargeCfg->period;
+    return (u32)( ( now - currValues.lastCollectionTime ) / chargeCfg->period );
 }
 
-void PaymentChargeClass::ExecuteConsumptionBasedCollection()
+void PaymentChargeClass::ExecuteConsumptionBasedCollection( PaymentTime now )
 {
     if( chargeCfg->period != 0 )
     {
-        u32 periodCounter = CalcPeriodPassed();  /* Getting how much periods has past since last_collection_time */
+        u32 periodCounter = CalcPeriodPassed( now );  /* Getting how much periods has past since last_collection_time */
         if( periodCounter == 0 )                                                
         {
             return;                                                             // Error: wrong clock!
@@ -1585,13 +2205,18 @@ void PaymentChargeClass::ExecuteConsumptionBasedCollection()
             /* !!!!!!! FOR TESTING. nado ot kuda to 4itati index teku6ego tarifa !!!!!!! */
             u8 currentTariffIndex = 0;
             
+            PAYMENT_PROFILE_BEGIN( registerRead );
             /* !!! Nado 4itati iz tariffnogo registra !!! */                                                       
             s8 valueScaler = GetScalerOfValueFromRegister( &chargeCfg->unitChargeActive.commodityReference.logicalName );
-            if( valueScaler == -128 )
-                return;                                                         // Error: scaler of value type from register is wrong
             
             /* !!! Nado 4itati iz tariffnogo registra !!! */                                                        
-            U64 value = GetValueFromRegister( &chargeCfg->unitChargeActive.commodityReference.logicalName );
+            U64 value = 0;
+            if( valueScaler != -128 )
+                value = GetValueFromRegister( &chargeCfg->unitChargeActive.commodityReference.logicalName );
+            PAYMENT_PROFILE_END( registerRead, PaymentProfileChargeRegisterRead );   // the failed reading is measured too
+            
+            if( valueScaler == -128 )
+                return;                                                         // Error: scaler of value type from register is wrong
             
             if( lastValue[currentTariffIndex] >= value )
                 return;                                                         // Error: value from register is wrong
@@ -1605,24 +2230,24 @@ void PaymentChargeClass::ExecuteConsumptionBasedCollection()
             
             lastValue[ currentTariffIndex ] = value;                        
             lastValue[ currentTariffIndex ] -= difference % scaleValue( unitsConsumed, commonScaler * -1 );;    // vi4etaem iz lastValue drobnuiu (neu4tionnuiu pri ras4iote sumToCollect) 4asti, 4tobi u4esti eio v sleduiu6em periode
-            FileIndexWrite( ftFile->ftLastMeasurementValue, currentTariffIndex, &lastValue[ currentTariffIndex ] );
+            MarkLastValueDirty( currentTariffIndex );
             
             sumToCollect += unitsConsumed * chargePerUnit;
-            FileWrite( ftFile->ftSumToCollect, &sumToCollect );
+            MarkDirty( chargeDirtySumToCollect );
             newCollection = true;            
         }            
     }
 }
 
-void PaymentChargeClass::ExecuteTimeBasedCollection()
+void PaymentChargeClass::ExecuteTimeBasedCollection( PaymentTime now )
 {
     if( chargeCfg->period != 0 )
     {
-        u32 periodCounter = CalcPeriodPassed();  /* Getting how much periods has past since last_collection_time */
+        u32 periodCounter = CalcPeriodPassed( now );  /* Getting how much periods has past since last_collection_time */
         if( periodCounter > 0 )
         {
             sumToCollect += chargeCfg->unitChargeActive.chargeTableElement[0].chargePerUnit * periodCounter;
-            FileWrite( ftFile->ftSumToCollect, &sumToCollect );                    
+            MarkDirty( chargeDirtySumToCollect );
             newCollection = true;
         }
     }
@@ -1639,13 +2264,13 @@ void PaymentChargeClass::ExecutePaymentEventBasedCollection( s32 topUpSum )
             if( chargeCfg->chargeConfiguration & chargePercentageBaseCollection )           
             {
                 sumToCollect += (topUpSum * chargeCfg->proportion) / 10000;
-                FileWrite( ftFile->ftSumToCollect, &sumToCollect );
+                MarkDirty( chargeDirtySumToCollect );
                 newCollection = true;
             }
             else
             {
                 sumToCollect += chargeCfg->unitChargeActive.chargeTableElement[0].chargePerUnit;
-                FileWrite( ftFile->ftSumToCollect, &sumToCollect );
+                MarkDirty( chargeDirtySumToCollect );
                 newCollection = true;
             }
         }
@@ -1655,17 +2280,26 @@ void PaymentChargeClass::ExecutePaymentEventBasedCollection( s32 topUpSum )
 
 
 void PaymentChargeClass::IdleSecond()
+{
+    PaymentTickContext tick;
+    PaymentGetTickContext( &tick );
+    IdleSecond( &tick );
+}
+
+void PaymentChargeClass::IdleSecond( const PaymentTickContext* tick )
 {
     if( isLinkedAccountActive )
     {
+        PAYMENT_PROFILE_BEGIN( idleSecond );
+
         /* Described in Blue Book. Charge - period */
         if( chargeCfg->chargeType == PaymentChargeConsumptionBased )
         {   
-            ExecuteConsumptionBasedCollection();         
+            ExecuteConsumptionBasedCollection( tick->utcSeconds );
         }
         else if( chargeCfg->chargeType == PaymentChargeTimeBased )
         {
-            ExecuteTimeBasedCollection();
+            ExecuteTimeBasedCollection( tick->utcSeconds );
         }   
 
         if( newCollection )                                              
@@ -1675,7 +2309,7 @@ void PaymentChargeClass::IdleSecond()
                 if( currValues.totalAmountRemaining != 0 )              // if totalAmountRemaining == 0 then this functionality doesn't work
                 {
                     sumToCollect = ReduceTotalAmountRemaining( sumToCollect );         // Vozmijno umeni6itsea sumToCollect
-                    FileWrite( ftFile->ftSumToCollect, &sumToCollect );
+                    MarkDirty( chargeDirtySumToCollect );
 //                    if( currValues.totalAmountRemaining == 0 )
 //                    {
 //                        // надо отключить сборы с этого charge потомучто лимит исчерпан
@@ -1683,6 +2317,8 @@ void PaymentChargeClass::IdleSecond()
                 }
             }     
         }
+        
+        PAYMENT_PROFILE_END( idleSecond, PaymentProfileChargeIdleSecond );
     }
 
     return;
@@ -1690,71 +2326,81 @@ void PaymentChargeClass::IdleSecond()
 
 void PaymentChargeClass::IdleMinute()
 {
-    if( !cmpDateTimeWithNotSpecifiedDateTime( &chargeCfg->unitChargeActivationTime ) )
+    PaymentTickContext tick;
+    PaymentGetTickContext( &tick );
+    IdleMinute( &tick );
+}
+
+void PaymentChargeClass::IdleMinute( const PaymentTickContext* tick )
+{
+    if( !deadlineScheduled )
     {
-        if( cmpDateTimeWithCurrDateTime( &chargeCfg->unitChargeActivationTime ) )
-            ActivatePassiveUnitCharge();
+        deadlineScheduled = true;
+        ScheduleUnitChargeActivation( getDeadlineFrom( tick->utcSeconds ) );
     }
 }
 
+void PaymentChargeClass::ScheduleUnitChargeActivation( PaymentTime from )
+{
+    if( !PaymentDeadlineSchedule( this, PaymentDeadlineUnitChargeActivation,
+                                  getDeadlineUTC( chargeCfg->unitChargeActivationTime, from ), DeadlineHandler ) )
+        deadlineScheduled = false;              // the queue is full, scheduled again in the next IdleMinute
+}
+
+void PaymentChargeClass::DeadlineHandler( void* object, u8 kind, u8 reason, PaymentTime now )
+{
+    PaymentChargeClass* charge = (PaymentChargeClass*)object;
+    
+    if( reason == PaymentDeadlineClockChanged )
+        charge->ScheduleUnitChargeActivation( getDeadlineFrom( now ) );
+    else if( kind == PaymentDeadlineUnitChargeActivation )
+        charge->ActivatePassiveUnitCharge();
+}
+
 void PaymentChargeClass::Init()
 {
-    FileRead( ftFile->ftTotalAmountPaid, &currValues.totalAmountPaid );
+    const u16 ftTimes[] = { ftFile->ftUnitChargeActivationTime, ftFile->ftLastCollectionTime };
+    PaymentTimeUpgradeRecords( ftFile->ftTimeFormat, ftTimes, sizeof( ftTimes ) / sizeof( ftTimes[0] ) );   // before the snapshot, the later writes are the seconds
+    
+    if( RestoreFromSnapshot() )
+        return;
     
-    const u8 lenBufUnitCharge = eDTL_Integer + eDTL_Integer + eDTL_LongUnsigned + 6 + eDTL_Integer + MAX_TARIFFS * ( MAX_INDEX_LEN + eDTL_Long );
-    BYTE bufUnitCharge[ lenBufUnitCharge ] = {};
+    PaymentCounterRead( ftFile->ftTotalAmountPaid, &currValues.totalAmountPaid );
     
     bool needActivatePassiveUnitCharge = true;
-    if( FileRead( ftFile->ftUnitChargeActive, bufUnitCharge ) == lenBufUnitCharge )     /* if in the flash was written unit_charge_active */
+    if( readUnitCharge( ftFile->ftUnitChargeActive, ftFile->ftUnitChargeActiveElement, &chargeCfg->unitChargeActive ) )  /* if in the flash was written unit_charge_active */
     {
-        convertUnitChargeFromMemoryBufferToStruct( bufUnitCharge, &chargeCfg->unitChargeActive );
         needActivatePassiveUnitCharge = false;                                          /* because unit_charge_active was saved we don't need to activate unit_charge_passive */
     }    
     
-    if( FileRead( ftFile->ftUnitChargePassive, bufUnitCharge ) == lenBufUnitCharge )    /* if in the flash was written unit_charge_passive */
+    if( !readUnitCharge( ftFile->ftUnitChargePassive, ftFile->ftUnitChargePassiveElement, &chargeCfg->unitChargePassive ) )   /* if in the flash wasn't written unit_charge_passive */
     {
-        convertUnitChargeFromMemoryBufferToStruct( bufUnitCharge, &chargeCfg->unitChargePassive );
+        writeUnitCharge( ftFile->ftUnitChargePassive, ftFile->ftUnitChargePassiveElement, &chargeCfg->unitChargePassive, 0xFF );  /* the later changes are written by elements */
     }
     
-    DWORD seconds = 0;
-    if( FileRead( ftFile->ftUnitChargeActivationTime, &seconds ) == eDTL_DoubleLongUnsigned ) /* if in the flash was written unit_charge_activation_time */
-    {        
-        UnpackTDateTime( seconds, &chargeCfg->unitChargeActivationTime );
-    }
-    else
-    {
-        chargeCfg->unitChargeActivationTime = { {0xff, 0xff, 0xff, 0xff, 0xff}, {0xff, 0xff, 0xff, 0xff}, 0xff, 0xff, {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff} };
-    }
+    chargeCfg->unitChargeActivationTime = readTimeFile( ftFile->ftUnitChargeActivationTime );
     
     u32 tmpPeriod = 0;
-    if( FileRead( ftFile->ftPeriod, &tmpPeriod ) != 0 )           /* read period from the flash. If nothing was written there, then will be used period from default cfg struct */
+    if( PaymentFileRead( ftFile->ftPeriod, &tmpPeriod ) != 0 )           /* read period from the flash. If nothing was written there, then will be used period from default cfg struct */
     {
         chargeCfg->period = tmpPeriod;
     }
       
-    seconds = 0;
-    if( FileRead( ftFile->ftLastCollectionTime, &seconds ) == eDTL_DoubleLongUnsigned )    /* if in the FRAM was written last_collection_time */
-    {
-        UnpackTDateTime( seconds, &currValues.lastCollectionTime );
-    }
-    else
-    {
-        currValues.lastCollectionTime = { {0xff, 0xff, 0xff, 0xff, 0xff}, {0xff, 0xff, 0xff, 0xff}, 0xff, 0xff, {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff} };
-    }
+    currValues.lastCollectionTime = readTimeFile( ftFile->ftLastCollectionTime );
     
-    FileRead( ftFile->ftLastCollectionAmount, &currValues.lastCollectionAmount );
+    PaymentFileRead( ftFile->ftLastCollectionAmount, &currValues.lastCollectionAmount );
 
-    FileRead( ftFile->ftTotalAmountRemaining, &currValues.totalAmountRemaining );
+    PaymentCounterRead( ftFile->ftTotalAmountRemaining, &currValues.totalAmountRemaining );
     
     if( chargeCfg->chargeType == PaymentChargeConsumptionBased )
     {
-        for( u8 i = 0; i < MAX_TARIFFS; ++i )
+        for( u8 i = MAX_TARIFFS; i-- > 0; )           // from the last index, see PaymentCounterIndexRead
         {
-            FileIndexRead( ftFile->ftLastMeasurementValue, i, &lastValue[i] );
+            PaymentCounterIndexRead( ftFile->ftLastMeasurementValue, i, &lastValue[i] );
         }
     }
     
-    FileRead( ftFile->ftSumToCollect, &sumToCollect );
+    PaymentCounterRead( ftFile->ftSumToCollect, &sumToCollect );
     if( sumToCollect != 0 )
         newCollection = true;
     else
@@ -1762,13 +2408,14 @@ void PaymentChargeClass::Init()
     
     if( needActivatePassiveUnitCharge )
     {
+        memset( &chargeCfg->unitChargeActive, 0, sizeof( chargeCfg->unitChargeActive ) );     /* nothing is in the file, so all elements are written */
         ActivatePassiveUnitCharge();
     } 
 }
 
 PaymentChargeClass::PaymentChargeClass( const LOGICAL_NAME* const _ln,
                                        PaymentChargeCfg* const cfg,
-                                       const ftPaymentCharge* const _ftFile) : ln( _ln ), chargeCfg(cfg), ftFile( _ftFile )
+                                       const ftPaymentCharge* const _ftFile) : ln( _ln ), chargeCfg(cfg), ftFile( _ftFile ), dirtyMask( 0 ), dirtyLastValueMask( 0 ), changeEvents( paymentEventAll ), deadlineScheduled( false )
 {
 #ifndef NEW_CONST_CLASS_MAP                                                                           
       //DataObjectsMap[(LOGICAL_NAME*)_ln] = this; 
@@ -1780,7 +2427,6 @@ PaymentChargeClass::PaymentChargeClass( const LOGICAL_NAME* const _ln,
 /*** Functions of PaymentTokenGatewayClass ***/
 /*********************************************/
 
-
 /************************************************************************************************/
 /*********** GET and SET functions for communication between Payment classes ********************/
 /************************************************************************************************/
@@ -1811,14 +2457,14 @@ s32 PaymentAccountClass::GetSumOfAllCurrentCreditAmount() const
     return sumOfAllCurrentCreditAmount;
 } 
 
-TDateTime* PaymentAccountClass::GetAccountActivationTime() const
+PaymentTime PaymentAccountClass::GetAccountActivationTime() const
 {
-    return &accountCfg->accountActivationTime;
+    return accountCfg->accountActivationTime;
 }
 
-TDateTime* PaymentAccountClass::GetAccountClosureTime() const
+PaymentTime PaymentAccountClass::GetAccountClosureTime() const
 {
-    return &accountCfg->accountClosureTime;
+    return accountCfg->accountClosureTime;
 }
 
 s8 PaymentAccountClass::GetCurrencyScale() const
@@ -1892,6 +2538,28 @@ bool PaymentCreditClass::GetRequiresCreditAmountToBePaidBack() const
     return creditCfg->creditConfiguration & creditCfgRepayment;
 }
 
+/* Share of the credit in available_credit of the account: the positive amount of the selected or in use credit */
+s32 PaymentCreditClass::GetAvailableCreditShare() const
+{
+    if( ( currValues.creditStatus == SELECTED || currValues.creditStatus == IN_USE ) &&
+        currValues.currentCreditAmount > 0 )
+        return currValues.currentCreditAmount;
+    
+    return 0;
+}
+
+/* Share of the credit in amount_to_clear of the account, without clearance_threshold */
+s32 PaymentCreditClass::GetAmountToClearShare() const
+{
+    if( GetRequiresCreditAmountToBePaidBack() )
+        return currValues.currentCreditAmount * -1;
+    
+    if( currValues.creditStatus == EXHAUSTED && currValues.currentCreditAmount < 0 )
+        return currValues.currentCreditAmount;
+    
+    return 0;
+}
+
 /*********************************************/
 /***** SET of PaymentCreditClass *************/
 /*********************************************/
@@ -1903,14 +2571,16 @@ bool PaymentCreditClass::InvokeCreditStatusToInUse()
         ( currValues.creditStatus == ENABLED && !(creditCfg->creditConfiguration & creditCfgConfirmation) ) )
     {
         currValues.creditStatus = IN_USE;
-        FileWrite( ftFile->ftCreditStatus, &currValues.creditStatus );
+        changeEvents |= paymentEventCreditStatus;
+        PaymentFileWrite( ftFile->ftCreditStatus, &currValues.creditStatus );
         
         return true;
     }
     else if( currValues.creditStatus == ENABLED && (creditCfg->creditConfiguration & creditCfgConfirmation) )
     {
         currValues.creditStatus = SELECTABLE;
-        FileWrite( ftFile->ftCreditStatus, &currValues.creditStatus );
+        changeEvents |= paymentEventCreditStatus;
+        PaymentFileWrite( ftFile->ftCreditStatus, &currValues.creditStatus );
     }
     
     return false;
@@ -1923,7 +2593,8 @@ bool PaymentCreditClass::InvokeCreditStatusToEnable()
         currValues.creditStatus == IN_USE )
     {
         currValues.creditStatus = ENABLED; 
-        FileWrite( ftFile->ftCreditStatus, &currValues.creditStatus );
+        changeEvents |= paymentEventCreditStatus;
+        PaymentFileWrite( ftFile->ftCreditStatus, &currValues.creditStatus );
         
         return true;
     }
@@ -1935,9 +2606,81 @@ void PaymentCreditClass::ResetCredit()
 {
     currValues.currentCreditAmount = 0;
     currValues.creditStatus = EXHAUSTED;
+    changeEvents |= paymentEventCreditAmount | paymentEventCreditStatus;
+    
+    dirtyMask |= creditDirtyCurrentCreditAmount;
+    Flush();
+    PaymentFileWrite( ftFile->ftCreditStatus, &currValues.creditStatus );
+}
+
+/* The function returns the change events raised since the previous call and clears them */
+u8 PaymentCreditClass::TakeChangeEvents()
+{
+    u8 events = changeEvents;
+    changeEvents = 0;
+    return events;
+}
+
+void PaymentCreditClass::MarkDirty( u8 mask )
+{
+    dirtyMask |= mask;
+    changeEvents |= paymentEventCreditAmount;
+#ifndef PAYMENT_WRITE_COALESCING
+    Flush();
+#endif // PAYMENT_WRITE_COALESCING
+}
+
+void PaymentCreditClass::AddToSnapshot() const
+{
+#ifdef PAYMENT_BOOT_SNAPSHOT
+    PaymentCreditSnapshot snapshot;
+    memset( &snapshot, 0, sizeof( snapshot ) );
+    snapshot.currValues = currValues;
+    snapshot.warningThreshold = creditCfg->warningThreshold;
+    snapshot.limit = creditCfg->limit;
+    
+    PaymentSnapshotAdd( ftFile->ftCurrentCreditAmount, &snapshot, sizeof( snapshot ) );
+#endif // PAYMENT_BOOT_SNAPSHOT
+}
+
+bool PaymentCreditClass::RestoreFromSnapshot()
+{
+#ifdef PAYMENT_BOOT_SNAPSHOT
+    PaymentSnapshotLoad();
+    
+    PaymentCreditSnapshot snapshot;
+    if( !PaymentSnapshotGet( ftFile->ftCurrentCreditAmount, &snapshot, sizeof( snapshot ) ) )
+        return false;
+    
+    currValues = snapshot.currValues;
+    creditCfg->warningThreshold = snapshot.warningThreshold;
+    creditCfg->limit = snapshot.limit;
     
-    FileWrite( ftFile->ftCurrentCreditAmount, &currValues.currentCreditAmount );
-    FileWrite( ftFile->ftCreditStatus, &currValues.creditStatus );
+    return true;
+#else
+    return false;
+#endif // PAYMENT_BOOT_SNAPSHOT
+}
+
+/* The function returns false if the dirty or queued counter has no place in the emergency record */
+bool PaymentCreditClass::AddDirtyToEmergency() const
+{
+    bool added = true;
+#ifdef PAYMENT_EMERGENCY_FLUSH
+    if( ( dirtyMask & creditDirtyCurrentCreditAmount ) || PaymentCounterIsQueued( ftFile->ftCurrentCreditAmount ) )
+        added &= PaymentEmergencyAdd( ftFile->ftCurrentCreditAmount, PAYMENT_EMERGENCY_NOT_INDEXED, &currValues.currentCreditAmount, sizeof( currValues.currentCreditAmount ) );
+#endif // PAYMENT_EMERGENCY_FLUSH
+    return added;
+}
+
+void PaymentCreditClass::Flush()
+{
+    PAYMENT_JOURNAL_BEGIN();
+    if( dirtyMask & creditDirtyCurrentCreditAmount )
+        PaymentCounterWrite( ftFile->ftCurrentCreditAmount, &currValues.currentCreditAmount );
+    PAYMENT_JOURNAL_COMMIT();
+    
+    dirtyMask = 0;
 }
 
 /*********************************************/
@@ -1984,17 +2727,26 @@ s32 PaymentChargeClass::GetSumToCollect() const
     return sumToCollect;
 }
 
+/* Share of the charge in aggregated_debt of the account: total_amount_remaining in the scale of the currency */
+s32 PaymentChargeClass::GetAggregatedDebtShare( s8 currencyScale ) const
+{
+    if( GetContinuousCollection() )
+        return 0;
+    
+    return scaleValue( currValues.totalAmountRemaining, GetPriceScale() - currencyScale );
+}
+
 /*********************************************/
 /***** SET of PaymentChargeClass *************/
 /*********************************************/
-void PaymentChargeClass::ConfirmCollection()
+void PaymentChargeClass::ConfirmCollection( PaymentTime now )
 {
     UpdateTotalAmountPaid( sumToCollect );
-    UpdateLastCollectionTime();
+    UpdateLastCollectionTime( now );
     UpdateLastCollectionAmount( sumToCollect );   
   
     sumToCollect = 0;
-    FileWrite( ftFile->ftSumToCollect, &sumToCollect );
+    MarkDirty( chargeDirtySumToCollect );
     newCollection = false;
 }
 
@@ -2011,14 +2763,14 @@ void PaymentChargeClass::ActivateCharge()
     
     ActivatePassiveUnitCharge();
     
-    UpdateLastCollectionTime();       // The activation time will be the starting point for the consumption based and time based collections
+    UpdateLastCollectionTime( PaymentTimeNow() );       // The activation time will be the starting point for the consumption based and time based collections
     
     for( u8 i = 0; i < MAX_TARIFFS; ++i )
     {
         /* !!! Nado 4itati iz tariffnogo registra !!! */            
         lastValue[i] = GetValueFromRegister( &chargeCfg->unitChargeActive.commodityReference.logicalName );
         
-        FileIndexWrite( ftFile->ftLastMeasurementValue, i, &lastValue[i] );           
+        MarkLastValueDirty( i );
     }
 }
 
@@ -2030,18 +2782,129 @@ void PaymentChargeClass::CloseCharge()
 void PaymentChargeClass::ResetCharge()
 {
     currValues.totalAmountPaid = 0;
-    currValues.lastCollectionTime = { {0xff, 0xff, 0xff, 0xff, 0xff}, {0xff, 0xff, 0xff, 0xff}, 0xff, 0xff, {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff} };
+    currValues.lastCollectionTime = PAYMENT_TIME_NOT_SPECIFIED;
     currValues.lastCollectionAmount = 0;
     currValues.totalAmountRemaining = 0;
     newCollection = false;
     sumToCollect = 0;
+    changeEvents |= paymentEventChargeAmount;
+    
+    dirtyMask |= chargeDirtyTotalAmountPaid | chargeDirtyTotalAmountRemaining | chargeDirtySumToCollect;
+    Flush();
+    writeTimeFile( ftFile->ftLastCollectionTime, currValues.lastCollectionTime );
+    PaymentFileWrite( ftFile->ftLastCollectionAmount, &currValues.lastCollectionAmount );
+}
+
+/* The function returns the change events raised since the previous call and clears them */
+u8 PaymentChargeClass::TakeChangeEvents()
+{
+    u8 events = changeEvents;
+    changeEvents = 0;
+    return events;
+}
+
+void PaymentChargeClass::MarkDirty( u8 mask )
+{
+    dirtyMask |= mask;
+    if( mask & chargeDirtyTotalAmountRemaining )
+        changeEvents |= paymentEventChargeAmount;
+#ifndef PAYMENT_WRITE_COALESCING
+    Flush();
+#endif // PAYMENT_WRITE_COALESCING
+}
+
+void PaymentChargeClass::MarkLastValueDirty( u8 tariffIndex )
+{
+    dirtyLastValueMask |= ( 1 << tariffIndex );
+#ifndef PAYMENT_WRITE_COALESCING
+    Flush();
+#endif // PAYMENT_WRITE_COALESCING
+}
+
+void PaymentChargeClass::AddToSnapshot() const
+{
+#ifdef PAYMENT_BOOT_SNAPSHOT
+    PaymentChargeSnapshot snapshot;
+    memset( &snapshot, 0, sizeof( snapshot ) );
+    snapshot.unitChargeActive = chargeCfg->unitChargeActive;
+    snapshot.unitChargePassive = chargeCfg->unitChargePassive;
+    snapshot.unitChargeActivationTime = chargeCfg->unitChargeActivationTime;
+    snapshot.currValues = currValues;
+    memcpy( snapshot.lastValue, lastValue, sizeof( snapshot.lastValue ) );
+    snapshot.period = chargeCfg->period;
+    snapshot.sumToCollect = sumToCollect;
+    
+    PaymentSnapshotAdd( ftFile->ftTotalAmountPaid, &snapshot, sizeof( snapshot ) );
+#endif // PAYMENT_BOOT_SNAPSHOT
+}
+
+bool PaymentChargeClass::RestoreFromSnapshot()
+{
+#ifdef PAYMENT_BOOT_SNAPSHOT
+    PaymentSnapshotLoad();
     
-    FileWrite( ftFile->ftTotalAmountPaid, &currValues.totalAmountPaid );
-    u32 seconds = PackTdateTime( &currValues.lastCollectionTime );
-    FileWrite( ftFile->ftLastCollectionTime, &seconds );
-    FileWrite( ftFile->ftLastCollectionAmount, &currValues.lastCollectionAmount );
-    FileWrite( ftFile->ftTotalAmountRemaining, &currValues.totalAmountRemaining );
-    FileWrite( ftFile->ftSumToCollect, &sumToCollect );
+    PaymentChargeSnapshot snapshot;
+    if( !PaymentSnapshotGet( ftFile->ftTotalAmountPaid, &snapshot, sizeof( snapshot ) ) )
+        return false;
+    
+    chargeCfg->unitChargeActive = snapshot.unitChargeActive;
+    chargeCfg->unitChargePassive = snapshot.unitChargePassive;
+    chargeCfg->unitChargeActivationTime = snapshot.unitChargeActivationTime;
+    chargeCfg->period = snapshot.period;
+    currValues = snapshot.currValues;
+    memcpy( lastValue, snapshot.lastValue, sizeof( lastValue ) );
+    sumToCollect = snapshot.sumToCollect;
+    newCollection = ( sumToCollect != 0 );
+    
+    return true;
+#else
+    return false;
+#endif // PAYMENT_BOOT_SNAPSHOT
+}
+
+/* The function returns false if some dirty or queued counter has no place in the emergency record */
+bool PaymentChargeClass::AddDirtyToEmergency() const
+{
+    bool added = true;
+#ifdef PAYMENT_EMERGENCY_FLUSH
+    if( ( dirtyMask & chargeDirtyTotalAmountPaid ) || PaymentCounterIsQueued( ftFile->ftTotalAmountPaid ) )
+        added &= PaymentEmergencyAdd( ftFile->ftTotalAmountPaid, PAYMENT_EMERGENCY_NOT_INDEXED, &currValues.totalAmountPaid, sizeof( currValues.totalAmountPaid ) );
+    if( ( dirtyMask & chargeDirtyTotalAmountRemaining ) || PaymentCounterIsQueued( ftFile->ftTotalAmountRemaining ) )
+        added &= PaymentEmergencyAdd( ftFile->ftTotalAmountRemaining, PAYMENT_EMERGENCY_NOT_INDEXED, &currValues.totalAmountRemaining, sizeof( currValues.totalAmountRemaining ) );
+    if( ( dirtyMask & chargeDirtySumToCollect ) || PaymentCounterIsQueued( ftFile->ftSumToCollect ) )
+        added &= PaymentEmergencyAdd( ftFile->ftSumToCollect, PAYMENT_EMERGENCY_NOT_INDEXED, &sumToCollect, sizeof( sumToCollect ) );
+    
+    bool lastValueQueued = PaymentCounterIsQueued( ftFile->ftLastMeasurementValue );
+    for( u8 i = 0; i < MAX_TARIFFS; ++i )
+    {
+        if( ( dirtyLastValueMask & ( 1 << i ) ) || lastValueQueued )
+            added &= PaymentEmergencyAdd( ftFile->ftLastMeasurementValue, i, &lastValue[i], sizeof( lastValue[i] ) );
+    }
+#endif // PAYMENT_EMERGENCY_FLUSH
+    return added;
+}
+
+void PaymentChargeClass::Flush()
+{
+    PAYMENT_JOURNAL_BEGIN();
+    if( dirtyMask & chargeDirtyTotalAmountPaid )
+        PaymentCounterWrite( ftFile->ftTotalAmountPaid, &currValues.totalAmountPaid );
+    if( dirtyMask & chargeDirtyTotalAmountRemaining )
+        PaymentCounterWrite( ftFile->ftTotalAmountRemaining, &currValues.totalAmountRemaining );
+    if( dirtyMask & chargeDirtySumToCollect )
+        PaymentCounterWrite( ftFile->ftSumToCollect, &sumToCollect );
+    
+    for( u8 i = 0; dirtyLastValueMask != 0 && i < MAX_TARIFFS; ++i )
+    {
+        if( dirtyLastValueMask & ( 1 << i ) )
+        {
+            PaymentCounterIndexWrite( ftFile->ftLastMeasurementValue, i, &lastValue[i] );
+            dirtyLastValueMask &= ~( 1 << i );
+        }
+    }
+    PAYMENT_JOURNAL_COMMIT();
+    
+    dirtyMask = 0;
 }
 
 void PaymentChargeClass::SetIsLinkedAccountActive( bool newIsLinkedAccountActive )
@@ -2093,23 +2956,139 @@ u8 PaymentTokenGatewayClass::GetExpiresTimeStatus() const
     return lastToken.expiresTimeStatusReceivedWithStart;
 }
 
+/* TID == 0 means that the token wasn't received, so the empty records are not found */
+bool PaymentTokenGatewayClass::CheckForDuplicatesReceivedTokenID( u32 rxTID ) const
+{
+    if( rxTID == 0 )
+        return false;
+    
+    for( u8 i = 0; i < NUM_OF_STORED_TOKENS_ID; ++i )
+    {
+        if( tokenIDHistory[i].tokenID == rxTID )
+            return true;                                /* the token was already received */
+    }
+    return false;
+}
+
 /*********************************************/
 /***** SET of PaymentTokenGatewayClass *******/
 /*********************************************/
 
+static u16 calcTokenIDRecordCrc( u8 index, const PaymentTokenIDRecord* record )
+{
+    u32 crc = PaymentCrc32( &index, sizeof( index ) );
+    return (u16)PaymentCrc32Continue( crc, record, sizeof( *record ) - sizeof( record->crc ) );
+}
+
+
+/*
+The history of the previous versions: ftTokenID is the indexed file of NUM_OF_STORED_TOKENS_ID TIDs
+and ftNextReceivedTokenIndex is the index of the next one. The TIDs are appended to ftTokenIDHistory
+from the oldest one and then ftNextReceivedTokenIndex is marked, so the migration interrupted by
+the power fail is repeated from the start with the same records.
+*/
+void PaymentTokenGatewayClass::MigrateTokenIDHistory()
+{
+    u8 legacyNextIndex = PAYMENT_TOKEN_ID_HISTORY_MIGRATED;
+    if( PaymentFileRead( ftFile->ftNextReceivedTokenIndex, &legacyNextIndex ) == 0 || legacyNextIndex >= NUM_OF_STORED_TOKENS_ID )
+        return;                                         // no token was received by the previous version or the history is already moved
+    
+    lastToken.nextReceivedTokenIndex = 0;
+    tokenIDHeadSeq = 0;
+    for( u8 i = 0; i < NUM_OF_STORED_TOKENS_ID; ++i )
+    {
+        u32 legacyTokenID = 0;
+        u8 legacyIndex = ( legacyNextIndex + i ) % NUM_OF_STORED_TOKENS_ID;
+        if( PaymentFileIndexRead( ftFile->ftTokenID, legacyIndex, &legacyTokenID ) == sizeof( legacyTokenID ) && legacyTokenID != 0 )
+            AppendTokenIDToHistory( legacyTokenID );
+    }
+    
+    legacyNextIndex = PAYMENT_TOKEN_ID_HISTORY_MIGRATED;
+    PaymentFileWrite( ftFile->ftNextReceivedTokenIndex, &legacyNextIndex );
+}
+
+/*
+Must be called by Init() before the first token is checked.
+The whole history is read by one read and checked in RAM: the records not written or torn are emptied.
+Every valid record followed by the record which is not valid or has not the next sequence number is the end
+of the written run, the newest of them is the head (the older runs may remain after the lost record
+in the middle of the ring).
+*/
+void PaymentTokenGatewayClass::LoadTokenIDHistory()
+{
+    if( PaymentFileRead( ftFile->ftTokenIDHistory, &tokenIDHistory ) != sizeof( tokenIDHistory ) )
+        memset( tokenIDHistory, 0, sizeof( tokenIDHistory ) );     // no TID was received
+    
+    u16 firstSeq = tokenIDHistory[0].seq;
+    bool firstValid = ( tokenIDHistory[0].crc == calcTokenIDRecordCrc( 0, &tokenIDHistory[0] ) );
+    u16 prevSeq = 0;
+    bool prevValid = false;
+    u8 head = NUM_OF_STORED_TOKENS_ID;                  // no valid record
+    
+    for( u16 i = 0; i <= NUM_OF_STORED_TOKENS_ID; ++i )
+    {
+        u16 currSeq = firstSeq;                         // the last record is followed by the first one
+        bool currValid = firstValid;
+        if( i < NUM_OF_STORED_TOKENS_ID )
+        {
+            PaymentTokenIDRecord* record = &tokenIDHistory[i];
+            currSeq = record->seq;
+            currValid = ( i == 0 ) ? firstValid : ( record->crc == calcTokenIDRecordCrc( (u8)i, record ) );
+            if( !currValid )
+                memset( record, 0, sizeof( *record ) );
+        }
+        
+        if( i != 0 && prevValid && !( currValid && currSeq == (u16)( prevSeq + 1 ) ) )
+        {
+            if( head == NUM_OF_STORED_TOKENS_ID || (s16)( prevSeq - tokenIDHeadSeq ) > 0 )
+            {
+                head = (u8)( i - 1 );
+                tokenIDHeadSeq = prevSeq;
+            }
+        }
+        
+        prevSeq = currSeq;
+        prevValid = currValid;
+    }
+    
+    if( head == NUM_OF_STORED_TOKENS_ID )
+    {
+        tokenIDHeadSeq = 0;
+        lastToken.tokenID = 0;
+        lastToken.nextReceivedTokenIndex = 0;
+        return;
+    }
+    
+    lastToken.tokenID = tokenIDHistory[head].tokenID;
+    lastToken.nextReceivedTokenIndex = ( head + 1 ) % NUM_OF_STORED_TOKENS_ID;
+}
+
+void PaymentTokenGatewayClass::AppendTokenIDToHistory( u32 newTokenID )
+{
+    u8 index = lastToken.nextReceivedTokenIndex;
+    
+    PaymentTokenIDRecord* record = &tokenIDHistory[index];
+    record->tokenID = newTokenID;
+    record->seq = ++tokenIDHeadSeq;
+    record->crc = calcTokenIDRecordCrc( index, record );
+    PaymentFileIndexWrite( ftFile->ftTokenIDHistory, index, record );
+    
+    IncrementNextReceivedTokenIndex();
+}
+
 void PaymentTokenGatewayClass::ConfirmReceivedToken()
 {
 //    newTokenTopUp = false;
 //    topUpSum = 0;
     currValues.tokenStatus.statusCode = executionOK;
-    FileWrite( ftFile->ftTokenStatusCode, &currValues.tokenStatus.statusCode );
+    PaymentFileWrite( ftFile->ftTokenStatusCode, &currValues.tokenStatus.statusCode );
 }
 
 void PaymentTokenGatewayClass::RefuseReceivedToken()
 {
 //    newTokenTopUp = false;
     currValues.tokenStatus.statusCode = executionFAIL;
-    FileWrite( ftFile->ftTokenStatusCode, &currValues.tokenStatus.statusCode );
+    PaymentFileWrite( ftFile->ftTokenStatusCode, &currValues.tokenStatus.statusCode );
 }
 
 /************************************************************************************************/
@@ -2267,7 +3246,7 @@ bool PaymentAccountClass::GetAttr13( uint8_t* buf_response, uint16_t& len_respon
 {
     buf_response[len_response++] = eDT_OctetString;
     buf_response[len_response++] = eDTL_DateTime;
-    memcpy( &buf_response[len_response], &accountCfg->accountActivationTime, eDTL_DateTime );
+    encodeTime( &buf_response[len_response], accountCfg->accountActivationTime );
     len_response += eDTL_DateTime;
     
     return true;
@@ -2277,7 +3256,7 @@ bool PaymentAccountClass::GetAttr14( uint8_t* buf_response, uint16_t& len_respon
 {
     buf_response[len_response++] = eDT_OctetString;
     buf_response[len_response++] = eDTL_DateTime;
-    memcpy( &buf_response[len_response], &accountCfg->accountClosureTime, eDTL_DateTime );
+    encodeTime( &buf_response[len_response], accountCfg->accountClosureTime );
     len_response += eDTL_DateTime;
     
     return true;
@@ -2353,6 +3332,7 @@ bool PaymentAccountClass::GetAttr19( uint8_t* buf_response, uint16_t& len_respon
 bool PaymentAccountClass::Get( uint8_t attrID, uint8_t* buf_request, uint8_t* buf_response, uint16_t& len_response )
 {
     len_response = 0;
+    PAYMENT_PROFILE_CODEC_GET( PaymentProfileCodecAccount, attrID, len_response );
     switch( attrID )
     {
         case PaymentAccountModeAndStatusAttr:               return GetAttr2( buf_response, len_response );
@@ -2474,11 +3454,7 @@ uint8_t PaymentAccountClass::SetAttr13( uint8_t* buf_request )
         bufDateTime[10] == 0xff &&
         bufDateTime[11] == 0xff )
     {
-        /* Clear previous DateTime */
-        memset( &accountCfg->accountActivationTime, 0, sizeof( accountCfg->accountActivationTime ) );
-        
-        /* Save all 0xff */
-        memcpy( &accountCfg->accountActivationTime, bufDateTime, sizeof( bufDateTime ) ); 
+        accountCfg->accountActivationTime = PAYMENT_TIME_NOT_SPECIFIED;
         
         return eDAR_Success;
     }
@@ -2496,11 +3472,7 @@ uint8_t PaymentAccountClass::SetAttr13( uint8_t* buf_request )
         tmpStructDateTime.time.hundredths == 0xff )
         return eDAR_OtherReason;
     
-    /* Clear previous DateTime */
-    memset( &accountCfg->accountActivationTime, 0, sizeof( accountCfg->accountActivationTime ) );
-    
-    /* Save new DateTime */
-    memcpy( &accountCfg->accountActivationTime, &tmpStructDateTime, sizeof( tmpStructDateTime ) );
+    accountCfg->accountActivationTime = PaymentTimeFromDateTime( &tmpStructDateTime );
   
     return eDAR_Success;
 }
@@ -2534,11 +3506,7 @@ uint8_t PaymentAccountClass::SetAttr14( uint8_t* buf_request )
         bufDateTime[10] == 0xff &&
         bufDateTime[11] == 0xff )
     {
-        /* Clear previous DateTime */
-        memset( &accountCfg->accountClosureTime, 0, sizeof( accountCfg->accountClosureTime ) );
-        
-        /* Save all 0xff */
-        memcpy( &accountCfg->accountClosureTime, bufDateTime, sizeof( bufDateTime ) ); 
+        accountCfg->accountClosureTime = PAYMENT_TIME_NOT_SPECIFIED;
         
         return eDAR_Success;
     }
@@ -2556,11 +3524,7 @@ uint8_t PaymentAccountClass::SetAttr14( uint8_t* buf_request )
         tmpStructDateTime.time.hundredths == 0xff )
         return eDAR_OtherReason;
     
-    /* Clear previous DateTime */
-    memset( &accountCfg->accountClosureTime, 0, sizeof( accountCfg->accountClosureTime ) );
-    
-    /* Save new DateTime */
-    memcpy( &accountCfg->accountClosureTime, &tmpStructDateTime, sizeof( tmpStructDateTime ) );
+    accountCfg->accountClosureTime = PaymentTimeFromDateTime( &tmpStructDateTime );
   
     return eDAR_Success;
 }
@@ -2610,7 +3574,7 @@ uint8_t PaymentAccountClass::SetAttr15( uint8_t* buf_request )
     bufForFlash[3] = accountCfg->currency.scale;
     bufForFlash[4] = accountCfg->currency.unit;
     
-    FileWrite( ftFile->ftCurrency, bufForFlash );    
+    PaymentFileWrite( ftFile->ftCurrency, &bufForFlash );    
     
     return eDAR_Success;
 }
@@ -2622,7 +3586,7 @@ uint8_t PaymentAccountClass::SetAttr18( uint8_t* buf_request )
   
     AXDRDecodeWord( &buf_request[1], &accountCfg->maxProvision );
     
-    FileWrite( ftFile->ftMaxProvision, &accountCfg->maxProvision );
+    PaymentFileWrite( ftFile->ftMaxProvision, &accountCfg->maxProvision );
     
     return eDAR_Success;
 }
@@ -2634,19 +3598,34 @@ uint8_t PaymentAccountClass::SetAttr19( uint8_t* buf_request )
     
     AXDRDecodeDoubleLong( &buf_request[1], &accountCfg->maxProvisionPeriod );
   
-    FileWrite( ftFile->ftMaxProvisionPeriod, &accountCfg->maxProvisionPeriod );
+    PaymentFileWrite( ftFile->ftMaxProvisionPeriod, &accountCfg->maxProvisionPeriod );
     
     return eDAR_Success;
 }
 
+/* The times written by the client are acted upon from the current time */
+uint8_t PaymentAccountClass::RescheduleDeadlines( uint8_t result )
+{
+    if( result == eDAR_Success && deadlineScheduled )
+    {
+        PaymentTickContext tick;
+        PaymentGetTickContext( &tick );
+        ScheduleDeadlines( tick.utcSeconds );
+    }
+    
+    return result;
+}
+
 uint8_t PaymentAccountClass::Set( uint8_t attrID, uint8_t* buf_request )
 {
+    PAYMENT_PROFILE_CODEC_SET( PaymentProfileCodecAccount, attrID, buf_request );
+    changeEvents |= paymentEventAccountConfig;
     switch( attrID )
     {
         case PaymentAccountClearanceThresholdAttr:              return SetAttr7( buf_request );
         case PaymentAccountTokenGatewayConfigurationAttr:       return SetAttr12( buf_request );
-        case PaymentAccountAccountActivationTimeAttr:           return SetAttr13( buf_request );
-        case PaymentAccountAccountClosureTimeAttr:              return SetAttr14( buf_request );
+        case PaymentAccountAccountActivationTimeAttr:           return RescheduleDeadlines( SetAttr13( buf_request ) );
+        case PaymentAccountAccountClosureTimeAttr:              return RescheduleDeadlines( SetAttr14( buf_request ) );
         case PaymentAccountCurrencyAttr:                        return SetAttr15( buf_request );
         case PaymentAccountMaxProvisionAttr:                    return SetAttr18( buf_request );
         case PaymentAccountMaxProvisionPeriodAttr:              return SetAttr19( buf_request );
@@ -2747,6 +3726,7 @@ bool PaymentCreditClass::GetAttr11( uint8_t* buf_response, uint16_t& len_respons
 bool PaymentCreditClass::Get( uint8_t attrID, uint8_t* buf_request, uint8_t* buf_response, uint16_t& len_response )
 {
     len_response = 0;
+    PAYMENT_PROFILE_CODEC_GET( PaymentProfileCodecCredit, attrID, len_response );
     switch( attrID )
     {
         case PaymentCreditCurrentCreditAmountAttr:              return GetAttr2( buf_response, len_response );
@@ -2791,7 +3771,7 @@ uint8_t PaymentCreditClass::SetAttr5( uint8_t* buf_request )
     
     AXDRDecodeDoubleLong( &buf_request[1], &creditCfg->warningThreshold );
   
-    FileWrite( ftFile->ftWarningThreshold, &creditCfg->warningThreshold );
+    PaymentFileWrite( ftFile->ftWarningThreshold, &creditCfg->warningThreshold );
     
     return eDAR_Success;
 }
@@ -2803,7 +3783,7 @@ uint8_t PaymentCreditClass::SetAttr6( uint8_t* buf_request )
     
     AXDRDecodeDoubleLong( &buf_request[1], &creditCfg->limit );
     
-    FileWrite( ftFile->ftLimit, &creditCfg->limit);
+    PaymentFileWrite( ftFile->ftLimit, &creditCfg->limit);
     
     return eDAR_Success;
 }
@@ -2902,18 +3882,32 @@ uint8_t PaymentCreditClass::SetAttr11( uint8_t* buf_request )
     return eDAR_Success;
 }
 
+uint8_t PaymentCreditClass::ReschedulePeriod( uint8_t result )
+{
+    if( result == eDAR_Success && deadlineScheduled )
+    {
+        PaymentTickContext tick;
+        PaymentGetTickContext( &tick );
+        SchedulePeriod( tick.utcSeconds );
+    }
+    
+    return result;
+}
+
 uint8_t PaymentCreditClass::Set( uint8_t attrID, uint8_t* buf_request )
 {
+    PAYMENT_PROFILE_CODEC_SET( PaymentProfileCodecCredit, attrID, buf_request );
+    changeEvents |= paymentEventCreditConfig;                                   // all writable attributes are used by the account or in ControlCreditStatus
     switch( attrID )
     {
-        case PaymentCreditCreditTypeAttr:                       return SetAttr3( buf_request );
+        case PaymentCreditCreditTypeAttr:                       return ReschedulePeriod( SetAttr3( buf_request ) );
         case PaymentCreditPriorityAttr:                         return SetAttr4( buf_request );
         case PaymentCreditWarningThresholdAttr:                 return SetAttr5( buf_request );
         case PaymentCreditLimitAttr:                            return SetAttr6( buf_request );
         case PaymentCreditCreditConfigurationAttr:              return SetAttr7( buf_request );
         case PaymentCreditPresetCreditAmountAttr:               return SetAttr9( buf_request );
         case PaymentCreditCreditAvailableThresholdAttr:         return SetAttr10( buf_request );
-        case PaymentCreditPeriodAttr:                           return SetAttr11( buf_request );
+        case PaymentCreditPeriodAttr:                           return ReschedulePeriod( SetAttr11( buf_request ) );
         default:                                                return eDAR_ObjectUndefined;
     }
 }
@@ -3016,7 +4010,7 @@ bool PaymentChargeClass::GetAttr7( uint8_t* buf_response, uint16_t& len_response
 {
     buf_response[len_response++] = eDT_OctetString;
     buf_response[len_response++] = eDTL_DateTime;
-    memcpy( &buf_response[len_response], &chargeCfg->unitChargeActivationTime, eDTL_DateTime );
+    encodeTime( &buf_response[len_response], chargeCfg->unitChargeActivationTime );
     len_response += eDTL_DateTime;
     
     return true;
@@ -3042,7 +4036,7 @@ bool PaymentChargeClass::GetAttr9( uint8_t* buf_response, uint16_t& len_response
 bool PaymentChargeClass::GetAttr10( uint8_t* buf_response, uint16_t& len_response ) const
 {
     buf_response[len_response++] = DateTime;
-    memcpy( &buf_response[len_response], &currValues.lastCollectionTime, eDTL_DateTime );
+    encodeTime( &buf_response[len_response], currValues.lastCollectionTime );
     len_response += eDTL_DateTime;
     
     return true;
@@ -3078,6 +4072,7 @@ bool PaymentChargeClass::GetAttr13( uint8_t* buf_response, uint16_t& len_respons
 bool PaymentChargeClass::Get( uint8_t attrID, uint8_t* buf_request, uint8_t* buf_response, uint16_t& len_response )
 {
     len_response = 0;
+    PAYMENT_PROFILE_CODEC_GET( PaymentProfileCodecCharge, attrID, len_response );
     switch( attrID )
     {
         case PaymentChargeTotalAmountPaidAttr:                  return GetAttr2( buf_response, len_response );
@@ -3220,14 +4215,14 @@ uint8_t SetPaymentChargeUnitCharge( uint8_t* buf_request, PaymentChargeUnitCharg
 
 uint8_t PaymentChargeClass::SetAttr6( uint8_t* buf_request )
 {
+    const PaymentChargeUnitCharge oldUnitCharge = chargeCfg->unitChargePassive;
+    
     u8 result = SetPaymentChargeUnitCharge( buf_request, &chargeCfg->unitChargePassive );
     if( result == Success )
     {
-        /* save in the flash the passive_unit_charge */
-        const u8 lenBufUnitCharge = eDTL_Integer + eDTL_Integer + eDTL_LongUnsigned + 6 + eDTL_Integer + MAX_TARIFFS * ( MAX_INDEX_LEN + eDTL_Long );
-        BYTE bufUnitCharge[ lenBufUnitCharge ] = {};    
-        convertUnitChargeFromStructToMemoryBuffer( bufUnitCharge, &chargeCfg->unitChargePassive );
-        FileWrite( ftFile->ftUnitChargePassive, bufUnitCharge );
+        /* save in the flash the changed elements of passive_unit_charge */
+        writeUnitCharge( ftFile->ftUnitChargePassive, ftFile->ftUnitChargePassiveElement, &chargeCfg->unitChargePassive,
+                         getChangedChargeTableElements( &oldUnitCharge, &chargeCfg->unitChargePassive ) );
     }
     
     return result;
@@ -3262,11 +4257,7 @@ uint8_t PaymentChargeClass::SetAttr7( uint8_t* buf_request )
         bufDateTime[10] == 0xff &&
         bufDateTime[11] == 0xff )
     {
-        /* Clear previous DateTime */
-        memset( &chargeCfg->unitChargeActivationTime, 0, sizeof( chargeCfg->period ) );
-        
-        /* Save all 0xff */
-        memcpy( &chargeCfg->unitChargeActivationTime, bufDateTime, sizeof( bufDateTime ) ); 
+        chargeCfg->unitChargeActivationTime = PAYMENT_TIME_NOT_SPECIFIED;
         
         return eDAR_Success;
     }
@@ -3284,18 +4275,11 @@ uint8_t PaymentChargeClass::SetAttr7( uint8_t* buf_request )
         tmpStructDateTime.time.hundredths == 0xff )
         return eDAR_OtherReason;
     
-    /* Clear previous DateTime */
-    memset( &chargeCfg->unitChargeActivationTime, 0, sizeof( chargeCfg->unitChargeActivationTime ) );
-    
-    /* Save new DateTime */
-    memcpy( &chargeCfg->unitChargeActivationTime, &tmpStructDateTime, sizeof( tmpStructDateTime ) );
+    chargeCfg->unitChargeActivationTime = PaymentTimeFromDateTime( &tmpStructDateTime );
   
-    DWORD seconds = PackTdateTime( &chargeCfg->unitChargeActivationTime );
-    FileWrite( ftFile->ftUnitChargeActivationTime, &seconds );
+    writeTimeFile( ftFile->ftUnitChargeActivationTime, chargeCfg->unitChargeActivationTime );
     
-    TDateTime currDateTime;
-    GetLocalTime_APDU( &currDateTime );
-    if( ClockCompareDateTime( &chargeCfg->unitChargeActivationTime, &currDateTime ) <= 0 )
+    if( chargeCfg->unitChargeActivationTime <= PaymentTimeNow() )
     {
         ActivatePassiveUnitCharge();
     }
@@ -3316,7 +4300,7 @@ uint8_t PaymentChargeClass::SetAttr8( uint8_t* buf_request )
     
     chargeCfg->period = tmpPeriod;
     
-    FileWrite( ftFile->ftPeriod, &chargeCfg->period );
+    PaymentFileWrite( ftFile->ftPeriod, &chargeCfg->period );
     
     return eDAR_Success;
 }
@@ -3350,14 +4334,29 @@ uint8_t PaymentChargeClass::SetAttr13( uint8_t* buf_request )
     return Success;
 }
 
+/* The activation time which is already passed is acted upon by SetAttr7 */
+uint8_t PaymentChargeClass::RescheduleUnitChargeActivation( uint8_t result )
+{
+    if( result == eDAR_Success && deadlineScheduled )
+    {
+        PaymentTickContext tick;
+        PaymentGetTickContext( &tick );
+        ScheduleUnitChargeActivation( tick.utcSeconds + 1 );
+    }
+    
+    return result;
+}
+
 uint8_t PaymentChargeClass::Set( uint8_t attrID, uint8_t* buf_request )
 {
+    PAYMENT_PROFILE_CODEC_SET( PaymentProfileCodecCharge, attrID, buf_request );
+    changeEvents |= paymentEventChargeConfig;
     switch( attrID )
     {
         case PaymentCreditCreditTypeAttr:                       return SetAttr3( buf_request );
         case PaymentCreditPriorityAttr:                         return SetAttr4( buf_request );
         case PaymentChargeUnitChargePassiveAttr:                return SetAttr6( buf_request );
-        case PaymentChargeUnitChargeActivationTimeAttr:         return SetAttr7( buf_request );
+        case PaymentChargeUnitChargeActivationTimeAttr:         return RescheduleUnitChargeActivation( SetAttr7( buf_request ) );
         case PaymentChargePeriodAttr:                           return SetAttr8( buf_request );
         case PaymentCreditPresetCreditAmountAttr:               return SetAttr9( buf_request );
         case PaymentChargeProportionAttr:                       return SetAttr13( buf_request );
@@ -3397,7 +4396,7 @@ bool PaymentTokenGatewayClass::GetAttr2( uint8_t* buf_response, uint16_t& len_re
 bool PaymentTokenGatewayClass::GetAttr3( uint8_t* buf_response, uint16_t& len_response ) const
 {
     buf_response[len_response++] = eDT_DateTime;
-    memcpy( &buf_response[len_response], &currValues.tokenTime, eDTL_DateTime );
+    encodeTime( &buf_response[len_response], currValues.tokenTime );
     len_response += eDTL_DateTime;
     
     return true;
@@ -3467,6 +4466,7 @@ bool PaymentTokenGatewayClass::GetAttrTokenID( uint8_t* buf_response, uint16_t&
 bool PaymentTokenGatewayClass::Get( uint8_t attrID, uint8_t* buf_request, uint8_t* buf_response, uint16_t& len_response )
 {
     len_response = 0;
+    PAYMENT_PROFILE_CODEC_GET( PaymentProfileCodecTokenGateway, attrID, len_response );
     switch( attrID )
     {
         case PaymentTokenGatewayTokenAttr:                      return GetAttr2( buf_response, len_response );
@@ -3483,12 +4483,72 @@ bool PaymentTokenGatewayClass::Get( uint8_t attrID, uint8_t* buf_request, uint8_
 /**** ACTION of PaymentTokenGatewayClass *****/
 /*********************************************/
 
+/*
+All files written by the token must have place in the log of the transaction: the files of the gateway and OutToken,
+the status and the times of the account, the statuses of the credits, unit_charge and the last collection of the charges
+and the counters, with PAYMENT_JOURNAL as one record of the journal
+*/
+#ifdef PAYMENT_TRANSACTION
+static const u16 PAYMENT_TRANSACTION_FILE_LEN = sizeof( PaymentTransactionRecordHeader );
+static const u16 PAYMENT_TRANSACTION_GATEWAY_LEN = 11 * PAYMENT_TRANSACTION_FILE_LEN + MAX_LEN_RECEIVED_TOKEN + sizeof( u32 ) + sizeof( u8 ) + sizeof( PaymentTokenIDRecord ) +
+               LEN_ACTIVE_TRANSACTION_ID + 2 * ( sizeof( u32 ) + sizeof( u8 ) ) + sizeof( eT_tokenStatusCode ) + (u8)OutTokenClass::outTokenLen::max;
+static const u16 PAYMENT_TRANSACTION_ACCOUNT_LEN = 3 * PAYMENT_TRANSACTION_FILE_LEN + sizeof( eT_account_status ) + 2 * sizeof( u32 );
+static const u16 PAYMENT_TRANSACTION_CREDIT_LEN = PAYMENT_TRANSACTION_FILE_LEN + sizeof( eT_creditStatus );
+static const u16 PAYMENT_TRANSACTION_CHARGE_LEN = PAYMENT_TRANSACTION_FILE_LEN + sizeof( PaymentChargeUnitChargeRecord ) +
+               MAX_TARIFFS * ( PAYMENT_TRANSACTION_FILE_LEN + LEN_STORED_CHARGE_TABLE_ELEMENT ) + 2 * ( PAYMENT_TRANSACTION_FILE_LEN + sizeof( u32 ) );
+#if defined PAYMENT_JOURNAL
+static const u16 PAYMENT_TRANSACTION_COUNTERS_LEN = PAYMENT_TRANSACTION_FILE_LEN + PAYMENT_JOURNAL_RECORD_LEN;
+#elif defined PAYMENT_RECORD_CRC
+static const u16 PAYMENT_TRANSACTION_COUNTERS_LEN = ( MAX_OBJECTS_IN_CREDIT_REF_LIST + MAX_OBJECTS_IN_CHARGE_REF_LIST * ( 3 + MAX_TARIFFS ) ) * ( PAYMENT_TRANSACTION_FILE_LEN + sizeof( PaymentRecord ) );
+#else
+static const u16 PAYMENT_TRANSACTION_COUNTERS_LEN = MAX_OBJECTS_IN_CREDIT_REF_LIST * ( PAYMENT_TRANSACTION_FILE_LEN + sizeof( s32 ) ) +
+               MAX_OBJECTS_IN_CHARGE_REF_LIST * ( 3 * ( PAYMENT_TRANSACTION_FILE_LEN + sizeof( s32 ) ) + MAX_TARIFFS * ( PAYMENT_TRANSACTION_FILE_LEN + sizeof( u64 ) ) );
+#endif // PAYMENT_JOURNAL
+static_assert( PAYMENT_TRANSACTION_MAX_LEN >= sizeof( PaymentTransactionHeader ) + PAYMENT_TRANSACTION_GATEWAY_LEN + PAYMENT_TRANSACTION_ACCOUNT_LEN +
+               MAX_OBJECTS_IN_CREDIT_REF_LIST * PAYMENT_TRANSACTION_CREDIT_LEN + MAX_OBJECTS_IN_CHARGE_REF_LIST * PAYMENT_TRANSACTION_CHARGE_LEN +
+               PAYMENT_TRANSACTION_COUNTERS_LEN + sizeof( u32 ), "PAYMENT_TRANSACTION_MAX_LEN is less than the files of the token" );
+
+/*
+The token refused at the commit has written no file, but has changed the objects in RAM: the gateway and
+the accounts of the maps which take its tokens are read again from the files, which hold the state before the token.
+*/
+static void reloadTokenObjects( PaymentTokenGatewayClass* tokenGateway )
+{
+#ifdef PAYMENT_RECORD_CRC
+    PaymentRecordResetCache();
+#endif // PAYMENT_RECORD_CRC
+#ifdef PAYMENT_JOURNAL
+    PaymentJournalReload();
+#endif // PAYMENT_JOURNAL
+    for( cicObjectsMap::iterator it = PaymentAccountObjectsMap.begin(); it != PaymentAccountObjectsMap.end(); ++it )
+        ((PaymentAccountClass*)it->second)->ReloadIfLinked( tokenGateway );
+    tokenGateway->Init();
+    tokenGateway->RefuseReceivedToken();
+}
+#endif // PAYMENT_TRANSACTION
+
 void PaymentTokenGatewayClass::Action( uint8_t attrID, uint8_t* buf_request, uint8_t* buf_response, uint16_t& len_response )
 {
     len_response = 0;
+    PAYMENT_PROFILE_CODEC_ACTION( PaymentProfileCodecTokenGateway, attrID, buf_request + 1, MAX_LEN_RECEIVED_TOKEN + 2 );     // buf_request[0] is not the data
     switch( attrID )
     {
         case PaymentTokenGatewayEnter:
+        {
+            PAYMENT_PROFILE_BEGIN( tokenEnter );
+            PAYMENT_TRANSACTION_BEGIN();                        // all files changed by the token are written at once
+            PAYMENT_JOURNAL_BEGIN();                            // the counters of the token go to one record of the journal
+            eT_tokenStatusCode tokenStatus = Enter( buf_request + 1 );
+            PAYMENT_JOURNAL_COMMIT();
+#ifdef PAYMENT_TRANSACTION
+            if( !PaymentTransactionCommit() )
+            {
+                reloadTokenObjects( this );
+                tokenStatus = executionFAIL;
+            }
+#endif // PAYMENT_TRANSACTION
+            PAYMENT_PROFILE_TOKEN_END( tokenEnter );
+          
             buf_response[len_response++] = eAR_Success;
             buf_response[len_response++] = 0x01;
             buf_response[len_response++] = 0x00;
@@ -3496,11 +4556,12 @@ void PaymentTokenGatewayClass::Action( uint8_t attrID, uint8_t* buf_request, uin
             buf_response[len_response++] = eDT_Structure;
             buf_response[len_response++] = 2;
             buf_response[len_response++] = eDT_Enum;
-            buf_response[len_response++] = Enter( buf_request + 1 );
+            buf_response[len_response++] = tokenStatus;
             buf_response[len_response++] = eDT_BitString;
             buf_response[len_response++] = 8;
             buf_response[len_response++] = 0;            
             break;
+        }
         default:
             buf_response[len_response++] = eAR_ObjectUndefined;
             buf_response[len_response++] = 0x00;
@@ -3514,6 +4575,7 @@ void PaymentTokenGatewayClass::Action( uint8_t attrID, uint8_t* buf_request, uin
 /************************************************************************************************/
 void OutTokenClass::UpdateValue( inTokenSubtype inSubtype, u32 tokenID, const BYTE* transactionID, u32 startTime, u8 startTimeStatus )
 {
+  PAYMENT_PROFILE_BEGIN( outTokenUpdate );
   BYTE outToken[(u8)outTokenLen::max] = {};
   
   outToken[(u8)commonFieldPosOutToken::type] = outTokenType;
@@ -3531,20 +4593,20 @@ void OutTokenClass::UpdateValue( inTokenSubtype inSubtype, u32 tokenID, const BY
   memcpy( &outToken[(u8)commonFieldPosOutToken::startTime], &startTime, sizeof(startTime) );
   outToken[(u8)commonFieldPosOutToken::startTimeStatus] = startTimeStatus;
   
-  u32 currDateTimeUTCSec = getCurrentUTCSecondsWithCorrection();
+  u32 currDateTimeUTCSec = PaymentTimeToRecord( PaymentTimeNow() );         // 32 bits of the token format
   memcpy( &outToken[(u8)commonFieldPosOutToken::tokenTime], (u8*)&currDateTimeUTCSec, sizeof(currDateTimeUTCSec) );
 #warning: "Need to clarify time status"
   outToken[(u8)commonFieldPosOutToken::tokenTimeStatus] = 0xFF;
   
   /* Current Asum RG value */
-  u64 currValueAsumRg = GetValueFromRegister( &RegisterAsumLN );
+  u64 currValueAsumRg = consumedKWh->GetCurrentKWh();
   memcpy( &outToken[(u8)commonFieldPosOutToken::activeEnergy], (u8*)&currValueAsumRg, sizeof(currValueAsumRg) );
   
-  u32 consumedKWh = ConsumedKWhFromStartObject.GetConsumedKWh();
-  memcpy( &outToken[(u8)commonFieldPosOutToken::usedEnergy], (u8*)&consumedKWh, sizeof(consumedKWh) );
+  u32 consumedKWhFromStart = consumedKWh->GetConsumedKWh();
+  memcpy( &outToken[(u8)commonFieldPosOutToken::usedEnergy], (u8*)&consumedKWhFromStart, sizeof(consumedKWhFromStart) );
   
   BYTE bufStates[6] = {};
-  InternalGetRequest( cicDataClassID, &cicDataState1BaseLN, 2, NULL, bufStates );
+  PaymentPortInternalGetRequest( cicDataClassID, &cicDataState1BaseLN, 2, bufStates );
   if( bufStates[0] == eDAR_Success && bufStates[1] == eDT_DoubleLongUnsigned )
   {
       memcpy( &outToken[(u8)commonFieldPosOutToken::states], &bufStates[2], eDTL_DoubleLongUnsigned );
@@ -3555,7 +4617,7 @@ void OutTokenClass::UpdateValue( inTokenSubtype inSubtype, u32 tokenID, const BY
   }
 
   BYTE bufAlarms[6] = {};
-  InternalGetRequest( cicDataClassID, &cicDataAlarmBaseLN, 2, NULL, bufAlarms );
+  PaymentPortInternalGetRequest( cicDataClassID, &cicDataAlarmBaseLN, 2, bufAlarms );
   if( bufAlarms[0] == eDAR_Success && bufAlarms[1] == eDT_DoubleLongUnsigned )
   {
       memcpy( &outToken[(u8)commonFieldPosOutToken::alarms], &bufAlarms[2], eDTL_DoubleLongUnsigned );
@@ -3572,10 +4634,10 @@ void OutTokenClass::UpdateValue( inTokenSubtype inSubtype, u32 tokenID, const BY
       inSubtype == inTokenSubtype::topUpToken ||
       inSubtype == inTokenSubtype::stopPaidToken )
   {
-      s32 availableCredit = PaymentImportAccount.GetSumOfAllCurrentCreditAmount();   /* Current acount credit + sum to Top Up this credit */
+      s32 availableCredit = account->GetSumOfAllCurrentCreditAmount();   /* Current acount credit + sum to Top Up this credit */
       memcpy( &outToken[(u8)specificPaidFieldPosOutToken::availableCredit], (u8*)&availableCredit, sizeof(availableCredit) );
       
-      s32 totalAmountPaid = PaymentImportAccount.GetSumOfAllChargeTotalAmountPaid();
+      s32 totalAmountPaid = account->GetSumOfAllChargeTotalAmountPaid();
       memcpy( &outToken[(u8)specificPaidFieldPosOutToken::usedCredit], (u8*)&totalAmountPaid, sizeof(totalAmountPaid) );
       
       memcpy( &outToken[(u8)specificPaidFieldPosOutToken::usedCredit + 4], aes_gsm_buf, sizeof(aes_gsm_buf) );
@@ -3585,10 +4647,14 @@ void OutTokenClass::UpdateValue( inTokenSubtype inSubtype, u32 tokenID, const BY
       memcpy( &outToken[(u8)commonFieldPosOutToken::alarms + 4], aes_gsm_buf, sizeof(aes_gsm_buf) );
   }
 
-  FileWrite( ftOutToken_Token, outToken );
+  PaymentFileWrite( ftOutToken, &outToken );
+  PAYMENT_PROFILE_END( outTokenUpdate, PaymentProfileOutTokenUpdate );
 }
 
-OutTokenClass::OutTokenClass( const LOGICAL_NAME* const _ln ) : ln( _ln )
+OutTokenClass::OutTokenClass( const LOGICAL_NAME* const _ln,
+                              const PaymentAccountClass* const _account,
+                              const ConsumedKWhFromStartClass* const _consumedKWh,
+                              const uint16_t _ftOutToken ) : ln( _ln ), account( _account ), consumedKWh( _consumedKWh ), ftOutToken( _ftOutToken )
 {
 #ifndef NEW_CONST_CLASS_MAP                                                                           
     DataObjectsMap[(LOGICAL_NAME*)_ln] = this; 
@@ -3602,7 +4668,7 @@ bool OutTokenClass::GetAttr2( uint8_t* buf_response, uint16_t& len_response ) co
   
     BYTE outToken[(u8)outTokenLen::max] = {};
   
-    if( FileRead( ftOutToken_Token, outToken ) == 0 )
+    if( PaymentFileRead( ftOutToken, &outToken ) == 0 )
     {
         buf_response[len_response++] = 0;
         return true;
@@ -3630,6 +4696,7 @@ bool OutTokenClass::GetAttr2( uint8_t* buf_response, uint16_t& len_response ) co
 bool OutTokenClass::Get( uint8_t attrID, uint8_t* buf_request, uint8_t* buf_response, uint16_t& len_response )
 {
     len_response = 0;
+    PAYMENT_PROFILE_CODEC_GET( PaymentProfileCodecData, attrID, len_response );
     switch( attrID )
     {
         case ValueAttr: return GetAttr2( buf_response, len_response );
@@ -3637,7 +4704,7 @@ bool OutTokenClass::Get( uint8_t attrID, uint8_t* buf_request, uint8_t* buf_resp
     }
 }
 
-ActiveTransactionIDClass::ActiveTransactionIDClass( const LOGICAL_NAME* const _ln ) : ln( _ln )
+ActiveTransactionIDClass::ActiveTransactionIDClass( const LOGICAL_NAME* const _ln, const PaymentTokenGatewayClass* const _tokenGateway ) : ln( _ln ), tokenGateway( _tokenGateway )
 {
 #ifndef NEW_CONST_CLASS_MAP                                                                           
     DataObjectsMap[(LOGICAL_NAME*)_ln] = this; 
@@ -3648,7 +4715,7 @@ bool ActiveTransactionIDClass::GetAttr2( uint8_t* buf_response, uint16_t& len_re
 {
     buf_response[len_response++] = eDT_OctetString;
     buf_response[len_response++] = LEN_ACTIVE_TRANSACTION_ID;
-    memcpy( &buf_response[len_response], TokenGatewayForImportAccount.GetActiveTransactionID(), LEN_ACTIVE_TRANSACTION_ID );
+    memcpy( &buf_response[len_response], tokenGateway->GetActiveTransactionID(), LEN_ACTIVE_TRANSACTION_ID );
     len_response += LEN_ACTIVE_TRANSACTION_ID;
     
     return true;
@@ -3657,6 +4724,7 @@ bool ActiveTransactionIDClass::GetAttr2( uint8_t* buf_response, uint16_t& len_re
 bool ActiveTransactionIDClass::Get( uint8_t attrID, uint8_t* buf_request, uint8_t* buf_response, uint16_t& len_response )
 {
     len_response = 0;
+    PAYMENT_PROFILE_CODEC_GET( PaymentProfileCodecData, attrID, len_response );
     switch( attrID )
     {
         case ValueAttr: return GetAttr2( buf_response, len_response );
@@ -3665,7 +4733,7 @@ bool ActiveTransactionIDClass::Get( uint8_t attrID, uint8_t* buf_request, uint8_
 }
 
 
-TopUpsSumClass::TopUpsSumClass( const LOGICAL_NAME* const _ln ) : ln( _ln )
+TopUpsSumClass::TopUpsSumClass( const LOGICAL_NAME* const _ln, const PaymentAccountClass* const _account ) : ln( _ln ), account( _account )
 {
 #ifndef NEW_CONST_CLASS_MAP                                                                           
     RegisterObjectsMap[(LOGICAL_NAME*)_ln] = this; 
@@ -3677,7 +4745,7 @@ bool TopUpsSumClass::GetAttr2( uint8_t* buf_response, uint16_t& len_response ) c
     buf_response[len_response++] = eDT_DoubleLong;
 
     /* sei4as na s4etu + potra4eno */
-    s32 startTopUpSum = PaymentImportAccount.GetSumOfAllCurrentCreditAmount() + PaymentImportAccount.GetSumOfAllChargeTotalAmountPaid();
+    s32 startTopUpSum = account->GetSumOfAllCurrentCreditAmount() + account->GetSumOfAllChargeTotalAmountPaid();
     AXDREncodeDoubleLong( &buf_response[len_response], startTopUpSum );
     len_response += eDTL_DoubleLong;
     
@@ -3690,7 +4758,7 @@ bool TopUpsSumClass::GetAttr3( uint8_t* buf_response, uint16_t& len_response ) c
     buf_response[len_response++] = 2;
     
     buf_response[len_response++] = eDT_Integer;
-    buf_response[len_response++] = PaymentImportAccount.GetCurrencyScale();
+    buf_response[len_response++] = account->GetCurrencyScale();
     
     buf_response[len_response++] = eDT_Enum;
     buf_response[len_response++] = UnitCurrency;
@@ -3701,6 +4769,7 @@ bool TopUpsSumClass::GetAttr3( uint8_t* buf_response, uint16_t& len_response ) c
 bool TopUpsSumClass::Get( uint8_t attrID, uint8_t* buf_request, uint8_t* buf_response, uint16_t& len_response )
 {
     len_response = 0;
+    PAYMENT_PROFILE_CODEC_GET( PaymentProfileCodecData, attrID, len_response );
     switch( attrID )
     {
         case ValueAttr:         return GetAttr2( buf_response, len_response );
@@ -3709,7 +4778,7 @@ bool TopUpsSumClass::Get( uint8_t attrID, uint8_t* buf_request, uint8_t* buf_res
     }
 }
 
-TotalAmountPaidClass::TotalAmountPaidClass( const LOGICAL_NAME* const _ln ) : ln( _ln )
+TotalAmountPaidClass::TotalAmountPaidClass( const LOGICAL_NAME* const _ln, const PaymentAccountClass* const _account ) : ln( _ln ), account( _account )
 {
 #ifndef NEW_CONST_CLASS_MAP                                                                           
     RegisterObjectsMap[(LOGICAL_NAME*)_ln] = this; 
@@ -3721,7 +4790,7 @@ bool TotalAmountPaidClass::GetAttr2( uint8_t* buf_response, uint16_t& len_respon
     buf_response[len_response++] = eDT_DoubleLong;
 
     /* potra4eno */
-    s32 totalAmountPaid = PaymentImportAccount.GetSumOfAllChargeTotalAmountPaid();
+    s32 totalAmountPaid = account->GetSumOfAllChargeTotalAmountPaid();
     AXDREncodeDoubleLong( &buf_response[len_response], totalAmountPaid );
     len_response += eDTL_DoubleLong;
     
@@ -3734,7 +4803,7 @@ bool TotalAmountPaidClass::GetAttr3( uint8_t* buf_response, uint16_t& len_respon
     buf_response[len_response++] = 2;
     
     buf_response[len_response++] = eDT_Integer;
-    buf_response[len_response++] = PaymentImportAccount.GetCurrencyScale();
+    buf_response[len_response++] = account->GetCurrencyScale();
     
     buf_response[len_response++] = eDT_Enum;
     buf_response[len_response++] = UnitCurrency;
@@ -3745,6 +4814,7 @@ bool TotalAmountPaidClass::GetAttr3( uint8_t* buf_response, uint16_t& len_respon
 bool TotalAmountPaidClass::Get( uint8_t attrID, uint8_t* buf_request, uint8_t* buf_response, uint16_t& len_response )
 {
     len_response = 0;
+    PAYMENT_PROFILE_CODEC_GET( PaymentProfileCodecData, attrID, len_response );
     switch( attrID )
     {
         case ValueAttr:         return GetAttr2( buf_response, len_response );
@@ -3753,7 +4823,9 @@ bool TotalAmountPaidClass::Get( uint8_t attrID, uint8_t* buf_request, uint8_t* b
     }
 }
 
-ConsumedKWhFromStartClass::ConsumedKWhFromStartClass( const LOGICAL_NAME* const _ln ) : ln( _ln ), kWhWhenStart(0)
+ConsumedKWhFromStartClass::ConsumedKWhFromStartClass( const LOGICAL_NAME* const _ln,
+                                                     const LOGICAL_NAME* const _energyRegisterLn,
+                                                     const uint16_t _ftKWhWhenStart ) : ln( _ln ), energyRegisterLn( _energyRegisterLn ), ftKWhWhenStart( _ftKWhWhenStart ), kWhWhenStart(0)
 {
 #ifndef NEW_CONST_CLASS_MAP                                                                           
     RegisterObjectsMap[(LOGICAL_NAME*)_ln] = this; 
@@ -3763,7 +4835,7 @@ ConsumedKWhFromStartClass::ConsumedKWhFromStartClass( const LOGICAL_NAME* const
 void ConsumedKWhFromStartClass::Init()
 {
     u64 tmpkWhWhenStart = 0;
-    if( FileRead( ftConsumedKWhFromStart_KWhWhenStart, &tmpkWhWhenStart ) != 0 )
+    if( PaymentFileRead( ftKWhWhenStart, &tmpkWhWhenStart ) != 0 )
     {
         kWhWhenStart = tmpkWhWhenStart;
     }
@@ -3771,17 +4843,22 @@ void ConsumedKWhFromStartClass::Init()
 
 void ConsumedKWhFromStartClass::UpdateKWhWhenStart()
 {
-    kWhWhenStart = GetValueFromRegister( &RegisterAsumLN );
+    kWhWhenStart = GetCurrentKWh();
     /* Save new value in ft */
-    FileWrite( ftConsumedKWhFromStart_KWhWhenStart, &kWhWhenStart );
+    PaymentFileWrite( ftKWhWhenStart, &kWhWhenStart );
 }
 
 u32 ConsumedKWhFromStartClass::GetConsumedKWh() const
 {
-    u64 currKWhValue = GetValueFromRegister( &RegisterAsumLN );
+    u64 currKWhValue = GetCurrentKWh();
     return (currKWhValue - kWhWhenStart);
 }
 
+u64 ConsumedKWhFromStartClass::GetCurrentKWh() const
+{
+    return GetValueFromRegister( energyRegisterLn );
+}
+
 bool ConsumedKWhFromStartClass::GetAttr2( uint8_t* buf_response, uint16_t& len_response ) const
 {
     buf_response[len_response++] = eDT_DoubleLongUnsigned;
@@ -3800,7 +4877,7 @@ bool ConsumedKWhFromStartClass::GetAttr3( uint8_t* buf_response, uint16_t& len_r
     buf_response[len_response++] = 2;
     
     buf_response[len_response++] = eDT_Integer;
-    buf_response[len_response++] = GetScalerOfValueFromRegister( &RegisterAsumLN );
+    buf_response[len_response++] = GetScalerOfValueFromRegister( energyRegisterLn );
     
     buf_response[len_response++] = eDT_Enum;
     buf_response[len_response++] = UnitWh;
@@ -3811,6 +4888,7 @@ bool ConsumedKWhFromStartClass::GetAttr3( uint8_t* buf_response, uint16_t& len_r
 bool ConsumedKWhFromStartClass::Get( uint8_t attrID, uint8_t* buf_request, uint8_t* buf_response, uint16_t& len_response )
 {
     len_response = 0;
+    PAYMENT_PROFILE_CODEC_GET( PaymentProfileCodecData, attrID, len_response );
     switch( attrID )
     {
         case ValueAttr:         return GetAttr2( buf_response, len_response );
@@ -3819,7 +4897,7 @@ bool ConsumedKWhFromStartClass::Get( uint8_t attrID, uint8_t* buf_request, uint8
     }
 }
 
-TokenIDClass::TokenIDClass( const LOGICAL_NAME* const _ln ) : ln( _ln )
+TokenIDClass::TokenIDClass( const LOGICAL_NAME* const _ln, const PaymentTokenGatewayClass* const _tokenGateway ) : ln( _ln ), tokenGateway( _tokenGateway )
 {
 #ifndef NEW_CONST_CLASS_MAP                                                                           
     DataObjectsMap[(LOGICAL_NAME*)_ln] = this; 
@@ -3830,7 +4908,7 @@ bool TokenIDClass::GetAttr2( uint8_t* buf_response, uint16_t& len_response ) con
 {
     buf_response[len_response++] = eDT_DoubleLongUnsigned;
 
-    u32 TID = TokenGatewayForImportAccount.GetTokenID();
+    u32 TID = tokenGateway->GetTokenID();
     AXDREncodeDword( &buf_response[len_response], TID );
     len_response += eDTL_DoubleLongUnsigned;
     
@@ -3840,6 +4918,7 @@ bool TokenIDClass::GetAttr2( uint8_t* buf_response, uint16_t& len_response ) con
 bool TokenIDClass::Get( uint8_t attrID, uint8_t* buf_request, uint8_t* buf_response, uint16_t& len_response )
 {
     len_response = 0;
+    PAYMENT_PROFILE_CODEC_GET( PaymentProfileCodecData, attrID, len_response );
     switch( attrID )
     {
         case ValueAttr:         return GetAttr2( buf_response, len_response );
@@ -3848,7 +4927,7 @@ bool TokenIDClass::Get( uint8_t attrID, uint8_t* buf_request, uint8_t* buf_respo
 }
 
 
-ExpiresTimeClass::ExpiresTimeClass( const LOGICAL_NAME* const _ln ) : ln( _ln )
+ExpiresTimeClass::ExpiresTimeClass( const LOGICAL_NAME* const _ln, const PaymentTokenGatewayClass* const _tokenGateway ) : ln( _ln ), tokenGateway( _tokenGateway )
 {
 #ifndef NEW_CONST_CLASS_MAP                                                                           
     DataObjectsMap[(LOGICAL_NAME*)_ln] = this; 
@@ -3860,11 +4939,11 @@ bool ExpiresTimeClass::GetAttr2( uint8_t* buf_response, uint16_t& len_response )
     buf_response[len_response++] = eDT_OctetString;
     buf_response[len_response++] = eDTL_DateTime;
 
-    u32 expiresTimeSec = TokenGatewayForImportAccount.GetExpiresTimeSec();
-    u8 expiresTimeStatus = TokenGatewayForImportAccount.GetExpiresTimeStatus();
+    u32 expiresTimeSec = tokenGateway->GetExpiresTimeSec();
+    u8 expiresTimeStatus = tokenGateway->GetExpiresTimeStatus();
     
     TDateTime expiresTime;
-    SecondsUTC_To_Local_DateTime_WithCorrection( expiresTimeSec, &expiresTime );    
+    PaymentTimeToDateTime( PaymentTimeFromRecord( expiresTimeSec ), &expiresTime );     // 0xFFFFFFFF is not specified, not 2116
     memcpy( &buf_response[len_response], &expiresTime, eDTL_DateTime );
     len_response += eDTL_DateTime - 1;
     
@@ -3876,6 +4955,7 @@ bool ExpiresTimeClass::GetAttr2( uint8_t* buf_response, uint16_t& len_response )
 bool ExpiresTimeClass::Get( uint8_t attrID, uint8_t* buf_request, uint8_t* buf_response, uint16_t& len_response )
 {
     len_response = 0;
+    PAYMENT_PROFILE_CODEC_GET( PaymentProfileCodecData, attrID, len_response );
     switch( attrID )
     {
         case ValueAttr:         return GetAttr2( buf_response, len_response );
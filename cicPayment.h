@@ -13,6 +13,9 @@
 #include "CommonTypes.h"
 #include "core.h"
 #include "cicData.h"
+#include "cicPaymentProfile.h"
+#include "cicPaymentTime.h"
+#include "cicPaymentDeadline.h"
 
 static const uint8_t MAX_OBJECTS_IN_CREDIT_REF_LIST     = 1;
 static const uint8_t MAX_OBJECTS_IN_CHARGE_REF_LIST     = 1;
@@ -30,6 +33,16 @@ static const uint8_t MAX_LEN_TOKEN_DESCRIPTION_ARRAY    = 3;
 static const uint8_t NUM_OF_STORED_TOKENS_ID            = 200;   // kol-vo sohraneaemih TID
 static const uint8_t AES_GSM_TAG_LEN                    = 12;
 
+/*
+Money counters of the credits and charges are shadowed in RAM and marked dirty when changed.
+With PAYMENT_WRITE_COALESCING they are written together every PAYMENT_FLUSH_PERIOD_SEC seconds
+and at the critical events (top-up, activation/closing/reset of the account, relay switching),
+otherwise every counter is written at once as before.
+*/
+#ifndef PAYMENT_FLUSH_PERIOD_SEC
+#define PAYMENT_FLUSH_PERIOD_SEC                60
+#endif
+
 static const uint8_t LEN_ACTIVE_TRANSACTION_ID          = 16;
 static const uint8_t LEN_KEY_EK                         = 24;
 static const uint8_t LEN_KEY_AK                         = 24;
@@ -145,8 +158,8 @@ typedef struct{
     const LOGICAL_NAME*                         chargeRefList[MAX_OBJECTS_IN_CHARGE_REF_LIST];          // 10
     PaymentAccountCreditChargeCfgElement        creditChargeCfg[MAX_OBJECTS_IN_CREDIT_CHARGE_CFG];      // 11
     PaymentAccountTokenGatewayCfgElement        tokenGatewayCfg[MAX_OBJECTS_IN_TOKEN_GATEWAY_CFG];      // 12
-    TDateTime                                   accountActivationTime;          // 13
-    TDateTime                                   accountClosureTime;             // 14
+    PaymentTime                                 accountActivationTime;          // 13
+    PaymentTime                                 accountClosureTime;             // 14
     PaymentAccountCurency                       currency;                       // 15
     s32                                         maxProvisionPeriod;             // 19
 	s32                                         clearanceThreshold;             // 7
@@ -171,6 +184,7 @@ typedef __packed struct {
     const uint16_t    ftMaxProvision;
     const uint16_t    ftMaxProvisionPeriod;
     const uint16_t    ftCurrency;
+    const uint16_t    ftTimeFormat;
 } ftPaymentAccount;
 
 /*********************************************/
@@ -211,6 +225,9 @@ static const uint8_t creditCfgRepayment                 = 0x04;         // requi
 static const uint8_t creditCfgResettable                = 0x08;         // resettable
 static const uint8_t creditCfgReceiveCreditToken        = 0x10;         // able to receive credit amounts from tokens
 
+/* Dirty counters of the credit */
+static const uint8_t creditDirtyCurrentCreditAmount     = 0x01;
+
 /* credit_status */
 enum eT_creditStatus{
     ENABLED,
@@ -300,15 +317,52 @@ typedef struct{
     chargeTableElementType      chargeTableElement[MAX_TARIFFS];                //  10 
 } PaymentChargeUnitCharge;
 
+/*
+Stored unit_charge: this header with CRC32 in ftUnitChargeActive/ftUnitChargePassive and every used
+element of charge_table in the indexed file ftUnitChargeActiveElement/ftUnitChargePassiveElement,
+so the change of one price rewrites only its element and the header.
+*/
+static const uint8_t PAYMENT_UNIT_CHARGE_VERSION        = 1;
+static const uint8_t LEN_STORED_CHARGE_TABLE_ELEMENT    = MAX_INDEX_LEN + eDTL_Long;
+
+typedef __packed struct{
+    u8                  version;
+    u8                  lenChargeTableElement;                                  // used elements, the rest are zero
+    s8                  commodityScale;
+    s8                  priceScale;
+    u16                 classId;
+    BYTE                logicalName[6];
+    s8                  attributeIndex;
+    u32                 crc;                                                    // CRC32 of the fields above and of the used elements
+} PaymentChargeUnitChargeRecord;
+
 /* charge_configuration */
 const uint8_t chargePercentageBaseCollection            = 0x01;
 const uint8_t chargeContinuousCollection                = 0x02;
 
+/* Dirty counters of the charge, lastValue[] has own mask of the tariffs */
+static const uint8_t chargeDirtyTotalAmountPaid         = 0x01;
+static const uint8_t chargeDirtyTotalAmountRemaining    = 0x02;
+static const uint8_t chargeDirtySumToCollect            = 0x04;
+
+/*
+Change events of the credits and the charges. The account takes them every second
+and recomputes only the values which depend on the raised events (see PaymentAccountClass::IdleSecond).
+*/
+static const uint8_t paymentEventCreditAmount           = 0x01;         // current_credit_amount of a credit
+static const uint8_t paymentEventCreditStatus           = 0x02;         // transition of credit_status
+static const uint8_t paymentEventCreditConfig           = 0x04;         // Set of the thresholds, limit or configuration of a credit
+static const uint8_t paymentEventChargeAmount           = 0x08;         // total_amount_remaining of a charge
+static const uint8_t paymentEventChargeConfig           = 0x10;         // Set of the configuration or activation of unit_charge
+static const uint8_t paymentEventAccountConfig          = 0x20;         // clearance_threshold, currency or status of the account
+static const uint8_t paymentEventCreditInUse            = 0x40;         // credit in use of the account
+static const uint8_t paymentEventAll                    = 0x7F;
+
 /* Charge's Configuration */
 typedef struct{
     PaymentChargeUnitCharge     unitChargeActive;               // 5
     PaymentChargeUnitCharge     unitChargePassive;              // 6
-    TDateTime                   unitChargeActivationTime;       // 7
+    PaymentTime                 unitChargeActivationTime;       // 7
 	u16                         proportion;                     // 13
     u32                         period;                         // 8
 	eT_PaymentChargeType        chargeType;                     // 3
@@ -317,7 +371,7 @@ typedef struct{
 } PaymentChargeCfg;
 
 typedef struct{
-	TDateTime                   lastCollectionTime;             // 10
+	PaymentTime                 lastCollectionTime;             // 10
     s32                         totalAmountPaid;	        // 2
     s32                         lastCollectionAmount; 	        // 11
     s32                         totalAmountRemaining;           // 12
@@ -327,6 +381,8 @@ typedef __packed struct {
     const uint16_t      ftTotalAmountPaid;
     const uint16_t      ftUnitChargeActive;
     const uint16_t      ftUnitChargePassive;
+    const uint16_t      ftUnitChargeActiveElement;
+    const uint16_t      ftUnitChargePassiveElement;
     const uint16_t      ftUnitChargeActivationTime;
     const uint16_t      ftPeriod;
     const uint16_t      ftLastCollectionTime;
@@ -334,6 +390,7 @@ typedef __packed struct {
     const uint16_t      ftTotalAmountRemaining;
     const uint16_t      ftLastMeasurementValue;
     const uint16_t      ftSumToCollect;
+    const uint16_t      ftTimeFormat;
 } ftPaymentCharge;
 
 /*********************************************/
@@ -385,7 +442,7 @@ typedef struct{
 /* Token Gateway's Configuration */
 typedef struct{
     BYTE                                token[MAX_LEN_RECEIVED_TOKEN];                          // dynamic
-    TDateTime                           tokenTime;                                              // dynamic
+    PaymentTime                         tokenTime;                                              // dynamic
     tokenDescriptionStruct              tokenDescription[MAX_LEN_TOKEN_DESCRIPTION_ARRAY];      // dynamic
     eT_PaymentTokenDeliveryMethod       tokenDeliveryMethod;                                    // dynamic
     PaymentTokenStatus                  tokenStatus;                                            // dynamic
@@ -412,6 +469,22 @@ typedef struct{
     u8                                  timeOfStartStatus;
 }PaymentTokenFormat;  
 
+/*
+History of the received TIDs for the check of the duplicates. ftTokenIDHistory is the indexed file of
+NUM_OF_STORED_TOKENS_ID records, the whole file is read as one block at the start and is kept in RAM
+(1600 bytes per gateway), the new TID is one record write.
+The head of the ring is the last valid record after which the sequence numbers break, so the index of the
+next record is not saved separately. The record torn by the power fail has the wrong CRC and is the break itself,
+so it does not move the head and is written again by the next token.
+*/
+typedef __packed struct{
+    u32                                 tokenID;
+    u16                                 seq;
+    u16                                 crc;            // low 16 bits of CRC32 of the index and of the fields above
+}PaymentTokenIDRecord;
+
+static const u8 PAYMENT_TOKEN_ID_HISTORY_MIGRATED       = 0xFF;     // in ftNextReceivedTokenIndex after the legacy history is moved
+
 typedef __packed struct {
     const uint16_t      ftToken;
     const uint16_t      ftTokenTime;
@@ -425,8 +498,67 @@ typedef __packed struct {
     const uint16_t      ftExpiresTimeStatusReceivedWithStart;
     const uint16_t      ftTimeOfStartSec;
     const uint16_t      ftTimeOfStartStatus;
+    const uint16_t      ftTokenIDHistory;
 } ftPaymentTokenGateway;
 
+/* Sections of the boot snapshot (PAYMENT_BOOT_SNAPSHOT) */
+typedef struct{
+    PaymentTime                         accountActivationTime;
+    PaymentTime                         accountClosureTime;
+    PaymentAccountCurency               currency;
+    s32                                 maxProvisionPeriod;
+    u16                                 maxProvision;
+    eT_account_status                   accountStatus;
+} PaymentAccountSnapshot;
+
+typedef struct{
+    PaymentCreditDynamicValues          currValues;
+    s32                                 warningThreshold;
+    s32                                 limit;
+} PaymentCreditSnapshot;
+
+typedef struct{
+    PaymentChargeUnitCharge             unitChargeActive;
+    PaymentChargeUnitCharge             unitChargePassive;
+    PaymentTime                         unitChargeActivationTime;
+    PaymentChargeDynamicValues          currValues;
+    u64                                 lastValue[MAX_TARIFFS];
+    u32                                 period;
+    s32                                 sumToCollect;
+} PaymentChargeSnapshot;
+
+/*
+Time of the tick. The clock is read once per pass of the scheduler and the same instant is passed
+to IdleSecond/IdleMinute of all Payment objects, so they do not read the clock again.
+The pass of the scheduler (PaymentIdlePass) reads the clock once and gives the context to all objects.
+The functions without the context are kept for the existing callers: the account and the charge read
+the clock themselves, IdleSecond() of the credit does not need the time and does not read it.
+*/
+typedef struct{
+    TDateTime                           localTime;
+    PaymentTime                         utcSeconds;     // the same instant as localTime
+} PaymentTickContext;
+
+void PaymentGetTickContext( PaymentTickContext* tick );
+
+class PaymentAccountClass;
+
+/*
+Pass of the scheduler over the Payment objects, the firmware calls it every second instead of
+IdleSecond()/IdleMinute() of every object: for all accounts of the map (account NULL), the host harness and
+the replay for the account of the simulated meter. Every account ticks its credits and charges before itself
+(PaymentAccountClass::IdlePass), at the new minute the deadline queue is run once after IdleMinute() of all objects.
+IdleMinute() of the objects does not run the deadline queue, only the pass does.
+The token gateways are not in the maps, their IdleMinute() is called by the firmware.
+*/
+void PaymentIdlePass( bool newMinute, PaymentAccountClass* account = NULL );
+
+/*
+Recovery of the files after the power fail: the interrupted token, the journal and the counters saved
+at the power fail are put to the files. The start of the meter calls it once before Init() of the Payment objects.
+*/
+void PaymentRecover();
+
 /***********************************************************************************************************/
 /****************************************** Interfaces of Classes ******************************************/
 /***********************************************************************************************************/
@@ -447,6 +579,8 @@ public:
   void Init();
   void IdleSecond();
   void IdleMinute();
+  void IdleSecond( const PaymentTickContext* tick );
+  void IdleMinute( const PaymentTickContext* tick );
   
   /* Functions for communication between Payment classes */
   void UpdateAmount( s32 value );               // Blue Book
@@ -460,9 +594,15 @@ public:
   s32 GetPresetCreditAmount() const;
   s32 GetCreditAvailableThreshold() const;
   bool GetRequiresCreditAmountToBePaidBack() const;     // credit_configuration bit 2
+  s32 GetAvailableCreditShare() const;
+  s32 GetAmountToClearShare() const;
   bool InvokeCreditStatusToInUse();
   bool InvokeCreditStatusToEnable();
   void ResetCredit();
+  void Flush();
+  void AddToSnapshot() const;
+  bool AddDirtyToEmergency() const;
+  u8 TakeChangeEvents();
   
 private:
   bool GetAttr2( uint8_t* buf_response, uint16_t& len_response ) const;
@@ -493,13 +633,21 @@ private:
   s32 SetAmountToValue( s32 newValue );
   
   /* Functions for internal work */
-  bool CheckPeriod();
   void ControlCreditStatus();
+  void MarkDirty( u8 mask );
+  bool RestoreFromSnapshot();
+  void SchedulePeriod( PaymentTime from );
+  uint8_t ReschedulePeriod( uint8_t result );
+  static void DeadlineHandler( void* object, u8 kind, u8 reason, PaymentTime now );
   
   PaymentCreditCfg* const       creditCfg;
   const ftPaymentCredit* const  ftFile;
   
   PaymentCreditDynamicValues    currValues;
+  
+  u8                            dirtyMask;              // counters changed in RAM and not written yet
+  u8                            changeEvents;           // paymentEvent* raised since the last tick of the account
+  bool                          deadlineScheduled;      // the period is put to the deadline queue in the first IdleMinute after Init
 };
 
 /*********************************************/
@@ -518,6 +666,8 @@ public:
   void Init();
   void IdleSecond();
   void IdleMinute();
+  void IdleSecond( const PaymentTickContext* tick );
+  void IdleMinute( const PaymentTickContext* tick );
   
   /* Functions for communication between Payment classes */
   const LOGICAL_NAME* GetLn() const;
@@ -528,13 +678,18 @@ public:
   s32 GetTotalAmountRemaining() const;
   bool GetNewCollection() const;
   s32 GetSumToCollect() const;
-  void ConfirmCollection();
+  s32 GetAggregatedDebtShare( s8 currencyScale ) const;
+  void ConfirmCollection( PaymentTime now );
   void RefuseCollection();
   void ActivateCharge();
   void CloseCharge();
   void ResetCharge();
   void SetIsLinkedAccountActive( bool newIsLinkedAccountActive );
   void ExecutePaymentEventBasedCollection( s32 topUpSum );
+  void Flush();
+  void AddToSnapshot() const;
+  bool AddDirtyToEmergency() const;
+  u8 TakeChangeEvents();
   
 private:  
   bool GetAttr2( uint8_t* buf_response, uint16_t& len_response ) const;
@@ -573,14 +728,20 @@ private:
       
   /* Functions for internal work */
   s32 UpdateTotalAmountPaid( s32 collectionValue );
-  void UpdateLastCollectionTime();
+  void UpdateLastCollectionTime( PaymentTime now );
   void UpdateLastCollectionAmount( s32 sum );
   s32 ReduceTotalAmountRemaining( s32 sum );
-  u32 CalcPeriodPassed() const;
-  void ExecuteConsumptionBasedCollection();
-  void ExecuteTimeBasedCollection();
+  u32 CalcPeriodPassed( PaymentTime now ) const;
+  void ExecuteConsumptionBasedCollection( PaymentTime now );
+  void ExecuteTimeBasedCollection( PaymentTime now );
   s16 GetCurrentChargePerUnit() const;
 //  u32 GetUnitsConsumedFromLastCollection() const;
+  void MarkDirty( u8 mask );
+  void MarkLastValueDirty( u8 tariffIndex );
+  bool RestoreFromSnapshot();
+  void ScheduleUnitChargeActivation( PaymentTime from );
+  uint8_t RescheduleUnitChargeActivation( uint8_t result );
+  static void DeadlineHandler( void* object, u8 kind, u8 reason, PaymentTime now );
   
   PaymentChargeCfg* const       chargeCfg;
   const ftPaymentCharge* const  ftFile;
@@ -593,11 +754,20 @@ private:
   
   bool                          newCollection;          // set in TRUE by the Charge if the current collection must be processed 
   s32                           sumToCollect;           // amount of the current collection
+  
+  u8                            dirtyMask;              // counters changed in RAM and not written yet
+  u8                            dirtyLastValueMask;     // bit per tariff of lastValue[]
+  u8                            changeEvents;           // paymentEvent* raised since the last tick of the account
+  bool                          deadlineScheduled;      // unit_charge_activation_time is put to the deadline queue in the first IdleMinute after Init
 };
 
 /*********************************************/
 /********** Token Gateway's Interface ********/
 /*********************************************/
+#if defined PAYMENT_HOST_BUILD
+class PaymentAccountClass;
+#endif // PAYMENT_HOST_BUILD
+
 class PaymentTokenGatewayClass : public COSEMInterfaceClassAbstract{
 public:
   PaymentTokenGatewayClass( const LOGICAL_NAME* const _ln, const ftPaymentTokenGateway* const _ftFile ); 
@@ -620,6 +790,9 @@ public:
   u8 GetExpiresTimeStatus() const;
   void ConfirmReceivedToken();
   void RefuseReceivedToken();
+#if defined PAYMENT_HOST_BUILD
+  void LinkAccount( PaymentAccountClass* const _account );     /* the account of the token path of the host, see host/cicPaymentHostGateway.cpp */
+#endif // PAYMENT_HOST_BUILD
   
   const u8 inTokenType = 0;
   
@@ -681,6 +854,9 @@ private:
   bool CheckReceivedTokenSubtype( u8 rxSubtype ) const;
   bool CheckReceivedTokenID( u32 rxTID, u8 rxTokenSubtype ) const;
   bool CheckForDuplicatesReceivedTokenID( u32 rxTID ) const;
+  void MigrateTokenIDHistory();
+  void LoadTokenIDHistory();
+  void AppendTokenIDToHistory( u32 newTokenID );
   bool CheckReceivedExpiresTime( u32 rxExpiresTimeSec, u8 rxExpiresTimeStatus, u8 rxTokenSubtype ) const;
   bool CheckReceivedOrderID( uint8_t* rxTransactionID, u8 rxTokenSubtype ) const;
   bool CheckSpecificFieldsReceivedToken( uint8_t* tokenRx ) const;
@@ -700,10 +876,16 @@ private:
   void ProcessToken( uint8_t* tokenRx );
   
   const ftPaymentTokenGateway* const    ftFile;
+#if defined PAYMENT_HOST_BUILD
+  PaymentAccountClass*                  account;
+#endif // PAYMENT_HOST_BUILD
   
   PaymentTokenGatewayDynamicValues      currValues;
   PaymentTokenFormat                    lastToken;
   
+  PaymentTokenIDRecord                  tokenIDHistory[NUM_OF_STORED_TOKENS_ID];
+  u16                                   tokenIDHeadSeq;         // seq of the newest record of the history
+  
 //  bool                                  newTokenTopUp;
 //  s32                                   topUpSum;
 };
@@ -729,13 +911,16 @@ public:
   void Init();
   void IdleSecond();
   void IdleMinute();
+  void IdleSecond( const PaymentTickContext* tick );
+  void IdleMinute( const PaymentTickContext* tick );
+  void IdlePass( const PaymentTickContext* tick, bool newMinute );     /* The credits, the charges and the account, see PaymentIdlePass */
   
   /* Functions for communication with StartStopService class */
   bool IsAccountActive() const;
 //  eT_tokenStatusCode RedirectToTokenGatewayEnter( uint8_t* buf_request ) const;
   s32 GetSumOfAllCurrentCreditAmount() const;
-  TDateTime* GetAccountActivationTime() const;
-  TDateTime* GetAccountClosureTime() const;
+  PaymentTime GetAccountActivationTime() const;
+  PaymentTime GetAccountClosureTime() const;
   s8 GetCurrencyScale() const;
   s32 GetSumOfAllChargeTotalAmountPaid() const;
   
@@ -743,6 +928,13 @@ public:
   void CloseAccount( s32 data = 0 );
   void ResetAccount( s32 data = 0 );
   void TopUpCredits( s32 topUpSum );   /* This function will be invoked by TokenGateway Object with StartPaid token and TopUp token */
+  void Flush();                        /* Writes the dirty counters of all credits and charges of the account */
+  void SaveBootSnapshot();             /* By EmergencyFlush() after the emergency record, see PAYMENT_BOOT_SNAPSHOT */
+  bool EmergencyFlush();               /* From the power fail handler, see PAYMENT_EMERGENCY_FLUSH. false if not all dirty counters are saved */
+  bool ReloadIfLinked( const PaymentTokenGatewayClass* const _tokenGateway );     /* By the token refused at the commit, see PAYMENT_TRANSACTION */
+#ifdef PAYMENT_AGGREGATES_CHECK
+  u32 GetAggregatesMismatches() const;
+#endif // PAYMENT_AGGREGATES_CHECK
   
 private:      
   bool GetAttr2( uint8_t* buf_response, uint16_t& len_response ) const;
@@ -778,22 +970,40 @@ private:
   */
   
   /* Functions for internal work */
-  void ExecuteCollection( u8 chargeIndex );
+  void ExecuteCollection( u8 chargeIndex, PaymentTime now );
   bool CheckCreditChargeConfiguration( u8 chargeIndex );        /* The functions returns: true if charge can collect from credit in_use; false if charge cann't collect from credit in_use. */
   void DistributeTopUpSumBetweenCredits( s32 topUpSum );
   void DistributeTopUpSumWithoutRestrictions( s32 topUpSum );
   void DistributeTopUpSumAccordingToProportion( s32 topUpSum );
   bool InvokeHighestPriorityCreditToInUse();
   void UpdateCurrentCreditStatus();
-  void UpdateAvailableCredit();
+  /*
+  available_credit, amount_to_clear and aggregated_debt of the account are running totals of the shares
+  of its credits and charges, updated by the difference of the share of the object which raised the change event.
+  With PAYMENT_AGGREGATES_CHECK (debug builds) they are recomputed from scratch every second and compared,
+  a mismatch is counted and the recomputed values are used.
+  */
+  void UpdateCreditShares( u8 creditIndex );
+  void UpdateChargeShare( u8 chargeIndex );
   void UpdateAmountToClear();
-  void UpdateAggregatedDebt();
+  void ResetAggregates();
+#ifdef PAYMENT_AGGREGATES_CHECK
+  void CheckAggregates();
+#endif // PAYMENT_AGGREGATES_CHECK
   void UpdateLowCreditThreshold();
   void UpdateNextCreditAvailableThreshold();
   void ManageCreditsStatuses();
   void ActivateLinkedCharges() const;
   void CloseLinkedCharges() const;
   u8 FindIndexOfNextPriorityCredit() const;
+  u8 TakeChangeEvents();
+  bool RestoreFromSnapshot();
+  void ScheduleDeadlines( PaymentTime from );
+  uint8_t RescheduleDeadlines( uint8_t result );
+  static void DeadlineHandler( void* object, u8 kind, u8 reason, PaymentTime now );
+#ifdef PAYMENT_PROFILING
+  PaymentProfileScenario GetProfileScenario() const;
+#endif // PAYMENT_PROFILING
   
   PaymentAccountCfg* const      accountCfg;
   PaymentCreditClass*           creditList[MAX_OBJECTS_IN_CREDIT_REF_LIST];
@@ -807,19 +1017,36 @@ private:
   uint8_t                       lenChargeList;
   uint8_t                       lenCreditChargeCfgList;
   uint8_t                       lenTokenGatewayCfgList;         
+  
+  u16                           secondsFromFlush;
+  
+  u8                            changeEvents;           // own paymentEvent* of the account, the events of the credits and charges are added in IdleSecond
+  u8                            nextPriorityCredit;     // FindIndexOfNextPriorityCredit() of the last recomputation
+  bool                          deadlineScheduled;      // the activation and closure times are put to the deadline queue in the first IdleMinute after Init
+  
+  /* Shares of the objects in the running totals */
+  s32                           availableCreditShare[MAX_OBJECTS_IN_CREDIT_REF_LIST];
+  s32                           amountToClearShare[MAX_OBJECTS_IN_CREDIT_REF_LIST];
+  s32                           aggregatedDebtShare[MAX_OBJECTS_IN_CHARGE_REF_LIST];
+  s32                           creditsAmountToClear;   // amount_to_clear without clearance_threshold
+#ifdef PAYMENT_AGGREGATES_CHECK
+  u32                           aggregatesMismatches;
+#endif // PAYMENT_AGGREGATES_CHECK
 };
 
 /************************************************************************************************/
 /*************************** Interfaces of Assist classes ***************************************/
 /************************************************************************************************/
 
+class ConsumedKWhFromStartClass;
+
 class OutTokenClass : public COSEMInterfaceClassAbstract{
 public:
   enum OutTokenAttributes{
     ValueAttr           = 2
   };
   
-  OutTokenClass( const LOGICAL_NAME* const _ln );
+  OutTokenClass( const LOGICAL_NAME* const _ln, const PaymentAccountClass* const _account, const ConsumedKWhFromStartClass* const _consumedKWh, const uint16_t _ftOutToken );
   
   const u8 outTokenType = 1;
   
@@ -870,6 +1097,10 @@ private:
   bool GetAttr2( uint8_t* buf_response, uint16_t& len_response ) const;
   
   const LOGICAL_NAME* const ln;
+  
+  const PaymentAccountClass* const              account;
+  const ConsumedKWhFromStartClass* const        consumedKWh;
+  const uint16_t                                ftOutToken;
 };
 
 class ActiveTransactionIDClass : public COSEMInterfaceClassAbstract{
@@ -878,7 +1109,7 @@ public:
     ValueAttr           = 2  
   };
   
-  ActiveTransactionIDClass( const LOGICAL_NAME* const _ln );
+  ActiveTransactionIDClass( const LOGICAL_NAME* const _ln, const PaymentTokenGatewayClass* const _tokenGateway );
   
   const LOGICAL_NAME* const ln;
   
@@ -886,6 +1117,8 @@ public:
   
 private:
   bool GetAttr2( uint8_t* buf_response, uint16_t& len_response ) const;
+  
+  const PaymentTokenGatewayClass* const tokenGateway;
 };
 
 class TopUpsSumClass : public COSEMInterfaceClassAbstract{
@@ -895,7 +1128,7 @@ public:
     ScalerUnitAttr       = 3       
   };
   
-  TopUpsSumClass( const LOGICAL_NAME* const _ln );
+  TopUpsSumClass( const LOGICAL_NAME* const _ln, const PaymentAccountClass* const _account );
   
   const LOGICAL_NAME* const ln;
   
@@ -904,6 +1137,8 @@ public:
 private:
   bool GetAttr2( uint8_t* buf_response, uint16_t& len_response ) const;
   bool GetAttr3( uint8_t* buf_response, uint16_t& len_response ) const;
+  
+  const PaymentAccountClass* const account;
 };
 
 class TotalAmountPaidClass : public COSEMInterfaceClassAbstract{
@@ -913,7 +1148,7 @@ public:
     ScalerUnitAttr       = 3       
   };
   
-  TotalAmountPaidClass( const LOGICAL_NAME* const _ln );
+  TotalAmountPaidClass( const LOGICAL_NAME* const _ln, const PaymentAccountClass* const _account );
   
   const LOGICAL_NAME* const ln;
   
@@ -922,6 +1157,8 @@ public:
 private:
   bool GetAttr2( uint8_t* buf_response, uint16_t& len_response ) const;
   bool GetAttr3( uint8_t* buf_response, uint16_t& len_response ) const;
+  
+  const PaymentAccountClass* const account;
 };
 
 class ConsumedKWhFromStartClass : public COSEMInterfaceClassAbstract{
@@ -931,12 +1168,13 @@ public:
     ScalerUnitAttr       = 3       
   };
   
-  ConsumedKWhFromStartClass( const LOGICAL_NAME* const _ln );
+  ConsumedKWhFromStartClass( const LOGICAL_NAME* const _ln, const LOGICAL_NAME* const _energyRegisterLn, const uint16_t _ftKWhWhenStart );
   
   const LOGICAL_NAME* const ln;
   
   void UpdateKWhWhenStart();
   u32 GetConsumedKWh() const;
+  u64 GetCurrentKWh() const;
   
   bool Get( uint8_t attrID, uint8_t* buf_request, uint8_t* buf_response, uint16_t& len_response );
   
@@ -946,6 +1184,9 @@ private:
   bool GetAttr2( uint8_t* buf_response, uint16_t& len_response ) const;
   bool GetAttr3( uint8_t* buf_response, uint16_t& len_response ) const;
   
+  const LOGICAL_NAME* const     energyRegisterLn;       /* A Rg */
+  const uint16_t                ftKWhWhenStart;
+  
   u64 kWhWhenStart; /* Value of A Rg when was start */
 };
 
@@ -955,7 +1196,7 @@ public:
     ValueAttr            = 2      
   };
   
-  TokenIDClass( const LOGICAL_NAME* const _ln );
+  TokenIDClass( const LOGICAL_NAME* const _ln, const PaymentTokenGatewayClass* const _tokenGateway );
   
   const LOGICAL_NAME* const ln;
   
@@ -963,6 +1204,8 @@ public:
   
 private:
   bool GetAttr2( uint8_t* buf_response, uint16_t& len_response ) const;
+  
+  const PaymentTokenGatewayClass* const tokenGateway;
 };
 
 class ExpiresTimeClass : public COSEMInterfaceClassAbstract{
@@ -971,7 +1214,7 @@ public:
     ValueAttr            = 2      
   };
   
-  ExpiresTimeClass( const LOGICAL_NAME* const _ln );
+  ExpiresTimeClass( const LOGICAL_NAME* const _ln, const PaymentTokenGatewayClass* const _tokenGateway );
   
   const LOGICAL_NAME* const ln;
   
@@ -979,10 +1222,17 @@ public:
   
 private:
   bool GetAttr2( uint8_t* buf_response, uint16_t& len_response ) const;
+  
+  const PaymentTokenGatewayClass* const tokenGateway;
 };
 
 /***********************************************************/
 extern PaymentTokenGatewayClass TokenGatewayForImportAccount;
 /***********************************************************/
 
+#ifdef PAYMENT_HOST_BUILD
+/* Objects of one more simulated meter of the host harness, see cicPayment.cpp */
+void PaymentCreateImportObjects( PaymentCreditClass** credit, PaymentChargeClass** charge, PaymentTokenGatewayClass** tokenGateway, PaymentAccountClass** account );
+#endif // PAYMENT_HOST_BUILD
+
 #endif // _PAYMENT_
\ No newline at end of file
@@ -0,0 +1,90 @@
+/*
+    \file PaymentClock.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+#include "cicPaymentClock.h"
+
+#ifdef PAYMENT_VIRTUAL_CLOCK
+
+#include "cicClock.h"
+#include "cicPaymentPort.h"
+#include "cicPaymentTime.h"
+#include "cicPaymentDeadline.h"
+
+static PAYMENT_THREAD_LOCAL PaymentVirtualClockContext defaultClock = { 0, 0xFFFFFFFF, {} };
+static PAYMENT_THREAD_LOCAL PaymentVirtualClockContext* currentClock = &defaultClock;
+
+void PaymentVirtualClockInitContext( PaymentVirtualClockContext* context )
+{
+    memset( context, 0, sizeof( *context ) );
+    context->convertedSeconds = 0xFFFFFFFF;
+}
+
+/* NULL returns to the default clock */
+void PaymentVirtualClockSelect( PaymentVirtualClockContext* context )
+{
+    currentClock = ( context != NULL ) ? context : &defaultClock;
+}
+
+/* The deadlines of the objects are computed again for the new time, as after the clock set of the firmware */
+static void clockAdjusted()
+{
+    TDateTime localTime;
+    PaymentVirtualClockGetLocalTime( &localTime );
+    PaymentDeadlineClockAdjusted( PaymentTimeFromDateTime( &localTime ) );
+}
+
+void PaymentVirtualClockSet( TDateTime* localDateTime )
+{
+    currentClock->seconds = GetSecondsUTC( localDateTime );
+    clockAdjusted();
+}
+
+void PaymentVirtualClockSetSeconds( u32 utcSeconds )
+{
+    currentClock->seconds = utcSeconds;
+    clockAdjusted();
+}
+
+u32 PaymentVirtualClockGetSeconds()
+{
+    return currentClock->seconds;
+}
+
+void PaymentVirtualClockGetLocalTime( TDateTime* dateTime )
+{
+    if( currentClock->convertedSeconds != currentClock->seconds )
+    {
+        SecondsTo_Local_DateTime( currentClock->seconds, &currentClock->localTime );
+        currentClock->localTime.time.hundredths = 0;
+        currentClock->convertedSeconds = currentClock->seconds;
+    }
+
+    *dateTime = currentClock->localTime;
+}
+
+/* Clock set by the user or by the time synchronization: forward (seconds > 0) or setback (seconds < 0) */
+void PaymentVirtualClockJump( s32 seconds )
+{
+    if( seconds < 0 && (u32)( -seconds ) > currentClock->seconds )
+        currentClock->seconds = 0;
+    else
+        currentClock->seconds += seconds;
+
+    clockAdjusted();
+}
+
+void PaymentVirtualClockRun( u32 seconds, PaymentVirtualTickHandler handler, void* arg )
+{
+    for( u32 i = 0; i < seconds; ++i )
+    {
+        ++currentClock->seconds;
+        handler( ( currentClock->seconds % 60 ) == 0, arg );
+    }
+}
+
+#endif // PAYMENT_VIRTUAL_CLOCK
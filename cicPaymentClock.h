@@ -0,0 +1,49 @@
+/*
+    \file PaymentClock.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+/*
+Simulation clock of the Payment objects (PAYMENT_VIRTUAL_CLOCK).
+The clock is kept as UTC seconds of cicClock and is converted to the local time
+(with time zone and DST) only when the seconds have changed.
+PaymentVirtualClockRun() ticks the clock second by second as fast as the CPU allows
+and calls the handler which must invoke IdleSecond (and IdleMinute when newMinute is true)
+of the Payment objects. Jumps and setbacks of the clock are done without ticks, every set of the clock
+calls PaymentDeadlineClockAdjusted() as the firmware does.
+Every simulated meter may have its own clock: the harness keeps a context per meter
+and selects it before running the objects of this meter. The selection is per thread.
+*/
+
+#if !defined _PAYMENT_CLOCK_
+#define _PAYMENT_CLOCK_
+
+#include "config.h"
+#include "CommonTypes.h"
+
+#ifdef PAYMENT_VIRTUAL_CLOCK
+
+typedef void ( *PaymentVirtualTickHandler )( bool newMinute, void* arg );
+
+typedef struct{
+    u32         seconds;                // UTC seconds of cicClock
+    u32         convertedSeconds;       // seconds for which localTime was calculated
+    TDateTime   localTime;
+} PaymentVirtualClockContext;
+
+void PaymentVirtualClockInitContext( PaymentVirtualClockContext* context );
+void PaymentVirtualClockSelect( PaymentVirtualClockContext* context );
+
+void PaymentVirtualClockSet( TDateTime* localDateTime );
+void PaymentVirtualClockSetSeconds( u32 utcSeconds );
+u32 PaymentVirtualClockGetSeconds();
+void PaymentVirtualClockGetLocalTime( TDateTime* dateTime );
+void PaymentVirtualClockJump( s32 seconds );
+void PaymentVirtualClockRun( u32 seconds, PaymentVirtualTickHandler handler, void* arg );
+
+#endif // PAYMENT_VIRTUAL_CLOCK
+
+#endif // _PAYMENT_CLOCK_
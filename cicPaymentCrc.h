@@ -0,0 +1,25 @@
+/*
+    \file PaymentCrc.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+/*
+CRC-32 (IEEE 802.3, reflected, init and final xor 0xFFFFFFFF) of the records of the Payment objects.
+The table driven slice-by-4 kernel takes 4 bytes per step, its tables (4 KB) are in the flash.
+With PAYMENT_CRC32_BITWISE the bitwise kernel without tables is compiled for the parts with small flash,
+the result is the same.
+*/
+
+#if !defined _PAYMENT_CRC_
+#define _PAYMENT_CRC_
+
+#include "config.h"
+#include "CommonTypes.h"
+
+u32 PaymentCrc32( const void* data, u16 len );
+u32 PaymentCrc32Continue( u32 crc, const void* data, u16 len );
+
+#endif // _PAYMENT_CRC_
@@ -0,0 +1,107 @@
+/*
+    \file PaymentDeadline.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+#include "cicPaymentDeadline.h"
+#include "cicPaymentPort.h"
+
+static PAYMENT_THREAD_LOCAL PaymentDeadlineContext defaultDeadline;
+static PAYMENT_THREAD_LOCAL PaymentDeadlineContext* currentDeadline = &defaultDeadline;
+
+void PaymentDeadlineInitContext( PaymentDeadlineContext* context )
+{
+    memset( context, 0, sizeof( *context ) );
+}
+
+/* NULL returns to the default queue */
+void PaymentDeadlineSelect( PaymentDeadlineContext* context )
+{
+    currentDeadline = ( context != NULL ) ? context : &defaultDeadline;
+}
+
+static void removeEntry( u8 pos )
+{
+    --currentDeadline->deadlineQueueLen;
+    for( u8 i = pos; i < currentDeadline->deadlineQueueLen; ++i )
+        currentDeadline->deadlineQueue[i] = currentDeadline->deadlineQueue[i + 1];
+}
+
+void PaymentDeadlineCancel( void* object, u8 kind )
+{
+    for( u8 i = 0; i < currentDeadline->deadlineQueueLen; ++i )
+    {
+        if( currentDeadline->deadlineQueue[i].object == object && currentDeadline->deadlineQueue[i].kind == kind )
+        {
+            removeEntry( i );
+            return;
+        }
+    }
+}
+
+/* The deadline of the same object and kind is replaced, PAYMENT_DEADLINE_NONE only removes it */
+bool PaymentDeadlineSchedule( void* object, u8 kind, PaymentTime due, PaymentDeadlineHandler handler )
+{
+    PaymentDeadlineCancel( object, kind );
+    
+    if( due == PAYMENT_DEADLINE_NONE )
+        return true;
+    
+    if( currentDeadline->deadlineQueueLen == PAYMENT_DEADLINE_QUEUE_LEN )
+        return false;
+    
+    u8 pos = currentDeadline->deadlineQueueLen;
+    while( pos > 0 && currentDeadline->deadlineQueue[pos - 1].due > due )
+    {
+        currentDeadline->deadlineQueue[pos] = currentDeadline->deadlineQueue[pos - 1];
+        --pos;
+    }
+    
+    currentDeadline->deadlineQueue[pos].due = due;
+    currentDeadline->deadlineQueue[pos].object = object;
+    currentDeadline->deadlineQueue[pos].handler = handler;
+    currentDeadline->deadlineQueue[pos].kind = kind;
+    ++currentDeadline->deadlineQueueLen;
+    return true;
+}
+
+/* All due deadlines are fired in the order of the time, also the ones missed in the previous minutes */
+void PaymentDeadlineRun( PaymentTime now )
+{
+    if( now < currentDeadline->deadlineLastRun )
+        PaymentDeadlineClockAdjusted( now );
+    currentDeadline->deadlineLastRun = now;
+    
+    while( currentDeadline->deadlineQueueLen != 0 && currentDeadline->deadlineQueue[0].due <= now )
+    {
+        PaymentDeadlineEntry entry = currentDeadline->deadlineQueue[0];
+        removeEntry( 0 );
+        entry.handler( entry.object, entry.kind, PaymentDeadlineDue, now );
+    }
+}
+
+/* Every object computes its deadline for the new time, the handlers replace the entries in the queue */
+void PaymentDeadlineClockAdjusted( PaymentTime now )
+{
+    PaymentDeadlineEntry entries[PAYMENT_DEADLINE_QUEUE_LEN];
+    u8 len = currentDeadline->deadlineQueueLen;
+    memcpy( entries, currentDeadline->deadlineQueue, len * sizeof( entries[0] ) );
+    
+    currentDeadline->deadlineLastRun = now;
+    for( u8 i = 0; i < len; ++i )
+        entries[i].handler( entries[i].object, entries[i].kind, PaymentDeadlineClockChanged, now );
+}
+
+PaymentTime PaymentDeadlineGetNext()
+{
+    return ( currentDeadline->deadlineQueueLen != 0 ) ? currentDeadline->deadlineQueue[0].due : PAYMENT_DEADLINE_NONE;
+}
+
+void PaymentDeadlineReset()
+{
+    currentDeadline->deadlineQueueLen = 0;
+    currentDeadline->deadlineLastRun = 0;
+}
@@ -0,0 +1,86 @@
+/*
+    \file PaymentDeadline.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+/*
+Queue of the deadlines of the Payment objects: account_activation_time, account_closure_time,
+unit_charge_activation_time and the period of the credits.
+The objects compute the PaymentTime of the next event only when the attribute is Set, at the start
+and after the clock is adjusted, and put it to the queue sorted by the time.
+PaymentDeadlineRun() is called once per pass of the scheduler after IdleMinute() of all objects (PaymentIdlePass)
+and compares the time of the tick with the head of the queue, so an event is not lost if its minute was missed
+(reset, long write): the overdue deadline is fired at the next tick.
+The queue is sized for the deadlines of the objects of one account, PaymentDeadlineSchedule() refuses the deadline
+if the queue is full and the object schedules it again in its next IdleMinute(). The handler of the object does the action and schedules its next deadline.
+The step of the clock backwards is found by PaymentDeadlineRun() itself, the firmware which sets the clock
+calls PaymentDeadlineClockAdjusted(), then all objects compute their deadlines again (the simulation clock
+of PAYMENT_VIRTUAL_CLOCK calls it when it is set).
+Every simulated meter of the host build has its own queue: the harness keeps a context per meter
+and selects it before running the objects of this meter, the selection is per thread.
+*/
+
+#if !defined _PAYMENT_DEADLINE_
+#define _PAYMENT_DEADLINE_
+
+#include "config.h"
+#include "CommonTypes.h"
+#include "cicPaymentTime.h"
+
+#ifndef PAYMENT_DEADLINE_QUEUE_LEN
+#define PAYMENT_DEADLINE_QUEUE_LEN              8       // 2 of the account, 1 of every charge and credit
+#endif
+
+/*
+At the start and after the clock is adjusted the deadlines overdue by less than this time are still fired
+(the reset in the minute of the event), the older ones are considered done before.
+*/
+#ifndef PAYMENT_DEADLINE_GRACE_SEC
+#define PAYMENT_DEADLINE_GRACE_SEC              300
+#endif
+
+static const PaymentTime PAYMENT_DEADLINE_NONE          = PAYMENT_TIME_NOT_SPECIFIED;
+
+enum PaymentDeadlineKind{
+    PaymentDeadlineAccountActivation            = 0,
+    PaymentDeadlineAccountClosure,
+    PaymentDeadlineUnitChargeActivation,
+    PaymentDeadlineCreditPeriod
+};
+
+enum PaymentDeadlineReason{
+    PaymentDeadlineDue                          = 0,    // the time of the deadline has come
+    PaymentDeadlineClockChanged                         // the clock was adjusted, the deadline must be computed again
+};
+
+/* The handler of the object. The entry is removed from the queue before the call */
+typedef void (*PaymentDeadlineHandler)( void* object, u8 kind, u8 reason, PaymentTime now );
+
+typedef struct{
+    PaymentTime                 due;
+    void*                       object;
+    PaymentDeadlineHandler      handler;
+    u8                          kind;
+} PaymentDeadlineEntry;
+
+/* Sorted by due, the head is the first entry */
+typedef struct{
+    PaymentDeadlineEntry        deadlineQueue[PAYMENT_DEADLINE_QUEUE_LEN];
+    u8                          deadlineQueueLen;
+    PaymentTime                 deadlineLastRun;
+} PaymentDeadlineContext;
+
+void PaymentDeadlineInitContext( PaymentDeadlineContext* context );
+void PaymentDeadlineSelect( PaymentDeadlineContext* context );
+
+bool PaymentDeadlineSchedule( void* object, u8 kind, PaymentTime due, PaymentDeadlineHandler handler );   // false if the queue is full
+void PaymentDeadlineCancel( void* object, u8 kind );
+void PaymentDeadlineRun( PaymentTime now );
+void PaymentDeadlineClockAdjusted( PaymentTime now );
+PaymentTime PaymentDeadlineGetNext();
+void PaymentDeadlineReset();
+
+#endif // _PAYMENT_DEADLINE_
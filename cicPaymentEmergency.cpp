@@ -0,0 +1,157 @@
+/*
+    \file PaymentEmergency.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+#include "cicPaymentEmergency.h"
+
+#ifdef PAYMENT_EMERGENCY_FLUSH
+
+#include "cicPaymentPort.h"
+#include "cicPaymentJournal.h"
+
+static PAYMENT_THREAD_LOCAL PaymentEmergencyContext defaultEmergency;
+static PAYMENT_THREAD_LOCAL PaymentEmergencyContext* currentEmergency = &defaultEmergency;
+
+void PaymentEmergencyInitContext( PaymentEmergencyContext* context )
+{
+    memset( context, 0, sizeof( *context ) );
+}
+
+/* NULL returns to the default emergency context */
+void PaymentEmergencySelect( PaymentEmergencyContext* context )
+{
+    currentEmergency = ( context != NULL ) ? context : &defaultEmergency;
+}
+
+/* The writes of the emergency files go directly to the port, they must not discard the record */
+static void writeFile( u16 ftId, const void* src, u16 len )
+{
+    PAYMENT_WRITE_STATS_RECORD( ftId, PAYMENT_WRITE_STATS_NOT_INDEXED, len );
+    PAYMENT_PROFILE_WRITE();
+    PaymentPortFileWrite( ftId, src, len );
+}
+
+void PaymentEmergencyBegin()
+{
+    currentEmergency->emergencyLen = sizeof( PaymentEmergencyHeader );
+    currentEmergency->emergencyCounters = 0;
+}
+
+bool PaymentEmergencyAdd( u16 ftId, u8 index, const void* data, u8 len )
+{
+    if( currentEmergency->emergencyLen + sizeof( PaymentEmergencyCounterHeader ) + len + sizeof( u32 ) > PAYMENT_EMERGENCY_MAX_LEN )
+        return false;
+
+    PaymentEmergencyCounterHeader counter = { ftId, index, len };
+    memcpy( &currentEmergency->emergencyArea[currentEmergency->emergencyLen], &counter, sizeof( counter ) );
+    currentEmergency->emergencyLen += sizeof( counter );
+    memcpy( &currentEmergency->emergencyArea[currentEmergency->emergencyLen], data, len );
+    currentEmergency->emergencyLen += len;
+    ++currentEmergency->emergencyCounters;
+
+    return true;
+}
+
+/* Only the used part of the area is written, the CRC makes the rest of the file ignored */
+void PaymentEmergencyCommit()
+{
+    if( currentEmergency->emergencyCounters == 0 )
+        return;
+
+    PaymentEmergencyHeader header;
+    header.seq = currentEmergency->emergencySeq + 1;
+    header.len = currentEmergency->emergencyLen + sizeof( u32 );
+    header.counters = currentEmergency->emergencyCounters;
+    memcpy( currentEmergency->emergencyArea, &header, sizeof( header ) );
+
+    u32 crc = PaymentCrc32( currentEmergency->emergencyArea, currentEmergency->emergencyLen );
+    memcpy( &currentEmergency->emergencyArea[currentEmergency->emergencyLen], &crc, sizeof( crc ) );
+
+    writeFile( ftPaymentEmergency_Area, currentEmergency->emergencyArea, header.len );
+    currentEmergency->emergencySeq = header.seq;
+    currentEmergency->emergencyPending = true;
+}
+
+/*
+The function is called at the start by PaymentRecover() before the files are read,
+only the first call works. The counters of the record are newer than the journal and the transaction log,
+so they are applied after them.
+*/
+void PaymentEmergencyRecover()
+{
+    if( currentEmergency->emergencyRecovered )
+        return;
+    currentEmergency->emergencyRecovered = true;
+
+#ifdef PAYMENT_TRANSACTION
+    PaymentTransactionRecover();
+#endif // PAYMENT_TRANSACTION
+#ifdef PAYMENT_JOURNAL
+    PaymentJournalInit();                       // older records of the journal must not be applied over the record later
+#endif // PAYMENT_JOURNAL
+
+    u32 appliedSeq = 0;
+    if( PaymentFileRead( ftPaymentEmergency_Applied, &appliedSeq ) != sizeof( appliedSeq ) )
+        appliedSeq = 0;
+    currentEmergency->emergencySeq = appliedSeq;
+
+    if( PaymentPortFileRead( ftPaymentEmergency_Area, currentEmergency->emergencyArea, sizeof( currentEmergency->emergencyArea ) ) < sizeof( PaymentEmergencyHeader ) )
+        return;
+
+    PaymentEmergencyHeader header;
+    memcpy( &header, currentEmergency->emergencyArea, sizeof( header ) );
+    if( header.seq == appliedSeq || header.len > PAYMENT_EMERGENCY_MAX_LEN || header.len < sizeof( header ) + sizeof( u32 ) )
+        return;
+
+    u32 crc;
+    memcpy( &crc, &currentEmergency->emergencyArea[header.len - sizeof( u32 )], sizeof( crc ) );
+    if( crc != PaymentCrc32( currentEmergency->emergencyArea, header.len - sizeof( u32 ) ) )
+        return;
+
+    u16 pos = sizeof( header );
+    while( pos + sizeof( PaymentEmergencyCounterHeader ) <= header.len - sizeof( u32 ) )
+    {
+        PaymentEmergencyCounterHeader counter;
+        memcpy( &counter, &currentEmergency->emergencyArea[pos], sizeof( counter ) );
+        pos += sizeof( counter );
+
+        PAYMENT_PROFILE_WRITE();
+#ifdef PAYMENT_RECORD_CRC
+        PaymentRecord record;
+        u16 slot = PaymentRecordPrepare( counter.ftId, ( counter.index == PAYMENT_EMERGENCY_NOT_INDEXED ) ? 0 : counter.index, &currentEmergency->emergencyArea[pos], counter.len, &record );
+        PAYMENT_WRITE_STATS_RECORD( counter.ftId, slot, sizeof( record ) );
+        PaymentPortFileIndexWrite( counter.ftId, slot, &record, sizeof( record ) );
+#else
+        PAYMENT_WRITE_STATS_RECORD( counter.ftId, ( counter.index == PAYMENT_EMERGENCY_NOT_INDEXED ) ? PAYMENT_WRITE_STATS_NOT_INDEXED : counter.index, counter.len );
+        if( counter.index == PAYMENT_EMERGENCY_NOT_INDEXED )
+            PaymentPortFileWrite( counter.ftId, &currentEmergency->emergencyArea[pos], counter.len );
+        else
+            PaymentPortFileIndexWrite( counter.ftId, counter.index, &currentEmergency->emergencyArea[pos], counter.len );
+#endif // PAYMENT_RECORD_CRC
+
+        pos += counter.len;
+    }
+
+    currentEmergency->emergencySeq = header.seq;
+    writeFile( ftPaymentEmergency_Applied, &currentEmergency->emergencySeq, sizeof( currentEmergency->emergencySeq ) );
+}
+
+/* The power came back: the boot snapshot saved with the record is old from now on too */
+void PaymentEmergencyDiscard()
+{
+#ifdef PAYMENT_BOOT_SNAPSHOT
+    PaymentSnapshotInvalidate();
+#endif // PAYMENT_BOOT_SNAPSHOT
+
+    if( !currentEmergency->emergencyPending )
+        return;
+
+    currentEmergency->emergencyPending = false;
+    writeFile( ftPaymentEmergency_Applied, &currentEmergency->emergencySeq, sizeof( currentEmergency->emergencySeq ) );
+}
+
+#endif // PAYMENT_EMERGENCY_FLUSH
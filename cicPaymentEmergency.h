@@ -0,0 +1,76 @@
+/*
+    \file PaymentEmergency.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+/*
+Emergency flush of the money counters at the power fail (PAYMENT_EMERGENCY_FLUSH).
+The handler of the power fail calls PaymentAccountClass::EmergencyFlush(), which puts only the dirty
+counters of the credits and charges and the ones still in the write queue (PAYMENT_WRITE_QUEUE) into one record
+with CRC32 and writes it to the reserved file ftPaymentEmergency_Area by one write, so the time is limited
+by the hold-up capacitor.
+At the start PaymentEmergencyRecover() writes the counters of the valid record to their files
+before Init() of the objects reads them and saves the sequence number of the record in ftPaymentEmergency_Applied.
+If the power comes back, the first write of the Payment files discards the record: the counters are still
+dirty in RAM or queued and are written by the usual flush or by the writer context.
+EmergencyFlush() returns false if the area has no place for all dirty counters, the record keeps the ones added.
+The worst time of the flush is measured by the stage PaymentProfileEmergencyFlush (PAYMENT_PROFILING).
+Every simulated meter of the host build has its own emergency context, selected by the harness with the meter.
+*/
+
+#if !defined _PAYMENT_EMERGENCY_
+#define _PAYMENT_EMERGENCY_
+
+#include "config.h"
+#include "CommonTypes.h"
+
+#ifndef PAYMENT_EMERGENCY_MAX_LEN
+#define PAYMENT_EMERGENCY_MAX_LEN               332     // 4 credits and 3 charges with all tariffs, checked in cicPayment.cpp
+#endif
+
+static const uint8_t PAYMENT_EMERGENCY_NOT_INDEXED      = 0xFF;     // index of the counter of the not indexed file
+
+typedef __packed struct{
+    u32         seq;
+    u16         len;                            // header, counters and CRC
+    u16         counters;
+} PaymentEmergencyHeader;
+
+typedef __packed struct{
+    u16         ftId;
+    u8          index;
+    u8          len;
+} PaymentEmergencyCounterHeader;
+
+#ifdef PAYMENT_EMERGENCY_FLUSH
+
+typedef struct{
+    BYTE        emergencyArea[PAYMENT_EMERGENCY_MAX_LEN];
+    u16         emergencyLen;
+    u16         emergencyCounters;
+    u32         emergencySeq;                   // the last written record
+    bool        emergencyPending;               // the record is written and not discarded
+    bool        emergencyRecovered;
+} PaymentEmergencyContext;
+
+void PaymentEmergencyInitContext( PaymentEmergencyContext* context );
+void PaymentEmergencySelect( PaymentEmergencyContext* context );
+
+void PaymentEmergencyBegin();
+bool PaymentEmergencyAdd( u16 ftId, u8 index, const void* data, u8 len );
+void PaymentEmergencyCommit();
+void PaymentEmergencyRecover();
+void PaymentEmergencyDiscard();
+
+#define PAYMENT_EMERGENCY_TOUCH()               PaymentEmergencyDiscard()
+
+#else
+
+#define PAYMENT_EMERGENCY_TOUCH()
+
+#endif // PAYMENT_EMERGENCY_FLUSH
+
+#endif // _PAYMENT_EMERGENCY_
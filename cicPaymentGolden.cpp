@@ -0,0 +1,109 @@
+/*
+    \file PaymentGolden.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+#include "cicPaymentGolden.h"
+
+#if defined PAYMENT_HOST_BUILD
+
+#include "cicPaymentPort.h"
+#include "utils.h"
+
+void PaymentGoldenCapture( const PaymentGoldenMeter* meter, u32 step, PaymentGoldenSnapshot* snapshot )
+{
+    memset( snapshot, 0, sizeof( *snapshot ) );
+
+    snapshot->step = step;
+#ifdef PAYMENT_VIRTUAL_CLOCK
+    snapshot->utcSeconds = PaymentVirtualClockGetSeconds();
+#endif // PAYMENT_VIRTUAL_CLOCK
+
+    snapshot->availableCredit = PaymentGetDoubleLongAttr( meter->account, PaymentAccountAvailableCreditAttr );
+    snapshot->amountToClear = PaymentGetDoubleLongAttr( meter->account, PaymentAccountAmountToClearAttr );
+    snapshot->aggregatedDebt = PaymentGetDoubleLongAttr( meter->account, PaymentAccountAggregatedDebtAttr );
+#ifdef PAYMENT_AGGREGATES_CHECK
+    snapshot->aggregatesMismatches = meter->account->GetAggregatesMismatches();
+#endif // PAYMENT_AGGREGATES_CHECK
+
+    snapshot->lenCreditList = meter->lenCreditList;
+    for( u8 i = 0; i < meter->lenCreditList; ++i )
+        snapshot->currentCreditAmount[i] = PaymentGetDoubleLongAttr( meter->creditList[i], PaymentCreditCurrentCreditAmountAttr );
+
+    snapshot->lenChargeList = meter->lenChargeList;
+    for( u8 i = 0; i < meter->lenChargeList; ++i )
+        snapshot->totalAmountPaid[i] = PaymentGetDoubleLongAttr( meter->chargeList[i], PaymentChargeTotalAmountPaidAttr );
+
+    snapshot->relay = PaymentPortGetRelayState();
+}
+
+static bool setDivergence( PaymentGoldenDivergence* divergence, PaymentGoldenField field, u8 index, s32 reference, s32 candidate )
+{
+    if( reference == candidate )
+        return false;
+
+    divergence->field = field;
+    divergence->index = index;
+    divergence->reference = reference;
+    divergence->candidate = candidate;
+
+    return true;
+}
+
+/* The function returns true if the snapshots are equal, else the first divergent value is in divergence */
+bool PaymentGoldenCompare( const PaymentGoldenSnapshot* reference, const PaymentGoldenSnapshot* candidate, PaymentGoldenDivergence* divergence )
+{
+    memset( divergence, 0, sizeof( *divergence ) );
+
+    if( setDivergence( divergence, PaymentGoldenLayout, 0, reference->lenCreditList, candidate->lenCreditList ) ||
+        setDivergence( divergence, PaymentGoldenLayout, 1, reference->lenChargeList, candidate->lenChargeList ) )
+        return false;
+
+    /* the healed aggregates are equal in both builds, so the drift is told only by the counter */
+    if( reference->aggregatesMismatches != 0 || candidate->aggregatesMismatches != 0 )
+    {
+        divergence->field = PaymentGoldenAggregatesMismatches;
+        divergence->reference = reference->aggregatesMismatches;
+        divergence->candidate = candidate->aggregatesMismatches;
+        return false;
+    }
+
+    if( setDivergence( divergence, PaymentGoldenAvailableCredit, 0, reference->availableCredit, candidate->availableCredit ) ||
+        setDivergence( divergence, PaymentGoldenAmountToClear, 0, reference->amountToClear, candidate->amountToClear ) ||
+        setDivergence( divergence, PaymentGoldenAggregatedDebt, 0, reference->aggregatedDebt, candidate->aggregatedDebt ) )
+        return false;
+
+    for( u8 i = 0; i < reference->lenCreditList; ++i )
+    {
+        if( setDivergence( divergence, PaymentGoldenCurrentCreditAmount, i, reference->currentCreditAmount[i], candidate->currentCreditAmount[i] ) )
+            return false;
+    }
+
+    for( u8 i = 0; i < reference->lenChargeList; ++i )
+    {
+        if( setDivergence( divergence, PaymentGoldenTotalAmountPaid, i, reference->totalAmountPaid[i], candidate->totalAmountPaid[i] ) )
+            return false;
+    }
+
+    if( setDivergence( divergence, PaymentGoldenRelay, 0, reference->relay, candidate->relay ) )
+        return false;
+
+    return true;
+}
+
+/* xorshift32: the same sequence on every build and platform, state must not be 0 */
+u32 PaymentGoldenRandom( u32* state )
+{
+    u32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+
+    return x;
+}
+
+#endif // PAYMENT_HOST_BUILD
@@ -0,0 +1,93 @@
+/*
+    \file PaymentGolden.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+/*
+Golden output comparison of the Payment objects in the host build (PAYMENT_HOST_BUILD).
+The reference build and the optimized build are run in lockstep by the harness on the same
+randomized ticks and tokens (PaymentGoldenRandom with the same seed gives the same stimulus in both).
+After every step each build captures the money values of the meter, the harness exchanges
+the snapshots and PaymentGoldenCompare reports the first divergent value.
+The snapshot is packed, so it may be passed between the processes as is.
+*/
+
+#if !defined _PAYMENT_GOLDEN_
+#define _PAYMENT_GOLDEN_
+
+#include "config.h"
+#include "CommonTypes.h"
+
+#if defined PAYMENT_HOST_BUILD
+
+#include "cicPayment.h"
+
+typedef __packed struct{
+    u32         step;
+    u32         utcSeconds;
+    s32         availableCredit;
+    s32         amountToClear;
+    s32         aggregatedDebt;
+    u32         aggregatesMismatches;           // shares healed by PAYMENT_AGGREGATES_CHECK, 0 without the check
+    s32         currentCreditAmount[MAX_OBJECTS_IN_CREDIT_REF_LIST];
+    s32         totalAmountPaid[MAX_OBJECTS_IN_CHARGE_REF_LIST];
+    u8          lenCreditList;
+    u8          lenChargeList;
+    u8          relay;
+} PaymentGoldenSnapshot;
+
+/* Compared values, in the order of the comparison */
+enum PaymentGoldenField{
+    PaymentGoldenNoDivergence           = 0,
+    PaymentGoldenLayout,                        // different number of credits or charges
+    PaymentGoldenAggregatesMismatches,          // any healed share in either build
+    PaymentGoldenAvailableCredit,
+    PaymentGoldenAmountToClear,
+    PaymentGoldenAggregatedDebt,
+    PaymentGoldenCurrentCreditAmount,           // index is the position in the credit list
+    PaymentGoldenTotalAmountPaid,               // index is the position in the charge list
+    PaymentGoldenRelay
+};
+
+typedef struct{
+    PaymentGoldenField  field;
+    u8                  index;
+    s32                 reference;
+    s32                 candidate;
+} PaymentGoldenDivergence;
+
+/* Objects of the compared meter */
+typedef struct{
+    PaymentAccountClass*        account;
+    PaymentCreditClass*         creditList[MAX_OBJECTS_IN_CREDIT_REF_LIST];
+    u8                          lenCreditList;
+    PaymentChargeClass*         chargeList[MAX_OBJECTS_IN_CHARGE_REF_LIST];
+    u8                          lenChargeList;
+} PaymentGoldenMeter;
+
+/* Value of the double-long-unsigned or double-long attribute read through Get, 0 if the attribute has other type */
+template< typename T >
+s32 PaymentGetDoubleLongAttr( T* object, u8 attrID )
+{
+    BYTE bufResponse[8] = {};
+    uint16_t lenResponse = 0;
+
+    if( !object->Get( attrID, NULL, bufResponse, lenResponse ) || ( bufResponse[0] != DoubleLong && bufResponse[0] != DoubleLongUnsigned ) )
+        return 0;
+
+    s32 value = 0;
+    AXDRDecodeDoubleLong( &bufResponse[1], &value );
+
+    return value;
+}
+
+void PaymentGoldenCapture( const PaymentGoldenMeter* meter, u32 step, PaymentGoldenSnapshot* snapshot );
+bool PaymentGoldenCompare( const PaymentGoldenSnapshot* reference, const PaymentGoldenSnapshot* candidate, PaymentGoldenDivergence* divergence );
+u32 PaymentGoldenRandom( u32* state );
+
+#endif // PAYMENT_HOST_BUILD
+
+#endif // _PAYMENT_GOLDEN_
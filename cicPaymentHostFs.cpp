@@ -0,0 +1,270 @@
+/*
+    \file PaymentHostFs.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+#include "cicPaymentHostFs.h"
+
+#if defined PAYMENT_HOST_BUILD && defined PAYMENT_HOST_FS
+
+#include "cicPaymentPort.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+static const u8 RECORD_ERASED                           = 0xFF;
+static const u8 RECORD_WRITTEN                          = 0x00;
+
+typedef struct{
+    PaymentHostFsFile   file;
+    u32                 offset;                 // of the first record in the image
+} PaymentHostFsEntry;
+
+static PAYMENT_THREAD_LOCAL PaymentHostFsEntry fsEntries[PAYMENT_HOST_FS_MAX_FILES];
+static PAYMENT_THREAD_LOCAL u16 fsEntriesNum = 0;
+static PAYMENT_THREAD_LOCAL PaymentHostFsConfig fsConfig;
+static PAYMENT_THREAD_LOCAL PaymentHostFsStats fsStats;
+static PAYMENT_THREAD_LOCAL u8* fsImage = NULL;
+static PAYMENT_THREAD_LOCAL u32 fsImageLen = 0;
+static PAYMENT_THREAD_LOCAL int fsFd = -1;
+static PAYMENT_THREAD_LOCAL u64 fsBytesToPowerCut = PAYMENT_HOST_FS_NO_POWER_CUT;
+static PAYMENT_THREAD_LOCAL bool fsPowerLost = false;
+
+static const PaymentHostFsEntry* findEntry( u16 ftId )
+{
+    for( u16 i = 0; i < fsEntriesNum; ++i )
+    {
+        if( fsEntries[i].file.ftId == ftId )
+            return &fsEntries[i];
+    }
+
+    ++fsStats.unknownFiles;
+    return NULL;
+}
+
+/* Bits of the flash go from 1 to 0 by the write, back to 1 only by the erase of the whole sector */
+static void chargeErase( u32 offset, const u8* src, u32 len )
+{
+    u32 lastErasedSector = 0xFFFFFFFF;
+
+    for( u32 i = 0; i < len; ++i )
+    {
+        if( ( fsImage[offset + i] & src[i] ) == src[i] )
+            continue;
+
+        u32 sector = ( offset + i ) / fsConfig.sectorSize;
+        if( sector != lastErasedSector )
+        {
+            lastErasedSector = sector;
+            ++fsStats.erasedSectors;
+            fsStats.busyNs += fsConfig.eraseSectorNs;
+        }
+    }
+}
+
+/* The function returns false if the power was cut during the write */
+static bool writeBytes( u32 offset, const u8* src, u32 len )
+{
+    if( fsPowerLost )
+        return false;
+
+    u32 written = len;
+    if( fsBytesToPowerCut != PAYMENT_HOST_FS_NO_POWER_CUT )
+    {
+        if( fsBytesToPowerCut < len )
+        {
+            written = (u32)fsBytesToPowerCut;
+            fsPowerLost = true;
+            ++fsStats.powerCuts;
+        }
+        fsBytesToPowerCut -= written;
+    }
+
+    chargeErase( offset, src, written );
+    memcpy( &fsImage[offset], src, written );
+
+    ++fsStats.writes;
+    fsStats.bytes += written;
+    fsStats.busyNs += fsConfig.writeLatencyNs + (u64)fsConfig.writeByteNs * written;
+
+    return !fsPowerLost;
+}
+
+static u16 readRecord( u16 ftId, u16 index, void* dst, u16 len )
+{
+    const PaymentHostFsEntry* entry = findEntry( ftId );
+    if( fsImage == NULL || entry == NULL || index >= entry->file.records )
+        return 0;
+
+    u32 offset = entry->offset + (u32)index * ( entry->file.recordLen + 1 );
+    if( fsImage[offset] != RECORD_WRITTEN )
+        return 0;
+
+    u16 readLen = ( len < entry->file.recordLen ) ? len : entry->file.recordLen;
+    memcpy( dst, &fsImage[offset + 1], readLen );
+    return readLen;
+}
+
+/* The indexed file read as a whole is the block of its records, the records never written are erased */
+static u16 readBlock( const PaymentHostFsEntry* entry, void* dst, u16 len )
+{
+    u8* block = (u8*)dst;
+    memset( block, RECORD_ERASED, len );
+
+    for( u16 index = 0; index < entry->file.records && (u32)index * entry->file.recordLen < len; ++index )
+    {
+        u32 offset = (u32)index * entry->file.recordLen;
+        u16 recordLen = ( len - offset < entry->file.recordLen ) ? (u16)( len - offset ) : entry->file.recordLen;
+        readRecord( entry->file.ftId, index, &block[offset], recordLen );
+    }
+    return len;
+}
+
+/* Data is written before the state byte, so the record torn at the first write stays not written */
+static void writeRecord( u16 ftId, u16 index, const void* src, u16 len )
+{
+    const PaymentHostFsEntry* entry = findEntry( ftId );
+    if( fsImage == NULL || entry == NULL || index >= entry->file.records )
+        return;
+
+    u32 offset = entry->offset + (u32)index * ( entry->file.recordLen + 1 );
+    u16 writeLen = ( len < entry->file.recordLen ) ? len : entry->file.recordLen;
+
+    if( !writeBytes( offset + 1, (const u8*)src, writeLen ) )
+        return;
+
+    if( fsImage[offset] != RECORD_WRITTEN )
+    {
+        u8 state = RECORD_WRITTEN;
+        writeBytes( offset, &state, sizeof( state ) );
+    }
+}
+
+/* The layout is defined by the table, so the image must be opened with the same table every time */
+bool PaymentHostFsOpen( const char* path, const PaymentHostFsFile* files, u16 filesNum, const PaymentHostFsConfig* config )
+{
+    if( filesNum > PAYMENT_HOST_FS_MAX_FILES || config->sectorSize == 0 )
+        return false;
+
+    PaymentHostFsClose();
+
+    fsConfig = *config;
+    fsEntriesNum = filesNum;
+    u32 offset = 0;
+    for( u16 i = 0; i < filesNum; ++i )
+    {
+        fsEntries[i].file = files[i];
+        fsEntries[i].offset = offset;
+
+        offset += (u32)files[i].records * ( files[i].recordLen + 1 );
+        offset = ( ( offset + fsConfig.sectorSize - 1 ) / fsConfig.sectorSize ) * fsConfig.sectorSize;
+    }
+    fsImageLen = ( offset == 0 ) ? fsConfig.sectorSize : offset;
+
+    fsFd = open( path, O_RDWR | O_CREAT, 0644 );
+    if( fsFd < 0 )
+        return false;
+
+    bool isNew = ( lseek( fsFd, 0, SEEK_END ) != (off_t)fsImageLen );
+    if( isNew && ftruncate( fsFd, fsImageLen ) != 0 )
+    {
+        PaymentHostFsClose();
+        return false;
+    }
+
+    void* image = mmap( NULL, fsImageLen, PROT_READ | PROT_WRITE, MAP_SHARED, fsFd, 0 );
+    if( image == MAP_FAILED )
+    {
+        PaymentHostFsClose();
+        return false;
+    }
+    fsImage = (u8*)image;
+
+    if( isNew )
+        PaymentHostFsFormat();
+
+    PaymentHostFsPowerOn();
+    PaymentHostFsResetStats();
+    return true;
+}
+
+void PaymentHostFsClose()
+{
+    if( fsImage != NULL )
+    {
+        msync( fsImage, fsImageLen, MS_SYNC );
+        munmap( fsImage, fsImageLen );
+        fsImage = NULL;
+    }
+
+    if( fsFd >= 0 )
+    {
+        close( fsFd );
+        fsFd = -1;
+    }
+}
+
+/* The erase is not counted in the statistics, it is the preparing of the image */
+void PaymentHostFsFormat()
+{
+    if( fsImage != NULL )
+        memset( fsImage, RECORD_ERASED, fsImageLen );
+}
+
+void PaymentHostFsSetPowerCut( u64 bytesFromNow )
+{
+    fsBytesToPowerCut = bytesFromNow;
+}
+
+bool PaymentHostFsIsPowerLost()
+{
+    return fsPowerLost;
+}
+
+/* The restart of the meter: the harness creates the objects again and calls Init() */
+void PaymentHostFsPowerOn()
+{
+    fsPowerLost = false;
+    fsBytesToPowerCut = PAYMENT_HOST_FS_NO_POWER_CUT;
+}
+
+const PaymentHostFsStats* PaymentHostFsGetStats()
+{
+    return &fsStats;
+}
+
+void PaymentHostFsResetStats()
+{
+    memset( &fsStats, 0, sizeof( fsStats ) );
+}
+
+/* File functions of the port */
+
+u16 PaymentPortFileRead( u16 ftId, void* dst, u16 len )
+{
+    const PaymentHostFsEntry* entry = findEntry( ftId );
+    if( fsImage != NULL && entry != NULL && entry->file.records > 1 )
+        return readBlock( entry, dst, len );
+
+    return readRecord( ftId, 0, dst, len );
+}
+
+void PaymentPortFileWrite( u16 ftId, const void* src, u16 len )
+{
+    writeRecord( ftId, 0, src, len );
+}
+
+u16 PaymentPortFileIndexRead( u16 ftId, u16 index, void* dst, u16 len )
+{
+    return readRecord( ftId, index, dst, len );
+}
+
+void PaymentPortFileIndexWrite( u16 ftId, u16 index, const void* src, u16 len )
+{
+    writeRecord( ftId, index, src, len );
+}
+
+#endif // PAYMENT_HOST_BUILD && PAYMENT_HOST_FS
@@ -0,0 +1,69 @@
+/*
+    \file PaymentHostFs.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+/*
+Emulator of ExportFs for the host build (PAYMENT_HOST_BUILD and PAYMENT_HOST_FS).
+It implements the file functions of the port over a memory mapped file, so the contents survive
+the restart of the harness process and the same image may be opened by the next run to check Init().
+The harness gives the table of the files: every record is placed with one state byte in front of it,
+the record which was never written is read with length 0 as in ExportFs. Every file starts at the sector.
+The flash timing is simulated, not waited: every write costs writeLatencyNs and writeByteNs per byte,
+and eraseSectorNs for every sector in which the bits must go from 0 to 1 (NOR flash).
+The power cut is armed at the byte offset in the stream of the written bytes: the write which crosses it
+is torn at this byte and all later writes are lost until PaymentHostFsPowerOn().
+The state is kept per thread (see PAYMENT_THREAD_LOCAL), every worker opens its own image.
+*/
+
+#if !defined _PAYMENT_HOST_FS_
+#define _PAYMENT_HOST_FS_
+
+#include "config.h"
+#include "CommonTypes.h"
+
+#if defined PAYMENT_HOST_BUILD && defined PAYMENT_HOST_FS
+
+#ifndef PAYMENT_HOST_FS_MAX_FILES
+#define PAYMENT_HOST_FS_MAX_FILES               96
+#endif
+
+static const u64 PAYMENT_HOST_FS_NO_POWER_CUT           = 0xFFFFFFFFFFFFFFFFULL;
+
+typedef struct{
+    u16         ftId;
+    u16         recordLen;
+    u16         records;                        // 1 for the not indexed file
+} PaymentHostFsFile;
+
+typedef struct{
+    u32         sectorSize;
+    u32         writeLatencyNs;                 // per write operation
+    u32         writeByteNs;                    // per written byte
+    u32         eraseSectorNs;                  // per erased sector
+} PaymentHostFsConfig;
+
+typedef struct{
+    u64         writes;
+    u64         bytes;
+    u64         erasedSectors;
+    u64         busyNs;                         // simulated time of the writes and erases
+    u32         unknownFiles;                   // accesses to the files which are not in the table
+    u32         powerCuts;
+} PaymentHostFsStats;
+
+bool PaymentHostFsOpen( const char* path, const PaymentHostFsFile* files, u16 filesNum, const PaymentHostFsConfig* config );
+void PaymentHostFsClose();
+void PaymentHostFsFormat();
+void PaymentHostFsSetPowerCut( u64 bytesFromNow );
+bool PaymentHostFsIsPowerLost();
+void PaymentHostFsPowerOn();
+const PaymentHostFsStats* PaymentHostFsGetStats();
+void PaymentHostFsResetStats();
+
+#endif // PAYMENT_HOST_BUILD && PAYMENT_HOST_FS
+
+#endif // _PAYMENT_HOST_FS_
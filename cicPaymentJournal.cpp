@@ -0,0 +1,311 @@
+/*
+    \file PaymentJournal.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+#include "cicPaymentJournal.h"
+
+#ifdef PAYMENT_JOURNAL
+
+static PAYMENT_THREAD_LOCAL PaymentJournalContext defaultJournal = { 1 };
+static PAYMENT_THREAD_LOCAL PaymentJournalContext* currentJournal = &defaultJournal;
+
+void PaymentJournalInitContext( PaymentJournalContext* context )
+{
+    memset( context, 0, sizeof( *context ) );
+    context->tailSeq = 1;
+}
+
+/* NULL returns to the default journal */
+void PaymentJournalSelect( PaymentJournalContext* context )
+{
+    currentJournal = ( context != NULL ) ? context : &defaultJournal;
+}
+
+/* The function returns the length of the valid record or 0 */
+static u16 readRecord( u32 seq, BYTE (*record)[PAYMENT_JOURNAL_RECORD_LEN] )
+{
+    u16 len = PaymentFileIndexRead( ftPaymentJournal_Record, seq % PAYMENT_JOURNAL_RECORDS, record );
+    if( len < sizeof( PaymentJournalHeader ) + sizeof( u32 ) )
+        return 0;
+
+    PaymentJournalHeader header;
+    memcpy( &header, *record, sizeof( header ) );
+    if( header.seq != seq || header.len > len || header.len < sizeof( header ) + sizeof( u32 ) )
+        return 0;
+
+    u32 crc;
+    memcpy( &crc, &( *record )[header.len - sizeof( u32 )], sizeof( crc ) );
+    if( crc != PaymentCrc32( *record, header.len - sizeof( u32 ) ) )
+        return 0;
+
+    return header.len;
+}
+
+/* The counters written directly to the port: the journal is the only writer of these files */
+static void writeCounter( const PaymentJournalCounterHeader* counter, const BYTE* data )
+{
+    PAYMENT_PROFILE_WRITE();
+#ifdef PAYMENT_RECORD_CRC
+    PaymentRecord record;
+    u16 slot = PaymentRecordPrepare( counter->ftId, ( counter->index == PAYMENT_JOURNAL_NOT_INDEXED ) ? 0 : counter->index, data, counter->len, &record );
+    PAYMENT_WRITE_STATS_RECORD( counter->ftId, slot, sizeof( record ) );
+    PaymentPortFileIndexWrite( counter->ftId, slot, &record, sizeof( record ) );
+#else
+    PAYMENT_WRITE_STATS_RECORD( counter->ftId, ( counter->index == PAYMENT_JOURNAL_NOT_INDEXED ) ? PAYMENT_WRITE_STATS_NOT_INDEXED : counter->index, counter->len );
+    if( counter->index == PAYMENT_JOURNAL_NOT_INDEXED )
+        PaymentPortFileWrite( counter->ftId, data, counter->len );
+    else
+        PaymentPortFileIndexWrite( counter->ftId, counter->index, data, counter->len );
+#endif // PAYMENT_RECORD_CRC
+}
+
+static PaymentJournalLive* findLive( u16 ftId, u8 index )
+{
+    for( u8 i = 0; i < currentJournal->liveCountersNum; ++i )
+    {
+        if( currentJournal->liveCounters[i].ftId == ftId && currentJournal->liveCounters[i].index == index )
+            return &currentJournal->liveCounters[i];
+    }
+    return NULL;
+}
+
+/*
+The function marks the counter as written by the record. If the table is full the counter is written
+to its file at once, so the retiring of the older records may skip it.
+*/
+static void setLive( const PaymentJournalCounterHeader* counter, const BYTE* data, u32 seq )
+{
+    PaymentJournalLive* live = findLive( counter->ftId, counter->index );
+    if( live == NULL && currentJournal->liveCountersNum < PAYMENT_JOURNAL_COUNTERS )
+    {
+        live = &currentJournal->liveCounters[currentJournal->liveCountersNum++];
+        live->ftId = counter->ftId;
+        live->index = counter->index;
+    }
+
+    if( live != NULL )
+        live->seq = seq;
+    else
+        writeCounter( counter, data );
+}
+
+/* The function takes the next counter of the valid record, pos starts at sizeof( PaymentJournalHeader ) */
+static const BYTE* nextCounter( const BYTE* record, u16 len, u16* pos, PaymentJournalCounterHeader* counter )
+{
+    if( *pos + sizeof( *counter ) > len - sizeof( u32 ) )
+        return NULL;
+
+    memcpy( counter, &record[*pos], sizeof( *counter ) );
+    if( counter->len > PAYMENT_JOURNAL_DATA_LEN || *pos + sizeof( *counter ) + counter->len > len - sizeof( u32 ) )
+        return NULL;
+
+    const BYTE* data = &record[*pos + sizeof( *counter )];
+    *pos += sizeof( *counter ) + counter->len;
+    return data;
+}
+
+/*
+The function writes the counters of the oldest record which have no newer records to their files.
+Only this record is read, the newer ones are known from the table of the live counters.
+*/
+static void retireTail()
+{
+    BYTE record[PAYMENT_JOURNAL_RECORD_LEN];
+    u32 seq = currentJournal->tailSeq++;
+    u16 len = readRecord( seq, &record );
+    if( len == 0 )
+        return;
+
+    u16 pos = sizeof( PaymentJournalHeader );
+    PaymentJournalCounterHeader counter;
+    while( const BYTE* data = nextCounter( record, len, &pos, &counter ) )
+    {
+        PaymentJournalLive* live = findLive( counter.ftId, counter.index );
+        if( live == NULL || live->seq != seq )
+            continue;
+
+        writeCounter( &counter, data );
+        *live = currentJournal->liveCounters[--currentJournal->liveCountersNum];
+    }
+}
+
+/*
+The function finds the last record of the ring: the valid record with the greatest sequence number.
+Torn record (power fail during the append) has wrong CRC and is not taken.
+*/
+static void findHead()
+{
+    BYTE record[PAYMENT_JOURNAL_RECORD_LEN];
+
+    currentJournal->headSeq = currentJournal->checkpointSeq;
+    for( u16 slot = 0; slot < PAYMENT_JOURNAL_RECORDS; ++slot )
+    {
+        if( PaymentFileIndexRead( ftPaymentJournal_Record, slot, &record ) < sizeof( PaymentJournalHeader ) )
+            continue;
+
+        PaymentJournalHeader header;
+        memcpy( &header, record, sizeof( header ) );
+        if( header.seq > currentJournal->headSeq && header.seq % PAYMENT_JOURNAL_RECORDS == slot && readRecord( header.seq, &record ) != 0 )
+            currentJournal->headSeq = header.seq;
+    }
+
+    currentJournal->tailSeq = currentJournal->checkpointSeq + 1;
+    if( currentJournal->headSeq >= PAYMENT_JOURNAL_RECORDS && currentJournal->tailSeq < currentJournal->headSeq - PAYMENT_JOURNAL_RECORDS + 1 )
+        currentJournal->tailSeq = currentJournal->headSeq - PAYMENT_JOURNAL_RECORDS + 1;
+}
+
+/* The function is called at the start by PaymentRecover(), only the first call works */
+void PaymentJournalInit()
+{
+    if( currentJournal->journalInitialized )
+        return;
+    currentJournal->journalInitialized = true;
+
+#ifdef PAYMENT_TRANSACTION
+    PaymentTransactionRecover();                // the log may hold the newest record of the ring
+#endif // PAYMENT_TRANSACTION
+
+    if( PaymentFileRead( ftPaymentJournal_CheckpointSeq, &currentJournal->checkpointSeq ) != sizeof( currentJournal->checkpointSeq ) )
+        currentJournal->checkpointSeq = 0;
+
+    findHead();
+
+    BYTE record[PAYMENT_JOURNAL_RECORD_LEN];
+    for( u32 seq = currentJournal->tailSeq; seq <= currentJournal->headSeq; ++seq )
+    {
+        u16 len = readRecord( seq, &record );
+        if( len == 0 )
+            continue;
+
+        u16 pos = sizeof( PaymentJournalHeader );
+        PaymentJournalCounterHeader counter;
+        while( const BYTE* data = nextCounter( record, len, &pos, &counter ) )
+            setLive( &counter, data, seq );
+    }
+
+    PaymentJournalCompact();
+}
+
+/* The ring is read again from the file, the record which was not written is forgotten */
+void PaymentJournalReload()
+{
+    PaymentJournalInitContext( currentJournal );
+    PaymentJournalInit();
+}
+
+void PaymentJournalBegin()
+{
+    if( currentJournal->journalDepth++ != 0 )
+        return;
+
+    currentJournal->journalLen = sizeof( PaymentJournalHeader );
+    currentJournal->journalCounters = 0;
+}
+
+/*
+The later write of the same counter replaces its value in the record.
+The counter which has no place in the record (the flush is larger than PAYMENT_JOURNAL_RECORD_LEN)
+starts the next record.
+*/
+void PaymentJournalAppend( u16 ftId, u8 index, const void* data, u8 len )
+{
+    if( len > PAYMENT_JOURNAL_DATA_LEN )
+        return;
+
+    if( currentJournal->journalDepth == 0 )
+    {
+        PaymentJournalBegin();
+        PaymentJournalAppend( ftId, index, data, len );
+        PaymentJournalCommit();
+        return;
+    }
+
+    u16 pos = sizeof( PaymentJournalHeader );
+    while( pos < currentJournal->journalLen )
+    {
+        PaymentJournalCounterHeader counter;
+        memcpy( &counter, &currentJournal->journalRecord[pos], sizeof( counter ) );
+        pos += sizeof( counter );
+
+        if( counter.ftId == ftId && counter.index == index && counter.len == len )
+        {
+            memcpy( &currentJournal->journalRecord[pos], data, len );
+            return;
+        }
+
+        pos += counter.len;
+    }
+
+    if( currentJournal->journalLen + sizeof( PaymentJournalCounterHeader ) + len + sizeof( u32 ) > PAYMENT_JOURNAL_RECORD_LEN )
+    {
+        u8 depth = currentJournal->journalDepth;
+        currentJournal->journalDepth = 1;
+        PaymentJournalCommit();
+        PaymentJournalBegin();
+        currentJournal->journalDepth = depth;
+    }
+
+    PaymentJournalCounterHeader counter = { ftId, index, len };
+    memcpy( &currentJournal->journalRecord[currentJournal->journalLen], &counter, sizeof( counter ) );
+    currentJournal->journalLen += sizeof( counter );
+    memcpy( &currentJournal->journalRecord[currentJournal->journalLen], data, len );
+    currentJournal->journalLen += len;
+    ++currentJournal->journalCounters;
+}
+
+/* The oldest record is retired before its slot is overwritten by the new one */
+void PaymentJournalCommit()
+{
+    if( currentJournal->journalDepth == 0 || --currentJournal->journalDepth != 0 )
+        return;
+
+    if( currentJournal->journalCounters == 0 )
+        return;
+
+    while( currentJournal->headSeq + 1 - currentJournal->tailSeq >= PAYMENT_JOURNAL_RECORDS )
+        retireTail();
+
+    PaymentJournalHeader header;
+    header.seq = currentJournal->headSeq + 1;
+    header.len = currentJournal->journalLen + sizeof( u32 );
+    header.counters = currentJournal->journalCounters;
+    memcpy( currentJournal->journalRecord, &header, sizeof( header ) );
+
+    u32 crc = PaymentCrc32( currentJournal->journalRecord, currentJournal->journalLen );
+    memcpy( &currentJournal->journalRecord[currentJournal->journalLen], &crc, sizeof( crc ) );
+
+    PaymentFileIndexWriteBuffer( ftPaymentJournal_Record, header.seq % PAYMENT_JOURNAL_RECORDS, currentJournal->journalRecord, header.len );
+    currentJournal->headSeq = header.seq;
+
+    u16 pos = sizeof( PaymentJournalHeader );
+    PaymentJournalCounterHeader counter;
+    while( const BYTE* data = nextCounter( currentJournal->journalRecord, header.len, &pos, &counter ) )
+        setLive( &counter, data, header.seq );
+}
+
+/* The function retires all live records and moves the checkpoint to the head */
+void PaymentJournalCompact()
+{
+    if( currentJournal->headSeq == currentJournal->checkpointSeq )
+        return;
+
+    while( currentJournal->tailSeq <= currentJournal->headSeq )
+        retireTail();
+    currentJournal->liveCountersNum = 0;
+
+    currentJournal->checkpointSeq = currentJournal->headSeq;
+    PAYMENT_WRITE_STATS_RECORD( ftPaymentJournal_CheckpointSeq, PAYMENT_WRITE_STATS_NOT_INDEXED, sizeof( currentJournal->checkpointSeq ) );
+    PAYMENT_PROFILE_WRITE();
+    PaymentPortFileWrite( ftPaymentJournal_CheckpointSeq, &currentJournal->checkpointSeq, sizeof( currentJournal->checkpointSeq ) );
+}
+
+u32 PaymentJournalGetLiveRecords()
+{
+    return currentJournal->headSeq + 1 - currentJournal->tailSeq;
+}
+
+#endif // PAYMENT_JOURNAL
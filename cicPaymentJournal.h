@@ -0,0 +1,179 @@
+/*
+    \file PaymentJournal.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+/*
+Journal of the money counters of the Payment objects (PAYMENT_JOURNAL).
+Instead of the rewriting of the fixed files of the counters the changes are appended as records
+with the sequence number and CRC32 to the ring of the records in the file ftPaymentJournal_Record,
+so the writes are spread over the whole ring. The counters written between PaymentJournalBegin()
+and PaymentJournalCommit() (the flush of the account) go to one record, the counter written outside
+is the record of its own.
+The fixed files of the counters are the checkpoint. Before the oldest record is overwritten by the ring
+it is retired: its counters which have no newer record are written to their fixed files, the newest record
+of every counter is kept in RAM, so the retiring does not read the other records.
+At the start all live records are applied to the fixed files and the sequence number of the checkpoint
+is saved in ftPaymentJournal_CheckpointSeq, so Init() of the objects reads the fixed files as before.
+The record written by the token is a file of its transaction (PAYMENT_TRANSACTION), so the log is
+recovered before the ring is read.
+With PAYMENT_RECORD_CRC the counters are written to the fixed files as the CRC protected records (cicPaymentRecord).
+Every simulated meter of the host build has its own journal: the harness keeps a context per meter
+and selects it before running the objects of this meter, the selection is per thread.
+*/
+
+#if !defined _PAYMENT_JOURNAL_
+#define _PAYMENT_JOURNAL_
+
+#include "config.h"
+#include "CommonTypes.h"
+#include "cicPaymentPort.h"
+#include "cicPaymentCrc.h"
+#include "cicPaymentRecord.h"
+
+#ifndef PAYMENT_JOURNAL_RECORDS
+#define PAYMENT_JOURNAL_RECORDS                 32      // records in the ring
+#endif
+
+#ifndef PAYMENT_JOURNAL_RECORD_LEN
+#define PAYMENT_JOURNAL_RECORD_LEN              128     // 1 credit and 1 charge with all tariffs, checked in cicPayment.cpp
+#endif
+
+#ifndef PAYMENT_JOURNAL_COUNTERS
+#define PAYMENT_JOURNAL_COUNTERS                32      // counters with the live records, checked in cicPayment.cpp
+#endif
+
+static const uint8_t PAYMENT_JOURNAL_DATA_LEN           = 8;        // the longest counter is u64
+static const uint8_t PAYMENT_JOURNAL_NOT_INDEXED        = 0xFF;     // index of the record of the not indexed file
+
+typedef __packed struct{
+    u32         seq;
+    u16         len;                            // header, counters and CRC
+    u16         counters;
+} PaymentJournalHeader;
+
+typedef __packed struct{
+    u16         ftId;
+    u8          index;
+    u8          len;
+} PaymentJournalCounterHeader;
+
+#ifdef PAYMENT_JOURNAL
+
+/* The newest record of the counter which is not in its fixed file yet */
+typedef struct{
+    u16         ftId;
+    u8          index;
+    u32         seq;
+} PaymentJournalLive;
+
+typedef struct{
+    u32                 tailSeq;                // the oldest record which is not retired
+    u32                 headSeq;                // the last appended record
+    u32                 checkpointSeq;          // records up to this one are in the fixed files
+    PaymentJournalLive  liveCounters[PAYMENT_JOURNAL_COUNTERS];
+    u8                  liveCountersNum;
+    bool                journalInitialized;
+    BYTE                journalRecord[PAYMENT_JOURNAL_RECORD_LEN];     // the record filled by the open flush
+    u16                 journalLen;
+    u16                 journalCounters;
+    u8                  journalDepth;           // nested Begin() are joined into the outer record
+} PaymentJournalContext;
+
+void PaymentJournalInitContext( PaymentJournalContext* context );
+void PaymentJournalSelect( PaymentJournalContext* context );
+
+void PaymentJournalInit();
+void PaymentJournalReload();
+void PaymentJournalBegin();
+void PaymentJournalAppend( u16 ftId, u8 index, const void* data, u8 len );
+void PaymentJournalCommit();
+void PaymentJournalCompact();
+u32 PaymentJournalGetLiveRecords();
+
+#define PAYMENT_JOURNAL_BEGIN()                 PaymentJournalBegin()
+#define PAYMENT_JOURNAL_COMMIT()                PaymentJournalCommit()
+
+#else
+
+#define PAYMENT_JOURNAL_BEGIN()
+#define PAYMENT_JOURNAL_COMMIT()
+
+#endif // PAYMENT_JOURNAL
+
+/* Writing of the counter to its file: with PAYMENT_RECORD_CRC as the CRC protected copy, else as it is */
+template< typename T >
+inline void PaymentCounterFileWrite( u16 ftId, u8 index, const T* src )
+{
+#ifdef PAYMENT_RECORD_CRC
+    PaymentRecord record;
+    u16 slot = PaymentRecordPrepare( ftId, ( index == PAYMENT_JOURNAL_NOT_INDEXED ) ? 0 : index, src, sizeof( T ), &record );
+    PaymentFileIndexWrite( ftId, slot, &record );
+#else
+    if( index == PAYMENT_JOURNAL_NOT_INDEXED )
+        PaymentFileWrite( ftId, src );
+    else
+        PaymentFileIndexWrite( ftId, index, src );
+#endif // PAYMENT_RECORD_CRC
+}
+
+/*
+Writing of the counters: to the journal with PAYMENT_JOURNAL, else to the file.
+In the open transaction the record of the journal is staged with the other files of the token.
+*/
+template< typename T >
+inline void PaymentCounterIndexWrite( u16 ftId, u8 index, const T* src )
+{
+#ifdef PAYMENT_JOURNAL
+    PaymentJournalAppend( ftId, index, src, sizeof( T ) );
+#else
+    PaymentCounterFileWrite( ftId, index, src );
+#endif // PAYMENT_JOURNAL
+}
+
+template< typename T >
+inline void PaymentCounterWrite( u16 ftId, const T* src )
+{
+    PaymentCounterIndexWrite( ftId, PAYMENT_JOURNAL_NOT_INDEXED, src );
+}
+
+/*
+Reading of the counters in Init(), returns 0 if the counter was not written or all its copies are broken.
+With PAYMENT_RECORD_CRC the indexed counters must be read from the last index, see cicPaymentRecord.h.
+*/
+template< typename T >
+inline u16 PaymentCounterIndexRead( u16 ftId, u8 index, T* dst )
+{
+#ifdef PAYMENT_RECORD_CRC
+    bool indexed = ( index != PAYMENT_JOURNAL_NOT_INDEXED );
+    return PaymentRecordRead( ftId, indexed ? index : 0, indexed, dst, sizeof( T ) );
+#else
+    if( index == PAYMENT_JOURNAL_NOT_INDEXED )
+        return PaymentFileRead( ftId, dst );
+    return PaymentFileIndexRead( ftId, index, dst );
+#endif // PAYMENT_RECORD_CRC
+}
+
+template< typename T >
+inline u16 PaymentCounterRead( u16 ftId, T* dst )
+{
+    return PaymentCounterIndexRead( ftId, PAYMENT_JOURNAL_NOT_INDEXED, dst );
+}
+
+/*
+The counter is not on the flash yet if its file or, with PAYMENT_JOURNAL, any record of the journal
+is in the write queue (PAYMENT_WRITE_QUEUE). Used by the emergency flush instead of the draining.
+*/
+inline bool PaymentCounterIsQueued( u16 ftId )
+{
+#ifdef PAYMENT_JOURNAL
+    if( PAYMENT_WRITE_QUEUE_HAS_FILE( ftPaymentJournal_Record ) )
+        return true;
+#endif // PAYMENT_JOURNAL
+    return PAYMENT_WRITE_QUEUE_HAS_FILE( ftId );
+}
+
+#endif // _PAYMENT_JOURNAL_
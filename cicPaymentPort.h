@@ -0,0 +1,233 @@
+/*
+    \file PaymentPort.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+/*
+Platform layer of the Payment objects.
+All accesses of the Payment classes to the storage (ExportFs), to the clock,
+to the registers and to the disconnector are done only through these functions.
+On the meter they are thin wrappers over the firmware services.
+In the host build (PAYMENT_HOST_BUILD) the same functions are implemented by the harness
+with in-memory stand-ins, so the Payment classes are compiled unchanged.
+*/
+
+#if !defined _PAYMENT_PORT_
+#define _PAYMENT_PORT_
+
+/*
+State of the simulation helpers (profiling, write statistics, selected clock) is kept per thread
+in the host build, so the harness may tick different meters on different cores.
+Every worker reads its own counters and merges them into the totals at the end of the run.
+*/
+#ifdef PAYMENT_HOST_BUILD
+#define PAYMENT_THREAD_LOCAL    thread_local
+#else
+#define PAYMENT_THREAD_LOCAL
+#endif
+
+#include "config.h"
+#include "CommonTypes.h"
+#include "cicClock.h"               // date/time conversions
+#include "ExportFs.h"               // ft* identifiers of the file table
+#include "cicPaymentWriteStats.h"
+#include "cicPaymentProfile.h"
+#include "cicPaymentSnapshot.h"
+#include "cicPaymentTransaction.h"
+#include "cicPaymentEmergency.h"
+#include "cicPaymentWriteQueue.h"
+
+#ifndef PAYMENT_HOST_BUILD
+
+#include "cicDC.h"
+#include "apduTask.h"
+
+/*
+Length of the file is known from the file table, so len is not used on the meter.
+The indexed file is read as one block of all its records.
+*/
+inline u16 PaymentPortFileRead( u16 ftId, void* dst, u16 len )
+{
+    return FileRead( ftId, dst );
+}
+
+inline void PaymentPortFileWrite( u16 ftId, const void* src, u16 len )
+{
+    FileWrite( ftId, (void*)src );
+}
+
+inline u16 PaymentPortFileIndexRead( u16 ftId, u16 index, void* dst, u16 len )
+{
+    return FileIndexRead( ftId, index, dst );
+}
+
+inline void PaymentPortFileIndexWrite( u16 ftId, u16 index, const void* src, u16 len )
+{
+    FileIndexWrite( ftId, index, (void*)src );
+}
+
+inline void PaymentPortInternalGetRequest( u16 classId, const LOGICAL_NAME* ln, u8 attrId, BYTE* bufResponse )
+{
+    InternalGetRequest( classId, ln, attrId, NULL, bufResponse );
+}
+
+inline bool PaymentPortGetRelayState()
+{
+    return cicDisconnectorControlBase.GetOutputState();
+}
+
+inline void PaymentPortDisconnectRelay()
+{
+    cicDisconnectorControlBase.ActionLocalDisconnect();
+}
+
+inline void PaymentPortReconnectRelay()
+{
+    cicDisconnectorControlBase.ActionLocalReconnect();
+}
+
+#ifdef PAYMENT_WRITE_QUEUE
+#include <intrinsics.h>
+
+/* The write queue is shared by the tick and the writer context, the sections are short and not nested */
+inline void PaymentPortEnterCritical()
+{
+    __disable_interrupt();
+}
+
+inline void PaymentPortExitCritical()
+{
+    __enable_interrupt();
+}
+#endif // PAYMENT_WRITE_QUEUE
+
+#ifdef PAYMENT_PROFILING
+/* DWT cycle counter of the Cortex-M core (DWT->CYCCNT). Must be enabled by the startup code. */
+inline u32 PaymentPortGetCycles()
+{
+    return *(volatile u32*)0xE0001004;
+}
+
+/* The core has no retired instructions counter */
+inline u32 PaymentPortGetInstructions()
+{
+    return 0;
+}
+#endif // PAYMENT_PROFILING
+
+#else // PAYMENT_HOST_BUILD
+
+/*
+Implemented by the host harness (in-memory file table, simulated clock, registers and relay).
+With PAYMENT_HOST_FS the file functions are implemented by the flash emulator cicPaymentHostFs.
+PaymentPortFileRead() of the indexed file returns its records as one block as on the meter,
+the records which were never written are erased (0xFF).
+*/
+u16 PaymentPortFileRead( u16 ftId, void* dst, u16 len );
+void PaymentPortFileWrite( u16 ftId, const void* src, u16 len );
+u16 PaymentPortFileIndexRead( u16 ftId, u16 index, void* dst, u16 len );
+void PaymentPortFileIndexWrite( u16 ftId, u16 index, const void* src, u16 len );
+void PaymentPortInternalGetRequest( u16 classId, const LOGICAL_NAME* ln, u8 attrId, BYTE* bufResponse );
+bool PaymentPortGetRelayState();
+void PaymentPortDisconnectRelay();
+void PaymentPortReconnectRelay();
+#ifdef PAYMENT_WRITE_QUEUE
+void PaymentPortEnterCritical();
+void PaymentPortExitCritical();
+#endif // PAYMENT_WRITE_QUEUE
+#ifdef PAYMENT_PROFILING
+u32 PaymentPortGetCycles();
+u32 PaymentPortGetInstructions();
+#endif // PAYMENT_PROFILING
+
+#endif // PAYMENT_HOST_BUILD
+
+#if defined PAYMENT_VIRTUAL_CLOCK
+/* Time of the Payment objects is driven by the simulation clock (soak tests, host harness) */
+#include "cicPaymentClock.h"
+
+inline void PaymentPortGetLocalTime( TDateTime* dateTime )
+{
+    PaymentVirtualClockGetLocalTime( dateTime );
+}
+#elif !defined PAYMENT_HOST_BUILD
+inline void PaymentPortGetLocalTime( TDateTime* dateTime )
+{
+    GetLocalTime_APDU( dateTime );
+}
+#else
+void PaymentPortGetLocalTime( TDateTime* dateTime );
+#endif // PAYMENT_VIRTUAL_CLOCK
+
+/*
+Typed access to the files. Length of the record is taken from the type of the value,
+for the buffers pass the address of the whole array ( &buf ).
+*/
+template< typename T >
+inline u16 PaymentFileRead( u16 ftId, T* dst )
+{
+    u16 queuedLen = 0;
+    if( PAYMENT_WRITE_QUEUE_READ( ftId, PAYMENT_WRITE_QUEUE_NOT_INDEXED, dst, sizeof( T ), &queuedLen ) )
+        return queuedLen;                       // the newer data is still in the queue
+    u16 fileLen = PaymentPortFileRead( ftId, dst, sizeof( T ) );
+    return PAYMENT_WRITE_QUEUE_READ_BLOCK( ftId, dst, sizeof( T ), fileLen );     // the queued records of the indexed file
+}
+
+template< typename T >
+inline void PaymentFileWrite( u16 ftId, const T* src )
+{
+    if( PAYMENT_TRANSACTION_STAGE( ftId, PAYMENT_TRANSACTION_NOT_INDEXED, src, sizeof( T ) ) )
+        return;                                 // written at the commit
+    PAYMENT_PROFILE_WRITE();
+    PAYMENT_EMERGENCY_TOUCH();
+#ifdef PAYMENT_WRITE_QUEUE
+    static_assert( sizeof( T ) <= PAYMENT_WRITE_QUEUE_DATA_LEN, "the file is longer than the record of the write queue" );
+#endif // PAYMENT_WRITE_QUEUE
+    if( PAYMENT_WRITE_QUEUE_POST( ftId, PAYMENT_WRITE_QUEUE_NOT_INDEXED, src, sizeof( T ) ) )
+        return;                                 // written by the writer context
+    PAYMENT_WRITE_STATS_RECORD( ftId, PAYMENT_WRITE_STATS_NOT_INDEXED, sizeof( T ) );
+    PaymentPortFileWrite( ftId, src, sizeof( T ) );
+}
+
+template< typename T >
+inline u16 PaymentFileIndexRead( u16 ftId, u16 index, T* dst )
+{
+    u16 queuedLen = 0;
+    if( PAYMENT_WRITE_QUEUE_READ( ftId, index, dst, sizeof( T ), &queuedLen ) )
+        return queuedLen;                       // the newer data is still in the queue
+    return PaymentPortFileIndexRead( ftId, index, dst, sizeof( T ) );
+}
+
+template< typename T >
+inline void PaymentFileIndexWrite( u16 ftId, u16 index, const T* src )
+{
+    if( PAYMENT_TRANSACTION_STAGE( ftId, index, src, sizeof( T ) ) )
+        return;                                 // written at the commit
+    PAYMENT_PROFILE_WRITE();
+    PAYMENT_EMERGENCY_TOUCH();
+#ifdef PAYMENT_WRITE_QUEUE
+    static_assert( sizeof( T ) <= PAYMENT_WRITE_QUEUE_DATA_LEN, "the file is longer than the record of the write queue" );
+#endif // PAYMENT_WRITE_QUEUE
+    if( PAYMENT_WRITE_QUEUE_POST( ftId, index, src, sizeof( T ) ) )
+        return;                                 // written by the writer context
+    PAYMENT_WRITE_STATS_RECORD( ftId, index, sizeof( T ) );
+    PaymentPortFileIndexWrite( ftId, index, src, sizeof( T ) );
+}
+
+/* Writing of the record of the variable length: only the used part of the buffer is written */
+inline void PaymentFileIndexWriteBuffer( u16 ftId, u16 index, const void* src, u16 len )
+{
+    if( PAYMENT_TRANSACTION_STAGE( ftId, index, src, len ) )
+        return;                                 // written at the commit
+    PAYMENT_PROFILE_WRITE();
+    PAYMENT_EMERGENCY_TOUCH();
+    if( PAYMENT_WRITE_QUEUE_POST( ftId, index, src, len ) )
+        return;                                 // written by the writer context
+    PAYMENT_WRITE_STATS_RECORD( ftId, index, len );
+    PaymentPortFileIndexWrite( ftId, index, src, len );
+}
+
+#endif // _PAYMENT_PORT_
@@ -0,0 +1,288 @@
+/*
+    \file PaymentProfile.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+#include "cicPaymentProfile.h"
+
+#ifdef PAYMENT_PROFILING
+
+#include "cicPaymentPort.h"
+#include "core.h"
+#include <string.h>
+
+static PAYMENT_THREAD_LOCAL PaymentProfileStats profileStats[PaymentProfileScenariosNum][PaymentProfileStagesNum];
+static PAYMENT_THREAD_LOCAL PaymentProfileScenario currentScenario = PaymentProfileSteadyState;
+static PAYMENT_THREAD_LOCAL PaymentProfileTokenStats tokenStats;
+static PAYMENT_THREAD_LOCAL u32 writesCounter = 0;
+static PAYMENT_THREAD_LOCAL PaymentProfileCodecStats codecStats[PaymentProfileCodecClassesNum][PaymentProfileCodecDirectionsNum][PAYMENT_PROFILE_CODEC_ATTRS + 1];
+
+static u16 latencyBucket( u32 cycles )
+{
+    if( cycles < PAYMENT_PROFILE_LATENCY_SUB_BUCKETS )
+        return (u16)cycles;
+
+    u8 msb = 31;
+    while( ( cycles & ( 1UL << msb ) ) == 0 )
+        --msb;
+
+    /* octave of the msb and the next PAYMENT_PROFILE_LATENCY_SUB_BITS bits under it */
+    u8 shift = msb - PAYMENT_PROFILE_LATENCY_SUB_BITS;
+    return (u16)( ( ( shift + 1 ) << PAYMENT_PROFILE_LATENCY_SUB_BITS ) + ( ( cycles >> shift ) & ( PAYMENT_PROFILE_LATENCY_SUB_BUCKETS - 1 ) ) );
+}
+
+/* Upper bound of the cycles which fall into the bucket */
+static u32 latencyBucketCycles( u16 bucket )
+{
+    if( bucket < PAYMENT_PROFILE_LATENCY_SUB_BUCKETS )
+        return bucket;
+
+    u8 shift = ( bucket >> PAYMENT_PROFILE_LATENCY_SUB_BITS ) - 1;
+    u64 base = (u64)( PAYMENT_PROFILE_LATENCY_SUB_BUCKETS + ( bucket & ( PAYMENT_PROFILE_LATENCY_SUB_BUCKETS - 1 ) ) ) << shift;
+    u64 upper = base + ( 1ULL << shift ) - 1;
+
+    return ( upper > 0xFFFFFFFF ) ? 0xFFFFFFFF : (u32)upper;
+}
+
+void PaymentProfileSetScenario( PaymentProfileScenario scenario )
+{
+    currentScenario = scenario;
+}
+
+void PaymentProfileBegin( PaymentProfileProbe* probe )
+{
+    probe->startWrites = writesCounter;
+    probe->startInstructions = PaymentPortGetInstructions();
+    probe->startCycles = PaymentPortGetCycles();
+}
+
+void PaymentProfileEnd( PaymentProfileStage stage, const PaymentProfileProbe* probe )
+{
+    u32 cycles = PaymentPortGetCycles() - probe->startCycles;          // unsigned difference is correct after counter overflow
+    u32 instructions = PaymentPortGetInstructions() - probe->startInstructions;
+
+    PaymentProfileStats* stats = &profileStats[currentScenario][stage];
+    ++stats->calls;
+    stats->sumCycles += cycles;
+    stats->sumInstructions += instructions;
+    if( cycles > stats->maxCycles )
+        stats->maxCycles = cycles;
+}
+
+const PaymentProfileStats* PaymentProfileGetStats( PaymentProfileScenario scenario, PaymentProfileStage stage )
+{
+    return &profileStats[scenario][stage];
+}
+
+u32 PaymentProfileGetNsPerCall( PaymentProfileScenario scenario, PaymentProfileStage stage )
+{
+    const PaymentProfileStats* stats = &profileStats[scenario][stage];
+    if( stats->calls == 0 )
+        return 0;
+
+    u64 cyclesPerCall = stats->sumCycles / stats->calls;
+    return (u32)( ( cyclesPerCall * 1000000000ULL ) / PAYMENT_CPU_FREQ_HZ );
+}
+
+u32 PaymentProfileGetInstructionsPerCall( PaymentProfileScenario scenario, PaymentProfileStage stage )
+{
+    const PaymentProfileStats* stats = &profileStats[scenario][stage];
+    if( stats->calls == 0 )
+        return 0;
+
+    return (u32)( stats->sumInstructions / stats->calls );
+}
+
+/* The longest call of the stage in all scenarios */
+u32 PaymentProfileGetWorstNs( PaymentProfileStage stage )
+{
+    u32 maxCycles = 0;
+    for( u8 scenario = 0; scenario < PaymentProfileScenariosNum; ++scenario )
+    {
+        if( profileStats[scenario][stage].maxCycles > maxCycles )
+            maxCycles = profileStats[scenario][stage].maxCycles;
+    }
+
+    return (u32)( ( (u64)maxCycles * 1000000000ULL ) / PAYMENT_CPU_FREQ_HZ );
+}
+
+/* Adds the counters of the calling thread to total */
+void PaymentProfileAccumulate( PaymentProfileStats total[PaymentProfileScenariosNum][PaymentProfileStagesNum] )
+{
+    for( u8 scenario = 0; scenario < PaymentProfileScenariosNum; ++scenario )
+    {
+        for( u8 stage = 0; stage < PaymentProfileStagesNum; ++stage )
+        {
+            const PaymentProfileStats* stats = &profileStats[scenario][stage];
+            PaymentProfileStats* sum = &total[scenario][stage];
+
+            sum->calls += stats->calls;
+            sum->sumCycles += stats->sumCycles;
+            sum->sumInstructions += stats->sumInstructions;
+            if( stats->maxCycles > sum->maxCycles )
+                sum->maxCycles = stats->maxCycles;
+        }
+    }
+}
+
+void PaymentProfileReset()
+{
+    memset( profileStats, 0, sizeof( profileStats ) );
+    memset( &tokenStats, 0, sizeof( tokenStats ) );
+    memset( codecStats, 0, sizeof( codecStats ) );
+}
+
+void PaymentProfileCountWrite()
+{
+    ++writesCounter;
+}
+
+void PaymentProfileTokenEnd( const PaymentProfileProbe* probe )
+{
+    u32 cycles = PaymentPortGetCycles() - probe->startCycles;
+    u32 writes = writesCounter - probe->startWrites;
+
+    PaymentProfileEnd( PaymentProfileTokenEnter, probe );
+
+    ++tokenStats.tokens;
+    tokenStats.sumCycles += cycles;
+    tokenStats.sumWrites += writes;
+    if( writes > tokenStats.maxWrites )
+        tokenStats.maxWrites = writes;
+    ++tokenStats.histogram[latencyBucket( cycles )];
+}
+
+const PaymentProfileTokenStats* PaymentProfileGetTokenStats()
+{
+    return &tokenStats;
+}
+
+/* The function returns the latency not exceeded by permille/1000 of the tokens (500 - p50, 990 - p99) */
+u32 PaymentProfileGetTokenLatencyNs( u16 permille )
+{
+    if( tokenStats.tokens == 0 )
+        return 0;
+
+    u64 rank = ( (u64)tokenStats.tokens * permille + 999 ) / 1000;
+    if( rank == 0 )
+        rank = 1;
+
+    u64 count = 0;
+    for( u16 bucket = 0; bucket < PAYMENT_PROFILE_LATENCY_BUCKETS; ++bucket )
+    {
+        count += tokenStats.histogram[bucket];
+        if( count >= rank )
+            return (u32)( ( (u64)latencyBucketCycles( bucket ) * 1000000000ULL ) / PAYMENT_CPU_FREQ_HZ );
+    }
+
+    return 0xFFFFFFFF;
+}
+
+/* Tokens per second of the CPU time spent in the token path */
+u32 PaymentProfileGetTokensPerSecond()
+{
+    if( tokenStats.sumCycles == 0 )
+        return 0;
+
+    return (u32)( ( (u64)tokenStats.tokens * PAYMENT_CPU_FREQ_HZ ) / tokenStats.sumCycles );
+}
+
+u32 PaymentProfileGetWritesPer100Tokens()
+{
+    if( tokenStats.tokens == 0 )
+        return 0;
+
+    return (u32)( ( tokenStats.sumWrites * 100 ) / tokenStats.tokens );
+}
+
+/* Adds the token statistics of the calling thread to total */
+void PaymentProfileAccumulateTokens( PaymentProfileTokenStats* total )
+{
+    total->tokens += tokenStats.tokens;
+    total->sumCycles += tokenStats.sumCycles;
+    total->sumWrites += tokenStats.sumWrites;
+    if( tokenStats.maxWrites > total->maxWrites )
+        total->maxWrites = tokenStats.maxWrites;
+
+    for( u16 bucket = 0; bucket < PAYMENT_PROFILE_LATENCY_BUCKETS; ++bucket )
+        total->histogram[bucket] += tokenStats.histogram[bucket];
+}
+
+void PaymentProfileCodecEnd( PaymentProfileCodecClass codecClass, PaymentProfileCodecDirection direction, u8 attrID, u16 bytes, const PaymentProfileProbe* probe )
+{
+    u32 cycles = PaymentPortGetCycles() - probe->startCycles;
+
+    if( attrID >= PAYMENT_PROFILE_CODEC_ATTRS )
+        attrID = PAYMENT_PROFILE_CODEC_OTHER_ATTR;
+
+    PaymentProfileCodecStats* stats = &codecStats[codecClass][direction][attrID];
+    ++stats->calls;
+    stats->sumCycles += cycles;
+    stats->sumBytes += bytes;
+    if( cycles > stats->maxCycles )
+        stats->maxCycles = cycles;
+}
+
+const PaymentProfileCodecStats* PaymentProfileGetCodecStats( PaymentProfileCodecClass codecClass, PaymentProfileCodecDirection direction, u8 attrID )
+{
+    if( attrID >= PAYMENT_PROFILE_CODEC_ATTRS )
+        attrID = PAYMENT_PROFILE_CODEC_OTHER_ATTR;
+
+    return &codecStats[codecClass][direction][attrID];
+}
+
+u32 PaymentProfileGetCodecBytesPerSecond( PaymentProfileCodecClass codecClass, PaymentProfileCodecDirection direction, u8 attrID )
+{
+    const PaymentProfileCodecStats* stats = PaymentProfileGetCodecStats( codecClass, direction, attrID );
+    if( stats->sumCycles == 0 )
+        return 0;
+
+    return (u32)( ( stats->sumBytes * PAYMENT_CPU_FREQ_HZ ) / stats->sumCycles );
+}
+
+static u16 dataLength( const BYTE* buf, u16 len, u8 depth )
+{
+    if( len == 0 )
+        return 0;
+    
+    u16 dataLen;
+    switch( buf[0] )
+    {
+        case eDT_Array:
+        case eDT_Structure:
+            if( len < 2 || depth == PAYMENT_PROFILE_DATA_DEPTH )
+                return 1;
+            dataLen = 2;
+            for( u8 i = 0; i < buf[1] && dataLen < len; ++i )
+                dataLen += dataLength( &buf[dataLen], len - dataLen, depth + 1 );
+            break;
+        case eDT_OctetString:       dataLen = ( len < 2 ) ? len : 2 + buf[1]; break;
+        case eDT_BitString:         dataLen = ( len < 2 ) ? len : 2 + ( buf[1] + 7 ) / 8; break;
+        case eDT_Integer:
+        case eDT_Unsigned:
+        case eDT_Enum:              dataLen = 1 + eDTL_Unsigned; break;
+        case eDT_Long:
+        case eDT_LongUnsigned:      dataLen = 1 + eDTL_LongUnsigned; break;
+        case eDT_DoubleLong:
+        case eDT_DoubleLongUnsigned:dataLen = 1 + eDTL_DoubleLong; break;
+        case eDT_Long64Unsigned:    dataLen = 1 + eDTL_Long64Unsigned; break;
+        case eDT_DateTime:          dataLen = 1 + eDTL_DateTime; break;
+        default:                    dataLen = 1; break;
+    }
+    
+    return ( dataLen < len ) ? dataLen : len;
+}
+
+/*
+Length of the A-XDR data with its tag, the types of the requests of the Payment classes are known, others are counted by the tag.
+The request is not validated yet: the bytes after len are not read and the nesting is limited by PAYMENT_PROFILE_DATA_DEPTH.
+*/
+u16 PaymentProfileDataLength( const BYTE* buf, u16 len )
+{
+    return dataLength( buf, len, 0 );
+}
+
+#endif // PAYMENT_PROFILING
@@ -0,0 +1,197 @@
+/*
+    \file PaymentProfile.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+/*
+Measurement of the time spent by the Payment objects in the tick path.
+Compiled only with PAYMENT_PROFILING, otherwise all macros are empty.
+Counters come from the port: DWT cycle counter on the meter, the harness counters in the host build.
+In the host build the statistics are kept per thread (see PAYMENT_THREAD_LOCAL).
+Entering of the tokens is measured separately: every token is put in the latency histogram
+and the writes to the files done while the token is processed are counted.
+Get, Set and Action of every attribute (method) are measured per class and attribute with the encoded/decoded bytes.
+*/
+
+#if !defined _PAYMENT_PROFILE_
+#define _PAYMENT_PROFILE_
+
+#include "config.h"
+#include "CommonTypes.h"
+
+#ifndef PAYMENT_CPU_FREQ_HZ
+#define PAYMENT_CPU_FREQ_HZ     72000000UL
+#endif
+
+/* Measured stages of the tick */
+enum PaymentProfileStage{
+    PaymentProfileAccountIdleSecond             = 0,    // whole PaymentAccountClass::IdleSecond
+    PaymentProfileInvokeCredit,                         // InvokeHighestPriorityCreditToInUse
+    PaymentProfileExecuteCollection,                    // ExecuteCollection of all charges
+    PaymentProfileUpdateAccountValues,                  // six Update* passes
+    PaymentProfileManageCreditsStatuses,                // ManageCreditsStatuses
+    PaymentProfileRelayControl,                         // disconnector query and control
+    PaymentProfileCreditIdleSecond,                     // whole PaymentCreditClass::IdleSecond
+    PaymentProfileChargeIdleSecond,                     // whole PaymentChargeClass::IdleSecond
+    PaymentProfileChargeRegisterRead,                   // register access from the charge
+    PaymentProfileTokenEnter,                           // whole Action( PaymentTokenGatewayEnter )
+    PaymentProfileTopUpCredits,                         // distribution of the top-up and event based collection
+    PaymentProfileOutTokenUpdate,                       // OutTokenClass::UpdateValue
+    PaymentProfileEmergencyFlush,                       // PaymentAccountClass::EmergencyFlush, must fit the hold-up time
+    PaymentProfileRecordWrite,                          // CRC of the counter record before the write
+    PaymentProfileRecordRead,                           // check of both copies of the counter in Init()
+    PaymentProfileStagesNum
+};
+
+/* State of the account in which the stage was measured */
+enum PaymentProfileScenario{
+    PaymentProfileSteadyState                   = 0,
+    PaymentProfileLowCredit,
+    PaymentProfileExhaustedCredit,
+    PaymentProfileCollectionPending,
+    PaymentProfileScenariosNum
+};
+
+/* Classes of the Get/Set codec statistics */
+enum PaymentProfileCodecClass{
+    PaymentProfileCodecAccount                  = 0,    // class 111
+    PaymentProfileCodecCredit,                          // class 112
+    PaymentProfileCodecCharge,                          // class 113
+    PaymentProfileCodecTokenGateway,                    // class 115
+    PaymentProfileCodecData,                            // helper data and register objects
+    PaymentProfileCodecClassesNum
+};
+
+enum PaymentProfileCodecDirection{
+    PaymentProfileCodecGet                      = 0,
+    PaymentProfileCodecSet,
+    PaymentProfileCodecAction,                          // attrID is the method
+    PaymentProfileCodecDirectionsNum
+};
+
+static const uint8_t PAYMENT_PROFILE_CODEC_ATTRS        = 20;   // attributes 0..19, all of the Payment classes
+static const uint8_t PAYMENT_PROFILE_CODEC_OTHER_ATTR   = PAYMENT_PROFILE_CODEC_ATTRS;     // the stats of all greater attributes
+static const uint16_t PAYMENT_PROFILE_SET_REQUEST_LEN   = 256;  // Set has no length of the request, the buffer of the request is not shorter
+static const uint8_t PAYMENT_PROFILE_DATA_DEPTH         = 4;    // nesting of the arrays and structures of the requests, the deeper data is counted by the tag
+
+typedef struct{
+    u32         calls;
+    u32         maxCycles;
+    u64         sumCycles;
+    u64         sumInstructions;
+} PaymentProfileStats;
+
+typedef struct{
+    u32         calls;
+    u32         maxCycles;
+    u64         sumCycles;
+    u64         sumBytes;
+} PaymentProfileCodecStats;
+
+/*
+Histogram of the token latency: PAYMENT_PROFILE_LATENCY_SUB_BUCKETS buckets per power of two of the cycles,
+so the error of the percentile is less than 1/PAYMENT_PROFILE_LATENCY_SUB_BUCKETS.
+*/
+#define PAYMENT_PROFILE_LATENCY_SUB_BITS        3
+#define PAYMENT_PROFILE_LATENCY_SUB_BUCKETS     ( 1 << PAYMENT_PROFILE_LATENCY_SUB_BITS )
+#define PAYMENT_PROFILE_LATENCY_BUCKETS         ( 32 * PAYMENT_PROFILE_LATENCY_SUB_BUCKETS )
+
+typedef struct{
+    u32         tokens;
+    u64         sumCycles;
+    u64         sumWrites;
+    u32         maxWrites;
+    u32         histogram[PAYMENT_PROFILE_LATENCY_BUCKETS];
+} PaymentProfileTokenStats;
+
+typedef struct{
+    u32         startCycles;
+    u32         startInstructions;
+    u32         startWrites;
+} PaymentProfileProbe;
+
+#ifdef PAYMENT_PROFILING
+
+void PaymentProfileSetScenario( PaymentProfileScenario scenario );
+void PaymentProfileBegin( PaymentProfileProbe* probe );
+void PaymentProfileEnd( PaymentProfileStage stage, const PaymentProfileProbe* probe );
+const PaymentProfileStats* PaymentProfileGetStats( PaymentProfileScenario scenario, PaymentProfileStage stage );
+u32 PaymentProfileGetNsPerCall( PaymentProfileScenario scenario, PaymentProfileStage stage );
+u32 PaymentProfileGetInstructionsPerCall( PaymentProfileScenario scenario, PaymentProfileStage stage );
+u32 PaymentProfileGetWorstNs( PaymentProfileStage stage );
+void PaymentProfileAccumulate( PaymentProfileStats total[PaymentProfileScenariosNum][PaymentProfileStagesNum] );
+void PaymentProfileReset();
+
+void PaymentProfileCountWrite();
+void PaymentProfileTokenEnd( const PaymentProfileProbe* probe );
+const PaymentProfileTokenStats* PaymentProfileGetTokenStats();
+u32 PaymentProfileGetTokenLatencyNs( u16 permille );
+u32 PaymentProfileGetTokensPerSecond();
+u32 PaymentProfileGetWritesPer100Tokens();
+void PaymentProfileAccumulateTokens( PaymentProfileTokenStats* total );
+
+void PaymentProfileCodecEnd( PaymentProfileCodecClass codecClass, PaymentProfileCodecDirection direction, u8 attrID, u16 bytes, const PaymentProfileProbe* probe );
+const PaymentProfileCodecStats* PaymentProfileGetCodecStats( PaymentProfileCodecClass codecClass, PaymentProfileCodecDirection direction, u8 attrID );
+u32 PaymentProfileGetCodecBytesPerSecond( PaymentProfileCodecClass codecClass, PaymentProfileCodecDirection direction, u8 attrID );
+u16 PaymentProfileDataLength( const BYTE* buf, u16 len );
+
+/*
+Get, Set and Action of the classes return from every case of the switch,
+so the measurement is finished by the destructor of the probe.
+Get takes the bytes from len_response, Set and Action the length of the A-XDR data of the request
+not longer than requestLen, it is taken before the probe is started.
+*/
+class PaymentProfileCodecScope{
+public:
+  PaymentProfileCodecScope( PaymentProfileCodecClass _codecClass, PaymentProfileCodecDirection _direction, u8 _attrID, const uint16_t* _bytes ) :
+    codecClass( _codecClass ), direction( _direction ), attrID( _attrID ), bytes( _bytes ), requestBytes( 0 )
+  {
+      PaymentProfileBegin( &probe );
+  }
+  
+  PaymentProfileCodecScope( PaymentProfileCodecClass _codecClass, PaymentProfileCodecDirection _direction, u8 _attrID, const BYTE* _request, u16 _requestLen ) :
+    codecClass( _codecClass ), direction( _direction ), attrID( _attrID ), bytes( NULL ), requestBytes( PaymentProfileDataLength( _request, _requestLen ) )
+  {
+      PaymentProfileBegin( &probe );
+  }
+  
+  ~PaymentProfileCodecScope()
+  {
+      PaymentProfileCodecEnd( codecClass, direction, attrID, ( bytes != NULL ) ? *bytes : requestBytes, &probe );
+  }
+  
+private:
+  const PaymentProfileCodecClass        codecClass;
+  const PaymentProfileCodecDirection    direction;
+  const u8                              attrID;
+  const uint16_t* const                 bytes;
+  const u16                             requestBytes;
+  PaymentProfileProbe                   probe;
+};
+
+#define PAYMENT_PROFILE_SCENARIO( scenario )    PaymentProfileSetScenario( scenario )
+#define PAYMENT_PROFILE_BEGIN( name )           PaymentProfileProbe profileProbe_##name; PaymentProfileBegin( &profileProbe_##name )
+#define PAYMENT_PROFILE_END( name, stage )      PaymentProfileEnd( stage, &profileProbe_##name )
+#define PAYMENT_PROFILE_TOKEN_END( name )       PaymentProfileTokenEnd( &profileProbe_##name )
+#define PAYMENT_PROFILE_WRITE()                 PaymentProfileCountWrite()
+#define PAYMENT_PROFILE_CODEC_GET( codecClass, attrID, len )    PaymentProfileCodecScope profileCodecScope( codecClass, PaymentProfileCodecGet, attrID, &len )
+#define PAYMENT_PROFILE_CODEC_SET( codecClass, attrID, request )                   PaymentProfileCodecScope profileCodecScope( codecClass, PaymentProfileCodecSet, attrID, (const BYTE*)( request ), PAYMENT_PROFILE_SET_REQUEST_LEN )
+#define PAYMENT_PROFILE_CODEC_ACTION( codecClass, methodID, request, len )         PaymentProfileCodecScope profileCodecScope( codecClass, PaymentProfileCodecAction, methodID, (const BYTE*)( request ), len )
+
+#else
+
+#define PAYMENT_PROFILE_SCENARIO( scenario )
+#define PAYMENT_PROFILE_BEGIN( name )
+#define PAYMENT_PROFILE_END( name, stage )
+#define PAYMENT_PROFILE_TOKEN_END( name )
+#define PAYMENT_PROFILE_WRITE()
+#define PAYMENT_PROFILE_CODEC_GET( codecClass, attrID, len )
+#define PAYMENT_PROFILE_CODEC_SET( codecClass, attrID, request )
+#define PAYMENT_PROFILE_CODEC_ACTION( codecClass, methodID, request, len )
+
+#endif // PAYMENT_PROFILING
+
+#endif // _PAYMENT_PROFILE_
@@ -0,0 +1,191 @@
+/*
+    \file PaymentRecord.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+#include "cicPaymentRecord.h"
+
+#ifdef PAYMENT_RECORD_CRC
+
+#include "cicPaymentPort.h"
+#include "cicPaymentCrc.h"
+
+static PAYMENT_THREAD_LOCAL PaymentRecordContext defaultRecord;
+static PAYMENT_THREAD_LOCAL PaymentRecordContext* currentRecord = &defaultRecord;
+
+void PaymentRecordInitContext( PaymentRecordContext* context )
+{
+    memset( context, 0, sizeof( *context ) );
+}
+
+/* NULL returns to the default context */
+void PaymentRecordSelect( PaymentRecordContext* context )
+{
+    currentRecord = ( context != NULL ) ? context : &defaultRecord;
+}
+
+static PaymentRecordCacheEntry* findCache( u16 ftId, u16 index )
+{
+    for( u8 i = 0; i < currentRecord->recordCacheNum; ++i )
+    {
+        if( currentRecord->recordCache[i].ftId == ftId && currentRecord->recordCache[i].index == index )
+            return &currentRecord->recordCache[i];
+    }
+    return NULL;
+}
+
+static void updateCache( u16 ftId, u16 index, u32 seq )
+{
+    PaymentRecordCacheEntry* entry = findCache( ftId, index );
+    if( entry == NULL )
+    {
+        if( currentRecord->recordCacheNum == PAYMENT_RECORD_CACHE )
+            return;                                                             // the counter is read from the file at every write
+        entry = &currentRecord->recordCache[currentRecord->recordCacheNum++];
+        entry->ftId = ftId;
+        entry->index = index;
+    }
+    entry->seq = seq;
+}
+
+/* The id and the index of the counter are in the CRC, so the copy of the other counter is not taken */
+static u32 calcCrc( u16 ftId, u16 index, const PaymentRecord* record )
+{
+    u16 key[2] = { ftId, index };
+    u32 crc = PaymentCrc32( key, sizeof( key ) );
+    return PaymentCrc32Continue( crc, record, sizeof( *record ) - sizeof( record->crc ) );
+}
+
+/* The function returns false if the copy was not written or is broken, the broken copies are counted in corrupted */
+static bool readCopy( u16 ftId, u16 index, u8 slot, PaymentRecord* record, u8* corrupted )
+{
+    u16 len = PaymentFileIndexRead( ftId, index * 2 + slot, record );
+    if( len == 0 )
+        return false;
+
+    if( len == sizeof( *record ) && record->crc == calcCrc( ftId, index, record ) )
+        return true;
+
+    ++currentRecord->recordStats.crcFailures;
+    ++*corrupted;
+    return false;
+}
+
+/* The function returns the slot of the newest valid copy (0 or 1), 0xFF if there is no one */
+static u8 findNewest( u16 ftId, u16 index, PaymentRecord copies[2], u8* corrupted )
+{
+    *corrupted = 0;
+    bool valid0 = readCopy( ftId, index, 0, &copies[0], corrupted );
+    bool valid1 = readCopy( ftId, index, 1, &copies[1], corrupted );
+
+    if( valid0 && valid1 )
+        return ( (s32)( copies[1].seq - copies[0].seq ) > 0 ) ? 1 : 0;        // the difference is correct after the overflow
+    if( valid0 )
+        return 0;
+    if( valid1 )
+        return 1;
+    return 0xFF;
+}
+
+/*
+The function fills the record of the new value of the counter and returns the index in the file
+where it must be written: the slot of the older copy.
+*/
+u16 PaymentRecordPrepare( u16 ftId, u16 index, const void* value, u8 len, PaymentRecord* record )
+{
+    PAYMENT_PROFILE_BEGIN( recordWrite );
+
+    u32 seq = 0;
+    const PaymentRecordCacheEntry* entry = findCache( ftId, index );
+    if( entry != NULL )
+    {
+        seq = entry->seq;
+    }
+    else
+    {
+        PaymentRecord copies[2];
+        u8 corrupted;
+        u8 newest = findNewest( ftId, index, copies, &corrupted );
+        if( newest != 0xFF )
+            seq = copies[newest].seq;
+    }
+
+    memset( record, 0, sizeof( *record ) );
+    memcpy( record->data, value, ( len < PAYMENT_RECORD_DATA_LEN ) ? len : PAYMENT_RECORD_DATA_LEN );
+    record->seq = seq + 1;
+    record->crc = calcCrc( ftId, index, record );
+
+    updateCache( ftId, index, record->seq );
+    ++currentRecord->recordStats.writes;
+
+    PAYMENT_PROFILE_END( recordWrite, PaymentProfileRecordWrite );
+    return index * 2 + ( record->seq & 1 );
+}
+
+static void writeRecord( u16 ftId, u16 index, const void* value, u8 len )
+{
+    PaymentRecord record;
+    u16 slot = PaymentRecordPrepare( ftId, index, value, len, &record );
+    PaymentFileIndexWrite( ftId, slot, &record );
+}
+
+/* The plain value of the firmware before the records is told from the record by the length */
+static u8 readPlainValue( u16 ftId, u16 index, bool indexed, void* value, u8 len )
+{
+    PaymentRecord raw;
+    u16 rawLen = indexed ? PaymentFileIndexRead( ftId, index, &raw ) : PaymentFileRead( ftId, &raw );
+    if( len > PAYMENT_RECORD_DATA_LEN || rawLen != len )
+        return 0;
+
+    memcpy( value, &raw, len );
+    writeRecord( ftId, index, value, len );             // both copies, the second one is over the plain value of the slot index * 2
+    writeRecord( ftId, index, value, len );
+    ++currentRecord->recordStats.converted;
+    return len;
+}
+
+/* The function returns len if the counter was restored, 0 if there is no valid copy */
+u8 PaymentRecordRead( u16 ftId, u16 index, bool indexed, void* value, u8 len )
+{
+    PAYMENT_PROFILE_BEGIN( recordRead );
+    ++currentRecord->recordStats.reads;
+
+    PaymentRecord copies[2];
+    u8 corrupted;
+    u8 newest = findNewest( ftId, index, copies, &corrupted );
+    if( newest == 0xFF )
+    {
+        u8 readLen = readPlainValue( ftId, index, indexed, value, len );
+        if( readLen == 0 && corrupted != 0 )
+            ++currentRecord->recordStats.lost;
+        PAYMENT_PROFILE_END( recordRead, PaymentProfileRecordRead );
+        return readLen;
+    }
+
+    /* the broken copy is the torn or damaged newer write, the older good copy is used */
+    if( corrupted != 0 )
+        ++currentRecord->recordStats.fallbacks;
+
+    u8 readLen = ( len < PAYMENT_RECORD_DATA_LEN ) ? len : PAYMENT_RECORD_DATA_LEN;
+    memcpy( value, copies[newest].data, readLen );
+    updateCache( ftId, index, copies[newest].seq );
+
+    PAYMENT_PROFILE_END( recordRead, PaymentProfileRecordRead );
+    return readLen;
+}
+
+/* The cached sequence numbers are read again from the files, the records prepared but not written are forgotten */
+void PaymentRecordResetCache()
+{
+    currentRecord->recordCacheNum = 0;
+}
+
+const PaymentRecordStats* PaymentRecordGetStats()
+{
+    return &currentRecord->recordStats;
+}
+
+#endif // PAYMENT_RECORD_CRC
@@ -0,0 +1,80 @@
+/*
+    \file PaymentRecord.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+/*
+CRC protected records of the money counters (PAYMENT_RECORD_CRC).
+Every counter is kept in two copies: the record with the value, the sequence number and CRC32 is written
+in turn to the slots index * 2 and index * 2 + 1 of its file, so the older copy is never overwritten
+by the write which may be torn. At the start the newest valid copy is used, if its CRC is wrong
+the older one is taken (the fallback), if both are wrong the counter is not restored as for the empty file.
+The sequence numbers of the counters are cached in RAM, so the write in the tick path does not read the file.
+The firmware before the records kept the plain value in the file: if there is no valid copy and the file
+(slot index of the indexed file) holds the value of the length of the counter, it is taken and rewritten
+as both copies. The indexed counters are read from the last index, so the plain value of the index is
+read before the copies of the lower index are written over it.
+Only the money counters are protected (the credit amount, total_amount_paid, total_amount_remaining,
+lastValue and sumToCollect of the charge): they are written in the tick path. unit_charge has its own CRC
+(see writeUnitCharge), the times are checked by PaymentTimeUpgradeRecords, the other files are the
+settings and statuses written by the tokens and Set and are read as they are.
+The checks and the CPU time of the writes and reads are measured by PaymentRecordGetStats() and
+the stages PaymentProfileRecordWrite and PaymentProfileRecordRead (PAYMENT_PROFILING).
+Every simulated meter of the host build has its own cache and statistics, selected by the harness with the meter.
+*/
+
+#if !defined _PAYMENT_RECORD_
+#define _PAYMENT_RECORD_
+
+#include "config.h"
+#include "CommonTypes.h"
+
+#ifndef PAYMENT_RECORD_CACHE
+#define PAYMENT_RECORD_CACHE                    32      // counters with the cached sequence number
+#endif
+
+static const uint8_t PAYMENT_RECORD_DATA_LEN            = 8;        // the longest counter is u64
+
+typedef __packed struct{
+    u8          data[PAYMENT_RECORD_DATA_LEN];
+    u32         seq;
+    u32         crc;                            // CRC32 of the fields above and of ftId and index
+} PaymentRecord;
+
+typedef struct{
+    u32         writes;
+    u32         reads;
+    u32         crcFailures;                    // copies with the wrong CRC found at the reading
+    u32         fallbacks;                      // counters restored from the older copy
+    u32         lost;                           // counters without any valid copy
+    u32         converted;                      // counters taken from the plain value of the firmware before
+} PaymentRecordStats;
+
+#ifdef PAYMENT_RECORD_CRC
+
+typedef struct{
+    u16         ftId;
+    u16         index;
+    u32         seq;                            // of the newest copy in the file
+} PaymentRecordCacheEntry;
+
+typedef struct{
+    PaymentRecordCacheEntry     recordCache[PAYMENT_RECORD_CACHE];
+    u8                          recordCacheNum;
+    PaymentRecordStats          recordStats;
+} PaymentRecordContext;
+
+void PaymentRecordInitContext( PaymentRecordContext* context );
+void PaymentRecordSelect( PaymentRecordContext* context );
+
+u16 PaymentRecordPrepare( u16 ftId, u16 index, const void* value, u8 len, PaymentRecord* record );
+u8 PaymentRecordRead( u16 ftId, u16 index, bool indexed, void* value, u8 len );
+const PaymentRecordStats* PaymentRecordGetStats();
+void PaymentRecordResetCache();
+
+#endif // PAYMENT_RECORD_CRC
+
+#endif // _PAYMENT_RECORD_
@@ -0,0 +1,172 @@
+/*
+    \file PaymentReplay.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+#include "cicPaymentReplay.h"
+
+#if defined PAYMENT_HOST_BUILD && defined PAYMENT_VIRTUAL_CLOCK
+
+#include "cicPaymentPort.h"
+#include "cicPaymentGolden.h"
+#include "utils.h"
+
+/* Values of the meter written to the timeline last time */
+typedef struct{
+    s32         availableCredit;
+    s32         amountToClear;
+    bool        relay;
+    bool        valid;
+} PaymentReplayLastValues;
+
+typedef struct{
+    const PaymentReplayMeter*   meter;
+    PaymentTimelineSink         sink;
+    void*                       arg;
+    PaymentReplayLastValues     last;
+} PaymentReplayContext;
+
+static void writeTimeline( PaymentReplayContext* context, u8 type, s32 value )
+{
+    PaymentTimelineRecord record;
+    record.utcSeconds = PaymentVirtualClockGetSeconds();
+    record.type = type;
+    record.value = value;
+
+    context->sink( &record, context->arg );
+}
+
+/* Changes of the account values and of the relay since the last record */
+static void updateTimeline( PaymentReplayContext* context )
+{
+    s32 availableCredit = PaymentGetDoubleLongAttr( context->meter->account, PaymentAccountAvailableCreditAttr );
+    s32 amountToClear = PaymentGetDoubleLongAttr( context->meter->account, PaymentAccountAmountToClearAttr );
+    bool relay = PaymentPortGetRelayState();
+
+    if( !context->last.valid || availableCredit != context->last.availableCredit )
+        writeTimeline( context, PaymentTimelineAvailableCredit, availableCredit );
+
+    if( !context->last.valid || amountToClear != context->last.amountToClear )
+        writeTimeline( context, PaymentTimelineAmountToClear, amountToClear );
+
+    if( !context->last.valid || relay != context->last.relay )
+        writeTimeline( context, PaymentTimelineRelay, relay );
+
+    context->last.availableCredit = availableCredit;
+    context->last.amountToClear = amountToClear;
+    context->last.relay = relay;
+    context->last.valid = true;
+}
+
+static void tickMeter( bool newMinute, void* arg )
+{
+    PaymentReplayContext* context = (PaymentReplayContext*)arg;
+    const PaymentReplayMeter* meter = context->meter;
+
+    PaymentIdlePass( newMinute, meter->account );
+    if( newMinute && meter->tokenGateway != NULL )
+        meter->tokenGateway->IdleMinute();                          // by the firmware after the pass
+
+    updateTimeline( context );
+}
+
+static PaymentReplayResult applyRecord( PaymentReplayContext* context, const PaymentTraceRecordHeader* header, const BYTE* payload )
+{
+    switch( header->type )
+    {
+        case PaymentTraceRegister:
+        {
+            if( header->len != sizeof( LOGICAL_NAME ) + sizeof( u64 ) )
+                return PaymentReplayTruncatedRecord;
+
+            LOGICAL_NAME ln;
+            u64 value;
+            memcpy( &ln, payload, sizeof( ln ) );
+            memcpy( &value, payload + sizeof( ln ), sizeof( value ) );
+            PaymentReplaySetRegister( &ln, value );
+            return PaymentReplayOK;
+        }
+        case PaymentTraceClockSet:
+        {
+            if( header->len != sizeof( u32 ) )
+                return PaymentReplayTruncatedRecord;
+
+            u32 utcSeconds;
+            memcpy( &utcSeconds, payload, sizeof( utcSeconds ) );
+            PaymentVirtualClockSetSeconds( utcSeconds );
+            updateTimeline( context );
+            return PaymentReplayOK;
+        }
+        case PaymentTraceToken:
+        {
+            if( context->meter->tokenGateway == NULL )
+                return PaymentReplayOK;
+
+            BYTE bufRequest[MAX_LEN_RECEIVED_TOKEN + 3] = {};            // the byte skipped by Action, the tag and the length of the token
+            BYTE bufResponse[16] = {};
+            uint16_t lenResponse = 0;
+
+            if( header->len > sizeof( bufRequest ) )
+                return PaymentReplayTruncatedRecord;
+
+            memcpy( bufRequest, payload, header->len );
+            context->meter->tokenGateway->Action( PaymentTokenGatewayEnter, bufRequest, bufResponse, lenResponse );
+            if( lenResponse > 6 && bufResponse[5] == eDT_Enum )
+                writeTimeline( context, PaymentTimelineTokenStatus, bufResponse[6] );
+
+            updateTimeline( context );
+            return PaymentReplayOK;
+        }
+        default:
+            return PaymentReplayUnknownRecord;
+    }
+}
+
+/*
+The function replays the trace on the objects of the meter. The simulation clock must be
+selected and set to the time of the trace start by the caller.
+The records of the same second are applied in the order of the trace.
+*/
+PaymentReplayResult PaymentReplayRun( const PaymentReplayMeter* meter, const BYTE* trace, u32 traceLen, PaymentTimelineSink sink, void* arg )
+{
+    PaymentReplayContext context;
+    memset( &context, 0, sizeof( context ) );
+    context.meter = meter;
+    context.sink = sink;
+    context.arg = arg;
+
+    updateTimeline( &context );
+
+    u32 pos = 0;
+    while( pos < traceLen )
+    {
+        if( traceLen - pos < sizeof( PaymentTraceRecordHeader ) )
+            return PaymentReplayTruncatedRecord;
+
+        PaymentTraceRecordHeader header;
+        memcpy( &header, &trace[pos], sizeof( header ) );
+        pos += sizeof( header );
+
+        if( traceLen - pos < header.len )
+            return PaymentReplayTruncatedRecord;
+
+        u32 currSeconds = PaymentVirtualClockGetSeconds();
+        if( header.utcSeconds < currSeconds )
+            return PaymentReplayRecordInPast;
+
+        PaymentVirtualClockRun( header.utcSeconds - currSeconds, tickMeter, &context );
+
+        PaymentReplayResult result = applyRecord( &context, &header, &trace[pos] );
+        if( result != PaymentReplayOK )
+            return result;
+
+        pos += header.len;
+    }
+
+    return PaymentReplayOK;
+}
+
+#endif // PAYMENT_HOST_BUILD && PAYMENT_VIRTUAL_CLOCK
@@ -0,0 +1,82 @@
+/*
+    \file PaymentReplay.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+/*
+Replay of the field traces in the host build (PAYMENT_HOST_BUILD and PAYMENT_VIRTUAL_CLOCK).
+The trace is a sequence of the records of the field meter: readings of the registers,
+sets of the clock and received tokens, ordered by the time. Between the records the simulation
+clock is ticked second by second and the real Payment objects of the meter are invoked,
+the record is applied at its second. Every change of the credit, of the debt, of the relay
+and every token status is written to the timeline as a compact binary record.
+*/
+
+#if !defined _PAYMENT_REPLAY_
+#define _PAYMENT_REPLAY_
+
+#include "config.h"
+#include "CommonTypes.h"
+
+#if defined PAYMENT_HOST_BUILD && defined PAYMENT_VIRTUAL_CLOCK
+
+#include "cicPayment.h"
+
+/* Types of the trace records */
+enum PaymentTraceRecordType{
+    PaymentTraceRegister                = 1,    // payload: LOGICAL_NAME of the register, u64 value
+    PaymentTraceClockSet                = 2,    // payload: u32 new UTC seconds of cicClock
+    PaymentTraceToken                   = 3     // payload: parameter of Action( PaymentTokenGatewayEnter ) as received
+};
+
+/* Header of the trace record, followed by len bytes of the payload */
+typedef __packed struct{
+    u32         utcSeconds;
+    u8          type;
+    u8          len;
+} PaymentTraceRecordHeader;
+
+/* Types of the timeline records */
+enum PaymentTimelineRecordType{
+    PaymentTimelineAvailableCredit      = 1,    // value: available credit of the account
+    PaymentTimelineAmountToClear        = 2,    // value: debt of the account
+    PaymentTimelineRelay                = 3,    // value: state of the disconnector output
+    PaymentTimelineTokenStatus          = 4     // value: eT_tokenStatusCode of the entered token
+};
+
+typedef __packed struct{
+    u32         utcSeconds;
+    u8          type;
+    s32         value;
+} PaymentTimelineRecord;
+
+typedef void ( *PaymentTimelineSink )( const PaymentTimelineRecord* record, void* arg );
+
+/* Objects of the replayed meter, the credits and charges are the lists of the account which ticks them (PaymentIdlePass) */
+typedef struct{
+    PaymentCreditClass*         creditList[MAX_OBJECTS_IN_CREDIT_REF_LIST];
+    u8                          lenCreditList;
+    PaymentChargeClass*         chargeList[MAX_OBJECTS_IN_CHARGE_REF_LIST];
+    u8                          lenChargeList;
+    PaymentTokenGatewayClass*   tokenGateway;
+    PaymentAccountClass*        account;
+} PaymentReplayMeter;
+
+typedef enum{
+    PaymentReplayOK                     = 0,
+    PaymentReplayTruncatedRecord,
+    PaymentReplayUnknownRecord,
+    PaymentReplayRecordInPast
+} PaymentReplayResult;
+
+/* Implemented by the host harness: new value of the register stand-in */
+void PaymentReplaySetRegister( const LOGICAL_NAME* ln, u64 value );
+
+PaymentReplayResult PaymentReplayRun( const PaymentReplayMeter* meter, const BYTE* trace, u32 traceLen, PaymentTimelineSink sink, void* arg );
+
+#endif // PAYMENT_HOST_BUILD && PAYMENT_VIRTUAL_CLOCK
+
+#endif // _PAYMENT_REPLAY_
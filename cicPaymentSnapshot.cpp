@@ -0,0 +1,160 @@
+/*
+    \file PaymentSnapshot.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+#include "cicPaymentSnapshot.h"
+
+#ifdef PAYMENT_BOOT_SNAPSHOT
+
+#include "cicPaymentPort.h"
+#include "cicPaymentCrc.h"
+
+static PAYMENT_THREAD_LOCAL PaymentSnapshotContext defaultSnapshot;
+static PAYMENT_THREAD_LOCAL PaymentSnapshotContext* currentSnapshot = &defaultSnapshot;
+
+void PaymentSnapshotInitContext( PaymentSnapshotContext* context )
+{
+    memset( context, 0, sizeof( *context ) );
+}
+
+/* NULL returns to the default snapshot */
+void PaymentSnapshotSelect( PaymentSnapshotContext* context )
+{
+    currentSnapshot = ( context != NULL ) ? context : &defaultSnapshot;
+}
+
+/* The writes of the snapshot files go directly to the port, they must not discard the emergency record */
+static void writeFile( u16 ftId, const void* src, u16 len )
+{
+    PAYMENT_WRITE_STATS_RECORD( ftId, PAYMENT_WRITE_STATS_NOT_INDEXED, len );
+    PAYMENT_PROFILE_WRITE();
+    PaymentPortFileWrite( ftId, src, len );
+}
+
+void PaymentSnapshotBegin()
+{
+    currentSnapshot->snapshotRestorable = false;
+    currentSnapshot->snapshotLen = sizeof( PaymentSnapshotHeader );
+}
+
+bool PaymentSnapshotAdd( u16 key, const void* data, u16 len )
+{
+    if( currentSnapshot->snapshotLen + sizeof( PaymentSnapshotSectionHeader ) + len + sizeof( u32 ) > PAYMENT_SNAPSHOT_MAX_LEN )
+        return false;
+
+    PaymentSnapshotSectionHeader section = { key, len };
+    memcpy( &currentSnapshot->snapshotBlob[currentSnapshot->snapshotLen], &section, sizeof( section ) );
+    currentSnapshot->snapshotLen += sizeof( section );
+    memcpy( &currentSnapshot->snapshotBlob[currentSnapshot->snapshotLen], data, len );
+    currentSnapshot->snapshotLen += len;
+
+    return true;
+}
+
+/* Blob is written before the marker, so the marker is never set for the torn blob. Only the used part is written */
+void PaymentSnapshotCommit()
+{
+    PaymentSnapshotHeader header;
+    header.magic = PAYMENT_SNAPSHOT_MAGIC;
+    header.version = PAYMENT_SNAPSHOT_VERSION;
+    header.len = currentSnapshot->snapshotLen + sizeof( u32 );
+    header.seq = currentSnapshot->snapshotSeq + 1;
+    memcpy( currentSnapshot->snapshotBlob, &header, sizeof( header ) );
+
+    u32 crc = PaymentCrc32( currentSnapshot->snapshotBlob, currentSnapshot->snapshotLen );
+    memcpy( &currentSnapshot->snapshotBlob[currentSnapshot->snapshotLen], &crc, sizeof( crc ) );
+
+    writeFile( ftPaymentSnapshot_Blob, currentSnapshot->snapshotBlob, header.len );
+
+    currentSnapshot->snapshotSeq = header.seq;
+    writeFile( ftPaymentSnapshot_Valid, &currentSnapshot->snapshotSeq, sizeof( currentSnapshot->snapshotSeq ) );
+    currentSnapshot->snapshotValid = true;
+}
+
+/*
+The function is called at the start by Init() of every Payment object, only the first call works.
+The valid blob is kept in RAM for Init() of all objects and cleared in the file at once:
+the objects change their state from the first tick.
+*/
+void PaymentSnapshotLoad()
+{
+    if( currentSnapshot->snapshotLoaded )
+        return;
+    currentSnapshot->snapshotLoaded = true;
+
+    u32 validSeq = 0;
+    if( PaymentFileRead( ftPaymentSnapshot_Valid, &validSeq ) != sizeof( validSeq ) )
+        validSeq = 0;
+
+    u16 len = PaymentFileRead( ftPaymentSnapshot_Blob, &currentSnapshot->snapshotBlob );
+    if( len < sizeof( PaymentSnapshotHeader ) )
+        return;
+
+    PaymentSnapshotHeader header;
+    memcpy( &header, currentSnapshot->snapshotBlob, sizeof( header ) );
+    currentSnapshot->snapshotSeq = header.seq;
+
+    if( header.magic != PAYMENT_SNAPSHOT_MAGIC || header.version != PAYMENT_SNAPSHOT_VERSION ||
+        header.len > len || header.len < sizeof( header ) + sizeof( u32 ) )
+        return;
+
+    u32 crc;
+    memcpy( &crc, &currentSnapshot->snapshotBlob[header.len - sizeof( u32 )], sizeof( crc ) );
+    if( crc != PaymentCrc32( currentSnapshot->snapshotBlob, header.len - sizeof( u32 ) ) )
+        return;
+
+    currentSnapshot->snapshotValid = ( validSeq != 0 && validSeq == header.seq );
+    currentSnapshot->snapshotRestorable = currentSnapshot->snapshotValid;
+    currentSnapshot->snapshotLen = header.len - sizeof( u32 );
+
+    PaymentSnapshotInvalidate();
+}
+
+/* The function copies the section of the object, returns false if the object must be read from the separate files */
+bool PaymentSnapshotGet( u16 key, void* data, u16 len )
+{
+    if( !currentSnapshot->snapshotRestorable )
+        return false;
+
+    u16 pos = sizeof( PaymentSnapshotHeader );
+    while( pos + sizeof( PaymentSnapshotSectionHeader ) <= currentSnapshot->snapshotLen )
+    {
+        PaymentSnapshotSectionHeader section;
+        memcpy( &section, &currentSnapshot->snapshotBlob[pos], sizeof( section ) );
+        pos += sizeof( section );
+
+        if( section.key == key )
+        {
+            if( section.len != len || pos + len > currentSnapshot->snapshotLen )
+                return false;
+
+            memcpy( data, &currentSnapshot->snapshotBlob[pos], len );
+            return true;
+        }
+
+        pos += section.len;
+    }
+
+    return false;
+}
+
+bool PaymentSnapshotIsValid()
+{
+    return currentSnapshot->snapshotValid;
+}
+
+void PaymentSnapshotInvalidate()
+{
+    if( !currentSnapshot->snapshotValid )
+        return;
+
+    currentSnapshot->snapshotValid = false;
+    u32 invalidSeq = 0;
+    writeFile( ftPaymentSnapshot_Valid, &invalidSeq, sizeof( invalidSeq ) );
+}
+
+#endif // PAYMENT_BOOT_SNAPSHOT
@@ -0,0 +1,74 @@
+/*
+    \file PaymentSnapshot.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+/*
+Boot snapshot of the Payment objects (PAYMENT_BOOT_SNAPSHOT).
+The state of the account, credits and charges is saved as one versioned blob with CRC32
+in ftPaymentSnapshot_Blob by the power fail handler after the emergency record, so at the start
+all objects are restored with one read.
+The blob is valid while ftPaymentSnapshot_Valid holds its sequence number. It is cleared once
+at the start when the blob is read, and by the discarding of the emergency record if the power
+comes back without the restart. Otherwise Init() of the objects reads the separate files as before.
+Every simulated meter of the host build has its own snapshot context, selected by the harness with the meter.
+*/
+
+#if !defined _PAYMENT_SNAPSHOT_
+#define _PAYMENT_SNAPSHOT_
+
+#include "config.h"
+#include "CommonTypes.h"
+
+#ifndef PAYMENT_SNAPSHOT_MAX_LEN
+#define PAYMENT_SNAPSHOT_MAX_LEN                768
+#endif
+
+static const u32 PAYMENT_SNAPSHOT_MAGIC                 = 0x50534E50;      // "PSNP"
+static const u16 PAYMENT_SNAPSHOT_VERSION               = 2;               // must be changed with any section layout
+
+typedef __packed struct{
+    u32         magic;
+    u16         version;
+    u16         len;                            // header, sections and CRC
+    u32         seq;
+} PaymentSnapshotHeader;
+
+/* Every section is the key (ft id of the first file of the object), the length and the data */
+typedef __packed struct{
+    u16         key;
+    u16         len;
+} PaymentSnapshotSectionHeader;
+
+#ifdef PAYMENT_BOOT_SNAPSHOT
+
+typedef struct{
+    BYTE        snapshotBlob[PAYMENT_SNAPSHOT_MAX_LEN];
+    u16         snapshotLen;
+    u32         snapshotSeq;
+    bool        snapshotValid;                  // the blob in the file is valid
+    bool        snapshotLoaded;                 // the blob was read at the start
+    bool        snapshotRestorable;             // snapshotBlob holds the valid blob read at the start
+} PaymentSnapshotContext;
+
+void PaymentSnapshotInitContext( PaymentSnapshotContext* context );
+void PaymentSnapshotSelect( PaymentSnapshotContext* context );
+
+void PaymentSnapshotBegin();
+bool PaymentSnapshotAdd( u16 key, const void* data, u16 len );
+void PaymentSnapshotCommit();
+void PaymentSnapshotLoad();
+bool PaymentSnapshotGet( u16 key, void* data, u16 len );
+bool PaymentSnapshotIsValid();
+void PaymentSnapshotInvalidate();
+
+#ifndef PAYMENT_EMERGENCY_FLUSH
+#error "PAYMENT_BOOT_SNAPSHOT is saved and discarded with the emergency record, define PAYMENT_EMERGENCY_FLUSH"
+#endif // PAYMENT_EMERGENCY_FLUSH
+
+#endif // PAYMENT_BOOT_SNAPSHOT
+
+#endif // _PAYMENT_SNAPSHOT_
@@ -0,0 +1,89 @@
+/*
+    \file PaymentTime.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+#include "cicPaymentTime.h"
+#include "cicPaymentPort.h"
+
+/* A definition with "not specified" notation in all fields of the attribute */
+bool PaymentDateTimeIsNotSpecified( const TDateTime* dateTime )
+{
+    return dateTime->date.year_hi == 0xff &&
+           dateTime->date.year_low == 0xff &&
+           dateTime->date.month == 0xff &&
+           dateTime->date.day == 0xff &&
+           dateTime->date.w_day == 0xff &&
+           dateTime->time.hour == 0xff &&
+           dateTime->time.minute == 0xff &&
+           dateTime->time.second == 0xff;
+}
+
+PaymentTime PaymentTimeFromDateTime( const TDateTime* dateTime )
+{
+    if( PaymentDateTimeIsNotSpecified( dateTime ) )
+        return PAYMENT_TIME_NOT_SPECIFIED;
+    
+    TDateTime copy = *dateTime;                                     // GetSecondsUTC() takes not const
+    return (PaymentTime)GetSecondsUTC( &copy ) + PAYMENT_TIME_CLOCK_EPOCH;
+}
+
+void PaymentTimeToDateTime( PaymentTime time, TDateTime* dateTime )
+{
+    if( time == PAYMENT_TIME_NOT_SPECIFIED )
+    {
+        memset( dateTime, 0xff, sizeof( *dateTime ) );
+        return;
+    }
+    
+    SecondsTo_Local_DateTime( (DWORD)( ( time > PAYMENT_TIME_CLOCK_EPOCH ) ? time - PAYMENT_TIME_CLOCK_EPOCH : 0 ), dateTime );
+}
+
+/* The date-time of the record in the PackTdateTime format is converted if all its fields are in the range */
+static PaymentTime timeFromPackedRecord( u32 packed )
+{
+    if( packed == PAYMENT_TIME_RECORD_NOT_SPECIFIED )
+        return PAYMENT_TIME_NOT_SPECIFIED;
+    
+    TDateTime dateTime;
+    UnpackTDateTime( packed, &dateTime );
+    if( dateTime.date.month < 1 || dateTime.date.month > 12 || dateTime.date.day < 1 || dateTime.date.day > 31 ||
+        dateTime.time.hour > 23 || dateTime.time.minute > 59 || dateTime.time.second > 59 )
+        return PAYMENT_TIME_NOT_SPECIFIED;
+    
+    return PaymentTimeFromDateTime( &dateTime );
+}
+
+/*
+The time files of the object are rewritten as the seconds once, ftFormat keeps the format of them.
+The files written before are in the PackTdateTime format, the record which can't be unpacked is not specified.
+*/
+void PaymentTimeUpgradeRecords( u16 ftFormat, const u16* ftIds, u8 count )
+{
+    u8 format = 0;
+    if( PaymentFileRead( ftFormat, &format ) == sizeof( format ) && format == PAYMENT_TIME_RECORD_FORMAT )
+        return;
+    
+    for( u8 i = 0; i < count; ++i )
+    {
+        u32 record = 0;
+        if( PaymentFileRead( ftIds[i], &record ) != sizeof( record ) )      // nothing was written in the file
+            continue;
+        
+        record = PaymentTimeToRecord( timeFromPackedRecord( record ) );
+        PaymentFileWrite( ftIds[i], &record );
+    }
+    
+    format = PAYMENT_TIME_RECORD_FORMAT;
+    PaymentFileWrite( ftFormat, &format );
+}
+
+PaymentTime PaymentTimeNow()
+{
+    TDateTime localTime;
+    PaymentPortGetLocalTime( &localTime );
+    return PaymentTimeFromDateTime( &localTime );
+}
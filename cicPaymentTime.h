@@ -0,0 +1,52 @@
+/*
+    \file PaymentTime.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+/*
+Time of the Payment objects. The timestamps (account_activation_time, account_closure_time,
+unit_charge_activation_time, last_collection_time, token_time, the deadlines) are kept as PaymentTime:
+the seconds from 1970-01-01 00:00:00 UTC. They are compared and subtracted as integers and written
+to the files as plain values, TDateTime is made only when the attribute is encoded or decoded.
+The period of the credit is a wildcard date-time and stays TDateTime.
+The epoch of cicClock (1980) is corrected only in PaymentTimeFromDateTime/PaymentTimeToDateTime.
+The files of the times were written in the PackTdateTime format before, PaymentTimeUpgradeRecords()
+converts them in Init() of the object once and marks the format in the file of the object.
+*/
+
+#if !defined _PAYMENT_TIME_
+#define _PAYMENT_TIME_
+
+#include "config.h"
+#include "CommonTypes.h"
+#include "cicClock.h"
+
+typedef u64 PaymentTime;
+
+static const PaymentTime PAYMENT_TIME_NOT_SPECIFIED     = 0xFFFFFFFFFFFFFFFFULL;    // all fields of the date-time are 0xff
+static const PaymentTime PAYMENT_TIME_CLOCK_EPOCH       = 315532800;                // 1980-01-01 00:00:00, GetSecondsUTC() counts from it
+
+/* The files keep 32 bits of the time (till 2106), 0xFFFFFFFF is not specified */
+static const u32 PAYMENT_TIME_RECORD_NOT_SPECIFIED      = 0xFFFFFFFF;
+static const u8 PAYMENT_TIME_RECORD_FORMAT              = 1;                        // the seconds, 0 (never written) is PackTdateTime
+
+bool PaymentDateTimeIsNotSpecified( const TDateTime* dateTime );
+PaymentTime PaymentTimeFromDateTime( const TDateTime* dateTime );
+void PaymentTimeToDateTime( PaymentTime time, TDateTime* dateTime );
+PaymentTime PaymentTimeNow();
+void PaymentTimeUpgradeRecords( u16 ftFormat, const u16* ftIds, u8 count );
+
+inline u32 PaymentTimeToRecord( PaymentTime time )
+{
+    return ( time == PAYMENT_TIME_NOT_SPECIFIED ) ? PAYMENT_TIME_RECORD_NOT_SPECIFIED : (u32)time;
+}
+
+inline PaymentTime PaymentTimeFromRecord( u32 seconds )
+{
+    return ( seconds == PAYMENT_TIME_RECORD_NOT_SPECIFIED ) ? PAYMENT_TIME_NOT_SPECIFIED : (PaymentTime)seconds;
+}
+
+#endif // _PAYMENT_TIME_
@@ -0,0 +1,247 @@
+/*
+    \file PaymentTransaction.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+#include "cicPaymentTransaction.h"
+
+#ifdef PAYMENT_TRANSACTION
+
+#include "cicPaymentPort.h"
+#include "cicPaymentCrc.h"
+#include <assert.h>
+
+static PAYMENT_THREAD_LOCAL PaymentTransactionContext defaultTransaction;
+static PAYMENT_THREAD_LOCAL PaymentTransactionContext* currentTransaction = &defaultTransaction;
+
+void PaymentTransactionInitContext( PaymentTransactionContext* context )
+{
+    memset( context, 0, sizeof( *context ) );
+}
+
+/* NULL returns to the default transaction context */
+void PaymentTransactionSelect( PaymentTransactionContext* context )
+{
+    currentTransaction = ( context != NULL ) ? context : &defaultTransaction;
+}
+
+/* The writes of the transaction files go directly to the port, they must not be staged */
+static void writeFile( u16 ftId, const void* src, u16 len )
+{
+    PAYMENT_WRITE_STATS_RECORD( ftId, PAYMENT_WRITE_STATS_NOT_INDEXED, len );
+    PAYMENT_PROFILE_WRITE();
+    PaymentPortFileWrite( ftId, src, len );
+}
+
+static bool checkLog( const PaymentTransactionHeader* header )
+{
+    if( header->len > PAYMENT_TRANSACTION_MAX_LEN || header->len < sizeof( *header ) + sizeof( u32 ) )
+        return false;
+
+    u32 crc;
+    memcpy( &crc, &currentTransaction->transactionLog[header->len - sizeof( u32 )], sizeof( crc ) );
+    return crc == PaymentCrc32( currentTransaction->transactionLog, header->len - sizeof( u32 ) );
+}
+
+/*
+With PAYMENT_WRITE_QUEUE the record of the file which is in the queue and all records after it
+are queued as the ordered ones, so they never go around the older queued data and the mark of the applied log
+is written after them. Returns true if the record is queued.
+*/
+static bool writeLogRecord( u16 ftId, u16 index, const void* src, u16 len, bool queued )
+{
+#ifdef PAYMENT_WRITE_QUEUE
+    if( queued || PaymentWriteQueueHasRecord( ftId, index ) )
+    {
+        PaymentWriteQueueAppend( ftId, index, src, len );
+        return true;
+    }
+#endif // PAYMENT_WRITE_QUEUE
+
+    PAYMENT_WRITE_STATS_RECORD( ftId, index, len );
+    PAYMENT_PROFILE_WRITE();
+    if( index == PAYMENT_TRANSACTION_NOT_INDEXED )
+        PaymentPortFileWrite( ftId, src, len );
+    else
+        PaymentPortFileIndexWrite( ftId, index, src, len );
+    return queued;
+}
+
+/*
+The function writes the records of the log to their files. The counters of the journal are not in the log,
+only the record of the journal, so the live records are not touched here.
+*/
+static void applyLog( u32 seq, u16 len )
+{
+    bool queued = false;
+    u16 pos = sizeof( PaymentTransactionHeader );
+    while( pos + sizeof( PaymentTransactionRecordHeader ) <= len )
+    {
+#if defined PAYMENT_HOST_BUILD
+        if( currentTransaction->transactionCutNext && currentTransaction->transactionCutRecords-- == 0 )
+            return;
+#endif // PAYMENT_HOST_BUILD
+        PaymentTransactionRecordHeader record;
+        memcpy( &record, &currentTransaction->transactionLog[pos], sizeof( record ) );
+        pos += sizeof( record );
+
+        queued = writeLogRecord( record.ftId, record.index, &currentTransaction->transactionLog[pos], record.len, queued );
+        pos += record.len;
+    }
+
+#if defined PAYMENT_HOST_BUILD
+    if( currentTransaction->transactionCutNext )
+        return;
+#endif // PAYMENT_HOST_BUILD
+    writeLogRecord( ftPaymentTransaction_Applied, PAYMENT_TRANSACTION_NOT_INDEXED, &seq, sizeof( seq ), queued );
+}
+
+void PaymentTransactionBegin()
+{
+    if( currentTransaction->transactionDepth++ != 0 )
+        return;
+
+    currentTransaction->transactionLen = sizeof( PaymentTransactionHeader );
+    currentTransaction->transactionRecords = 0;
+    currentTransaction->transactionOverflow = false;
+}
+
+/*
+The function puts the write into the log of the open transaction, returns false if there is no one.
+The later write of the same file replaces the staged value, so every file is written once at the commit.
+*/
+bool PaymentTransactionStage( u16 ftId, u16 index, const void* data, u16 len )
+{
+    if( currentTransaction->transactionDepth == 0 )
+        return false;
+
+    u16 pos = sizeof( PaymentTransactionHeader );
+    while( pos < currentTransaction->transactionLen )
+    {
+        PaymentTransactionRecordHeader record;
+        memcpy( &record, &currentTransaction->transactionLog[pos], sizeof( record ) );
+        pos += sizeof( record );
+
+        if( record.ftId == ftId && record.index == index && record.len == len )
+        {
+            memcpy( &currentTransaction->transactionLog[pos], data, len );
+            return true;
+        }
+
+        pos += record.len;
+    }
+
+    /* The log is full: the write is dropped and the whole transaction is refused at the commit */
+    bool fits = ( currentTransaction->transactionLen + sizeof( PaymentTransactionRecordHeader ) + len + sizeof( u32 ) <= PAYMENT_TRANSACTION_MAX_LEN );
+    assert( fits );
+    if( !fits )
+    {
+        currentTransaction->transactionOverflow = true;
+        return true;
+    }
+
+    PaymentTransactionRecordHeader record = { ftId, index, len };
+    memcpy( &currentTransaction->transactionLog[currentTransaction->transactionLen], &record, sizeof( record ) );
+    currentTransaction->transactionLen += sizeof( record );
+    memcpy( &currentTransaction->transactionLog[currentTransaction->transactionLen], data, len );
+    currentTransaction->transactionLen += len;
+    ++currentTransaction->transactionRecords;
+
+    return true;
+}
+
+/* The function returns false if the transaction is refused because the log was full */
+bool PaymentTransactionCommit()
+{
+    if( currentTransaction->transactionDepth == 0 || --currentTransaction->transactionDepth != 0 )
+        return true;
+
+#if defined PAYMENT_HOST_BUILD
+    currentTransaction->transactionOverflow |= currentTransaction->transactionRefuseNext;
+    currentTransaction->transactionRefuseNext = false;
+#endif // PAYMENT_HOST_BUILD
+    if( currentTransaction->transactionOverflow )
+    {
+        ++currentTransaction->transactionRefused;
+        return false;
+    }
+
+    if( currentTransaction->transactionRecords == 0 )
+        return true;
+
+    PaymentTransactionHeader header;
+    header.seq = currentTransaction->transactionSeq + 1;
+    header.len = currentTransaction->transactionLen + sizeof( u32 );
+    header.records = currentTransaction->transactionRecords;
+    memcpy( currentTransaction->transactionLog, &header, sizeof( header ) );
+
+    u32 crc = PaymentCrc32( currentTransaction->transactionLog, currentTransaction->transactionLen );
+    memcpy( &currentTransaction->transactionLog[currentTransaction->transactionLen], &crc, sizeof( crc ) );
+
+    writeFile( ftPaymentTransaction_Log, currentTransaction->transactionLog, header.len );
+    currentTransaction->transactionSeq = header.seq;
+
+    applyLog( header.seq, currentTransaction->transactionLen );
+#if defined PAYMENT_HOST_BUILD
+    currentTransaction->transactionCutNext = false;
+#endif // PAYMENT_HOST_BUILD
+    return true;
+}
+
+/*
+The function is called at the start by PaymentRecover() before the files are read,
+only the first call works. The valid log which was not applied completely is applied again.
+The log is read with the length it was written.
+*/
+void PaymentTransactionRecover()
+{
+    if( currentTransaction->transactionRecovered )
+        return;
+    currentTransaction->transactionRecovered = true;
+
+    u32 appliedSeq = 0;
+    if( PaymentFileRead( ftPaymentTransaction_Applied, &appliedSeq ) != sizeof( appliedSeq ) )
+        appliedSeq = 0;
+    currentTransaction->transactionSeq = appliedSeq;
+
+    u16 len = PaymentFileRead( ftPaymentTransaction_Log, &currentTransaction->transactionLog );
+    if( len < sizeof( PaymentTransactionHeader ) )
+        return;
+
+    PaymentTransactionHeader header;
+    memcpy( &header, currentTransaction->transactionLog, sizeof( header ) );
+    if( header.len > len || !checkLog( &header ) || header.seq == appliedSeq )
+        return;
+
+    currentTransaction->transactionSeq = header.seq;
+    applyLog( header.seq, header.len - sizeof( u32 ) );
+}
+
+bool PaymentTransactionIsOpen()
+{
+    return currentTransaction->transactionDepth != 0;
+}
+
+u32 PaymentTransactionGetRefused()
+{
+    return currentTransaction->transactionRefused;
+}
+
+#if defined PAYMENT_HOST_BUILD
+void PaymentTransactionRefuseNext()
+{
+    currentTransaction->transactionRefuseNext = true;
+}
+
+/* The files of the token stay partly written and the log is not marked as applied until the restart */
+void PaymentTransactionCutNext( u16 records )
+{
+    currentTransaction->transactionCutNext = true;
+    currentTransaction->transactionCutRecords = records;
+}
+#endif // PAYMENT_HOST_BUILD
+
+#endif // PAYMENT_TRANSACTION
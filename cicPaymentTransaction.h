@@ -0,0 +1,92 @@
+/*
+    \file PaymentTransaction.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+/*
+Atomic writing of the group of the files (PAYMENT_TRANSACTION).
+While the transaction is open PaymentFileWrite(), PaymentFileIndexWrite() and the counter writes
+do not go to the files but are staged in RAM. At the commit all staged records are written
+as one log with CRC32 to ftPaymentTransaction_Log, then applied to their files one after another
+and the sequence number of the log is saved in ftPaymentTransaction_Applied.
+If the power fails before the log is written completely, its CRC is wrong and none of the records is applied.
+If it fails during the applying, the log is applied again at the start by PaymentTransactionRecover(),
+so the token is executed fully or not at all.
+With PAYMENT_JOURNAL the counters of the token go to one record of the journal, which is staged as the file.
+The log is sized for all files of the token (checked in cicPayment.cpp). If it is full anyway, the transaction
+is refused: nothing is written and PaymentTransactionCommit() returns false.
+Every simulated meter of the host build has its own transaction context, selected by the harness with the meter.
+*/
+
+#if !defined _PAYMENT_TRANSACTION_
+#define _PAYMENT_TRANSACTION_
+
+#include "config.h"
+#include "CommonTypes.h"
+
+#ifndef PAYMENT_TRANSACTION_MAX_LEN
+#define PAYMENT_TRANSACTION_MAX_LEN             704     // log with the header and CRC, checked in cicPayment.cpp
+#endif
+
+static const uint16_t PAYMENT_TRANSACTION_NOT_INDEXED   = 0xFFFF;   // index of the record of the not indexed file
+
+typedef __packed struct{
+    u32         seq;
+    u16         len;                            // header, records and CRC
+    u16         records;
+} PaymentTransactionHeader;
+
+typedef __packed struct{
+    u16         ftId;
+    u16         index;
+    u16         len;
+} PaymentTransactionRecordHeader;
+
+#ifdef PAYMENT_TRANSACTION
+
+typedef struct{
+    BYTE        transactionLog[PAYMENT_TRANSACTION_MAX_LEN];
+    u16         transactionLen;
+    u16         transactionRecords;
+    u32         transactionSeq;                 // the last written log
+    u8          transactionDepth;               // nested Begin() are joined into the outer transaction
+    bool        transactionRecovered;
+    bool        transactionOverflow;
+    u32         transactionRefused;             // transactions not written because the log was full
+#if defined PAYMENT_HOST_BUILD
+    bool        transactionRefuseNext;
+    bool        transactionCutNext;
+    u16         transactionCutRecords;          // records applied by the next commit before the power cut
+#endif // PAYMENT_HOST_BUILD
+} PaymentTransactionContext;
+
+void PaymentTransactionInitContext( PaymentTransactionContext* context );
+void PaymentTransactionSelect( PaymentTransactionContext* context );
+
+void PaymentTransactionBegin();
+bool PaymentTransactionCommit();
+bool PaymentTransactionIsOpen();
+bool PaymentTransactionStage( u16 ftId, u16 index, const void* data, u16 len );
+void PaymentTransactionRecover();
+u32 PaymentTransactionGetRefused();
+#if defined PAYMENT_HOST_BUILD
+void PaymentTransactionRefuseNext();            // the next commit is refused as with the full log (the tests of the host)
+void PaymentTransactionCutNext( u16 records );  // the power is cut after the records of the next log are applied (the tests of the host)
+#endif // PAYMENT_HOST_BUILD
+
+#define PAYMENT_TRANSACTION_BEGIN()             PaymentTransactionBegin()
+#define PAYMENT_TRANSACTION_COMMIT()            PaymentTransactionCommit()
+#define PAYMENT_TRANSACTION_STAGE( ftId, index, data, len )     PaymentTransactionStage( ftId, index, data, len )
+
+#else
+
+#define PAYMENT_TRANSACTION_BEGIN()
+#define PAYMENT_TRANSACTION_COMMIT()            true
+#define PAYMENT_TRANSACTION_STAGE( ftId, index, data, len )     false
+
+#endif // PAYMENT_TRANSACTION
+
+#endif // _PAYMENT_TRANSACTION_
@@ -0,0 +1,314 @@
+/*
+    \file PaymentWriteQueue.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+#include "cicPaymentWriteQueue.h"
+
+#ifdef PAYMENT_WRITE_QUEUE
+
+#include "cicPaymentPort.h"
+#include <assert.h>
+
+enum{
+    queueRecordFree = 0,
+    queueRecordQueued,
+    queueRecordWriting,                         // taken by the writer or by the caller, the data is not changed
+};
+
+/* Shared by the tick and the writer context, every access is in the critical section */
+static PAYMENT_THREAD_LOCAL PaymentWriteQueueContext defaultQueue;
+static PAYMENT_THREAD_LOCAL PaymentWriteQueueContext* currentQueue = &defaultQueue;
+
+void PaymentWriteQueueInitContext( PaymentWriteQueueContext* context )
+{
+    memset( context, 0, sizeof( *context ) );
+}
+
+/* NULL returns to the default queue */
+void PaymentWriteQueueSelect( PaymentWriteQueueContext* context )
+{
+    currentQueue = ( context != NULL ) ? context : &defaultQueue;
+}
+
+/* The queued records are dropped without the writing, the files were formatted */
+void PaymentWriteQueueReset()
+{
+    PaymentPortEnterCritical();
+    PaymentWriteQueueInitContext( currentQueue );
+    PaymentPortExitCritical();
+}
+
+static void writeRecord( const PaymentWriteQueueRecord* record )
+{
+    PAYMENT_WRITE_STATS_RECORD( record->ftId, record->index, record->len );
+    if( record->index == PAYMENT_WRITE_QUEUE_NOT_INDEXED )
+        PaymentPortFileWrite( record->ftId, record->data, record->len );
+    else
+        PaymentPortFileIndexWrite( record->ftId, record->index, record->data, record->len );
+}
+
+/* The newest record of the file or NULL. Must be called in the critical section */
+static PaymentWriteQueueRecord* findRecord( u16 ftId, u16 index )
+{
+    PaymentWriteQueueRecord* newest = NULL;
+    for( u16 i = 0; i < PAYMENT_WRITE_QUEUE_RECORDS; ++i )
+    {
+        PaymentWriteQueueRecord* record = &currentQueue->queueRecords[i];
+        if( record->state != queueRecordFree && record->ftId == ftId && record->index == index &&
+            ( newest == NULL || record->seq > newest->seq ) )
+            newest = record;
+    }
+    return newest;
+}
+
+/*
+The record can be written if no older record of the same file is queued or being written,
+the ordered record only if it is the oldest one. Must be called in the critical section.
+*/
+static bool canWrite( const PaymentWriteQueueRecord* record )
+{
+    if( record->state != queueRecordQueued )
+        return false;
+
+    for( u16 i = 0; i < PAYMENT_WRITE_QUEUE_RECORDS; ++i )
+    {
+        const PaymentWriteQueueRecord* older = &currentQueue->queueRecords[i];
+        if( older->state == queueRecordFree || older->seq >= record->seq )
+            continue;
+        if( record->ordered || ( older->ftId == record->ftId && older->index == record->index ) )
+            return false;
+    }
+    return true;
+}
+
+/* The oldest record which can be written is taken by the calling context, NULL if there is no one */
+static PaymentWriteQueueRecord* takeRecord()
+{
+    PaymentPortEnterCritical();
+    PaymentWriteQueueRecord* oldest = NULL;
+    for( u16 i = 0; i < PAYMENT_WRITE_QUEUE_RECORDS; ++i )
+    {
+        PaymentWriteQueueRecord* record = &currentQueue->queueRecords[i];
+        if( canWrite( record ) && ( oldest == NULL || record->seq < oldest->seq ) )
+            oldest = record;
+    }
+    if( oldest != NULL )
+        oldest->state = queueRecordWriting;
+    PaymentPortExitCritical();
+
+    return oldest;
+}
+
+static void writeTaken( PaymentWriteQueueRecord* record )
+{
+    writeRecord( record );
+
+    PaymentPortEnterCritical();
+    record->state = queueRecordFree;
+    --currentQueue->queueDepth;
+    ++currentQueue->queueStats.written;
+    PaymentPortExitCritical();
+}
+
+/* Must be called in the critical section */
+static PaymentWriteQueueRecord* findFree()
+{
+    for( u16 i = 0; i < PAYMENT_WRITE_QUEUE_RECORDS; ++i )
+    {
+        if( currentQueue->queueRecords[i].state == queueRecordFree )
+            return &currentQueue->queueRecords[i];
+    }
+    return NULL;
+}
+
+/*
+The record is queued after all older ones. If the queue is full the caller writes the oldest record
+which can be written (counted as the stall), the records taken by the other context are not waited for.
+*/
+static void putRecord( u16 ftId, u16 index, const void* data, u16 len, bool ordered )
+{
+    assert( len <= PAYMENT_WRITE_QUEUE_DATA_LEN );     // checked at the compile time by the callers
+
+    PaymentPortEnterCritical();
+    ++currentQueue->queueStats.posted;
+    PaymentWriteQueueRecord* record = findRecord( ftId, index );
+    if( !ordered && record != NULL && record->state == queueRecordQueued && !record->ordered )
+    {
+        record->len = len;
+        memcpy( record->data, data, len );
+        ++currentQueue->queueStats.coalesced;
+        PaymentPortExitCritical();
+        return;
+    }
+
+    while( ( record = findFree() ) == NULL )
+    {
+        ++currentQueue->queueStats.stalls;
+        PaymentPortExitCritical();
+
+        PaymentWriteQueueRecord* taken = takeRecord();
+        if( taken == NULL )
+        {
+            /* all records wait for the ones being written, possible only if the ordered records fill the queue */
+            assert( false );
+            PaymentWriteQueueRecord direct;
+            direct.ftId = ftId;
+            direct.index = index;
+            direct.len = len;
+            memcpy( direct.data, data, len );
+            writeRecord( &direct );
+            return;
+        }
+        writeTaken( taken );
+
+        PaymentPortEnterCritical();
+    }
+
+    record->seq = ++currentQueue->queueSeq;
+    record->ftId = ftId;
+    record->index = index;
+    record->len = len;
+    record->ordered = ordered;
+    memcpy( record->data, data, len );
+    record->state = queueRecordQueued;
+    ++currentQueue->queueDepth;
+    if( currentQueue->queueDepth > currentQueue->queueStats.maxDepth )
+        currentQueue->queueStats.maxDepth = currentQueue->queueDepth;
+    PaymentPortExitCritical();
+}
+
+/* The queued record of the same file is replaced by the newer one, the function always returns true */
+bool PaymentWriteQueuePost( u16 ftId, u16 index, const void* data, u16 len )
+{
+    putRecord( ftId, index, data, len, false );
+    return true;
+}
+
+/* The record is never joined with the queued ones and is written after all older records */
+void PaymentWriteQueueAppend( u16 ftId, u16 index, const void* data, u16 len )
+{
+    putRecord( ftId, index, data, len, true );
+}
+
+/* The function returns false if the file is not queued and must be read, readLen is the length of the queued data */
+bool PaymentWriteQueueRead( u16 ftId, u16 index, void* data, u16 len, u16* readLen )
+{
+    PaymentPortEnterCritical();
+    const PaymentWriteQueueRecord* record = findRecord( ftId, index );
+    if( record != NULL )
+    {
+        *readLen = ( len < record->len ) ? len : record->len;
+        memcpy( data, record->data, *readLen );
+    }
+    PaymentPortExitCritical();
+
+    return record != NULL;
+}
+
+/*
+The queued records of the indexed file are put over the block read from the file (fileLen bytes) in the order
+of the posts, the record of the index is at index * its length. The parts of the block which were never written
+are erased as in the file. The function returns the length of the block.
+*/
+u16 PaymentWriteQueueReadBlock( u16 ftId, void* data, u16 len, u16 fileLen )
+{
+    u8* block = (u8*)data;
+    u32 lastSeq = 0;
+    PaymentPortEnterCritical();
+    for( ;; )
+    {
+        const PaymentWriteQueueRecord* next = NULL;
+        for( u16 i = 0; i < PAYMENT_WRITE_QUEUE_RECORDS; ++i )
+        {
+            const PaymentWriteQueueRecord* record = &currentQueue->queueRecords[i];
+            if( record->state != queueRecordFree && record->ftId == ftId && record->index != PAYMENT_WRITE_QUEUE_NOT_INDEXED &&
+                record->seq > lastSeq && ( next == NULL || record->seq < next->seq ) )
+                next = record;
+        }
+        if( next == NULL )
+            break;
+
+        if( fileLen == 0 )
+        {
+            memset( block, 0xFF, len );
+            fileLen = len;
+        }
+        u32 offset = (u32)next->index * next->len;
+        if( offset < len )
+            memcpy( &block[offset], next->data, ( len - offset < next->len ) ? len - offset : next->len );
+        lastSeq = next->seq;
+    }
+    PaymentPortExitCritical();
+
+    return fileLen;
+}
+
+/*
+Called by the writer context. The record stays in the queue while it is written,
+so the readers get its data, and is not replaced by the newer one (that one is queued after it).
+*/
+bool PaymentWriteQueueWriteNext()
+{
+    PaymentWriteQueueRecord* record = takeRecord();
+    if( record == NULL )
+        return false;
+
+    writeTaken( record );
+    return true;
+}
+
+/*
+The caller writes all records it can. The records of the file being written by the other context
+stay queued after it, they are never written around it.
+*/
+void PaymentWriteQueueDrain()
+{
+    while( PaymentWriteQueueWriteNext() )
+        ;
+}
+
+bool PaymentWriteQueueHasRecord( u16 ftId, u16 index )
+{
+    PaymentPortEnterCritical();
+    bool queued = ( findRecord( ftId, index ) != NULL );
+    PaymentPortExitCritical();
+
+    return queued;
+}
+
+bool PaymentWriteQueueHasFile( u16 ftId )
+{
+    bool queued = false;
+    PaymentPortEnterCritical();
+    for( u16 i = 0; i < PAYMENT_WRITE_QUEUE_RECORDS; ++i )
+    {
+        if( currentQueue->queueRecords[i].state != queueRecordFree && currentQueue->queueRecords[i].ftId == ftId )
+            queued = true;
+    }
+    PaymentPortExitCritical();
+
+    return queued;
+}
+
+u16 PaymentWriteQueueGetDepth()
+{
+    PaymentPortEnterCritical();
+    u16 depth = currentQueue->queueDepth;
+    PaymentPortExitCritical();
+
+    return depth;
+}
+
+void PaymentWriteQueueGetStats( PaymentWriteQueueStats* stats )
+{
+    PaymentPortEnterCritical();
+    *stats = currentQueue->queueStats;
+    PaymentPortExitCritical();
+}
+
+#endif // PAYMENT_WRITE_QUEUE
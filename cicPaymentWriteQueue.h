@@ -0,0 +1,100 @@
+/*
+    \file PaymentWriteQueue.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+/*
+Queue of the writes of the Payment objects (PAYMENT_WRITE_QUEUE).
+PaymentFileWrite() and PaymentFileIndexWrite() only post the record to the bounded queue in RAM,
+the low priority writer context calls PaymentWriteQueueWriteNext() and writes the records to the files,
+so the time of the tick does not depend on the flash timing.
+The record of the file which is still in the queue is replaced by the newer one, PaymentFileRead()
+and PaymentFileIndexRead() return the queued data, so the readers never see the older file.
+The indexed file read as one block gets its queued records put over the records read from the file.
+If the queue is full the caller writes the oldest record it can (counted as the stall).
+The state of the queue is shared by the tick and the writer context and is accessed only in the short sections
+of PaymentPortEnterCritical(), the record being written by one context stays in the queue unchanged,
+so the other one never waits for it. A record is never written before the older record of the same file,
+the ordered records (PaymentWriteQueueAppend) are written after all older ones.
+The transaction writes its files which are in the queue as the ordered records, the files of the journal
+compaction, the snapshot and the emergency area are never queued. At the power fail the queued counters
+are put into the emergency record, the queue is not drained.
+Every simulated meter of the host build has its own queue, selected by the harness with the meter.
+*/
+
+#if !defined _PAYMENT_WRITE_QUEUE_
+#define _PAYMENT_WRITE_QUEUE_
+
+#include "config.h"
+#include "CommonTypes.h"
+
+#ifndef PAYMENT_WRITE_QUEUE_RECORDS
+#define PAYMENT_WRITE_QUEUE_RECORDS             16
+#endif
+
+#ifndef PAYMENT_WRITE_QUEUE_DATA_LEN
+#define PAYMENT_WRITE_QUEUE_DATA_LEN            128     // the record of the journal and the received token, checked in cicPayment.cpp
+#endif
+
+static const uint16_t PAYMENT_WRITE_QUEUE_NOT_INDEXED   = 0xFFFF;   // index of the record of the not indexed file
+
+typedef struct{
+    u32         posted;
+    u32         coalesced;                      // replaced records of the same file
+    u32         written;
+    u32         stalls;                         // records written by the caller because the queue was full
+    u16         maxDepth;
+} PaymentWriteQueueStats;
+
+#ifdef PAYMENT_WRITE_QUEUE
+
+typedef struct{
+    u32         seq;                            // order of the posts
+    u16         ftId;
+    u16         index;
+    u16         len;
+    u8          state;
+    bool        ordered;                        // written only after all older records
+    u8          data[PAYMENT_WRITE_QUEUE_DATA_LEN];
+} PaymentWriteQueueRecord;
+
+typedef struct{
+    PaymentWriteQueueRecord     queueRecords[PAYMENT_WRITE_QUEUE_RECORDS];
+    u32                         queueSeq;
+    u16                         queueDepth;
+    PaymentWriteQueueStats      queueStats;
+} PaymentWriteQueueContext;
+
+void PaymentWriteQueueInitContext( PaymentWriteQueueContext* context );
+void PaymentWriteQueueSelect( PaymentWriteQueueContext* context );
+void PaymentWriteQueueReset();
+
+bool PaymentWriteQueuePost( u16 ftId, u16 index, const void* data, u16 len );
+void PaymentWriteQueueAppend( u16 ftId, u16 index, const void* data, u16 len );
+bool PaymentWriteQueueRead( u16 ftId, u16 index, void* data, u16 len, u16* readLen );
+u16 PaymentWriteQueueReadBlock( u16 ftId, void* data, u16 len, u16 fileLen );
+bool PaymentWriteQueueWriteNext();
+void PaymentWriteQueueDrain();
+bool PaymentWriteQueueHasRecord( u16 ftId, u16 index );
+bool PaymentWriteQueueHasFile( u16 ftId );
+u16 PaymentWriteQueueGetDepth();
+void PaymentWriteQueueGetStats( PaymentWriteQueueStats* stats );
+
+#define PAYMENT_WRITE_QUEUE_POST( ftId, index, data, len )      PaymentWriteQueuePost( ftId, index, data, len )
+#define PAYMENT_WRITE_QUEUE_READ( ftId, index, data, len, readLen )     PaymentWriteQueueRead( ftId, index, data, len, readLen )
+#define PAYMENT_WRITE_QUEUE_READ_BLOCK( ftId, data, len, fileLen )     PaymentWriteQueueReadBlock( ftId, data, len, fileLen )
+#define PAYMENT_WRITE_QUEUE_HAS_FILE( ftId )                    PaymentWriteQueueHasFile( ftId )
+
+#else
+
+#define PAYMENT_WRITE_QUEUE_POST( ftId, index, data, len )      false
+#define PAYMENT_WRITE_QUEUE_READ( ftId, index, data, len, readLen )     false
+#define PAYMENT_WRITE_QUEUE_READ_BLOCK( ftId, data, len, fileLen )     ( fileLen )
+#define PAYMENT_WRITE_QUEUE_HAS_FILE( ftId )                    ( (void)( ftId ), false )
+
+#endif // PAYMENT_WRITE_QUEUE
+
+#endif // _PAYMENT_WRITE_QUEUE_
@@ -0,0 +1,174 @@
+/*
+    \file PaymentWriteStats.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+#include "cicPaymentWriteStats.h"
+
+#ifdef PAYMENT_WRITE_STATS
+
+#include "cicPaymentPort.h"
+
+static PAYMENT_THREAD_LOCAL PaymentWriteStatsContext defaultStats = { {}, 0, 0, 0xff };
+static PAYMENT_THREAD_LOCAL PaymentWriteStatsContext* currentStats = &defaultStats;
+
+void PaymentWriteStatsInitContext( PaymentWriteStatsContext* context )
+{
+    memset( context, 0, sizeof( *context ) );
+    context->writeStatsCurrentDay = 0xff;
+}
+
+/* NULL returns to the default statistics */
+void PaymentWriteStatsSelect( PaymentWriteStatsContext* context )
+{
+    currentStats = ( context != NULL ) ? context : &defaultStats;
+}
+
+static PaymentWriteStatsFile* findFile( PaymentWriteStatsContext* context, u16 ftId, u16 index )
+{
+    for( u8 i = 0; i < context->writeStatsFilesNum; ++i )
+    {
+        if( context->writeStatsFiles[i].ftId == ftId && context->writeStatsFiles[i].index == index )
+            return &context->writeStatsFiles[i];
+    }
+
+    if( context->writeStatsFilesNum == MAX_PAYMENT_WRITE_STATS_FILES )
+        return NULL;                                                            // table is full, the file is not counted
+
+    PaymentWriteStatsFile* file = &context->writeStatsFiles[context->writeStatsFilesNum++];
+    memset( file, 0, sizeof( *file ) );
+    file->ftId = ftId;
+    file->index = index;
+
+    return file;
+}
+
+void PaymentWriteStatsRecord( u16 ftId, u16 index, u16 len )
+{
+    PaymentWriteStatsFile* file = findFile( currentStats, ftId, index );
+    if( file == NULL )
+        return;
+
+    ++file->writesToday;
+    file->bytesToday += len;
+}
+
+/* Closes the day when the date of the (simulated) clock has changed, now is the time of the tick */
+void PaymentWriteStatsIdleMinute( const TDateTime* now )
+{
+    if( currentStats->writeStatsCurrentDay == 0xff )
+    {
+        currentStats->writeStatsCurrentDay = now->date.day;
+        return;
+    }
+
+    if( now->date.day != currentStats->writeStatsCurrentDay )
+    {
+        currentStats->writeStatsCurrentDay = now->date.day;
+        PaymentWriteStatsEndOfDay();
+    }
+}
+
+void PaymentWriteStatsEndOfDay()
+{
+    for( u8 i = 0; i < currentStats->writeStatsFilesNum; ++i )
+    {
+        PaymentWriteStatsFile* file = &currentStats->writeStatsFiles[i];
+
+        if( file->writesToday > file->maxWritesPerDay )
+            file->maxWritesPerDay = file->writesToday;
+
+        file->writesTotal += file->writesToday;
+        file->bytesTotal += file->bytesToday;
+        file->writesToday = 0;
+        file->bytesToday = 0;
+    }
+
+    ++currentStats->writeStatsDays;
+}
+
+u32 PaymentWriteStatsGetDays()
+{
+    return currentStats->writeStatsDays;
+}
+
+u8 PaymentWriteStatsGetFilesNum()
+{
+    return currentStats->writeStatsFilesNum;
+}
+
+const PaymentWriteStatsFile* PaymentWriteStatsGetFile( u8 pos )
+{
+    if( pos >= currentStats->writeStatsFilesNum )
+        return NULL;
+
+    return &currentStats->writeStatsFiles[pos];
+}
+
+/*
+The function returns after how many days the location reaches the endurance of the memory.
+Every write of the location rewrites it, so one write is one cycle.
+Returns 0xFFFFFFFF if the file was not written during the finished days.
+*/
+u32 PaymentWriteStatsProjectLifetimeDays( const PaymentWriteStatsFile* file, u64 enduranceCycles )
+{
+    if( currentStats->writeStatsDays == 0 || file->writesTotal == 0 )
+        return 0xFFFFFFFF;
+
+    u64 lifetimeDays = ( enduranceCycles * currentStats->writeStatsDays ) / file->writesTotal;
+    if( lifetimeDays > 0xFFFFFFFF )
+        return 0xFFFFFFFF;
+
+    return (u32)lifetimeDays;
+}
+
+/* The function returns the location with the most writes per day (the shortest lifetime) */
+const PaymentWriteStatsFile* PaymentWriteStatsFindWorstFile()
+{
+    const PaymentWriteStatsFile* worstFile = NULL;
+
+    for( u8 i = 0; i < currentStats->writeStatsFilesNum; ++i )
+    {
+        if( worstFile == NULL || currentStats->writeStatsFiles[i].writesTotal > worstFile->writesTotal )
+            worstFile = &currentStats->writeStatsFiles[i];
+    }
+
+    return worstFile;
+}
+
+/*
+Adds the statistics of the selected meter to the totals. Locations are matched by ftId and index,
+the days are added as the days of the meters, so the projected lifetime of the totals is for the average meter.
+maxWritesPerDay of the totals is the maximum over the meters.
+*/
+void PaymentWriteStatsAccumulate( PaymentWriteStatsContext* total )
+{
+    for( u8 i = 0; i < currentStats->writeStatsFilesNum; ++i )
+    {
+        const PaymentWriteStatsFile* file = &currentStats->writeStatsFiles[i];
+        PaymentWriteStatsFile* sum = findFile( total, file->ftId, file->index );
+        if( sum == NULL )
+            continue;
+
+        sum->writesToday += file->writesToday;
+        sum->bytesToday += file->bytesToday;
+        sum->writesTotal += file->writesTotal;
+        sum->bytesTotal += file->bytesTotal;
+        if( file->maxWritesPerDay > sum->maxWritesPerDay )
+            sum->maxWritesPerDay = file->maxWritesPerDay;
+    }
+
+    total->writeStatsDays += currentStats->writeStatsDays;
+}
+
+void PaymentWriteStatsReset()
+{
+    currentStats->writeStatsFilesNum = 0;
+    currentStats->writeStatsDays = 0;
+    currentStats->writeStatsCurrentDay = 0xff;
+}
+
+#endif // PAYMENT_WRITE_STATS
@@ -0,0 +1,76 @@
+/*
+    \file PaymentWriteStats.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+/*
+Statistics of the writes of the Payment objects to the FRAM/flash (PAYMENT_WRITE_STATS).
+Every write through the port is counted per location of the ft* file (the not indexed file or one index
+of the indexed file, so every record of a ring is counted apart): number of operations and bytes,
+for the current day and for all finished days. From the average writes per day and the
+endurance of the memory part the expected lifetime of every location is projected.
+Every simulated meter of the host build has its own statistics, selected by the harness with the meter.
+The statistics of the fleet are summed into one more context by PaymentWriteStatsAccumulate() and are read
+with the same functions after it is selected.
+*/
+
+#if !defined _PAYMENT_WRITE_STATS_
+#define _PAYMENT_WRITE_STATS_
+
+#include "config.h"
+#include "CommonTypes.h"
+#include "cicClock.h"               // TDateTime of the tick
+
+static const uint8_t MAX_PAYMENT_WRITE_STATS_FILES      = 128;      // locations: the rings and the CRC records take one per index
+static const uint16_t PAYMENT_WRITE_STATS_NOT_INDEXED   = 0xFFFF;   // index of the not indexed file
+
+static const u64 PAYMENT_FRAM_ENDURANCE_CYCLES          = 100000000000000ULL;      // 10^14
+static const u64 PAYMENT_FLASH_ENDURANCE_CYCLES         = 100000ULL;               // 10^5
+
+typedef struct{
+    u16         ftId;
+    u16         index;
+    u32         writesToday;
+    u32         bytesToday;
+    u32         maxWritesPerDay;
+    u64         writesTotal;                    // finished days only
+    u64         bytesTotal;                     // finished days only
+} PaymentWriteStatsFile;
+
+#ifdef PAYMENT_WRITE_STATS
+
+typedef struct{
+    PaymentWriteStatsFile   writeStatsFiles[MAX_PAYMENT_WRITE_STATS_FILES];
+    u8                      writeStatsFilesNum;
+    u32                     writeStatsDays;     // finished days, of all meters in the totals
+    u8                      writeStatsCurrentDay;
+} PaymentWriteStatsContext;
+
+void PaymentWriteStatsInitContext( PaymentWriteStatsContext* context );
+void PaymentWriteStatsSelect( PaymentWriteStatsContext* context );
+
+void PaymentWriteStatsRecord( u16 ftId, u16 index, u16 len );
+void PaymentWriteStatsIdleMinute( const TDateTime* now );
+void PaymentWriteStatsEndOfDay();
+u32 PaymentWriteStatsGetDays();
+u8 PaymentWriteStatsGetFilesNum();
+const PaymentWriteStatsFile* PaymentWriteStatsGetFile( u8 pos );
+u32 PaymentWriteStatsProjectLifetimeDays( const PaymentWriteStatsFile* file, u64 enduranceCycles );
+const PaymentWriteStatsFile* PaymentWriteStatsFindWorstFile();
+void PaymentWriteStatsAccumulate( PaymentWriteStatsContext* total );
+void PaymentWriteStatsReset();
+
+#define PAYMENT_WRITE_STATS_RECORD( ftId, index, len )  PaymentWriteStatsRecord( ftId, index, len )
+#define PAYMENT_WRITE_STATS_IDLE_MINUTE( now )          PaymentWriteStatsIdleMinute( now )
+
+#else
+
+#define PAYMENT_WRITE_STATS_RECORD( ftId, index, len )
+#define PAYMENT_WRITE_STATS_IDLE_MINUTE( now )
+
+#endif // PAYMENT_WRITE_STATS
+
+#endif // _PAYMENT_WRITE_STATS_
@@ -0,0 +1,212 @@
+/*
+    \file HostFirmware.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+/*
+Stand-in implementations of the firmware services used by the Payment objects in the host build:
+the conversions of cicClock, A-XDR, the wildcard check, the logical names and the object maps.
+The host has no time zone and DST, the local time is UTC.
+*/
+
+#include "config.h"
+#include <time.h>
+#include "CommonTypes.h"
+#include "cicClock.h"
+#include "core.h"
+#include "wildcards.h"
+#include "_objectMaps.h"
+
+/* The maps are filled by the constructors of the static Payment objects, so they are constructed first */
+cicObjectsMap DataObjectsMap __attribute__(( init_priority( 101 ) ));
+cicObjectsMap RegisterObjectsMap __attribute__(( init_priority( 101 ) ));
+cicObjectsMap PaymentAccountObjectsMap __attribute__(( init_priority( 101 ) ));
+cicObjectsMap PaymentCreditObjectsMap __attribute__(( init_priority( 101 ) ));
+cicObjectsMap PaymentChargeObjectsMap __attribute__(( init_priority( 101 ) ));
+
+const LOGICAL_NAME RegisterAsumLN                   = { 1, 0, 15, 8, 0, 255 };
+const LOGICAL_NAME cicDataState1BaseLN              = { 0, 0, 96, 5, 0, 255 };
+const LOGICAL_NAME cicDataAlarmBaseLN               = { 0, 0, 97, 98, 0, 255 };
+
+const LOGICAL_NAME PaymentImportAccountLn           = { 0, 0, 19, 0, 0, 255 };
+const LOGICAL_NAME PaymentImportCreditLn            = { 0, 0, 19, 10, 0, 255 };
+const LOGICAL_NAME PaymentActiveImportChargeLn      = { 0, 0, 19, 20, 0, 255 };
+const LOGICAL_NAME PaymentImportTokenGatewayLn      = { 0, 0, 19, 40, 0, 255 };
+const LOGICAL_NAME ActiveTransactionIDLn            = { 0, 0, 96, 60, 31, 255 };
+const LOGICAL_NAME TopUpsSumLn                      = { 0, 0, 96, 60, 32, 255 };
+const LOGICAL_NAME TotalAmountPaidLn                = { 0, 0, 96, 60, 33, 255 };
+const LOGICAL_NAME ExpiresTimeLn                    = { 0, 0, 96, 60, 34, 255 };
+const LOGICAL_NAME OutTokenLn                       = { 0, 0, 96, 60, 35, 255 };
+const LOGICAL_NAME ConsumedKWhFromStartLn           = { 1, 0, 15, 9, 0, 255 };
+const LOGICAL_NAME TokenIDLn                        = { 0, 0, 128, 8, 0, 255 };
+
+/************************************************************************************************/
+/******************************************* Clock **********************************************/
+/************************************************************************************************/
+
+static const s32 DAYS_FROM_1970_TO_1980             = 3652;
+
+/* Days from 1970-01-01 of the civil date */
+static s32 daysFromCivil( s32 year, u32 month, u32 day )
+{
+    year -= ( month <= 2 );
+    s32 era = ( year >= 0 ? year : year - 399 ) / 400;
+    u32 yearOfEra = (u32)( year - era * 400 );
+    u32 dayOfYear = ( 153 * ( month + ( month > 2 ? -3 : 9 ) ) + 2 ) / 5 + day - 1;
+    u32 dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + (s32)dayOfEra - 719468;
+}
+
+static void civilFromDays( s32 days, u16* year, u8* month, u8* day )
+{
+    days += 719468;
+    s32 era = ( days >= 0 ? days : days - 146096 ) / 146097;
+    u32 dayOfEra = (u32)( days - era * 146097 );
+    u32 yearOfEra = ( dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096 ) / 365;
+    u32 dayOfYear = dayOfEra - ( 365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100 );
+    u32 mp = ( 5 * dayOfYear + 2 ) / 153;
+    *day = (u8)( dayOfYear - ( 153 * mp + 2 ) / 5 + 1 );
+    *month = (u8)( mp < 10 ? mp + 3 : mp - 9 );
+    *year = (u16)( (s32)yearOfEra + era * 400 + ( *month <= 2 ) );
+}
+
+u32 GetSecondsUTC( TDateTime* dateTime )
+{
+    u16 year = dateTime->date.year_hi << 8 | dateTime->date.year_low;
+    s32 days = daysFromCivil( year, dateTime->date.month, dateTime->date.day ) - DAYS_FROM_1970_TO_1980;
+
+    return (u32)days * 86400 + dateTime->time.hour * 3600 + dateTime->time.minute * 60 + dateTime->time.second;
+}
+
+void SecondsTo_Local_DateTime( DWORD seconds, TDateTime* dateTime )
+{
+    u16 year;
+
+    memset( dateTime, 0, sizeof( *dateTime ) );
+    civilFromDays( (s32)( seconds / 86400 ) + DAYS_FROM_1970_TO_1980, &year, &dateTime->date.month, &dateTime->date.day );
+    dateTime->date.year_hi = year >> 8;
+    dateTime->date.year_low = year & 0xff;
+    dateTime->date.w_day = GetWeekDayFromDate( year, dateTime->date.month, dateTime->date.day );
+    dateTime->time.hour = ( seconds % 86400 ) / 3600;
+    dateTime->time.minute = ( seconds % 3600 ) / 60;
+    dateTime->time.second = seconds % 60;
+    dateTime->time.hundredths = 0;
+}
+
+/* 1970-01-01 was Thursday */
+u8 GetWeekDayFromDate( u16 year, u8 month, u8 day )
+{
+    s32 days = daysFromCivil( year, month, day );
+    return (u8)( ( ( days % 7 ) + 7 + 3 ) % 7 + 1 );
+}
+
+void GetLocalTime_APDU( TDateTime* dateTime )
+{
+    SecondsTo_Local_DateTime( (DWORD)( time( NULL ) - (time_t)DAYS_FROM_1970_TO_1980 * 86400 ), dateTime );
+}
+
+DWORD PackTdateTime( TDateTime* dateTime )
+{
+    u16 year = dateTime->date.year_hi << 8 | dateTime->date.year_low;
+
+    return (DWORD)( year - 2000 ) << 26 |
+           (DWORD)( dateTime->date.month & 0x0f ) << 22 |
+           (DWORD)( dateTime->date.day & 0x1f ) << 17 |
+           (DWORD)( dateTime->time.hour & 0x1f ) << 12 |
+           (DWORD)( dateTime->time.minute & 0x3f ) << 6 |
+           (DWORD)( dateTime->time.second & 0x3f );
+}
+
+void UnpackTDateTime( DWORD packed, TDateTime* dateTime )
+{
+    u16 year = ( packed >> 26 ) + 2000;
+
+    memset( dateTime, 0, sizeof( *dateTime ) );
+    dateTime->date.year_hi = year >> 8;
+    dateTime->date.year_low = year & 0xff;
+    dateTime->date.month = ( packed >> 22 ) & 0x0f;
+    dateTime->date.day = ( packed >> 17 ) & 0x1f;
+    dateTime->date.w_day = GetWeekDayFromDate( year, dateTime->date.month, dateTime->date.day );
+    dateTime->time.hour = ( packed >> 12 ) & 0x1f;
+    dateTime->time.minute = ( packed >> 6 ) & 0x3f;
+    dateTime->time.second = packed & 0x3f;
+}
+
+/************************************************************************************************/
+/******************************************* A-XDR **********************************************/
+/************************************************************************************************/
+
+static void encodeBigEndian( BYTE* buf, u64 value, u8 len )
+{
+    for( u8 i = 0; i < len; ++i )
+        buf[i] = (BYTE)( value >> ( 8 * ( len - 1 - i ) ) );
+}
+
+static u64 decodeBigEndian( const BYTE* buf, u8 len )
+{
+    u64 value = 0;
+    for( u8 i = 0; i < len; ++i )
+        value = value << 8 | buf[i];
+    return value;
+}
+
+void AXDREncodeWord( BYTE* buf, u16 value )             { encodeBigEndian( buf, value, 2 ); }
+void AXDRDecodeWord( BYTE* buf, u16* value )            { *value = (u16)decodeBigEndian( buf, 2 ); }
+void AXDREncodeShort( BYTE* buf, s16 value )            { encodeBigEndian( buf, (u16)value, 2 ); }
+void AXDRDecodeShort( BYTE* buf, s16* value )           { *value = (s16)decodeBigEndian( buf, 2 ); }
+void AXDREncodeDword( BYTE* buf, u32 value )            { encodeBigEndian( buf, value, 4 ); }
+void AXDRDecodeDword( BYTE* buf, u32* value )           { *value = (u32)decodeBigEndian( buf, 4 ); }
+void AXDREncodeDoubleLong( BYTE* buf, s32 value )       { encodeBigEndian( buf, (u32)value, 4 ); }
+void AXDRDecodeDoubleLong( BYTE* buf, s32* value )      { *value = (s32)decodeBigEndian( buf, 4 ); }
+void AXDREncodeULong64( BYTE* buf, u64 value )          { encodeBigEndian( buf, value, 8 ); }
+
+void AXDRDecodeULong64( BYTE* buf, u8* value )
+{
+    u64 decoded = decodeBigEndian( buf, 8 );
+    memcpy( value, &decoded, sizeof( decoded ) );
+}
+
+void AXDREncodeBitStringTag( BYTE* buf, u8* bits, u8 bitsNum )
+{
+    buf[0] = eDT_BitString;
+    buf[1] = bitsNum;
+    memcpy( &buf[2], bits, ( bitsNum + 7 ) / 8 );
+}
+
+void AXDRDecodeBitStringFixed( BYTE* buf, u8* bits, u8 bitsNum )
+{
+    memcpy( bits, buf, ( bitsNum + 7 ) / 8 );
+}
+
+void AXDREncodeOctetStringTag( BYTE* buf, u8* data, u8 len )
+{
+    buf[0] = eDT_OctetString;
+    buf[1] = len;
+    memcpy( &buf[2], data, len );
+}
+
+/************************************************************************************************/
+/***************************************** Wildcards ********************************************/
+/************************************************************************************************/
+
+static bool inRangeOrWildcard( u8 value, u8 min, u8 max, u8 wildcard )
+{
+    return ( value >= min && value <= max ) || value == wildcard;
+}
+
+bool IsValidWildcard( TDateTime* dateTime )
+{
+    u8 month = dateTime->date.month;
+    u8 day = dateTime->date.day;
+
+    return ( inRangeOrWildcard( month, 1, 12, 0xff ) || month == 0xfd || month == 0xfe ) &&
+           ( inRangeOrWildcard( day, 1, 31, 0xff ) || day == 0xfd || day == 0xfe ) &&
+           inRangeOrWildcard( dateTime->date.w_day, 1, 7, 0xff ) &&
+           inRangeOrWildcard( dateTime->time.hour, 0, 23, 0xff ) &&
+           inRangeOrWildcard( dateTime->time.minute, 0, 59, 0xff ) &&
+           inRangeOrWildcard( dateTime->time.second, 0, 59, 0xff );
+}
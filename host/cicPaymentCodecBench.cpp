@@ -0,0 +1,196 @@
+/*
+    \file PaymentCodecBench.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+
+/*
+Benchmark of the COSEM codec of the Payment classes (PAYMENT_PROFILING).
+Every attribute of the account, credit, charge and token gateway and of the helper data objects is read by Get,
+every writable attribute is written by Set with the worst-case payload (cicPaymentCodecPayload), the tokens of the
+vending mix go through Action of the token gateway. The attribute above the table is requested as well,
+its calls are counted in the last row of the class.
+The table gives bytes/call, ns/call, the worst call and bytes/sec of every attribute.
+Usage: payment_codec_bench [iterations]
+*/
+
+#include "cicPaymentHost.h"
+#include "cicPaymentPort.h"
+#include "cicPaymentCodecPayload.h"
+#include "cicPaymentTokenMix.h"
+#include "_objectMaps.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static PaymentHostObjects objects;
+
+static const char* const classNames[PaymentProfileCodecClassesNum] = {
+    "account", "credit", "charge", "token gateway", "data"
+};
+
+static const char* const directionNames[PaymentProfileCodecDirectionsNum] = {
+    "get", "set", "action"
+};
+
+static const u8 ABOVE_TABLE_ATTR        = PAYMENT_PROFILE_CODEC_ATTRS + 5;
+
+typedef struct{
+    BYTE        payload[PAYMENT_CODEC_PAYLOAD_BUF_LEN];
+    u16         len;
+} SetPayload;
+
+static SetPayload payloads[PaymentProfileCodecTokenGateway][PAYMENT_PROFILE_CODEC_ATTRS];
+
+template< typename T >
+static void getAll( T* object, u8 firstAttr, u8 lastAttr )
+{
+    BYTE bufResponse[PAYMENT_CODEC_PAYLOAD_BUF_LEN * 2];
+    uint16_t lenResponse;
+
+    for( u8 attrID = firstAttr; attrID <= lastAttr; ++attrID )
+        object->Get( attrID, NULL, bufResponse, lenResponse );
+    object->Get( ABOVE_TABLE_ATTR, NULL, bufResponse, lenResponse );
+}
+
+template< typename T >
+static void getData( cicObjectsMap* map, const LOGICAL_NAME* ln, u8 lastAttr )
+{
+    T* object = (T*)(*map)[(LOGICAL_NAME*)ln];
+    if( object != NULL )
+        getAll( object, 1, lastAttr );
+}
+
+template< typename T >
+static u8 setAll( T* object, PaymentProfileCodecClass codecClass )
+{
+    u8 failed = 0;
+    for( u8 attrID = 0; attrID < PAYMENT_PROFILE_CODEC_ATTRS; ++attrID )
+    {
+        SetPayload* payload = &payloads[codecClass][attrID];
+        if( payload->len != 0 && object->Set( attrID, payload->payload ) != Success )
+        {
+            printf( "%s attribute %u: the payload is refused\n", classNames[codecClass], attrID );
+            ++failed;
+        }
+    }
+    object->Set( ABOVE_TABLE_ATTR, payloads[codecClass][0].payload );
+    return failed;
+}
+
+static void printStats()
+{
+    printf( "%-14s %-7s %5s %10s %10s %10s %10s %12s\n", "class", "", "attr", "calls", "bytes", "ns/call", "worst ns", "bytes/s" );
+    for( u8 codecClass = 0; codecClass < PaymentProfileCodecClassesNum; ++codecClass )
+    {
+        for( u8 direction = 0; direction < PaymentProfileCodecDirectionsNum; ++direction )
+        {
+            for( u8 attrID = 0; attrID <= PAYMENT_PROFILE_CODEC_OTHER_ATTR; ++attrID )
+            {
+                const PaymentProfileCodecStats* stats = PaymentProfileGetCodecStats( (PaymentProfileCodecClass)codecClass, (PaymentProfileCodecDirection)direction, attrID );
+                if( stats->calls == 0 )
+                    continue;
+
+                char attrName[8];
+                snprintf( attrName, sizeof( attrName ), ( attrID == PAYMENT_PROFILE_CODEC_OTHER_ATTR ) ? ">=%u" : "%u", attrID );
+                printf( "%-14s %-7s %5s %10u %10llu %10llu %10llu %12u\n", classNames[codecClass], directionNames[direction], attrName, stats->calls,
+                        (unsigned long long)( stats->sumBytes / stats->calls ),
+                        (unsigned long long)( stats->sumCycles * 1000000000ULL / PAYMENT_CPU_FREQ_HZ / stats->calls ),
+                        (unsigned long long)stats->maxCycles * 1000000000ULL / PAYMENT_CPU_FREQ_HZ,
+                        PaymentProfileGetCodecBytesPerSecond( (PaymentProfileCodecClass)codecClass, (PaymentProfileCodecDirection)direction, attrID ) );
+            }
+        }
+    }
+}
+
+int main( int argc, char** argv )
+{
+    u32 iterations = ( argc > 1 ) ? atoi( argv[1] ) : 1000;
+
+    if( !PaymentHostGetImportObjects( &objects ) )
+    {
+        printf( "objects are not registered in the maps\n" );
+        return 1;
+    }
+
+    PaymentHostFormat();
+    PaymentHostSetRegister( &RegisterAsumLN, 0, 0, UnitWh );
+
+    TDateTime start = {};
+    start.date.year_hi = 2021 >> 8;
+    start.date.year_low = 2021 & 0xff;
+    start.date.month = 3;
+    start.date.day = 1;
+    PaymentVirtualClockSet( &start );
+
+    PaymentHostInitObjects( &objects );
+
+    PaymentTokenMix mix;
+    BYTE bufToken[PAYMENT_HOST_TOKEN_BUF_LEN];
+    BYTE bufResponse[16];
+    uint16_t lenResponse;
+    PaymentTokenMixInit( &mix, &PAYMENT_TOKEN_MIX_CAMPAIGN, 1 );
+
+    /* the order is open, so the gateway and the helper objects hold the values of the token */
+    do
+    {
+        PaymentTokenMixNext( &mix, bufToken );
+        objects.tokenGateway->Action( PaymentTokenGatewayEnter, bufToken, bufResponse, lenResponse );
+        PaymentTokenMixResult( &mix, ( lenResponse > 6 ) ? bufResponse[6] : (u8)executionFAIL );
+    } while( mix.order != (u8)inTokenSubtype::startPaidToken );
+
+    PaymentCodecPayloadPrepare( &objects );
+    for( u8 codecClass = 0; codecClass < PaymentProfileCodecTokenGateway; ++codecClass )
+    {
+        for( u8 attrID = 0; attrID < PAYMENT_PROFILE_CODEC_ATTRS; ++attrID )
+            payloads[codecClass][attrID].len = PaymentCodecPayloadBuildSet( &objects, (PaymentProfileCodecClass)codecClass, attrID, payloads[codecClass][attrID].payload );
+    }
+
+    /* the request nested deeper than its buffer is not read after the buffer */
+    BYTE nested[2 * PAYMENT_PROFILE_DATA_DEPTH + 2];
+    for( u8 i = 0; i < sizeof( nested ); i += 2 )
+    {
+        nested[i] = eDT_Structure;
+        nested[i + 1] = 0xFF;
+    }
+    if( PaymentProfileDataLength( nested, sizeof( nested ) ) > sizeof( nested ) )
+    {
+        printf( "length of the nested request is out of its buffer\n" );
+        return 1;
+    }
+
+    PaymentProfileReset();
+    u8 failed = 0;
+    for( u32 i = 0; i < iterations; ++i )
+    {
+        getAll( objects.account, 1, PaymentAccountMaxProvisionPeriodAttr );
+        getAll( objects.creditList[0], 1, PaymentCreditPeriodAttr );
+        getAll( objects.chargeList[0], 1, PaymentChargeProportionAttr );
+        getAll( objects.tokenGateway, 1, PaymentTokenGatewayTokenStatusAttr );
+
+        getData<OutTokenClass>( &DataObjectsMap, &OutTokenLn, OutTokenClass::ValueAttr );
+        getData<ActiveTransactionIDClass>( &DataObjectsMap, &ActiveTransactionIDLn, ActiveTransactionIDClass::ValueAttr );
+        getData<TokenIDClass>( &DataObjectsMap, &TokenIDLn, TokenIDClass::ValueAttr );
+        getData<ExpiresTimeClass>( &DataObjectsMap, &ExpiresTimeLn, ExpiresTimeClass::ValueAttr );
+        getData<TopUpsSumClass>( &RegisterObjectsMap, &TopUpsSumLn, TopUpsSumClass::ScalerUnitAttr );
+        getData<TotalAmountPaidClass>( &RegisterObjectsMap, &TotalAmountPaidLn, TotalAmountPaidClass::ScalerUnitAttr );
+        getData<ConsumedKWhFromStartClass>( &RegisterObjectsMap, &ConsumedKWhFromStartLn, ConsumedKWhFromStartClass::ScalerUnitAttr );
+
+        failed += setAll( objects.account, PaymentProfileCodecAccount );
+        failed += setAll( objects.creditList[0], PaymentProfileCodecCredit );
+        failed += setAll( objects.chargeList[0], PaymentProfileCodecCharge );
+
+        PaymentTokenMixNext( &mix, bufToken );
+        objects.tokenGateway->Action( PaymentTokenGatewayEnter, bufToken, bufResponse, lenResponse );
+        PaymentTokenMixResult( &mix, ( lenResponse > 6 ) ? bufResponse[6] : (u8)executionFAIL );
+
+        if( failed != 0 )
+            return 1;
+    }
+
+    printStats();
+    return 0;
+}
@@ -0,0 +1,188 @@
+/*
+    \file PaymentCodecPayload.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+
+#include "cicPaymentCodecPayload.h"
+#include "cicPaymentPort.h"
+#include "_objectMaps.h"
+#include <string.h>
+
+/* Writable attributes, as in Set() of the classes */
+static const u8 accountSetAttrs[] = { 7, 12, 13, 14, 15, 18, 19 };
+static const u8 creditSetAttrs[] = { 3, 4, 5, 6, 7, 9, 10, 11 };
+static const u8 chargeSetAttrs[] = { 3, 4, 6, 7, 8, 9, 13 };
+
+static bool isWritable( const u8* attrs, u8 attrsNum, u8 attrID )
+{
+    for( u8 i = 0; i < attrsNum; ++i )
+    {
+        if( attrs[i] == attrID )
+            return true;
+    }
+    return false;
+}
+
+static u16 buildDateTime( BYTE* buf, PaymentTime time )
+{
+    TDateTime dateTime;
+    PaymentTimeToDateTime( time, &dateTime );
+
+    buf[0] = OctetString;
+    buf[1] = eDTL_DateTime;
+    memcpy( &buf[2], &dateTime, eDTL_DateTime );
+    return 2 + eDTL_DateTime;
+}
+
+/* 2099-01-01, never reached by the runs of the harness */
+static PaymentTime farFuture()
+{
+    TDateTime dateTime = {};
+    dateTime.date.year_hi = 2099 >> 8;
+    dateTime.date.year_low = 2099 & 0xff;
+    dateTime.date.month = 1;
+    dateTime.date.day = 1;
+    dateTime.date.w_day = 0xff;
+    dateTime.time.hundredths = 0xff;
+    dateTime.deviation_hi = 0x80;
+    return PaymentTimeFromDateTime( &dateTime );
+}
+
+/* unit_charge with all tariffs and the longest index */
+static u16 buildUnitCharge( BYTE* buf )
+{
+    u16 len = 0;
+    buf[len++] = Structure;
+    buf[len++] = 3;
+
+    buf[len++] = Structure;                         // charge_per_unit_scaling
+    buf[len++] = 2;
+    buf[len++] = Integer;
+    buf[len++] = (BYTE)-3;
+    buf[len++] = Integer;
+    buf[len++] = (BYTE)-2;
+
+    buf[len++] = Structure;                         // commodity
+    buf[len++] = 3;
+    buf[len++] = LongUnsigned;
+    AXDREncodeWord( &buf[len], RegisterClassID );
+    len += eDTL_LongUnsigned;
+    buf[len++] = OctetString;
+    buf[len++] = 6;
+    memcpy( &buf[len], &RegisterAsumLN, 6 );
+    len += 6;
+    buf[len++] = Integer;
+    buf[len++] = 2;
+
+    buf[len++] = Array;                             // charge_table
+    buf[len++] = MAX_TARIFFS;
+    for( u8 i = 0; i < MAX_TARIFFS; ++i )
+    {
+        buf[len++] = Structure;
+        buf[len++] = 2;
+        buf[len++] = OctetString;
+        buf[len++] = MAX_INDEX_LEN;
+        memset( &buf[len], i + 1, MAX_INDEX_LEN );
+        len += MAX_INDEX_LEN;
+        buf[len++] = Long;
+        AXDREncodeShort( &buf[len], (s16)( 100 + i ) );
+        len += eDTL_Long;
+    }
+    return len;
+}
+
+static u16 buildTokenGatewayConfiguration( BYTE* buf )
+{
+    u16 len = 0;
+    buf[len++] = Array;
+    buf[len++] = MAX_OBJECTS_IN_TOKEN_GATEWAY_CFG;
+    for( u8 i = 0; i < MAX_OBJECTS_IN_TOKEN_GATEWAY_CFG; ++i )
+    {
+        buf[len++] = Structure;
+        buf[len++] = 2;
+        buf[len++] = OctetString;
+        buf[len++] = 6;
+        memcpy( &buf[len], &PaymentImportCreditLn, 6 );      // the credit of the reference list
+        len += 6;
+        buf[len++] = Unsigned;
+        buf[len++] = 100 / MAX_OBJECTS_IN_TOKEN_GATEWAY_CFG;
+    }
+    return len;
+}
+
+static void tick( bool newMinute, void* arg )
+{
+    PaymentHostTickObjects( (const PaymentHostObjects*)arg, newMinute );
+}
+
+void PaymentCodecPayloadPrepare( const PaymentHostObjects* objects )
+{
+    BYTE buf[PAYMENT_CODEC_PAYLOAD_BUF_LEN];
+
+    buildTokenGatewayConfiguration( buf );
+    objects->account->Set( PaymentAccountTokenGatewayConfigurationAttr, buf );
+    buildDateTime( buf, farFuture() );
+    objects->account->Set( PaymentAccountAccountClosureTimeAttr, buf );
+
+    /* the passive unit charge becomes active at the next minutes, then the next activation is far */
+    for( u8 i = 0; i < objects->lenChargeList; ++i )
+    {
+        buildUnitCharge( buf );
+        objects->chargeList[i]->Set( PaymentChargeUnitChargePassiveAttr, buf );
+        buildDateTime( buf, PaymentTimeNow() + 120 );
+        objects->chargeList[i]->Set( PaymentChargeUnitChargeActivationTimeAttr, buf );
+    }
+    PaymentVirtualClockRun( 240, tick, (void*)objects );
+
+    for( u8 i = 0; i < objects->lenChargeList; ++i )
+    {
+        buildUnitCharge( buf );
+        objects->chargeList[i]->Set( PaymentChargeUnitChargePassiveAttr, buf );
+        buildDateTime( buf, farFuture() );
+        objects->chargeList[i]->Set( PaymentChargeUnitChargeActivationTimeAttr, buf );
+    }
+}
+
+template< typename T >
+static u16 getValue( T* object, u8 attrID, BYTE* buf )
+{
+    uint16_t len = 0;
+    if( !object->Get( attrID, NULL, buf, len ) )
+        return 0;
+    return len;
+}
+
+u16 PaymentCodecPayloadBuildSet( const PaymentHostObjects* objects, PaymentProfileCodecClass codecClass, u8 attrID, BYTE* buf )
+{
+    switch( codecClass )
+    {
+        case PaymentProfileCodecAccount:
+            if( !isWritable( accountSetAttrs, sizeof( accountSetAttrs ), attrID ) )
+                return 0;
+            if( attrID == PaymentAccountAccountActivationTimeAttr || attrID == PaymentAccountAccountClosureTimeAttr )
+                return buildDateTime( buf, farFuture() );
+            return getValue( objects->account, attrID, buf );
+
+        case PaymentProfileCodecCredit:
+            if( !isWritable( creditSetAttrs, sizeof( creditSetAttrs ), attrID ) )
+                return 0;
+            if( attrID == PaymentCreditPeriodAttr )
+                return buildDateTime( buf, farFuture() );
+            return getValue( objects->creditList[0], attrID, buf );
+
+        case PaymentProfileCodecCharge:
+            if( !isWritable( chargeSetAttrs, sizeof( chargeSetAttrs ), attrID ) )
+                return 0;
+            if( attrID == PaymentChargeUnitChargeActivationTimeAttr )
+                return buildDateTime( buf, farFuture() );
+            return getValue( objects->chargeList[0], attrID, buf );
+
+        default:
+            return 0;
+    }
+}
@@ -0,0 +1,35 @@
+/*
+    \file PaymentCodecPayload.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+
+/*
+Worst-case payloads of Get and Set of the Payment attributes (PAYMENT_HOST_BUILD).
+PaymentCodecPayloadPrepare() fills the variable parts of the objects to their maximum: all tariffs of the
+passive and the active unit charge, all entries of the token gateway configuration and the specified times,
+so Get encodes the longest value of every attribute.
+PaymentCodecPayloadBuildSet() gives the longest valid request of Set: the value read by Get after the preparation,
+the times are fully specified and far in the future, so the Set of them does not fire a deadline.
+*/
+
+#if !defined _PAYMENT_CODEC_PAYLOAD_
+#define _PAYMENT_CODEC_PAYLOAD_
+
+#include "cicPaymentHost.h"
+#include "cicPaymentProfile.h"
+
+#if defined PAYMENT_HOST_BUILD
+
+#define PAYMENT_CODEC_PAYLOAD_BUF_LEN           256
+
+void PaymentCodecPayloadPrepare( const PaymentHostObjects* objects );    // ticks the objects for the activation of the unit charge
+u16 PaymentCodecPayloadBuildSet( const PaymentHostObjects* objects, PaymentProfileCodecClass codecClass, u8 attrID, BYTE* buf );  // 0 - not writable
+
+#endif // PAYMENT_HOST_BUILD
+
+#endif // _PAYMENT_CODEC_PAYLOAD_
@@ -0,0 +1,134 @@
+/*
+    \file PaymentCrcBench.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+
+/*
+Benchmark of the CRC protection of the money counters (PAYMENT_RECORD_CRC).
+The CRC-32 kernel of cicPaymentCrc is compared with the bitwise loop (PAYMENT_CRC32_BITWISE) on the lengths
+of the counter record, the unit charge and the snapshot, and the write and the read of the counter record
+are compared with the plain value of the counter in the same files of the harness.
+The time is taken by PaymentPortGetCycles(), on the meter the same loop gives the cycles of the DWT counter.
+Usage: payment_crc_bench [iterations]
+*/
+
+#include "cicPaymentHost.h"
+#include "cicPaymentPort.h"
+#include "cicPaymentCrc.h"
+#include "cicPaymentRecord.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static const u16 BENCH_FILE = ftLastPaymentFile;                    // not used by the Payment objects
+
+/* The kernel of PAYMENT_CRC32_BITWISE */
+static u32 crc32Bitwise( const void* data, u16 len )
+{
+    const u8* bytes = (const u8*)data;
+    u32 crc = 0xFFFFFFFF;
+
+    for( u16 i = 0; i < len; ++i )
+    {
+        crc ^= bytes[i];
+        for( u8 bit = 0; bit < 8; ++bit )
+            crc = ( crc >> 1 ) ^ ( 0xEDB88320 & ( 0 - ( crc & 1 ) ) );
+    }
+
+    return ~crc;
+}
+
+static double nsPerCall( u32 cycles, u32 iterations )
+{
+    return (double)cycles * 1000000000.0 / PAYMENT_CPU_FREQ_HZ / iterations;
+}
+
+static volatile u32 sink;
+
+int main( int argc, char** argv )
+{
+    u32 iterations = ( argc > 1 ) ? atoi( argv[1] ) : 100000;
+    u32 failures = 0;
+
+    static u8 data[512];
+    for( u16 i = 0; i < sizeof( data ); ++i )
+        data[i] = (u8)( i * 31 + 7 );
+
+    const u16 lengths[] = { sizeof( PaymentRecord ) - sizeof( u32 ) + 2 * sizeof( u16 ), 64, 512 };
+
+    printf( "%-28s %8s %12s %12s %8s\n", "crc32", "bytes", "table ns", "bitwise ns", "speedup" );
+    for( u8 i = 0; i < sizeof( lengths ) / sizeof( lengths[0] ); ++i )
+    {
+        u16 len = lengths[i];
+        if( PaymentCrc32( data, len ) != crc32Bitwise( data, len ) )
+        {
+            printf( "FAIL: the kernels differ on %u bytes\n", len );
+            ++failures;
+        }
+
+        u32 start = PaymentPortGetCycles();
+        for( u32 n = 0; n < iterations; ++n )
+            sink = PaymentCrc32( data, len );
+        u32 tableCycles = PaymentPortGetCycles() - start;
+
+        start = PaymentPortGetCycles();
+        for( u32 n = 0; n < iterations; ++n )
+            sink = crc32Bitwise( data, len );
+        u32 bitwiseCycles = PaymentPortGetCycles() - start;
+
+        double tableNs = nsPerCall( tableCycles, iterations );
+        double bitwiseNs = nsPerCall( bitwiseCycles, iterations );
+        printf( "%-28s %8u %12.1f %12.1f %8.1f\n", "", len, tableNs, bitwiseNs, ( tableNs > 0 ) ? bitwiseNs / tableNs : 0.0 );
+    }
+
+    PaymentHostFormat();
+    u64 value = 0;
+
+    /* the plain counter: one write of the value, one read in Init() */
+    u32 start = PaymentPortGetCycles();
+    for( u32 n = 0; n < iterations; ++n )
+    {
+        ++value;
+        PaymentPortFileIndexWrite( BENCH_FILE, 0, &value, sizeof( value ) );
+    }
+    double plainWriteNs = nsPerCall( PaymentPortGetCycles() - start, iterations );
+
+    start = PaymentPortGetCycles();
+    for( u32 n = 0; n < iterations; ++n )
+        PaymentPortFileIndexRead( BENCH_FILE, 0, &value, sizeof( value ) );
+    double plainReadNs = nsPerCall( PaymentPortGetCycles() - start, iterations );
+
+    /* the record: the sequence number from the cache and CRC at the write, both copies are checked at the read */
+    PaymentHostFormat();
+    start = PaymentPortGetCycles();
+    for( u32 n = 0; n < iterations; ++n )
+    {
+        ++value;
+        PaymentRecord record;
+        u16 slot = PaymentRecordPrepare( BENCH_FILE, 0, &value, sizeof( value ), &record );
+        PaymentPortFileIndexWrite( BENCH_FILE, slot, &record, sizeof( record ) );
+    }
+    double recordWriteNs = nsPerCall( PaymentPortGetCycles() - start, iterations );
+
+    u64 restored = 0;
+    start = PaymentPortGetCycles();
+    for( u32 n = 0; n < iterations; ++n )
+        PaymentRecordRead( BENCH_FILE, 0, true, &restored, sizeof( restored ) );
+    double recordReadNs = nsPerCall( PaymentPortGetCycles() - start, iterations );
+
+    if( restored != value )
+    {
+        printf( "FAIL: the record gives %llu instead of %llu\n", (unsigned long long)restored, (unsigned long long)value );
+        ++failures;
+    }
+
+    printf( "\n%-28s %12s %12s %12s\n", "counter u64", "plain ns", "record ns", "extra ns" );
+    printf( "%-28s %12.1f %12.1f %12.1f\n", "write", plainWriteNs, recordWriteNs, recordWriteNs - plainWriteNs );
+    printf( "%-28s %12.1f %12.1f %12.1f\n", "read", plainReadNs, recordReadNs, recordReadNs - plainReadNs );
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,269 @@
+/*
+    \file PaymentFleetBench.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+
+/*
+Benchmark of the fleet simulation: every meter is a separate set of the import objects with its own files,
+registers and clock, the meters are ticked by the work-stealing scheduler (cicPaymentHostFleet) one day per step.
+The meters differ by the consumption, so a part of them goes to the low and exhausted credit.
+The table gives the meter-seconds per second of every worker (core), the steals and the IdleSecond calls
+of the accounts measured by the probes of the worker, the write statistics of the fleet are summed over the meters.
+With "check" the fleet is run once more by one worker and the result of every meter must be the same.
+Usage: payment_fleet_bench [meters] [days] [workers] [check]
+*/
+
+#include "cicPaymentHostFleet.h"
+#include "cicPaymentPort.h"
+#include "cicPaymentGolden.h"
+#include "_objectMaps.h"
+#include <mutex>
+#include <thread>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct{
+    PaymentHostObjects  objects;
+    u64                 consumedWh;
+    u32                 whPerSecond;
+    u32                 daysLeft;
+} FleetMeter;
+
+typedef struct{
+    s32                 availableCredit;
+    u64                 consumedWh;
+    u64                 fileWrites;
+    bool                relayConnected;
+} FleetResult;
+
+static FleetMeter* fleet = NULL;
+static PaymentHostMeter** meters = NULL;
+static u32 metersNum = 0;
+static u32 days = 0;
+
+#ifdef PAYMENT_PROFILING
+static std::mutex profileLock;
+static PaymentProfileStats profileTotal[PaymentProfileScenariosNum][PaymentProfileStagesNum];
+static u64 workerTicks[MAX_PAYMENT_HOST_FLEET_WORKERS];
+#endif // PAYMENT_PROFILING
+
+static void tick( bool newMinute, void* arg )
+{
+    FleetMeter* meter = (FleetMeter*)arg;
+    if( meter->whPerSecond != 0 )
+    {
+        meter->consumedWh += meter->whPerSecond;
+        PaymentHostSetRegisterValue( &RegisterAsumLN, meter->consumedWh );
+    }
+
+    PaymentHostTickObjects( &meter->objects, newMinute );
+}
+
+static bool step( u32 meterPos, void* arg )
+{
+    FleetMeter* meter = &fleet[meterPos];
+    PaymentVirtualClockRun( 86400, tick, meter );
+    return --meter->daysLeft != 0;
+}
+
+static void workerEnd( u8 worker, void* arg )
+{
+#ifdef PAYMENT_PROFILING
+    u64 ticks = 0;
+    for( u8 scenario = 0; scenario < PaymentProfileScenariosNum; ++scenario )
+        ticks += PaymentProfileGetStats( (PaymentProfileScenario)scenario, PaymentProfileAccountIdleSecond )->calls;
+    workerTicks[worker] = ticks;
+
+    std::lock_guard<std::mutex> guard( profileLock );
+    PaymentProfileAccumulate( profileTotal );
+#endif // PAYMENT_PROFILING
+}
+
+static bool createFleet()
+{
+    TDateTime start = {};
+    start.date.year_hi = 2021 >> 8;
+    start.date.year_low = 2021 & 0xff;
+    start.date.month = 3;
+    start.date.day = 1;
+
+    for( u32 pos = 0; pos < metersNum; ++pos )
+    {
+        FleetMeter* meter = &fleet[pos];
+        meters[pos] = PaymentHostMeterCreate();
+        PaymentHostMeterSelect( meters[pos] );
+
+        PaymentHostFormat();
+        PaymentHostSetRegister( &RegisterAsumLN, 0, 0, UnitWh );
+        PaymentVirtualClockSet( &start );
+
+        PaymentHostCreateObjects( &meter->objects );
+        PaymentHostInitObjects( &meter->objects );
+        meter->consumedWh = 0;
+        meter->whPerSecond = pos % 4;
+        meter->daysLeft = days;
+
+        BYTE transactionID[LEN_ACTIVE_TRANSACTION_ID] = { 1 };
+        if( PaymentHostEnterToken( &meter->objects, (u8)inTokenSubtype::startPaidToken, 1, transactionID, 20000 + pos ) != executionOK )
+        {
+            printf( "startPaid token is refused by meter %u\n", pos );
+            PaymentHostMeterSelect( NULL );
+            return false;
+        }
+    }
+
+    PaymentHostMeterSelect( NULL );
+    return true;
+}
+
+static void getResults( FleetResult* results )
+{
+    for( u32 pos = 0; pos < metersNum; ++pos )
+    {
+        PaymentHostMeterSelect( meters[pos] );
+        results[pos].availableCredit = PaymentGetDoubleLongAttr( fleet[pos].objects.account, PaymentAccountAvailableCreditAttr );
+        results[pos].consumedWh = fleet[pos].consumedWh;
+        results[pos].fileWrites = PaymentHostGetStats()->fileWrites;
+        results[pos].relayConnected = PaymentPortGetRelayState();
+    }
+    PaymentHostMeterSelect( NULL );
+}
+
+static bool sameResult( const FleetResult* a, const FleetResult* b )
+{
+    return ( a->availableCredit == b->availableCredit ) && ( a->consumedWh == b->consumedWh ) &&
+           ( a->fileWrites == b->fileWrites ) && ( a->relayConnected == b->relayConnected );
+}
+
+/* The objects of the meters are kept to the end of the process, only the meters are destroyed */
+static void destroyFleet()
+{
+    for( u32 pos = 0; pos < metersNum; ++pos )
+        PaymentHostMeterDestroy( meters[pos] );
+}
+
+static void printWorkers( const PaymentHostFleetWorkerStats* stats, u8 workersNum )
+{
+    u64 meterSeconds = 0;
+    u64 wallNs = 0;
+
+    printf( "%-8s %10s %8s %12s %14s %12s\n", "worker", "steps", "steals", "wall ms", "meter-s/s", "IdleSecond" );
+    for( u8 worker = 0; worker < workersNum; ++worker )
+    {
+        u64 workerSeconds = stats[worker].steps * 86400;
+        u64 ticks = 0;
+#ifdef PAYMENT_PROFILING
+        ticks = workerTicks[worker];
+#endif // PAYMENT_PROFILING
+        printf( "%-8u %10llu %8llu %12llu %14llu %12llu\n", worker, (unsigned long long)stats[worker].steps,
+                (unsigned long long)stats[worker].steals, (unsigned long long)( stats[worker].wallNs / 1000000 ),
+                (unsigned long long)( ( stats[worker].wallNs != 0 ) ? workerSeconds * 1000000000ULL / stats[worker].wallNs : 0 ),
+                (unsigned long long)ticks );
+
+        meterSeconds += workerSeconds;
+        if( stats[worker].wallNs > wallNs )
+            wallNs = stats[worker].wallNs;
+    }
+
+    if( wallNs == 0 )
+        return;
+
+    u64 rate = meterSeconds * 1000000000ULL / wallNs;
+    printf( "fleet: %llu meter-s/s, %llu meter-s/s per core, 100k meters x 1 year in %llu h\n",
+            (unsigned long long)rate, (unsigned long long)( rate / workersNum ),
+            (unsigned long long)( ( rate != 0 ) ? 100000ULL * 365 * 86400 / rate / 3600 : 0 ) );
+}
+
+static void printWriteStats()
+{
+#ifdef PAYMENT_WRITE_STATS
+    PaymentWriteStatsContext* total = new PaymentWriteStatsContext();
+    PaymentWriteStatsInitContext( total );
+    for( u32 pos = 0; pos < metersNum; ++pos )
+    {
+        PaymentHostMeterSelect( meters[pos] );
+        PaymentWriteStatsAccumulate( total );
+    }
+    PaymentHostMeterSelect( NULL );
+
+    PaymentWriteStatsSelect( total );
+    const PaymentWriteStatsFile* worst = PaymentWriteStatsFindWorstFile();
+    if( worst != NULL )
+        printf( "writes: %u locations, %u meter-days, worst ftId %u index %u: %llu writes, FRAM lifetime %u days\n",
+                PaymentWriteStatsGetFilesNum(), PaymentWriteStatsGetDays(), worst->ftId, worst->index,
+                (unsigned long long)worst->writesTotal, PaymentWriteStatsProjectLifetimeDays( worst, PAYMENT_FRAM_ENDURANCE_CYCLES ) );
+    PaymentWriteStatsSelect( NULL );
+    delete total;
+#endif // PAYMENT_WRITE_STATS
+}
+
+int main( int argc, char** argv )
+{
+    metersNum = ( argc > 1 ) ? atoi( argv[1] ) : 64;
+    days = ( argc > 2 ) ? atoi( argv[2] ) : 2;
+    u32 workersNum = ( argc > 3 ) ? atoi( argv[3] ) : std::thread::hardware_concurrency();
+    bool check = ( argc > 4 ) && ( strcmp( argv[4], "check" ) == 0 );
+
+    if( ( metersNum == 0 ) || ( days == 0 ) )
+    {
+        printf( "usage: payment_fleet_bench [meters] [days] [workers] [check]\n" );
+        return 1;
+    }
+    if( ( workersNum == 0 ) || ( workersNum > MAX_PAYMENT_HOST_FLEET_WORKERS ) )
+        workersNum = ( workersNum == 0 ) ? 1 : MAX_PAYMENT_HOST_FLEET_WORKERS;
+
+    fleet = new FleetMeter[metersNum];
+    meters = new PaymentHostMeter*[metersNum];
+    FleetResult* results = new FleetResult[metersNum];
+    PaymentHostFleetWorkerStats stats[MAX_PAYMENT_HOST_FLEET_WORKERS];
+
+    if( !createFleet() )
+        return 1;
+
+    PaymentHostFleetRun( meters, metersNum, (u8)workersNum, step, workerEnd, NULL, stats );
+    printf( "%u meters x %u days, %u workers\n", metersNum, days, workersNum );
+    printWorkers( stats, (u8)workersNum );
+    printWriteStats();
+    getResults( results );
+
+    u32 exhausted = 0;
+    for( u32 pos = 0; pos < metersNum; ++pos )
+        exhausted += results[pos].relayConnected ? 0 : 1;
+    printf( "relay disconnected on %u meters\n", exhausted );
+
+    if( check )
+    {
+        FleetResult* reference = new FleetResult[metersNum];
+        destroyFleet();
+        if( !createFleet() )
+            return 1;
+
+        PaymentHostFleetRun( meters, metersNum, 1, step, NULL, NULL, stats );
+        getResults( reference );
+
+        for( u32 pos = 0; pos < metersNum; ++pos )
+        {
+            if( !sameResult( &reference[pos], &results[pos] ) )
+            {
+                printf( "meter %u differs from the run of one worker: credit %d/%d, writes %llu/%llu\n", pos,
+                        results[pos].availableCredit, reference[pos].availableCredit,
+                        (unsigned long long)results[pos].fileWrites, (unsigned long long)reference[pos].fileWrites );
+                return 1;
+            }
+        }
+        printf( "results of %u workers are the same as of one worker\n", workersNum );
+        delete[] reference;
+    }
+
+    destroyFleet();
+    delete[] results;
+    delete[] meters;
+    delete[] fleet;
+    return 0;
+}
@@ -0,0 +1,195 @@
+/*
+    \file PaymentGoldenLockstep.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+
+
+/*
+Lockstep run of two builds of the Payment objects (cicPaymentGolden). The driver starts the stepper
+of the reference build and the stepper of the candidate build (cicPaymentGoldenStep) with the same steps and seed,
+reads the snapshots of every step from both, compares them and lets both make the next step.
+The first divergence in availableCredit, amountToClear, aggregatedDebt, currentCreditAmount, totalAmountPaid
+or the relay state is reported with the step and the virtual time, then both steppers are stopped.
+Usage: payment_golden_lockstep <reference stepper> <candidate stepper> [steps] [seed]
+*/
+
+#include "cicPaymentGolden.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define PAYMENT_GOLDEN_LOCKSTEP_PROGRESS    1000000     // steps between the progress lines
+
+typedef struct{
+    const char* path;
+    pid_t       pid;
+    int         request;        // the byte to continue or to stop
+    int         snapshot;       // the snapshots of the steps
+} Stepper;
+
+static const char* const fieldNames[] = {
+    "", "layout", "aggregatesMismatches", "availableCredit", "amountToClear", "aggregatedDebt", "currentCreditAmount", "totalAmountPaid", "relay"
+};
+
+static bool start( Stepper* stepper, const char* steps, const char* seed )
+{
+    int request[2];
+    int snapshot[2];
+
+    if( pipe( request ) != 0 )
+        return false;
+    if( pipe( snapshot ) != 0 )
+    {
+        close( request[0] );
+        close( request[1] );
+        return false;
+    }
+
+    stepper->pid = fork();
+    if( stepper->pid == 0 )
+    {
+        dup2( request[0], STDIN_FILENO );
+        dup2( snapshot[1], STDOUT_FILENO );
+        close( request[0] );
+        close( request[1] );
+        close( snapshot[0] );
+        close( snapshot[1] );
+        execl( stepper->path, stepper->path, steps, seed, (char*)NULL );
+        _exit( 127 );
+    }
+
+    close( request[0] );
+    close( snapshot[1] );
+    stepper->request = request[1];
+    stepper->snapshot = snapshot[0];
+    if( stepper->pid < 0 )
+    {
+        close( stepper->request );
+        close( stepper->snapshot );
+        return false;
+    }
+    return true;
+}
+
+static bool receive( const Stepper* stepper, PaymentGoldenSnapshot* snapshot )
+{
+    BYTE* data = (BYTE*)snapshot;
+    size_t len = sizeof( *snapshot );
+
+    while( len != 0 )
+    {
+        ssize_t received = read( stepper->snapshot, data, len );
+        if( received <= 0 )
+            return false;
+        data += received;
+        len -= received;
+    }
+    return true;
+}
+
+static void stop( Stepper* stepper )
+{
+    BYTE proceed = 0;
+    int status = 0;
+
+    if( write( stepper->request, &proceed, 1 ) != 1 )
+        kill( stepper->pid, SIGTERM );
+    close( stepper->request );
+    close( stepper->snapshot );
+    waitpid( stepper->pid, &status, 0 );
+}
+
+int main( int argc, char** argv )
+{
+    if( argc < 3 )
+    {
+        printf( "usage: payment_golden_lockstep <reference stepper> <candidate stepper> [steps] [seed]\n" );
+        return 1;
+    }
+
+    const char* steps = ( argc > 3 ) ? argv[3] : "1000000";
+    const char* seed = ( argc > 4 ) ? argv[4] : "1";
+    u32 stepsNum = strtoul( steps, NULL, 10 );
+
+    /* a stepper which stops early must not kill the driver on the write */
+    signal( SIGPIPE, SIG_IGN );
+
+    Stepper reference = { argv[1] };
+    Stepper candidate = { argv[2] };
+    if( !start( &reference, steps, seed ) )
+    {
+        printf( "%s is not started\n", reference.path );
+        return 1;
+    }
+    if( !start( &candidate, steps, seed ) )
+    {
+        printf( "%s is not started\n", candidate.path );
+        stop( &reference );
+        return 1;
+    }
+
+    int result = 0;
+    u32 step = 0;
+    while( step < stepsNum )
+    {
+        PaymentGoldenSnapshot snapshotReference;
+        PaymentGoldenSnapshot snapshotCandidate;
+        PaymentGoldenDivergence divergence;
+
+        if( !receive( &reference, &snapshotReference ) || !receive( &candidate, &snapshotCandidate ) )
+        {
+            printf( "stepper ended at step %u\n", step + 1 );
+            result = 1;
+            break;
+        }
+        ++step;
+
+        if( snapshotReference.step != step || snapshotCandidate.step != step ||
+            snapshotReference.utcSeconds != snapshotCandidate.utcSeconds )
+        {
+            printf( "steppers are out of step at step %u: reference step %u at %u, candidate step %u at %u\n", step,
+                    snapshotReference.step, snapshotReference.utcSeconds, snapshotCandidate.step, snapshotCandidate.utcSeconds );
+            result = 1;
+            break;
+        }
+
+        if( !PaymentGoldenCompare( &snapshotReference, &snapshotCandidate, &divergence ) )
+        {
+            printf( "divergence at step %u, utc %u: %s[%u] reference %d, candidate %d\n", step, snapshotReference.utcSeconds,
+                    fieldNames[divergence.field], divergence.index, divergence.reference, divergence.candidate );
+            result = 1;
+            break;
+        }
+
+        if( step == stepsNum )
+            break;
+
+        BYTE proceed = 1;
+        if( write( reference.request, &proceed, 1 ) != 1 || write( candidate.request, &proceed, 1 ) != 1 )
+        {
+            printf( "stepper ended at step %u\n", step );
+            result = 1;
+            break;
+        }
+
+        if( step % PAYMENT_GOLDEN_LOCKSTEP_PROGRESS == 0 )
+        {
+            printf( "%u steps, utc %u\n", step, snapshotReference.utcSeconds );
+            fflush( stdout );
+        }
+    }
+
+    stop( &reference );
+    stop( &candidate );
+
+    if( result == 0 )
+        printf( "%u steps, no divergence\n", step );
+    return result;
+}
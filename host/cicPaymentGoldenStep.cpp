@@ -0,0 +1,136 @@
+/*
+    \file PaymentGoldenStep.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+
+
+/*
+Stepper of the lockstep run (cicPaymentGoldenLockstep): one process per build, the same source is linked
+with payment_reference and with payment_optimized. The randomized ticks and tokens come from PaymentGoldenRandom
+and cicPaymentTokenMix with the seed of the command line, so both builds get the same stimulus.
+After every step the snapshot (PaymentGoldenSnapshot) is written to stdout and the stepper waits for one byte
+on stdin: 1 continues, anything else or the end of the stream stops it.
+Usage: payment_golden_step_<build> [steps] [seed]
+*/
+
+#include "cicPaymentHost.h"
+#include "cicPaymentPort.h"
+#include "cicPaymentGolden.h"
+#include "cicPaymentTokenMix.h"
+#include "_objectMaps.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define PAYMENT_GOLDEN_STEP_TOKEN           8       // 1 of 8 steps enters a token
+#define PAYMENT_GOLDEN_STEP_LOAD            16      // 1 of 16 steps changes the load
+#define PAYMENT_GOLDEN_STEP_DAY             256     // 1 of 256 steps runs for a day
+#define PAYMENT_GOLDEN_STEP_MAX_SECONDS     600
+
+static PaymentHostObjects objects;
+static u64 consumedWh = 0;
+static u32 whPerSecond = 2;
+
+static void tick( bool newMinute, void* arg )
+{
+    consumedWh += whPerSecond;
+    PaymentHostSetRegisterValue( &RegisterAsumLN, consumedWh );
+    PaymentHostTickObjects( &objects, newMinute );
+}
+
+static void enter( PaymentTokenMix* mix )
+{
+    BYTE bufRequest[PAYMENT_HOST_TOKEN_BUF_LEN];
+    BYTE bufResponse[16] = {};
+    uint16_t lenResponse = 0;
+
+    PaymentTokenMixNext( mix, bufRequest );
+    objects.tokenGateway->Action( PaymentTokenGatewayEnter, bufRequest, bufResponse, lenResponse );
+    PaymentTokenMixResult( mix, ( lenResponse > 6 && bufResponse[5] == eDT_Enum ) ? bufResponse[6] : (u8)executionFAIL );
+}
+
+static bool writeAll( const void* buf, size_t len )
+{
+    const BYTE* data = (const BYTE*)buf;
+
+    while( len != 0 )
+    {
+        ssize_t written = write( STDOUT_FILENO, data, len );
+        if( written <= 0 )
+            return false;
+        data += written;
+        len -= written;
+    }
+    return true;
+}
+
+int main( int argc, char** argv )
+{
+    u32 stepsNum = ( argc > 1 ) ? strtoul( argv[1], NULL, 10 ) : 1000000;
+    u32 seed = ( argc > 2 ) ? strtoul( argv[2], NULL, 10 ) : 1;
+
+    if( seed == 0 )
+        seed = 1;
+    if( !PaymentHostGetImportObjects( &objects ) )
+    {
+        fprintf( stderr, "objects are not registered in the maps\n" );
+        return 1;
+    }
+
+    PaymentHostFormat();
+    PaymentHostSetRegister( &RegisterAsumLN, 0, 0, UnitWh );
+
+    TDateTime start = {};
+    start.date.year_hi = 2021 >> 8;
+    start.date.year_low = 2021 & 0xff;
+    start.date.month = 3;
+    start.date.day = 1;
+    PaymentVirtualClockSet( &start );
+
+    PaymentHostInitObjects( &objects );
+
+    PaymentGoldenMeter meter = {};
+    meter.account = objects.account;
+    meter.lenCreditList = objects.lenCreditList;
+    for( u8 i = 0; i < objects.lenCreditList; ++i )
+        meter.creditList[i] = objects.creditList[i];
+    meter.lenChargeList = objects.lenChargeList;
+    for( u8 i = 0; i < objects.lenChargeList; ++i )
+        meter.chargeList[i] = objects.chargeList[i];
+
+    PaymentTokenMix mix;
+    PaymentTokenMixInit( &mix, &PAYMENT_TOKEN_MIX_CAMPAIGN, seed );
+    u32 random = seed;
+
+    for( u32 step = 1; step <= stepsNum; ++step )
+    {
+        u32 value = PaymentGoldenRandom( &random );
+
+        if( value % PAYMENT_GOLDEN_STEP_TOKEN == 0 )
+            enter( &mix );
+        else if( value % PAYMENT_GOLDEN_STEP_DAY == 1 )
+            PaymentVirtualClockRun( 86400, tick, NULL );
+        else
+        {
+            if( value % PAYMENT_GOLDEN_STEP_LOAD == 1 )
+                whPerSecond = PaymentGoldenRandom( &random ) % 8;
+            PaymentVirtualClockRun( 1 + PaymentGoldenRandom( &random ) % PAYMENT_GOLDEN_STEP_MAX_SECONDS, tick, NULL );
+        }
+
+        PaymentGoldenSnapshot snapshot;
+        PaymentGoldenCapture( &meter, step, &snapshot );
+        if( !writeAll( &snapshot, sizeof( snapshot ) ) )
+            return 1;
+
+        BYTE proceed = 0;
+        if( step != stepsNum && ( read( STDIN_FILENO, &proceed, 1 ) != 1 || proceed != 1 ) )
+            break;
+    }
+
+    return 0;
+}
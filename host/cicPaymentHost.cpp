@@ -0,0 +1,561 @@
+/*
+    \file PaymentHost.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+#include "cicPaymentHost.h"
+
+#if defined PAYMENT_HOST_BUILD
+
+#include "cicPaymentPort.h"
+#include "cicPayment.h"
+#include "cicPaymentReplay.h"
+#include "cicPaymentJournal.h"
+#include "cicPaymentHostFs.h"
+#include "core.h"
+#include "_objectMaps.h"
+#include <map>
+#include <vector>
+#include <mutex>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+typedef struct{
+    u64         value;
+    s8          scaler;
+    u8          unit;
+} PaymentHostRegister;
+
+struct PaymentHostMeter{
+    std::map< u32, std::vector< u8 > >          files;          // key: ftId << 16 | index
+    std::map< u64, PaymentHostRegister >        registers;      // key: packed logical name
+    std::map< u64, u32 >                        dataValues;
+    bool                                        relay;
+    PaymentHostStats                            stats;
+#ifdef PAYMENT_VIRTUAL_CLOCK
+    PaymentVirtualClockContext                  clock;
+#endif // PAYMENT_VIRTUAL_CLOCK
+    PaymentDeadlineContext                      deadline;
+#ifdef PAYMENT_WRITE_STATS
+    PaymentWriteStatsContext                    writeStats;
+#endif // PAYMENT_WRITE_STATS
+#ifdef PAYMENT_RECORD_CRC
+    PaymentRecordContext                        record;
+#endif // PAYMENT_RECORD_CRC
+#ifdef PAYMENT_JOURNAL
+    PaymentJournalContext                       journal;
+#endif // PAYMENT_JOURNAL
+#ifdef PAYMENT_BOOT_SNAPSHOT
+    PaymentSnapshotContext                      snapshot;
+#endif // PAYMENT_BOOT_SNAPSHOT
+#ifdef PAYMENT_TRANSACTION
+    PaymentTransactionContext                   transaction;
+#endif // PAYMENT_TRANSACTION
+#ifdef PAYMENT_EMERGENCY_FLUSH
+    PaymentEmergencyContext                     emergency;
+#endif // PAYMENT_EMERGENCY_FLUSH
+#ifdef PAYMENT_WRITE_QUEUE
+    PaymentWriteQueueContext                    writeQueue;
+#endif // PAYMENT_WRITE_QUEUE
+};
+
+static const u16 NOT_INDEXED                    = 0xFFFF;
+
+static PAYMENT_THREAD_LOCAL PaymentHostMeter* selectedMeter = NULL;
+static PAYMENT_THREAD_LOCAL PaymentHostMeter* defaultMeter = NULL;
+
+static void initMeter( PaymentHostMeter* meter )
+{
+    meter->relay = true;
+    memset( &meter->stats, 0, sizeof( meter->stats ) );
+#ifdef PAYMENT_VIRTUAL_CLOCK
+    PaymentVirtualClockInitContext( &meter->clock );
+#endif // PAYMENT_VIRTUAL_CLOCK
+    PaymentDeadlineInitContext( &meter->deadline );
+#ifdef PAYMENT_WRITE_STATS
+    PaymentWriteStatsInitContext( &meter->writeStats );
+#endif // PAYMENT_WRITE_STATS
+#ifdef PAYMENT_RECORD_CRC
+    PaymentRecordInitContext( &meter->record );
+#endif // PAYMENT_RECORD_CRC
+#ifdef PAYMENT_JOURNAL
+    PaymentJournalInitContext( &meter->journal );
+#endif // PAYMENT_JOURNAL
+#ifdef PAYMENT_BOOT_SNAPSHOT
+    PaymentSnapshotInitContext( &meter->snapshot );
+#endif // PAYMENT_BOOT_SNAPSHOT
+#ifdef PAYMENT_TRANSACTION
+    PaymentTransactionInitContext( &meter->transaction );
+#endif // PAYMENT_TRANSACTION
+#ifdef PAYMENT_EMERGENCY_FLUSH
+    PaymentEmergencyInitContext( &meter->emergency );
+#endif // PAYMENT_EMERGENCY_FLUSH
+#ifdef PAYMENT_WRITE_QUEUE
+    PaymentWriteQueueInitContext( &meter->writeQueue );
+#endif // PAYMENT_WRITE_QUEUE
+}
+
+static PaymentHostMeter* currentMeter()
+{
+    if( selectedMeter != NULL )
+        return selectedMeter;
+
+    if( defaultMeter == NULL )
+    {
+        defaultMeter = new PaymentHostMeter();
+        initMeter( defaultMeter );
+    }
+    return defaultMeter;
+}
+
+static u64 lnKey( const LOGICAL_NAME* ln )
+{
+    return (u64)ln->_A << 40 | (u64)ln->_B << 32 | (u64)ln->_C << 24 | (u64)ln->_D << 16 | (u64)ln->_E << 8 | ln->_F;
+}
+
+PaymentHostMeter* PaymentHostMeterCreate()
+{
+    PaymentHostMeter* meter = new PaymentHostMeter();
+    initMeter( meter );
+    return meter;
+}
+
+void PaymentHostMeterDestroy( PaymentHostMeter* meter )
+{
+    if( selectedMeter == meter )
+        PaymentHostMeterSelect( NULL );
+    delete meter;
+}
+
+/* The state of the modules is selected with the meter, NULL returns the modules to their defaults of the thread */
+void PaymentHostMeterSelect( PaymentHostMeter* meter )
+{
+    selectedMeter = meter;
+#ifdef PAYMENT_VIRTUAL_CLOCK
+    PaymentVirtualClockSelect( ( meter != NULL ) ? &meter->clock : NULL );
+#endif // PAYMENT_VIRTUAL_CLOCK
+    PaymentDeadlineSelect( ( meter != NULL ) ? &meter->deadline : NULL );
+#ifdef PAYMENT_WRITE_STATS
+    PaymentWriteStatsSelect( ( meter != NULL ) ? &meter->writeStats : NULL );
+#endif // PAYMENT_WRITE_STATS
+#ifdef PAYMENT_RECORD_CRC
+    PaymentRecordSelect( ( meter != NULL ) ? &meter->record : NULL );
+#endif // PAYMENT_RECORD_CRC
+#ifdef PAYMENT_JOURNAL
+    PaymentJournalSelect( ( meter != NULL ) ? &meter->journal : NULL );
+#endif // PAYMENT_JOURNAL
+#ifdef PAYMENT_BOOT_SNAPSHOT
+    PaymentSnapshotSelect( ( meter != NULL ) ? &meter->snapshot : NULL );
+#endif // PAYMENT_BOOT_SNAPSHOT
+#ifdef PAYMENT_TRANSACTION
+    PaymentTransactionSelect( ( meter != NULL ) ? &meter->transaction : NULL );
+#endif // PAYMENT_TRANSACTION
+#ifdef PAYMENT_EMERGENCY_FLUSH
+    PaymentEmergencySelect( ( meter != NULL ) ? &meter->emergency : NULL );
+#endif // PAYMENT_EMERGENCY_FLUSH
+#ifdef PAYMENT_WRITE_QUEUE
+    PaymentWriteQueueSelect( ( meter != NULL ) ? &meter->writeQueue : NULL );
+#endif // PAYMENT_WRITE_QUEUE
+}
+
+PaymentHostMeter* PaymentHostMeterGetSelected()
+{
+    return currentMeter();
+}
+
+/*
+RAM of the modules is lost with the power, the write statistics and the clock are kept by the harness.
+The thread without the selected meter works with the defaults of the modules, which are not restarted.
+*/
+void PaymentHostRestart()
+{
+    PaymentHostMeter* meter = selectedMeter;
+    if( meter == NULL )
+        return;
+
+    PaymentDeadlineInitContext( &meter->deadline );
+#ifdef PAYMENT_RECORD_CRC
+    PaymentRecordInitContext( &meter->record );
+#endif // PAYMENT_RECORD_CRC
+#ifdef PAYMENT_JOURNAL
+    PaymentJournalInitContext( &meter->journal );
+#endif // PAYMENT_JOURNAL
+#ifdef PAYMENT_BOOT_SNAPSHOT
+    PaymentSnapshotInitContext( &meter->snapshot );
+#endif // PAYMENT_BOOT_SNAPSHOT
+#ifdef PAYMENT_TRANSACTION
+    PaymentTransactionInitContext( &meter->transaction );
+#endif // PAYMENT_TRANSACTION
+#ifdef PAYMENT_EMERGENCY_FLUSH
+    PaymentEmergencyInitContext( &meter->emergency );
+#endif // PAYMENT_EMERGENCY_FLUSH
+#ifdef PAYMENT_WRITE_QUEUE
+    PaymentWriteQueueReset();
+#endif // PAYMENT_WRITE_QUEUE
+}
+
+/* The records still queued would be written over the formatted files */
+void PaymentHostFormat()
+{
+#ifdef PAYMENT_HOST_FS
+    PaymentHostFsFormat();
+#else
+    currentMeter()->files.clear();
+#endif // PAYMENT_HOST_FS
+#ifdef PAYMENT_WRITE_QUEUE
+    PaymentWriteQueueReset();
+#endif // PAYMENT_WRITE_QUEUE
+}
+
+void PaymentHostSetRegister( const LOGICAL_NAME* ln, u64 value, s8 scaler, u8 unit )
+{
+    PaymentHostRegister& reg = currentMeter()->registers[lnKey( ln )];
+    reg.value = value;
+    reg.scaler = scaler;
+    reg.unit = unit;
+}
+
+/* The scaler and unit of the new register are 0 Wh */
+void PaymentHostSetRegisterValue( const LOGICAL_NAME* ln, u64 value )
+{
+    PaymentHostMeter* meter = currentMeter();
+    std::map< u64, PaymentHostRegister >::iterator it = meter->registers.find( lnKey( ln ) );
+
+    if( it == meter->registers.end() )
+        PaymentHostSetRegister( ln, value, 0, UnitWh );
+    else
+        it->second.value = value;
+}
+
+void PaymentHostSetDataValue( const LOGICAL_NAME* ln, u32 value )
+{
+    currentMeter()->dataValues[lnKey( ln )] = value;
+}
+
+void PaymentHostSetRelay( bool connected )
+{
+    currentMeter()->relay = connected;
+}
+
+const PaymentHostStats* PaymentHostGetStats()
+{
+    return &currentMeter()->stats;
+}
+
+void PaymentHostResetStats()
+{
+    memset( &currentMeter()->stats, 0, sizeof( currentMeter()->stats ) );
+}
+
+u16 PaymentHostBuildToken( BYTE* buf, u8 subtype, u32 tokenID, const BYTE* transactionID, s32 amount, u32 expiresTime )
+{
+    u8 len;
+    switch( (inTokenSubtype)subtype )
+    {
+        case inTokenSubtype::startPaidToken:    len = (u8)PaymentTokenGatewayClass::inTokenLen::startPaid; break;
+        case inTokenSubtype::topUpToken:        len = (u8)PaymentTokenGatewayClass::inTokenLen::topUp; break;
+        case inTokenSubtype::stopPaidToken:     len = (u8)PaymentTokenGatewayClass::inTokenLen::stopPaid; break;
+        case inTokenSubtype::startNonPaidToken: len = (u8)PaymentTokenGatewayClass::inTokenLen::startNonPaid; break;
+        default:                                len = (u8)PaymentTokenGatewayClass::inTokenLen::stopNonPaid; break;
+    }
+
+    /* buf[0] is skipped by Action, the token starts with its tag */
+    memset( buf, 0, PAYMENT_HOST_TOKEN_BUF_LEN );
+    BYTE* token = &buf[1];
+    token[(u8)PaymentTokenGatewayClass::commonFieldPosInToken::tag] = eDT_OctetString;
+    token[(u8)PaymentTokenGatewayClass::commonFieldPosInToken::len] = len;
+    token[(u8)PaymentTokenGatewayClass::commonFieldPosInToken::subtype] = subtype;
+    AXDREncodeDword( &token[(u8)PaymentTokenGatewayClass::commonFieldPosInToken::tokenID], tokenID );
+    AXDREncodeDword( &token[(u8)PaymentTokenGatewayClass::commonFieldPosInToken::expiresTime], expiresTime );
+    token[(u8)PaymentTokenGatewayClass::commonFieldPosInToken::expiresTimeStatus] = 0;
+    memcpy( &token[(u8)PaymentTokenGatewayClass::commonFieldPosInToken::transactionID], transactionID, LEN_ACTIVE_TRANSACTION_ID );
+    if( (inTokenSubtype)subtype == inTokenSubtype::startPaidToken || (inTokenSubtype)subtype == inTokenSubtype::topUpToken )
+        AXDREncodeDoubleLong( &token[(u8)PaymentTokenGatewayClass::specificFieldPosTopUpToken::amount], amount );
+
+    return 1 + (u8)PaymentTokenGatewayClass::commonFieldPosInToken::type + len;
+}
+
+bool PaymentHostGetImportObjects( PaymentHostObjects* objects )
+{
+    memset( objects, 0, sizeof( *objects ) );
+    objects->account = (PaymentAccountClass*)PaymentAccountObjectsMap[(LOGICAL_NAME*)&PaymentImportAccountLn];
+    objects->creditList[0] = (PaymentCreditClass*)PaymentCreditObjectsMap[(LOGICAL_NAME*)&PaymentImportCreditLn];
+    objects->chargeList[0] = (PaymentChargeClass*)PaymentChargeObjectsMap[(LOGICAL_NAME*)&PaymentActiveImportChargeLn];
+    objects->tokenGateway = &TokenGatewayForImportAccount;
+    objects->lenCreditList = 1;
+    objects->lenChargeList = 1;
+    if( objects->account != NULL )
+        objects->tokenGateway->LinkAccount( objects->account );
+
+    return objects->account != NULL && objects->creditList[0] != NULL && objects->chargeList[0] != NULL;
+}
+
+/* The objects of one more meter: the import objects with the default configuration, see PaymentCreateImportObjects() */
+void PaymentHostCreateObjects( PaymentHostObjects* objects )
+{
+    memset( objects, 0, sizeof( *objects ) );
+    PaymentCreateImportObjects( &objects->creditList[0], &objects->chargeList[0], &objects->tokenGateway, &objects->account );
+    objects->lenCreditList = 1;
+    objects->lenChargeList = 1;
+    objects->tokenGateway->LinkAccount( objects->account );
+}
+
+/* The start of the meter: the files are recovered once before the objects read them */
+void PaymentHostInitObjects( const PaymentHostObjects* objects )
+{
+    PaymentRecover();
+    for( u8 i = 0; i < objects->lenCreditList; ++i )
+        objects->creditList[i]->Init();
+    for( u8 i = 0; i < objects->lenChargeList; ++i )
+        objects->chargeList[i]->Init();
+    if( objects->tokenGateway != NULL )
+        objects->tokenGateway->Init();
+    objects->account->Init();
+}
+
+/* The pass of the firmware over the account of the selected meter, the credits and charges are the lists of the account */
+void PaymentHostTickObjects( const PaymentHostObjects* objects, bool newMinute )
+{
+    PaymentIdlePass( newMinute, objects->account );
+
+    if( !newMinute )
+        return;
+
+    if( objects->tokenGateway != NULL )
+        objects->tokenGateway->IdleMinute();                        // by the firmware after the pass
+#ifdef PAYMENT_WRITE_QUEUE
+    PaymentWriteQueueDrain();                                       // the writer context runs after the pass
+#endif // PAYMENT_WRITE_QUEUE
+}
+
+u8 PaymentHostEnterToken( const PaymentHostObjects* objects, u8 subtype, u32 tokenID, const BYTE* transactionID, s32 amount )
+{
+    BYTE bufRequest[PAYMENT_HOST_TOKEN_BUF_LEN];
+    BYTE bufResponse[16] = {};
+    uint16_t lenResponse = 0;
+
+    PaymentHostBuildToken( bufRequest, subtype, tokenID, transactionID, amount, PAYMENT_TIME_RECORD_NOT_SPECIFIED );
+    objects->tokenGateway->Action( PaymentTokenGatewayEnter, bufRequest, bufResponse, lenResponse );
+
+    return ( lenResponse > 6 && bufResponse[5] == eDT_Enum ) ? bufResponse[6] : (u8)executionFAIL;
+}
+
+#ifdef PAYMENT_VIRTUAL_CLOCK
+void PaymentReplaySetRegister( const LOGICAL_NAME* ln, u64 value )
+{
+    PaymentHostSetRegisterValue( ln, value );
+}
+#endif // PAYMENT_VIRTUAL_CLOCK
+
+/************************************************************************************************/
+/************************************** Port functions ******************************************/
+/************************************************************************************************/
+
+#ifndef PAYMENT_HOST_FS
+/*
+The indexed file read as a whole is the block of its records, the length of the record is the length
+of the written ones. 0 if no record was written.
+*/
+static u16 readBlock( const PaymentHostMeter* meter, u16 ftId, void* dst, u16 len )
+{
+    std::map< u32, std::vector< u8 > >::const_iterator it = meter->files.lower_bound( (u32)ftId << 16 );
+    if( it == meter->files.end() || ( it->first >> 16 ) != ftId || ( it->first & 0xFFFF ) == NOT_INDEXED )
+        return 0;
+
+    u16 recordLen = (u16)it->second.size();
+    memset( dst, 0xFF, len );
+    for( ; it != meter->files.end() && ( it->first >> 16 ) == ftId && ( it->first & 0xFFFF ) != NOT_INDEXED; ++it )
+    {
+        u32 offset = ( it->first & 0xFFFF ) * (u32)recordLen;
+        if( offset >= len )
+            break;
+
+        u32 copyLen = ( it->second.size() < recordLen ) ? it->second.size() : recordLen;
+        if( copyLen > len - offset )
+            copyLen = len - offset;
+        memcpy( (u8*)dst + offset, it->second.data(), copyLen );
+    }
+    return len;
+}
+
+/* The record which was never written is read with length 0 as in ExportFs */
+static u16 readRecord( u16 ftId, u16 index, void* dst, u16 len )
+{
+    PaymentHostMeter* meter = currentMeter();
+    ++meter->stats.fileReads;
+
+    std::map< u32, std::vector< u8 > >::const_iterator it = meter->files.find( (u32)ftId << 16 | index );
+    if( it == meter->files.end() )
+        return ( index == NOT_INDEXED ) ? readBlock( meter, ftId, dst, len ) : 0;
+
+    u16 readLen = ( len < it->second.size() ) ? len : (u16)it->second.size();
+    memcpy( dst, it->second.data(), readLen );
+    return readLen;
+}
+
+static void writeRecord( u16 ftId, u16 index, const void* src, u16 len )
+{
+    PaymentHostMeter* meter = currentMeter();
+    ++meter->stats.fileWrites;
+    meter->stats.bytesWritten += len;
+
+    std::vector< u8 >& record = meter->files[(u32)ftId << 16 | index];
+    record.assign( (const u8*)src, (const u8*)src + len );
+}
+
+u16 PaymentPortFileRead( u16 ftId, void* dst, u16 len )
+{
+    return readRecord( ftId, NOT_INDEXED, dst, len );
+}
+
+void PaymentPortFileWrite( u16 ftId, const void* src, u16 len )
+{
+    writeRecord( ftId, NOT_INDEXED, src, len );
+}
+
+u16 PaymentPortFileIndexRead( u16 ftId, u16 index, void* dst, u16 len )
+{
+    return readRecord( ftId, index, dst, len );
+}
+
+void PaymentPortFileIndexWrite( u16 ftId, u16 index, const void* src, u16 len )
+{
+    writeRecord( ftId, index, src, len );
+}
+#endif // PAYMENT_HOST_FS
+
+/* Value and scaler_unit of the registers (class 3), value of the states and alarms (class 1) */
+void PaymentPortInternalGetRequest( u16 classId, const LOGICAL_NAME* ln, u8 attrId, BYTE* bufResponse )
+{
+    PaymentHostMeter* meter = currentMeter();
+
+    if( classId == RegisterClassID )
+    {
+        ++meter->stats.registerReads;
+
+        std::map< u64, PaymentHostRegister >::const_iterator it = meter->registers.find( lnKey( ln ) );
+        if( it == meter->registers.end() )
+        {
+            bufResponse[0] = ObjectUndefined;
+            return;
+        }
+
+        bufResponse[0] = Success;
+        if( attrId == 2 )
+        {
+            bufResponse[1] = eDT_Long64Unsigned;
+            AXDREncodeULong64( &bufResponse[2], it->second.value );
+        }
+        else if( attrId == 3 )
+        {
+            bufResponse[1] = Structure;
+            bufResponse[2] = 2;
+            bufResponse[3] = Integer;
+            bufResponse[4] = (BYTE)it->second.scaler;
+            bufResponse[5] = Enum;
+            bufResponse[6] = it->second.unit;
+        }
+        else
+        {
+            bufResponse[0] = ObjectUndefined;
+        }
+        return;
+    }
+
+    std::map< u64, u32 >::const_iterator it = meter->dataValues.find( lnKey( ln ) );
+    if( classId != cicDataClassID || attrId != 2 || it == meter->dataValues.end() )
+    {
+        bufResponse[0] = ObjectUndefined;
+        return;
+    }
+
+    bufResponse[0] = Success;
+    bufResponse[1] = eDT_DoubleLongUnsigned;
+    AXDREncodeDword( &bufResponse[2], it->second );
+}
+
+bool PaymentPortGetRelayState()
+{
+    return currentMeter()->relay;
+}
+
+void PaymentPortDisconnectRelay()
+{
+    PaymentHostMeter* meter = currentMeter();
+    if( meter->relay )
+        ++meter->stats.relaySwitches;
+    meter->relay = false;
+}
+
+void PaymentPortReconnectRelay()
+{
+    PaymentHostMeter* meter = currentMeter();
+    if( !meter->relay )
+        ++meter->stats.relaySwitches;
+    meter->relay = true;
+}
+
+#ifdef PAYMENT_WRITE_QUEUE
+/* One lock for all threads: the tick and the writer context of the queue may run on different threads */
+static std::mutex criticalSection;
+
+void PaymentPortEnterCritical()
+{
+    criticalSection.lock();
+}
+
+void PaymentPortExitCritical()
+{
+    criticalSection.unlock();
+}
+#endif // PAYMENT_WRITE_QUEUE
+
+#ifdef PAYMENT_PROFILING
+/* Monotonic time scaled to PAYMENT_CPU_FREQ_HZ, the host build sets it to 1 GHz so a cycle is a nanosecond */
+u32 PaymentPortGetCycles()
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    u64 ns = (u64)now.tv_sec * 1000000000ULL + now.tv_nsec;
+    return (u32)( ns * ( PAYMENT_CPU_FREQ_HZ / 1000000ULL ) / 1000ULL );
+}
+
+/* Retired instructions of the calling thread, 0 if perf events are not permitted */
+u32 PaymentPortGetInstructions()
+{
+    static PAYMENT_THREAD_LOCAL int fd = -2;
+
+    if( fd == -2 )
+    {
+        struct perf_event_attr attr;
+        memset( &attr, 0, sizeof( attr ) );
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof( attr );
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = (int)syscall( __NR_perf_event_open, &attr, 0, -1, -1, 0 );
+    }
+
+    u64 instructions = 0;
+    if( fd < 0 || read( fd, &instructions, sizeof( instructions ) ) != sizeof( instructions ) )
+        return 0;
+    return (u32)instructions;
+}
+#endif // PAYMENT_PROFILING
+
+#ifndef PAYMENT_VIRTUAL_CLOCK
+void PaymentPortGetLocalTime( TDateTime* dateTime )
+{
+    GetLocalTime_APDU( dateTime );
+}
+#endif // PAYMENT_VIRTUAL_CLOCK
+
+#endif // PAYMENT_HOST_BUILD
@@ -0,0 +1,81 @@
+/*
+    \file PaymentHost.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+/*
+Harness of the host build (PAYMENT_HOST_BUILD): the implementation of the port functions
+over the in-memory stand-ins of the meter.
+Every simulated meter has its own file table, registers, relay, simulation clock and the state
+of the modules (deadlines, journal, snapshot, transaction, emergency area, CRC records, write statistics).
+The meter is selected per thread before its Payment objects are invoked, a thread which
+has not selected a meter works with its own default meter.
+With PAYMENT_HOST_FS the files are kept by the flash emulator (cicPaymentHostFs) instead of the table.
+*/
+
+#if !defined _PAYMENT_HOST_
+#define _PAYMENT_HOST_
+
+#include "config.h"
+#include "CommonTypes.h"
+#include "cicPayment.h"
+
+#if defined PAYMENT_HOST_BUILD
+
+typedef struct{
+    u64         fileReads;
+    u64         fileWrites;
+    u64         bytesWritten;
+    u64         registerReads;
+    u32         relaySwitches;
+} PaymentHostStats;
+
+typedef struct PaymentHostMeter PaymentHostMeter;
+
+PaymentHostMeter* PaymentHostMeterCreate();
+void PaymentHostMeterDestroy( PaymentHostMeter* meter );
+void PaymentHostMeterSelect( PaymentHostMeter* meter );         // NULL returns to the default meter of the thread
+PaymentHostMeter* PaymentHostMeterGetSelected();
+
+/* The functions below work with the selected meter */
+void PaymentHostFormat();                                       // all files are erased, as on the new meter (the image of PAYMENT_HOST_FS)
+void PaymentHostRestart();                                      // the power cut of the selected meter: the files are kept, the queued records are lost
+void PaymentHostSetRegister( const LOGICAL_NAME* ln, u64 value, s8 scaler, u8 unit );
+void PaymentHostSetRegisterValue( const LOGICAL_NAME* ln, u64 value );
+void PaymentHostSetDataValue( const LOGICAL_NAME* ln, u32 value ); // states and alarms objects of cicData
+void PaymentHostSetRelay( bool connected );
+const PaymentHostStats* PaymentHostGetStats();
+void PaymentHostResetStats();
+
+/*
+Parameter of Action( PaymentTokenGatewayEnter ) with the token of the subtype (inTokenSubtype).
+The amount is used by the startPaid and topUp tokens, the expires time (PaymentTimeToRecord) by the start tokens.
+The function returns the length of the parameter, buf must hold PAYMENT_HOST_TOKEN_BUF_LEN bytes.
+*/
+#define PAYMENT_HOST_TOKEN_BUF_LEN              ( MAX_LEN_RECEIVED_TOKEN + 3 )
+
+u16 PaymentHostBuildToken( BYTE* buf, u8 subtype, u32 tokenID, const BYTE* transactionID, s32 amount, u32 expiresTime );
+
+/* Objects of one simulated meter, the credits and charges are the lists of the account which ticks them (PaymentIdlePass) */
+typedef struct{
+    PaymentCreditClass*         creditList[MAX_OBJECTS_IN_CREDIT_REF_LIST];
+    u8                          lenCreditList;
+    PaymentChargeClass*         chargeList[MAX_OBJECTS_IN_CHARGE_REF_LIST];
+    u8                          lenChargeList;
+    PaymentTokenGatewayClass*   tokenGateway;
+    PaymentAccountClass*        account;
+} PaymentHostObjects;
+
+bool PaymentHostGetImportObjects( PaymentHostObjects* objects );        // the import objects of cicPayment.cpp
+void PaymentHostCreateObjects( PaymentHostObjects* objects );           // the objects of one more meter
+void PaymentHostInitObjects( const PaymentHostObjects* objects );       // as at the start of the meter
+void PaymentHostTickObjects( const PaymentHostObjects* objects, bool newMinute );
+u8 PaymentHostEnterToken( const PaymentHostObjects* objects, u8 subtype, u32 tokenID, const BYTE* transactionID, s32 amount );     // eT_tokenStatusCode
+
+#endif // PAYMENT_HOST_BUILD
+
+#endif // _PAYMENT_HOST_
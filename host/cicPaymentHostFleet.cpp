@@ -0,0 +1,133 @@
+/*
+    \file PaymentHostFleet.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+
+#include "cicPaymentHostFleet.h"
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <string.h>
+
+/* The deque of one worker, its owner works at the back, the thieves at the front */
+struct FleetDeque{
+    std::mutex                                  lock;
+    std::deque<u32>                             tasks;
+};
+
+struct FleetRun{
+    PaymentHostMeter* const*                    meters;
+    PaymentHostFleetStep                        step;
+    PaymentHostFleetWorkerEnd                   workerEnd;
+    void*                                       arg;
+    u8                                          workersNum;
+    FleetDeque                                  deques[MAX_PAYMENT_HOST_FLEET_WORKERS];
+    std::atomic<u32>                            metersLeft;
+};
+
+static bool popOwn( FleetDeque* deque, u32* meterPos )
+{
+    std::lock_guard<std::mutex> guard( deque->lock );
+    if( deque->tasks.empty() )
+        return false;
+
+    *meterPos = deque->tasks.back();
+    deque->tasks.pop_back();
+    return true;
+}
+
+static bool steal( FleetRun* run, u8 worker, u32* meterPos )
+{
+    for( u8 i = 1; i < run->workersNum; ++i )
+    {
+        FleetDeque* victim = &run->deques[( worker + i ) % run->workersNum];
+        std::lock_guard<std::mutex> guard( victim->lock );
+        if( victim->tasks.empty() )
+            continue;
+
+        *meterPos = victim->tasks.front();
+        victim->tasks.pop_front();
+        return true;
+    }
+    return false;
+}
+
+static void workerRun( FleetRun* run, u8 worker, PaymentHostFleetWorkerStats* stats )
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    FleetDeque* own = &run->deques[worker];
+
+    while( run->metersLeft.load() != 0 )
+    {
+        u32 meterPos;
+        if( !popOwn( own, &meterPos ) )
+        {
+            if( !steal( run, worker, &meterPos ) )
+            {
+                std::this_thread::yield();      // the last steps of the other meters are in progress
+                continue;
+            }
+            ++stats->steals;
+        }
+
+        PaymentHostMeterSelect( run->meters[meterPos] );
+        bool more = run->step( meterPos, run->arg );
+        PaymentHostMeterSelect( NULL );
+        ++stats->steps;
+
+        if( more )
+        {
+            std::lock_guard<std::mutex> guard( own->lock );
+            own->tasks.push_back( meterPos );
+        }
+        else
+            run->metersLeft.fetch_sub( 1 );
+    }
+
+    if( run->workerEnd != NULL )
+        run->workerEnd( worker, run->arg );
+
+    stats->wallNs = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count();
+}
+
+void PaymentHostFleetRun( PaymentHostMeter* const* meters, u32 metersNum, u8 workersNum,
+                          PaymentHostFleetStep step, PaymentHostFleetWorkerEnd workerEnd, void* arg,
+                          PaymentHostFleetWorkerStats* stats )
+{
+    if( workersNum == 0 )
+        workersNum = 1;
+    if( workersNum > MAX_PAYMENT_HOST_FLEET_WORKERS )
+        workersNum = MAX_PAYMENT_HOST_FLEET_WORKERS;
+
+    FleetRun* run = new FleetRun();
+    run->meters = meters;
+    run->step = step;
+    run->workerEnd = workerEnd;
+    run->arg = arg;
+    run->workersNum = workersNum;
+    run->metersLeft.store( metersNum );
+
+    /* the meters are dealt in blocks, the neighbours of one worker share nothing with the other workers */
+    for( u32 pos = 0; pos < metersNum; ++pos )
+        run->deques[(u64)pos * workersNum / metersNum].tasks.push_front( pos );
+
+    memset( stats, 0, sizeof( *stats ) * workersNum );
+
+    std::vector<std::thread> threads;
+    for( u8 worker = 1; worker < workersNum; ++worker )
+        threads.push_back( std::thread( workerRun, run, worker, &stats[worker] ) );
+    workerRun( run, 0, &stats[0] );
+
+    for( size_t i = 0; i < threads.size(); ++i )
+        threads[i].join();
+
+    delete run;
+}
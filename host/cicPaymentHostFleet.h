@@ -0,0 +1,46 @@
+/*
+    \file PaymentHostFleet.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+
+/*
+Work-stealing scheduler of the fleet simulation (PAYMENT_HOST_BUILD).
+Every meter is one task: the step advances the meter by a chunk of the simulated time and tells if
+the meter has more steps. The next step of the meter is pushed to the deque of the worker which has made
+the step, a worker takes the tasks from the back of its own deque and, when it is empty, steals from the front
+of the deques of the other workers. A meter has one task at most, so its steps are made one after another
+in the same order for any number of workers and the result of every meter is deterministic.
+The step is invoked with its meter selected on the thread of the worker.
+*/
+
+#if !defined _PAYMENT_HOST_FLEET_
+#define _PAYMENT_HOST_FLEET_
+
+#include "cicPaymentHost.h"
+
+#if defined PAYMENT_HOST_BUILD
+
+typedef bool (*PaymentHostFleetStep)( u32 meterPos, void* arg );       // true while the meter has more steps
+typedef void (*PaymentHostFleetWorkerEnd)( u8 worker, void* arg );     // on the thread of the worker after its last step
+
+typedef struct{
+    u64         steps;
+    u64         steals;
+    u64         wallNs;                         // from the start of the worker to its end
+} PaymentHostFleetWorkerStats;
+
+static const uint8_t MAX_PAYMENT_HOST_FLEET_WORKERS     = 64;
+
+/* stats holds workersNum entries, workerEnd may be NULL */
+void PaymentHostFleetRun( PaymentHostMeter* const* meters, u32 metersNum, u8 workersNum,
+                          PaymentHostFleetStep step, PaymentHostFleetWorkerEnd workerEnd, void* arg,
+                          PaymentHostFleetWorkerStats* stats );
+
+#endif // PAYMENT_HOST_BUILD
+
+#endif // _PAYMENT_HOST_FLEET_
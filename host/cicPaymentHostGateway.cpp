@@ -0,0 +1,357 @@
+/*
+    \file PaymentHostGateway.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+
+/*
+Stand-in of the token path of the gateway for the host build: the constructor, Init(), IdleMinute(), Enter()
+and the check, update and process functions are in the firmware of the meter, not in cicPayment.cpp.
+The stand-in follows the orders of the HES as the token mix does (see cicPaymentTokenMix.h): the start token
+opens the order, the other tokens must carry its ID, the paid tokens top up, activate and close the account
+linked by the harness with LinkAccount(). The TIDs are checked and kept by the history of cicPayment.cpp.
+*/
+
+#include "cicPayment.h"
+#include "cicPaymentPort.h"
+#include "cicPaymentTime.h"
+#include "utils.h"
+#include "_objectMaps.h"
+#include <string.h>
+
+#if defined PAYMENT_HOST_BUILD
+
+PaymentTokenGatewayClass::PaymentTokenGatewayClass( const LOGICAL_NAME* const _ln,
+                                                   const ftPaymentTokenGateway* const _ftFile ) : ln( _ln ), ftFile( _ftFile ), account( NULL ), tokenIDHeadSeq( 0 )
+{
+#ifndef NEW_CONST_CLASS_MAP                                                                           
+    DataObjectsMap[(LOGICAL_NAME*)_ln] = this; 
+#endif // NEW_CONST_CLASS_MAP
+}
+
+void PaymentTokenGatewayClass::LinkAccount( PaymentAccountClass* const _account )
+{
+    account = _account;
+}
+
+void PaymentTokenGatewayClass::Init()
+{
+    memset( &currValues, 0, sizeof( currValues ) );
+    memset( &lastToken, 0, sizeof( lastToken ) );
+    
+    PaymentFileRead( ftFile->ftToken, &currValues.token );
+    u32 tokenTime = PAYMENT_TIME_RECORD_NOT_SPECIFIED;
+    PaymentFileRead( ftFile->ftTokenTime, &tokenTime );
+    currValues.tokenTime = PaymentTimeFromRecord( tokenTime );
+    PaymentFileRead( ftFile->ftTokenDeliveryMethod, &currValues.tokenDeliveryMethod );
+    PaymentFileRead( ftFile->ftTokenStatusCode, &currValues.tokenStatus.statusCode );
+    
+    PaymentFileRead( ftFile->ftActiveTransactionID, &lastToken.activeTransactionID );
+    
+    u8 subtype = (u8)inTokenSubtype::none;
+    PaymentFileRead( ftFile->ftLastTokenSubtype, &subtype );
+    lastToken.subtype = (inTokenSubtype)subtype;
+    
+    lastToken.expiresTimeSecReceivedWithStart = PAYMENT_TIME_RECORD_NOT_SPECIFIED;
+    lastToken.expiresTimeStatusReceivedWithStart = 0xFF;
+    PaymentFileRead( ftFile->ftExpiresTimeSecReceivedWithStart, &lastToken.expiresTimeSecReceivedWithStart );
+    PaymentFileRead( ftFile->ftExpiresTimeStatusReceivedWithStart, &lastToken.expiresTimeStatusReceivedWithStart );
+    
+    lastToken.timeOfStartSec = PAYMENT_TIME_RECORD_NOT_SPECIFIED;
+    lastToken.timeOfStartStatus = 0xFF;
+    PaymentFileRead( ftFile->ftTimeOfStartSec, &lastToken.timeOfStartSec );
+    PaymentFileRead( ftFile->ftTimeOfStartStatus, &lastToken.timeOfStartStatus );
+    
+    MigrateTokenIDHistory();
+    LoadTokenIDHistory();                       // tokenID and nextReceivedTokenIndex of lastToken
+}
+
+void PaymentTokenGatewayClass::IdleMinute()
+{
+    if( HasExpiresTimeCome() )
+        ProcessExpiresTime();
+}
+
+/*
+The token is the parameter of the method: the tag and the length of the octet-string followed by the token.
+The token is accepted only when all checks are passed, then its TID is added to the history
+and the files of the token are written (in one transaction with PAYMENT_TRANSACTION).
+*/
+eT_tokenStatusCode PaymentTokenGatewayClass::Enter( uint8_t* rxToken )
+{
+    currValues.tokenStatus.statusCode = CheckReceivedToken( rxToken );
+    currValues.tokenStatus.dataValue = 0;
+    
+    if( currValues.tokenStatus.statusCode == validationOK )
+    {
+        UpdateTokenFormatFields( rxToken );
+        ProcessToken( rxToken );                /* ends by ConfirmReceivedToken() or RefuseReceivedToken() */
+    }
+    else
+    {
+        PaymentFileWrite( ftFile->ftTokenStatusCode, &currValues.tokenStatus.statusCode );
+    }
+    
+    return currValues.tokenStatus.statusCode;
+}
+
+eT_tokenStatusCode PaymentTokenGatewayClass::CheckReceivedToken( uint8_t* tokenRx ) const
+{
+    if( !CheckFormatReceivedToken( tokenRx ) )
+        return formatFAIL;
+    
+#warning: "Need to check AES_GSM tag of the token"
+    
+    eT_tokenStatusCode status = CheckCommonFieldsReceivedToken( tokenRx );
+    if( status != validationOK )
+        return status;
+    
+    if( !CheckSpecificFieldsReceivedToken( tokenRx ) )
+        return validationFAIL;
+    
+    return validationOK;
+}
+
+bool PaymentTokenGatewayClass::CheckFormatReceivedToken( uint8_t* tokenRx ) const
+{
+    if( tokenRx[(u8)commonFieldPosInToken::tag] != eDT_OctetString || tokenRx[(u8)commonFieldPosInToken::type] != inTokenType )
+        return false;
+    
+    u8 rxSubtype = tokenRx[(u8)commonFieldPosInToken::subtype];
+    if( !CheckReceivedTokenSubtype( rxSubtype ) )
+        return false;
+    
+    return CheckLenReceivedToken( tokenRx[(u8)commonFieldPosInToken::len], rxSubtype );
+}
+
+bool PaymentTokenGatewayClass::CheckLenReceivedToken( uint8_t lenRxToken, uint8_t rxTokenSubtype ) const
+{
+    switch( (inTokenSubtype)rxTokenSubtype )
+    {
+        case inTokenSubtype::startPaidToken:    return lenRxToken == (u8)inTokenLen::startPaid;
+        case inTokenSubtype::topUpToken:        return lenRxToken == (u8)inTokenLen::topUp;
+        case inTokenSubtype::stopPaidToken:     return lenRxToken == (u8)inTokenLen::stopPaid;
+        case inTokenSubtype::startNonPaidToken: return lenRxToken == (u8)inTokenLen::startNonPaid;
+        case inTokenSubtype::stopNonPaidToken:  return lenRxToken == (u8)inTokenLen::stopNonPaid;
+        default:                                return false;
+    }
+}
+
+bool PaymentTokenGatewayClass::CheckReceivedTokenSubtype( u8 rxSubtype ) const
+{
+    return rxSubtype >= (u8)inTokenSubtype::startPaidToken && rxSubtype <= (u8)inTokenSubtype::stopNonPaidToken;
+}
+
+eT_tokenStatusCode PaymentTokenGatewayClass::CheckCommonFieldsReceivedToken( uint8_t* tokenRx ) const
+{
+    u8 rxSubtype = tokenRx[(u8)commonFieldPosInToken::subtype];
+    
+    u32 rxTID = 0;
+    AXDRDecodeDword( &tokenRx[(u8)commonFieldPosInToken::tokenID], &rxTID );
+    if( !CheckReceivedTokenID( rxTID, rxSubtype ) )
+        return validationFAIL;
+    
+    if( !CheckReceivedOrderID( &tokenRx[(u8)commonFieldPosInToken::transactionID], rxSubtype ) )
+        return validationFAIL;
+    
+    return validationOK;
+}
+
+/* The TIDs of all subtypes are in one history */
+bool PaymentTokenGatewayClass::CheckReceivedTokenID( u32 rxTID, u8 ) const
+{
+    return !CheckForDuplicatesReceivedTokenID( rxTID );
+}
+
+
+static bool isTransactionIDEmpty( const BYTE* transactionID )
+{
+    for( u8 i = 0; i < LEN_ACTIVE_TRANSACTION_ID; ++i )
+    {
+        if( transactionID[i] != 0 )
+            return false;
+    }
+    return true;
+}
+
+/* The start token opens the order when no order is active, the other tokens must belong to the active order */
+bool PaymentTokenGatewayClass::CheckReceivedOrderID( uint8_t* rxTransactionID, u8 rxTokenSubtype ) const
+{
+    if( (inTokenSubtype)rxTokenSubtype == inTokenSubtype::startPaidToken ||
+        (inTokenSubtype)rxTokenSubtype == inTokenSubtype::startNonPaidToken )
+    {
+        return isTransactionIDEmpty( lastToken.activeTransactionID ) && !isTransactionIDEmpty( rxTransactionID );
+    }
+    
+    return !isTransactionIDEmpty( lastToken.activeTransactionID ) &&
+           memcmp( rxTransactionID, lastToken.activeTransactionID, LEN_ACTIVE_TRANSACTION_ID ) == 0;
+}
+
+/* The paid tokens need the linked account, ProcessToken() relies on it */
+bool PaymentTokenGatewayClass::CheckSpecificFieldsReceivedToken( uint8_t* tokenRx ) const
+{
+    s32 amount = 0;
+    switch( (inTokenSubtype)tokenRx[(u8)commonFieldPosInToken::subtype] )
+    {
+        case inTokenSubtype::startPaidToken:
+            AXDRDecodeDoubleLong( &tokenRx[(u8)specificFieldPosStartPaidToken::amount], &amount );
+            return account != NULL && amount >= 0;
+        case inTokenSubtype::topUpToken:
+            AXDRDecodeDoubleLong( &tokenRx[(u8)specificFieldPosTopUpToken::amount], &amount );
+            return account != NULL && account->IsAccountActive() && amount > 0;
+        case inTokenSubtype::stopPaidToken:
+            return account != NULL;
+        default:
+            return true;
+    }
+}
+
+void PaymentTokenGatewayClass::UpdateTokenFormatFields( uint8_t* tokenRx )
+{
+    memset( currValues.token, 0, sizeof( currValues.token ) );
+    memcpy( currValues.token, &tokenRx[(u8)commonFieldPosInToken::type], tokenRx[(u8)commonFieldPosInToken::len] );
+    PaymentFileWrite( ftFile->ftToken, &currValues.token );
+    
+    currValues.tokenTime = PaymentTimeNow();
+    u32 tokenTime = PaymentTimeToRecord( currValues.tokenTime );
+    PaymentFileWrite( ftFile->ftTokenTime, &tokenTime );
+    
+    UpdateTokenSubtype( (inTokenSubtype)tokenRx[(u8)commonFieldPosInToken::subtype] );
+    
+    u32 rxTID = 0;
+    AXDRDecodeDword( &tokenRx[(u8)commonFieldPosInToken::tokenID], &rxTID );
+    UpdateTokenID( rxTID );
+}
+
+void PaymentTokenGatewayClass::UpdateTokenSubtype( inTokenSubtype newTokenSubtype )
+{
+    lastToken.subtype = newTokenSubtype;
+    u8 subtype = (u8)newTokenSubtype;
+    PaymentFileWrite( ftFile->ftLastTokenSubtype, &subtype );
+}
+
+void PaymentTokenGatewayClass::IncrementNextReceivedTokenIndex()
+{
+    lastToken.nextReceivedTokenIndex = ( lastToken.nextReceivedTokenIndex + 1 ) % NUM_OF_STORED_TOKENS_ID;
+}
+
+void PaymentTokenGatewayClass::UpdateTokenID( u32 newTokenID )
+{
+    lastToken.tokenID = newTokenID;
+    AppendTokenIDToHistory( newTokenID );
+}
+
+void PaymentTokenGatewayClass::UpdateExpiresTime( u32 newExpiresTime, u8 newExpiresTimeStatus )
+{
+    lastToken.expiresTimeSecReceivedWithStart = newExpiresTime;
+    lastToken.expiresTimeStatusReceivedWithStart = newExpiresTimeStatus;
+    PaymentFileWrite( ftFile->ftExpiresTimeSecReceivedWithStart, &lastToken.expiresTimeSecReceivedWithStart );
+    PaymentFileWrite( ftFile->ftExpiresTimeStatusReceivedWithStart, &lastToken.expiresTimeStatusReceivedWithStart );
+}
+
+void PaymentTokenGatewayClass::UpdateTimeOfStart( u32 newTimeOfStartSec, u8 newTimeOfStartStatus )
+{
+    lastToken.timeOfStartSec = newTimeOfStartSec;
+    lastToken.timeOfStartStatus = newTimeOfStartStatus;
+    PaymentFileWrite( ftFile->ftTimeOfStartSec, &lastToken.timeOfStartSec );
+    PaymentFileWrite( ftFile->ftTimeOfStartStatus, &lastToken.timeOfStartStatus );
+}
+
+void PaymentTokenGatewayClass::UpdateTransactionID( uint8_t* newTransactionID )
+{
+    memcpy( lastToken.activeTransactionID, newTransactionID, LEN_ACTIVE_TRANSACTION_ID );
+    PaymentFileWrite( ftFile->ftActiveTransactionID, &lastToken.activeTransactionID );
+}
+
+void PaymentTokenGatewayClass::ResetActiveTransactionID()
+{
+    memset( lastToken.activeTransactionID, 0, LEN_ACTIVE_TRANSACTION_ID );
+    PaymentFileWrite( ftFile->ftActiveTransactionID, &lastToken.activeTransactionID );
+}
+
+bool PaymentTokenGatewayClass::HasExpiresTimeCome() const
+{
+    if( isTransactionIDEmpty( lastToken.activeTransactionID ) ||
+        lastToken.expiresTimeSecReceivedWithStart == PAYMENT_TIME_RECORD_NOT_SPECIFIED )
+    {
+        return false;
+    }
+    
+    return PaymentTimeNow() >= PaymentTimeFromRecord( lastToken.expiresTimeSecReceivedWithStart );
+}
+
+/* The expired order is finished as by the stop token */
+void PaymentTokenGatewayClass::ProcessExpiresTime()
+{
+    if( account != NULL )
+        account->CloseAccount();
+    
+    ResetActiveTransactionID();
+    UpdateExpiresTime( PAYMENT_TIME_RECORD_NOT_SPECIFIED, 0xFF );
+}
+
+void PaymentTokenGatewayClass::ProcessToken( uint8_t* tokenRx )
+{
+    u32 expiresTimeSec = 0;
+    AXDRDecodeDword( &tokenRx[(u8)commonFieldPosInToken::expiresTime], &expiresTimeSec );
+    u8 expiresTimeStatus = tokenRx[(u8)commonFieldPosInToken::expiresTimeStatus];
+    s32 amount = 0;
+    
+    switch( lastToken.subtype )
+    {
+        case inTokenSubtype::startPaidToken:
+            UpdateTransactionID( &tokenRx[(u8)commonFieldPosInToken::transactionID] );
+            UpdateExpiresTime( expiresTimeSec, expiresTimeStatus );
+            UpdateTimeOfStart( PaymentTimeToRecord( currValues.tokenTime ), 0 );
+            
+            if( !account->IsAccountActive() )
+            {
+                account->ResetAccount();                        /* the account closed by the previous order starts as the new one */
+                account->ActivateAccount();
+            }
+            
+            AXDRDecodeDoubleLong( &tokenRx[(u8)specificFieldPosStartPaidToken::amount], &amount );
+            if( amount > 0 )
+                account->TopUpCredits( amount );                /* confirms the token when the sum is distributed */
+            else
+                ConfirmReceivedToken();
+            break;
+            
+        case inTokenSubtype::topUpToken:
+            AXDRDecodeDoubleLong( &tokenRx[(u8)specificFieldPosTopUpToken::amount], &amount );
+            account->TopUpCredits( amount );
+            break;
+            
+        case inTokenSubtype::stopPaidToken:
+            account->CloseAccount();
+            ResetActiveTransactionID();
+            UpdateExpiresTime( PAYMENT_TIME_RECORD_NOT_SPECIFIED, 0xFF );
+            ConfirmReceivedToken();
+            break;
+            
+        case inTokenSubtype::startNonPaidToken:
+            UpdateTransactionID( &tokenRx[(u8)commonFieldPosInToken::transactionID] );
+            UpdateExpiresTime( expiresTimeSec, expiresTimeStatus );
+            UpdateTimeOfStart( PaymentTimeToRecord( currValues.tokenTime ), 0 );
+            ConfirmReceivedToken();
+            break;
+            
+        case inTokenSubtype::stopNonPaidToken:
+            ResetActiveTransactionID();
+            UpdateExpiresTime( PAYMENT_TIME_RECORD_NOT_SPECIFIED, 0xFF );
+            ConfirmReceivedToken();
+            break;
+            
+        default:
+            break;
+    }
+    
+    if( currValues.tokenStatus.statusCode != executionOK )
+        RefuseReceivedToken();
+}
+
+#endif // PAYMENT_HOST_BUILD
@@ -0,0 +1,160 @@
+/*
+    \file PaymentHostReplay.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+
+/*
+Test of the replay: the trace of a field meter (the startPaid token, the readings of the register
+and the set of the clock) is replayed on the import objects of cicPayment.cpp and the timeline is checked.
+The broken traces are refused with their result. The program returns 0 if all checks pass.
+*/
+
+#include "cicPaymentHost.h"
+#include "cicPaymentPort.h"
+#include "cicPaymentReplay.h"
+#include "_objectMaps.h"
+#include <stdio.h>
+#include <vector>
+
+static const PaymentTime START_UTC = 1614556800;             // 2021-03-01 00:00:00
+
+static u32 failures = 0;
+
+static void check( bool condition, const char* what )
+{
+    if( !condition )
+    {
+        printf( "FAIL: %s\n", what );
+        ++failures;
+    }
+}
+
+static void addRecord( std::vector< BYTE >& trace, u32 utcSeconds, u8 type, const void* payload, u8 len )
+{
+    PaymentTraceRecordHeader header;
+    memset( &header, 0, sizeof( header ) );
+    header.utcSeconds = utcSeconds;
+    header.type = type;
+    header.len = len;
+
+    const BYTE* bytes = (const BYTE*)&header;
+    trace.insert( trace.end(), bytes, bytes + sizeof( header ) );
+    trace.insert( trace.end(), (const BYTE*)payload, (const BYTE*)payload + len );
+}
+
+static void addRegister( std::vector< BYTE >& trace, u32 utcSeconds, u64 value )
+{
+    BYTE payload[sizeof( LOGICAL_NAME ) + sizeof( u64 )];
+    memcpy( payload, &RegisterAsumLN, sizeof( LOGICAL_NAME ) );
+    memcpy( &payload[sizeof( LOGICAL_NAME )], &value, sizeof( value ) );
+    addRecord( trace, utcSeconds, PaymentTraceRegister, payload, sizeof( payload ) );
+}
+
+static void addClockSet( std::vector< BYTE >& trace, u32 utcSeconds, u32 newSeconds )
+{
+    addRecord( trace, utcSeconds, PaymentTraceClockSet, &newSeconds, sizeof( newSeconds ) );
+}
+
+static void addToken( std::vector< BYTE >& trace, u32 utcSeconds, u8 subtype, u32 tokenID, s32 amount )
+{
+    BYTE transactionID[LEN_ACTIVE_TRANSACTION_ID] = { 1, 2, 3, 4 };
+    BYTE buf[PAYMENT_HOST_TOKEN_BUF_LEN];
+    u16 len = PaymentHostBuildToken( buf, subtype, tokenID, transactionID, amount, PAYMENT_TIME_RECORD_NOT_SPECIFIED );
+    addRecord( trace, utcSeconds, PaymentTraceToken, buf, (u8)len );
+}
+
+static void collect( const PaymentTimelineRecord* record, void* arg )
+{
+    ( (std::vector< PaymentTimelineRecord >*)arg )->push_back( *record );
+}
+
+/* the last record of the type at or before utcSeconds, NULL if none */
+static const PaymentTimelineRecord* lastRecord( const std::vector< PaymentTimelineRecord >& timeline, u8 type, u32 utcSeconds )
+{
+    const PaymentTimelineRecord* last = NULL;
+    for( size_t i = 0; i < timeline.size(); ++i )
+        if( timeline[i].type == type && timeline[i].utcSeconds <= utcSeconds )
+            last = &timeline[i];
+    return last;
+}
+
+int main()
+{
+    PaymentHostObjects objects;
+    if( !PaymentHostGetImportObjects( &objects ) )
+    {
+        printf( "FAIL: objects are not registered in the maps\n" );
+        return 1;
+    }
+
+    PaymentReplayMeter meter;
+    memset( &meter, 0, sizeof( meter ) );
+    memcpy( meter.creditList, objects.creditList, sizeof( meter.creditList ) );
+    meter.lenCreditList = objects.lenCreditList;
+    memcpy( meter.chargeList, objects.chargeList, sizeof( meter.chargeList ) );
+    meter.lenChargeList = objects.lenChargeList;
+    meter.tokenGateway = objects.tokenGateway;
+    meter.account = objects.account;
+
+    PaymentHostFormat();
+    PaymentHostSetRegister( &RegisterAsumLN, 0, 0, UnitWh );
+    PaymentVirtualClockSetSeconds( START_UTC );
+    PaymentHostInitObjects( &objects );
+
+    /* 1 kWh at 1.84 per kWh after the start, the clock is set forward by the head end */
+    std::vector< BYTE > trace;
+    addRegister( trace, START_UTC + 30, 0 );
+    addToken( trace, START_UTC + 60, (u8)inTokenSubtype::startPaidToken, 1, 10000 );
+    addRegister( trace, START_UTC + 180, 1000 );
+    addClockSet( trace, START_UTC + 400, START_UTC + 3600 );
+    addRegister( trace, START_UTC + 3720, 1000 );
+
+    std::vector< PaymentTimelineRecord > timeline;
+    check( PaymentReplayRun( &meter, trace.data(), (u32)trace.size(), collect, &timeline ) == PaymentReplayOK, "trace is replayed" );
+    check( PaymentVirtualClockGetSeconds() == START_UTC + 3720, "clock is at the last record" );
+
+    bool ordered = true;
+    for( size_t i = 1; i < timeline.size(); ++i )
+        ordered = ordered && timeline[i - 1].utcSeconds <= timeline[i].utcSeconds;
+    check( ordered, "timeline is ordered by the time" );
+
+    const PaymentTimelineRecord* status = lastRecord( timeline, PaymentTimelineTokenStatus, START_UTC + 3720 );
+    check( status != NULL && status->utcSeconds == START_UTC + 60 && status->value == executionOK, "startPaid token is executed at its second" );
+
+    const PaymentTimelineRecord* credit = lastRecord( timeline, PaymentTimelineAvailableCredit, START_UTC + 179 );
+    check( credit != NULL && credit->value == 10000, "available credit after startPaid" );
+    credit = lastRecord( timeline, PaymentTimelineAvailableCredit, START_UTC + 3720 );
+    check( credit != NULL && credit->value == 10000 - 184 && credit->utcSeconds >= START_UTC + 180 && credit->utcSeconds < START_UTC + 400,
+           "consumption is collected before the clock set" );
+
+    const PaymentTimelineRecord* relay = lastRecord( timeline, PaymentTimelineRelay, START_UTC + 3720 );
+    check( relay != NULL && relay->value == 1, "relay is connected" );
+
+    /* the broken traces stop the replay */
+    u32 now = PaymentVirtualClockGetSeconds();
+    std::vector< BYTE > broken;
+    addRegister( broken, now - 1, 1000 );
+    check( PaymentReplayRun( &meter, broken.data(), (u32)broken.size(), collect, &timeline ) == PaymentReplayRecordInPast, "record in the past is refused" );
+
+    broken.clear();
+    addRegister( broken, now + 10, 1000 );
+    check( PaymentReplayRun( &meter, broken.data(), (u32)broken.size() - 1, collect, &timeline ) == PaymentReplayTruncatedRecord, "truncated payload is refused" );
+
+    broken.clear();
+    addRecord( broken, now + 20, 0xEE, NULL, 0 );
+    check( PaymentReplayRun( &meter, broken.data(), (u32)broken.size(), collect, &timeline ) == PaymentReplayUnknownRecord, "unknown record is refused" );
+
+    if( failures != 0 )
+    {
+        printf( "%u checks failed\n", failures );
+        return 1;
+    }
+
+    printf( "replay: OK, %u timeline records\n", (u32)timeline.size() );
+    return 0;
+}
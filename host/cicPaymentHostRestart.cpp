@@ -0,0 +1,373 @@
+/*
+    \file PaymentHostRestart.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+
+/*
+Restart of the meter after the power cut at the faults of the persistence modules.
+Every scenario formats the meter, runs the paid account, makes the fault in the files, restarts the meter
+by PaymentHostRestart() and checks the credit, the status of the account and the paid amount
+against the state which the files must restore.
+With PAYMENT_HOST_FS the files are kept in the image of the flash emulator (the path is the argument),
+and the power is cut at every byte written by the token.
+The program returns 0 if all checks pass.
+*/
+
+#include "cicPaymentHost.h"
+#include "cicPaymentPort.h"
+#include "cicPaymentJournal.h"
+#include "cicPaymentHostFs.h"
+#include "_objectMaps.h"
+#include <stdio.h>
+
+static PaymentHostObjects objects;
+static u32 failures = 0;
+
+typedef struct{
+    s32         creditAmount;
+    s32         totalAmountPaid;
+    bool        active;
+} RestartState;
+
+static void check( bool condition, const char* what )
+{
+    if( !condition )
+    {
+        printf( "FAIL: %s\n", what );
+        ++failures;
+    }
+}
+
+static void tick( bool newMinute, void* arg )
+{
+    PaymentHostTickObjects( &objects, newMinute );
+}
+
+static void getState( RestartState* state )
+{
+    state->creditAmount = objects.account->GetSumOfAllCurrentCreditAmount();
+    state->totalAmountPaid = objects.account->GetSumOfAllChargeTotalAmountPaid();
+    state->active = objects.account->IsAccountActive();
+}
+
+static void checkState( const RestartState* expected, const char* scenario )
+{
+    RestartState state;
+    getState( &state );
+    if( state.creditAmount != expected->creditAmount || state.totalAmountPaid != expected->totalAmountPaid || state.active != expected->active )
+    {
+        printf( "FAIL: %s: credit %d paid %d active %d, expected %d %d %d\n", scenario, state.creditAmount, state.totalAmountPaid, state.active,
+                expected->creditAmount, expected->totalAmountPaid, expected->active );
+        ++failures;
+    }
+}
+
+static void restart()
+{
+    PaymentHostRestart();
+    PaymentHostInitObjects( &objects );
+}
+
+/* The formatted meter with the paid account, 1 kWh is collected and flushed */
+static void startMeter()
+{
+    PaymentHostFormat();
+    PaymentHostRestart();
+    PaymentHostSetRegister( &RegisterAsumLN, 0, 0, UnitWh );
+    PaymentHostInitObjects( &objects );
+    PaymentVirtualClockRun( 120, tick, NULL );
+
+    BYTE transactionID[LEN_ACTIVE_TRANSACTION_ID] = { 1, 2, 3, 4 };
+    check( PaymentHostEnterToken( &objects, (u8)inTokenSubtype::startPaidToken, 1, transactionID, 10000 ) == executionOK, "startPaid token is executed" );
+    PaymentHostSetRegisterValue( &RegisterAsumLN, 1000 );
+    PaymentVirtualClockRun( 3 * PAYMENT_FLUSH_PERIOD_SEC + 120, tick, NULL );
+}
+
+/* The consumption of 1 kWh more is collected, its counters are flushed by one record of the journal */
+static void consume( u64 value )
+{
+    PaymentHostSetRegisterValue( &RegisterAsumLN, value );
+    PaymentVirtualClockRun( 3 * PAYMENT_FLUSH_PERIOD_SEC + 120, tick, NULL );
+}
+
+#ifdef PAYMENT_JOURNAL
+/* The power is cut while the newest record of the journal is appended: the counters of the older records are restored */
+static void tornJournalRecord()
+{
+    startMeter();
+    RestartState before;
+    getState( &before );
+    u32 liveRecords = PaymentJournalGetLiveRecords();
+
+    consume( 2000 );
+    RestartState after;
+    getState( &after );
+    check( after.creditAmount < before.creditAmount, "torn journal: consumption is collected" );
+    check( PaymentJournalGetLiveRecords() == liveRecords + 1, "torn journal: the counters are flushed by one record" );
+
+    BYTE record[PAYMENT_JOURNAL_RECORD_LEN];
+    PaymentJournalHeader header;
+    u32 headSeq = 0;
+    u16 headSlot = 0;
+    for( u16 slot = 0; slot < PAYMENT_JOURNAL_RECORDS; ++slot )
+    {
+        if( PaymentPortFileIndexRead( ftPaymentJournal_Record, slot, record, sizeof( record ) ) < sizeof( header ) )
+            continue;
+        memcpy( &header, record, sizeof( header ) );
+        if( header.seq != 0xFFFFFFFF && header.seq > headSeq )
+        {
+            headSeq = header.seq;
+            headSlot = slot;
+        }
+    }
+
+    u16 len = PaymentPortFileIndexRead( ftPaymentJournal_Record, headSlot, record, sizeof( record ) );
+    memcpy( &header, record, sizeof( header ) );
+    check( len >= header.len && header.len > sizeof( header ), "torn journal: the newest record is read" );
+    memset( &record[header.len / 2], 0xFF, header.len - header.len / 2 );     // the second half is not programmed
+    PaymentPortFileIndexWrite( ftPaymentJournal_Record, headSlot, record, len );
+
+    restart();
+    checkState( &before, "torn journal record" );
+    PaymentVirtualClockRun( 3 * PAYMENT_FLUSH_PERIOD_SEC + 120, tick, NULL );
+    checkState( &after, "torn journal record, consumption is collected again" );
+}
+#endif // PAYMENT_JOURNAL
+
+/* The consumption is collected and its counters are dirty in RAM: the power is cut before the next flush */
+static void consumeNotFlushed( u64 value )
+{
+    s32 creditAmount = objects.account->GetSumOfAllCurrentCreditAmount();
+    PaymentHostSetRegisterValue( &RegisterAsumLN, value );
+    for( u16 i = 0; i < 120 && objects.account->GetSumOfAllCurrentCreditAmount() == creditAmount; ++i )
+        PaymentVirtualClockRun( 1, tick, NULL );
+}
+
+#ifdef PAYMENT_BOOT_SNAPSHOT
+/* The power fail handler saves the boot snapshot: the objects are restored from it with fewer reads than from the files */
+static void bootSnapshot()
+{
+    startMeter();
+    consumeNotFlushed( 2000 );
+    RestartState before;
+    getState( &before );
+
+    check( objects.account->EmergencyFlush(), "boot snapshot: all dirty counters are saved at the power fail" );
+    check( PaymentSnapshotIsValid(), "boot snapshot: snapshot is saved at the power fail" );
+
+    restart();
+    checkState( &before, "boot snapshot" );
+    check( !PaymentSnapshotIsValid(), "boot snapshot: snapshot is cleared at the start" );
+#ifdef PAYMENT_RECORD_CRC
+    u32 snapshotReads = PaymentRecordGetStats()->reads;
+#endif // PAYMENT_RECORD_CRC
+
+    restart();
+    checkState( &before, "boot snapshot, restart from the files" );
+#ifdef PAYMENT_RECORD_CRC
+    check( snapshotReads < PaymentRecordGetStats()->reads, "boot snapshot: counters are not read from the files" );
+#endif // PAYMENT_RECORD_CRC
+}
+#endif // PAYMENT_BOOT_SNAPSHOT
+
+#ifdef PAYMENT_EMERGENCY_FLUSH
+/* The counters of the emergency record are applied over the journal at the start, once */
+static void emergencyRecord()
+{
+    startMeter();
+    consumeNotFlushed( 2000 );
+    RestartState before;
+    getState( &before );
+
+    check( objects.account->EmergencyFlush(), "emergency record: all dirty counters are saved at the power fail" );
+#ifdef PAYMENT_BOOT_SNAPSHOT
+    u32 invalidSeq = 0;
+    PaymentPortFileWrite( ftPaymentSnapshot_Valid, &invalidSeq, sizeof( invalidSeq ) );      // the objects are read from the files
+#endif // PAYMENT_BOOT_SNAPSHOT
+    BYTE area[PAYMENT_EMERGENCY_MAX_LEN];
+    PaymentEmergencyHeader header;
+    check( PaymentPortFileRead( ftPaymentEmergency_Area, area, sizeof( area ) ) >= sizeof( header ), "emergency record: the record is written" );
+    memcpy( &header, area, sizeof( header ) );
+
+    restart();
+    checkState( &before, "emergency record" );
+    u32 appliedSeq = 0;
+    PaymentPortFileRead( ftPaymentEmergency_Applied, &appliedSeq, sizeof( appliedSeq ) );
+    check( header.counters > 0 && header.seq == appliedSeq, "emergency record: the record is marked as applied" );
+
+    consume( 3000 );
+    RestartState after;
+    getState( &after );
+    restart();
+    checkState( &after, "emergency record, the applied record is not applied again" );
+}
+#endif // PAYMENT_EMERGENCY_FLUSH
+
+#ifdef PAYMENT_TRANSACTION
+/* The power is cut while the files of the token are written: the log is applied again at the start */
+static void interruptedTransaction()
+{
+    startMeter();
+    BYTE transactionID[LEN_ACTIVE_TRANSACTION_ID] = { 1, 2, 3, 4 };
+    PaymentTransactionCutNext( 1 );
+    check( PaymentHostEnterToken( &objects, (u8)inTokenSubtype::topUpToken, 2, transactionID, 700 ) == executionOK, "interrupted transaction: topUp token is executed" );
+    RestartState after;
+    getState( &after );
+
+    BYTE log[PAYMENT_TRANSACTION_MAX_LEN];
+    PaymentTransactionHeader header;
+    u32 appliedSeq = 0;
+    PaymentPortFileRead( ftPaymentTransaction_Log, log, sizeof( log ) );
+    memcpy( &header, log, sizeof( header ) );
+    PaymentPortFileRead( ftPaymentTransaction_Applied, &appliedSeq, sizeof( appliedSeq ) );
+    check( header.records > 1 && header.seq != appliedSeq, "interrupted transaction: the log is not applied completely" );
+
+    restart();
+    checkState( &after, "interrupted transaction" );
+    PaymentPortFileRead( ftPaymentTransaction_Applied, &appliedSeq, sizeof( appliedSeq ) );
+    check( header.seq == appliedSeq, "interrupted transaction: the log is applied at the start" );
+    check( PaymentHostEnterToken( &objects, (u8)inTokenSubtype::topUpToken, 2, transactionID, 700 ) == validationFAIL, "interrupted transaction: token ID is kept" );
+}
+#endif // PAYMENT_TRANSACTION
+
+#ifdef PAYMENT_HOST_FS
+/* The files of the import objects and of the modules, the length of the record is the longest write */
+static const PaymentHostFsFile hostFsFiles[] = {
+    { ftImportAccount_AccountStatus,                    16,                                             1 },
+    { ftImportAccount_AccountActivationTime,            sizeof( u32 ),                                  1 },
+    { ftImportAccount_AccountClosureTime,               sizeof( u32 ),                                  1 },
+    { ftImportAccount_MaxProvision,                     16,                                             1 },
+    { ftImportAccount_MaxProvisionPeriod,               16,                                             1 },
+    { ftImportAccount_Currency,                         16,                                             1 },
+    { ftImportAccount_TimeFormat,                       16,                                             1 },
+    { ftImportCredit_CurrentCreditAmountQ,              sizeof( PaymentRecord ),                        2 },
+    { ftImportCredit_WarningThreshold,                  16,                                             1 },
+    { ftImportCredit_Limit,                             16,                                             1 },
+    { ftImportCredit_CreditStatus,                      16,                                             1 },
+    { ftActiveImportCharge_TotalAmountPaidQ,            sizeof( PaymentRecord ),                        2 },
+    { ftActiveImportCharge_UnitChargeActive,            sizeof( PaymentChargeUnitChargeRecord ),        1 },
+    { ftActiveImportCharge_UnitChargePassive,           sizeof( PaymentChargeUnitChargeRecord ),        1 },
+    { ftActiveImportCharge_UnitChargeActiveElement,     LEN_STORED_CHARGE_TABLE_ELEMENT,                MAX_TARIFFS },
+    { ftActiveImportCharge_UnitChargePassiveElement,    LEN_STORED_CHARGE_TABLE_ELEMENT,                MAX_TARIFFS },
+    { ftActiveImportCharge_UnitChargeActivationTime,    sizeof( u32 ),                                  1 },
+    { ftActiveImportCharge_Period,                      16,                                             1 },
+    { ftActiveImportCharge_LastCollectionTimeQ,         sizeof( u32 ),                                  1 },
+    { ftActiveImportCharge_LastCollectionAmountQ,       16,                                             1 },
+    { ftActiveImportCharge_TotalAmountRemainingQ,       sizeof( PaymentRecord ),                        2 },
+    { ftActiveImportCharge_LastMeasurementValueQ,       sizeof( PaymentRecord ),                        2 * MAX_TARIFFS },
+    { ftActiveImportCharge_SumToCollectQ,               sizeof( PaymentRecord ),                        2 },
+    { ftActiveImportCharge_TimeFormat,                  16,                                             1 },
+    { ftImportTokenGateway_Token,                       MAX_LEN_RECEIVED_TOKEN,                         1 },
+    { ftImportTokenGateway_TokenTime,                   sizeof( u32 ),                                  1 },
+    { ftImportTokenGateway_TokenDeliveryMethod,         16,                                             1 },
+    { ftImportTokenGateway_TokenStatusCode,             16,                                             1 },
+    { ftImportTokenGateway_TokenID,                     sizeof( u32 ),                                  NUM_OF_STORED_TOKENS_ID },
+    { ftImportTokenGateway_NextReceivedTokenIndex,      16,                                             1 },
+    { ftImportTokenGateway_ActiveTransactionID,         LEN_ACTIVE_TRANSACTION_ID,                      1 },
+    { ftImportTokenGateway_LastTokenSubtype,            16,                                             1 },
+    { ftImportTokenGateway_ExpiresTime,                 sizeof( u32 ),                                  1 },
+    { ftImportTokenGateway_ExpiresTimeStatus,           16,                                             1 },
+    { ftImportTokenGateway_TimeOfStart,                 sizeof( u32 ),                                  1 },
+    { ftImportTokenGateway_TimeOfStartStatus,           16,                                             1 },
+    { ftImportTokenGateway_TokenIDHistory,              sizeof( PaymentTokenIDRecord ),                 NUM_OF_STORED_TOKENS_ID },
+    { ftOutToken_Token,                                 (u16)OutTokenClass::outTokenLen::max,       1 },
+    { ftConsumedKWhFromStart_KWhWhenStart,              sizeof( u64 ),                                  1 },
+    { ftPaymentJournal_Record,                          PAYMENT_JOURNAL_RECORD_LEN,                     PAYMENT_JOURNAL_RECORDS },
+    { ftPaymentJournal_CheckpointSeq,                   sizeof( u32 ),                                  1 },
+    { ftPaymentSnapshot_Blob,                           PAYMENT_SNAPSHOT_MAX_LEN,                       1 },
+    { ftPaymentSnapshot_Valid,                          sizeof( u32 ),                                  1 },
+    { ftPaymentTransaction_Log,                         PAYMENT_TRANSACTION_MAX_LEN,                    1 },
+    { ftPaymentTransaction_Applied,                     sizeof( u32 ),                                  1 },
+    { ftPaymentEmergency_Area,                          PAYMENT_EMERGENCY_MAX_LEN,                      1 },
+    { ftPaymentEmergency_Applied,                       sizeof( u32 ),                                  1 },
+};
+
+/*
+The power is cut at every byte written by the topUp token: after the restart the token is executed fully
+or not at all, the token ID is kept only with the executed token.
+*/
+static void powerCutToken()
+{
+    BYTE transactionID[LEN_ACTIVE_TRANSACTION_ID] = { 1, 2, 3, 4 };
+    u32 cuts = 0;
+    for( u64 cut = 0; ; ++cut )
+    {
+        startMeter();
+        RestartState before;
+        getState( &before );
+
+        PaymentHostFsSetPowerCut( cut );
+        PaymentHostEnterToken( &objects, (u8)inTokenSubtype::topUpToken, 2, transactionID, 700 );
+        if( !PaymentHostFsIsPowerLost() )
+            break;
+        ++cuts;
+
+        PaymentHostFsPowerOn();
+        restart();
+        RestartState state;
+        getState( &state );
+        bool executed = ( state.creditAmount == before.creditAmount + 700 );
+        u8 status = PaymentHostEnterToken( &objects, (u8)inTokenSubtype::topUpToken, 2, transactionID, 700 );
+        if( ( !executed && state.creditAmount != before.creditAmount ) || state.totalAmountPaid != before.totalAmountPaid ||
+            state.active != before.active || status != ( executed ? validationFAIL : executionOK ) )
+        {
+            printf( "FAIL: power cut at byte %llu: credit %d, expected %d or %d, token status %u\n", (unsigned long long)cut,
+                    state.creditAmount, before.creditAmount, before.creditAmount + 700, status );
+            ++failures;
+        }
+    }
+    check( cuts > 0, "power cut: the writes of the token are cut" );
+    check( PaymentHostFsGetStats()->unknownFiles == 0, "power cut: all files are in the table of the image" );
+}
+#endif // PAYMENT_HOST_FS
+
+int main( int argc, char* argv[] )
+{
+    if( !PaymentHostGetImportObjects( &objects ) )
+    {
+        printf( "FAIL: objects are not registered in the maps\n" );
+        return 1;
+    }
+
+    PaymentHostMeterSelect( PaymentHostMeterCreate() );         // PaymentHostRestart() needs the selected meter
+#ifdef PAYMENT_HOST_FS
+    PaymentHostFsConfig config = { 4096, 0, 0, 0 };
+    if( !PaymentHostFsOpen( ( argc > 1 ) ? argv[1] : "payment_host_restart.img", hostFsFiles, sizeof( hostFsFiles ) / sizeof( hostFsFiles[0] ), &config ) )
+    {
+        printf( "FAIL: image is not opened\n" );
+        return 1;
+    }
+#endif // PAYMENT_HOST_FS
+
+    TDateTime start = {};
+    start.date.year_hi = 2021 >> 8;
+    start.date.year_low = 2021 & 0xff;
+    start.date.month = 3;
+    start.date.day = 1;
+    PaymentVirtualClockSet( &start );
+
+#ifdef PAYMENT_JOURNAL
+    tornJournalRecord();
+#endif // PAYMENT_JOURNAL
+#ifdef PAYMENT_BOOT_SNAPSHOT
+    bootSnapshot();
+#endif // PAYMENT_BOOT_SNAPSHOT
+#ifdef PAYMENT_EMERGENCY_FLUSH
+    emergencyRecord();
+#endif // PAYMENT_EMERGENCY_FLUSH
+#ifdef PAYMENT_TRANSACTION
+    interruptedTransaction();
+#endif // PAYMENT_TRANSACTION
+#ifdef PAYMENT_HOST_FS
+    powerCutToken();
+    PaymentHostFsClose();
+#endif // PAYMENT_HOST_FS
+
+    printf( "%s: %u failures\n", failures == 0 ? "PASS" : "FAIL", failures );
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,262 @@
+/*
+    \file PaymentHostSmoke.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+/*
+Smoke test of the host build: the Payment objects of cicPayment.cpp are initialized on the formatted
+meter, ticked by the simulation clock and the tokens are entered through Action( PaymentTokenGatewayEnter ).
+The program returns 0 if all checks pass.
+*/
+
+#include "cicPaymentHost.h"
+#include "cicPaymentPort.h"
+#include "cicPaymentGolden.h"
+#include "cicPaymentRecord.h"
+#include "cicPaymentJournal.h"
+#include "_objectMaps.h"
+#include <stdio.h>
+
+static const PaymentTime START_UTC = 1614556800;             // 2021-03-01 00:00:00
+
+static PaymentHostObjects objects;
+static u32 failures = 0;
+
+static void check( bool condition, const char* what )
+{
+    if( !condition )
+    {
+        printf( "FAIL: %s\n", what );
+        ++failures;
+    }
+}
+
+static void tick( bool newMinute, void* arg )
+{
+    PaymentHostTickObjects( &objects, newMinute );
+}
+
+static s32 availableCredit()
+{
+    return PaymentGetDoubleLongAttr( objects.account, PaymentAccountAvailableCreditAttr );
+}
+
+/* charge_per_unit of the first element of unit_charge_active, the last long of the encoded attribute */
+static s16 unitChargeActivePrice()
+{
+    BYTE bufResponse[128] = {};
+    uint16_t lenResponse = 0;
+    if( !objects.chargeList[0]->Get( PaymentChargeUnitChargeActiveAttr, NULL, bufResponse, lenResponse ) )
+        return 0;
+
+    for( uint16_t pos = lenResponse; pos >= 3; --pos )
+    {
+        if( bufResponse[pos - 3] == Long )
+        {
+            s16 price = 0;
+            AXDRDecodeShort( &bufResponse[pos - 2], &price );
+            return price;
+        }
+    }
+    return 0;
+}
+
+int main()
+{
+    if( !PaymentHostGetImportObjects( &objects ) )
+    {
+        printf( "FAIL: objects are not registered in the maps\n" );
+        return 1;
+    }
+
+    PaymentHostFormat();
+    PaymentHostSetRegister( &RegisterAsumLN, 0, 0, UnitWh );
+
+    TDateTime start = {};
+    start.date.year_hi = 2021 >> 8;
+    start.date.year_low = 2021 & 0xff;
+    start.date.month = 3;
+    start.date.day = 1;
+    PaymentVirtualClockSet( &start );
+
+    PaymentHostInitObjects( &objects );
+    PaymentVirtualClockRun( 120, tick, NULL );
+    check( !objects.account->IsAccountActive(), "new account is not active" );
+
+    BYTE transactionID[LEN_ACTIVE_TRANSACTION_ID] = { 1, 2, 3, 4 };
+    check( PaymentHostEnterToken( &objects, (u8)inTokenSubtype::startPaidToken, 1, transactionID, 10000 ) == executionOK, "startPaid token is executed" );
+    PaymentVirtualClockRun( 60, tick, NULL );
+    check( objects.account->IsAccountActive(), "account is active after startPaid" );
+    check( availableCredit() == 10000, "available credit after startPaid" );
+    check( objects.account->GetAccountActivationTime() >= START_UTC && objects.account->GetAccountActivationTime() < START_UTC + 300, "activation time is the seconds from 1970" );
+
+    /* the start token without the expires time: all fields of the date-time are not specified */
+    ExpiresTimeClass* expiresTime = (ExpiresTimeClass*)DataObjectsMap[(LOGICAL_NAME*)&ExpiresTimeLn];
+    BYTE bufExpiresTime[32] = {};
+    uint16_t lenExpiresTime = 0;
+    check( expiresTime != NULL && expiresTime->Get( ExpiresTimeClass::ValueAttr, NULL, bufExpiresTime, lenExpiresTime ), "expires time is read" );
+    check( lenExpiresTime == 2 + eDTL_DateTime && bufExpiresTime[2] == 0xff && bufExpiresTime[3] == 0xff && bufExpiresTime[4] == 0xff, "expires time not specified is not a date" );
+
+    check( PaymentHostEnterToken( &objects, (u8)inTokenSubtype::topUpToken, 2, transactionID, 500 ) == executionOK, "topUp token is executed" );
+    check( PaymentHostEnterToken( &objects, (u8)inTokenSubtype::topUpToken, 2, transactionID, 500 ) == validationFAIL, "duplicate token ID is refused" );
+    objects.tokenGateway->Init();                               // the record of the TID may be still in the write queue
+    check( PaymentHostEnterToken( &objects, (u8)inTokenSubtype::topUpToken, 2, transactionID, 500 ) == validationFAIL, "token ID history is read with the newest record" );
+    PaymentVirtualClockRun( 60, tick, NULL );
+    check( availableCredit() == 10500, "available credit after topUp" );
+#ifdef PAYMENT_TRANSACTION
+    BYTE transactionLog[PAYMENT_TRANSACTION_MAX_LEN];
+    PaymentTransactionHeader transactionHeader;
+    u16 transactionLen = PaymentPortFileRead( ftPaymentTransaction_Log, transactionLog, sizeof( transactionLog ) );
+    memcpy( &transactionHeader, transactionLog, sizeof( transactionHeader ) );
+    check( transactionLen == transactionHeader.len && transactionLen < PAYMENT_TRANSACTION_MAX_LEN, "only the used part of the log is written" );
+    check( PaymentTransactionGetRefused() == 0, "files of the tokens have place in the log" );
+#endif // PAYMENT_TRANSACTION
+    check( PaymentPortGetRelayState(), "relay is connected" );
+
+    /* 1 kWh at 1.84 per kWh is collected from the credit */
+    PaymentHostSetRegisterValue( &RegisterAsumLN, 1000 );
+    PaymentVirtualClockRun( 180, tick, NULL );
+    check( availableCredit() == 10500 - 184, "consumption is collected" );
+
+#ifdef PAYMENT_TRANSACTION
+    /* the token refused at the commit changes neither the files nor RAM */
+    s32 creditBeforeRefused = availableCredit();
+    PaymentTransactionRefuseNext();
+    check( PaymentHostEnterToken( &objects, (u8)inTokenSubtype::topUpToken, 4, transactionID, 700 ) == executionFAIL, "token is refused when the commit fails" );
+    check( objects.account->GetSumOfAllCurrentCreditAmount() == creditBeforeRefused, "credit is rolled back when the commit fails" );
+    PaymentVirtualClockRun( 60, tick, NULL );
+    check( availableCredit() == creditBeforeRefused, "available credit is not changed by the refused token" );
+    check( PaymentHostEnterToken( &objects, (u8)inTokenSubtype::topUpToken, 4, transactionID, 700 ) == executionOK, "TID of the refused token is not kept" );
+    PaymentVirtualClockRun( 60, tick, NULL );
+    check( availableCredit() == creditBeforeRefused + 700, "token is executed after the refused commit" );
+#endif // PAYMENT_TRANSACTION
+
+#ifdef PAYMENT_JOURNAL
+    /* the ring of the journal is wrapped: the oldest records are retired to the fixed files one by one */
+    for( u16 i = 1; i <= PAYMENT_JOURNAL_RECORDS + 8; ++i )
+    {
+        PaymentHostSetRegisterValue( &RegisterAsumLN, 1000 + i * 1000 );
+        PaymentVirtualClockRun( 120, tick, NULL );
+    }
+    check( availableCredit() < 10500 - 184, "consumption is collected while the journal wraps" );
+    check( PaymentJournalGetLiveRecords() <= PAYMENT_JOURNAL_RECORDS, "journal records are retired before they are overwritten" );
+    PaymentJournalCompact();
+    s32 fileAmount = 0;
+    PaymentCounterRead( ftImportCredit_CurrentCreditAmountQ, &fileAmount );
+    check( fileAmount == objects.creditList[0]->GetCurrentCreditAmount(), "journal is compacted to the fixed files" );
+#endif // PAYMENT_JOURNAL
+    s32 creditBeforeRestart = availableCredit();
+
+    /* restart: the values are restored from the files */
+    PaymentHostInitObjects( &objects );
+    PaymentVirtualClockRun( 60, tick, NULL );
+    check( objects.account->IsAccountActive(), "account is active after restart" );
+    check( availableCredit() == creditBeforeRestart, "available credit after restart" );
+    check( PaymentHostEnterToken( &objects, (u8)inTokenSubtype::topUpToken, 2, transactionID, 500 ) == validationFAIL, "token ID history survives restart" );
+
+    check( PaymentHostEnterToken( &objects, (u8)inTokenSubtype::stopPaidToken, 3, transactionID, 0 ) == executionOK, "stopPaid token is executed" );
+    PaymentVirtualClockRun( 60, tick, NULL );
+    check( !objects.account->IsAccountActive(), "account is closed after stopPaid" );
+
+    /* the next order is started in the second of the closure: the closure time is kept and does not close it */
+    check( PaymentHostEnterToken( &objects, (u8)inTokenSubtype::startPaidToken, 5, transactionID, 1000 ) == executionOK, "startPaid token of the next order is executed" );
+    PaymentVirtualClockRun( 60, tick, NULL );
+    check( PaymentHostEnterToken( &objects, (u8)inTokenSubtype::stopPaidToken, 6, transactionID, 0 ) == executionOK, "stopPaid token of the order is executed" );
+    PaymentTime closure = objects.account->GetAccountClosureTime();
+    check( PaymentHostEnterToken( &objects, (u8)inTokenSubtype::startPaidToken, 7, transactionID, 1000 ) == executionOK, "startPaid token in the second of stopPaid is executed" );
+    PaymentVirtualClockRun( 120, tick, NULL );
+    check( objects.account->IsAccountActive(), "account started in the second of the closure stays active" );
+    check( closure != PAYMENT_TIME_NOT_SPECIFIED && objects.account->GetAccountClosureTime() == closure, "closure time is kept by the activation" );
+
+    /* the time files written by the firmware before the seconds are in the PackTdateTime format */
+    PaymentHostFormat();
+    TDateTime legacy = start;
+    legacy.time.hour = 10;
+    u32 packed = PackTdateTime( &legacy );
+    PaymentPortFileWrite( ftImportAccount_AccountActivationTime, &packed, sizeof( packed ) );
+    packed = 0xDEADBEEF;                                        // month 10, day 22, hour 27
+    PaymentPortFileWrite( ftImportAccount_AccountClosureTime, &packed, sizeof( packed ) );
+    PaymentHostInitObjects( &objects );
+    check( objects.account->GetAccountActivationTime() == START_UTC + 10 * 3600, "legacy activation time is converted" );
+    check( objects.account->GetAccountClosureTime() == PAYMENT_TIME_NOT_SPECIFIED, "legacy time out of the range is not specified" );
+    PaymentHostInitObjects( &objects );
+    check( objects.account->GetAccountActivationTime() == START_UTC + 10 * 3600, "converted activation time is not converted again" );
+
+    /* the money counters written by the firmware before the CRC records are the plain values */
+    PaymentHostFormat();
+    s32 plainAmount = 7000;
+    PaymentPortFileWrite( ftImportCredit_CurrentCreditAmountQ, &plainAmount, sizeof( plainAmount ) );
+    PaymentHostInitObjects( &objects );
+    check( objects.creditList[0]->GetCurrentCreditAmount() == 7000, "plain credit amount is read" );
+    PaymentHostInitObjects( &objects );
+    check( objects.creditList[0]->GetCurrentCreditAmount() == 7000, "plain credit amount is kept after restart" );
+#ifdef PAYMENT_RECORD_CRC
+    check( PaymentRecordGetStats()->converted == 1, "plain credit amount is rewritten as the record once" );
+#endif // PAYMENT_RECORD_CRC
+
+    /* unit_charge_active of the firmware before the records is the whole structure in one buffer, the price is 250 */
+    PaymentHostFormat();
+    BYTE legacyUnitCharge[2 + 2 + 6 + 1 + MAX_TARIFFS * ( MAX_INDEX_LEN + 2 )] = { (BYTE)-3, (BYTE)-2, 0, Register };
+    memcpy( &legacyUnitCharge[4], &RegisterAsumLN, 6 );
+    legacyUnitCharge[10] = 2;
+    legacyUnitCharge[11 + MAX_INDEX_LEN + 1] = 250;
+    PaymentPortFileWrite( ftActiveImportCharge_UnitChargeActive, legacyUnitCharge, sizeof( legacyUnitCharge ) );
+    PaymentHostInitObjects( &objects );
+    check( unitChargeActivePrice() == 250, "legacy unit_charge_active is decoded" );
+#ifdef PAYMENT_WRITE_QUEUE
+    PaymentWriteQueueDrain();                                   // the file is read below without the queue
+#endif // PAYMENT_WRITE_QUEUE
+    check( PaymentPortFileRead( ftActiveImportCharge_UnitChargeActive, legacyUnitCharge, sizeof( legacyUnitCharge ) ) == sizeof( PaymentChargeUnitChargeRecord ),
+           "legacy unit_charge_active is written as the record" );
+    PaymentHostInitObjects( &objects );
+    check( unitChargeActivePrice() == 250, "unit_charge_active is read from the record" );
+
+    /* account_activation_time is fired by the deadline queue once per pass */
+    PaymentHostFormat();
+    PaymentHostInitObjects( &objects );
+    TDateTime activation;
+    PaymentTimeToDateTime( PaymentTimeNow() + 300, &activation );
+    BYTE bufRequest[2 + eDTL_DateTime] = { OctetString, eDTL_DateTime };
+    memcpy( &bufRequest[2], &activation, eDTL_DateTime );
+    check( objects.account->Set( PaymentAccountAccountActivationTimeAttr, bufRequest ) == eDAR_Success, "account_activation_time is set" );
+    PaymentVirtualClockRun( 240, tick, NULL );
+    check( !objects.account->IsAccountActive(), "account is not active before account_activation_time" );
+    PaymentVirtualClockRun( 120, tick, NULL );
+    check( objects.account->IsAccountActive(), "account is activated at account_activation_time" );
+
+#ifdef PAYMENT_BOOT_SNAPSHOT
+    /* the boot snapshot is saved by the power fail handler and cleared when the power comes back */
+    check( objects.account->EmergencyFlush(), "all dirty counters are saved at the power fail" );
+    check( PaymentSnapshotIsValid(), "boot snapshot is saved at the power fail" );
+    BYTE blob[PAYMENT_SNAPSHOT_MAX_LEN];
+    PaymentSnapshotHeader blobHeader;
+    u16 blobLen = PaymentPortFileRead( ftPaymentSnapshot_Blob, blob, sizeof( blob ) );
+    memcpy( &blobHeader, blob, sizeof( blobHeader ) );
+    check( blobLen == blobHeader.len && blobLen < PAYMENT_SNAPSHOT_MAX_LEN, "only the used part of the snapshot is written" );
+    BYTE maxProvision[1 + eDTL_LongUnsigned] = { LongUnsigned, 0x01, 0x00 };
+    check( objects.account->Set( PaymentAccountMaxProvisionAttr, maxProvision ) == eDAR_Success, "max_provision is set after the power comes back" );
+    check( !PaymentSnapshotIsValid(), "boot snapshot is cleared by the first write after the power comes back" );
+#endif // PAYMENT_BOOT_SNAPSHOT
+
+#ifdef PAYMENT_WRITE_QUEUE
+    /* the indexed file read as one block gets its records which are still in the write queue */
+    PaymentHostFormat();
+    u32 queuedRecord = 0x11223344;
+    PaymentFileIndexWrite( ftImportTokenGateway_TokenIDHistory, 2, &queuedRecord );
+    u32 queuedBlock[4] = {};
+    check( PaymentFileRead( ftImportTokenGateway_TokenIDHistory, &queuedBlock ) == sizeof( queuedBlock ), "queued indexed file is read as the block" );
+    check( queuedBlock[2] == queuedRecord && queuedBlock[0] == 0xFFFFFFFF, "queued record is put over the block" );
+    PaymentWriteQueueDrain();
+    queuedRecord = 0x55667788;
+    PaymentFileIndexWrite( ftImportTokenGateway_TokenIDHistory, 2, &queuedRecord );
+    PaymentFileRead( ftImportTokenGateway_TokenIDHistory, &queuedBlock );
+    check( queuedBlock[2] == queuedRecord, "queued record is newer than the written one" );
+#endif // PAYMENT_WRITE_QUEUE
+
+    printf( "%s: %u failures, %llu file writes\n", failures == 0 ? "PASS" : "FAIL", failures, (unsigned long long)PaymentHostGetStats()->fileWrites );
+    return failures == 0 ? 0 : 1;
+}
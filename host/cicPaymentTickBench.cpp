@@ -0,0 +1,131 @@
+/*
+    \file PaymentTickBench.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+/*
+Benchmark of the tick path (PAYMENT_PROFILING).
+The import meter goes through all scenarios of the profile: steady state without consumption,
+consumption with the pending collections, low credit below the warning threshold and exhausted credit.
+The stages are measured by the probes in the Payment objects, the table gives ns/tick, instructions/tick
+and the worst call of every stage in every scenario. The same probes use the DWT counter on the meter.
+Usage: payment_tick_bench [hours of every phase]
+*/
+
+#include "cicPaymentHost.h"
+#include "cicPaymentPort.h"
+#include "cicPaymentGolden.h"
+#include "_objectMaps.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static PaymentHostObjects objects;
+static u64 consumedWh = 0;
+static u32 whPerSecond = 0;
+
+static const char* const stageNames[PaymentProfileStagesNum] = {
+    "account IdleSecond", "invoke credit", "execute collection", "update values", "manage statuses",
+    "relay control", "credit IdleSecond", "charge IdleSecond", "register read", "token enter",
+    "top up credits", "out token update", "emergency flush", "record write", "record read"
+};
+
+static const char* const scenarioNames[PaymentProfileScenariosNum] = {
+    "steady", "low credit", "exhausted", "collection"
+};
+
+static void tick( bool newMinute, void* arg )
+{
+    if( whPerSecond != 0 )
+    {
+        consumedWh += whPerSecond;
+        PaymentHostSetRegisterValue( &RegisterAsumLN, consumedWh );
+    }
+
+    PaymentHostTickObjects( &objects, newMinute );
+}
+
+static void setWarningThreshold( s32 threshold )
+{
+    BYTE bufRequest[5];
+    bufRequest[0] = DoubleLong;
+    AXDREncodeDoubleLong( &bufRequest[1], threshold );
+    objects.creditList[0]->Set( PaymentCreditWarningThresholdAttr, bufRequest );
+}
+
+static void printStats()
+{
+    printf( "%-12s %-20s %10s %10s %12s %10s\n", "scenario", "stage", "calls", "ns/tick", "instr/tick", "worst ns" );
+    for( u8 scenario = 0; scenario < PaymentProfileScenariosNum; ++scenario )
+    {
+        for( u8 stage = 0; stage < PaymentProfileStagesNum; ++stage )
+        {
+            const PaymentProfileStats* stats = PaymentProfileGetStats( (PaymentProfileScenario)scenario, (PaymentProfileStage)stage );
+            if( stats->calls == 0 )
+                continue;
+
+            printf( "%-12s %-20s %10u %10u %12u %10llu\n", scenarioNames[scenario], stageNames[stage], stats->calls,
+                    PaymentProfileGetNsPerCall( (PaymentProfileScenario)scenario, (PaymentProfileStage)stage ),
+                    PaymentProfileGetInstructionsPerCall( (PaymentProfileScenario)scenario, (PaymentProfileStage)stage ),
+                    (unsigned long long)stats->maxCycles * 1000000000ULL / PAYMENT_CPU_FREQ_HZ );
+        }
+    }
+}
+
+int main( int argc, char** argv )
+{
+    u32 phaseSeconds = 3600 * ( ( argc > 1 ) ? atoi( argv[1] ) : 1 );
+
+    if( !PaymentHostGetImportObjects( &objects ) )
+    {
+        printf( "objects are not registered in the maps\n" );
+        return 1;
+    }
+
+    PaymentHostFormat();
+    PaymentHostSetRegister( &RegisterAsumLN, 0, 0, UnitWh );
+
+    TDateTime start = {};
+    start.date.year_hi = 2021 >> 8;
+    start.date.year_low = 2021 & 0xff;
+    start.date.month = 3;
+    start.date.day = 1;
+    PaymentVirtualClockSet( &start );
+
+    PaymentHostInitObjects( &objects );
+    setWarningThreshold( 5000 );
+
+    BYTE transactionID[LEN_ACTIVE_TRANSACTION_ID] = { 1 };
+    if( PaymentHostEnterToken( &objects, (u8)inTokenSubtype::startPaidToken, 1, transactionID, 20000 ) != executionOK )
+    {
+        printf( "startPaid token is refused\n" );
+        return 1;
+    }
+
+    PaymentVirtualClockRun( 60, tick, NULL );           // the first tick computes all values
+    PaymentProfileReset();
+
+    /* steady state, then the consumption drains the credit to low and to exhausted */
+    PaymentVirtualClockRun( phaseSeconds, tick, NULL );
+    whPerSecond = 3;
+    PaymentVirtualClockRun( phaseSeconds * 12, tick, NULL );
+    whPerSecond = 0;
+    PaymentVirtualClockRun( phaseSeconds, tick, NULL );
+
+    printStats();
+    printf( "relay %s, available credit %d\n", PaymentPortGetRelayState() ? "connected" : "disconnected",
+            PaymentGetDoubleLongAttr( objects.account, PaymentAccountAvailableCreditAttr ) );
+
+    for( u8 scenario = 0; scenario < PaymentProfileScenariosNum; ++scenario )
+    {
+        if( PaymentProfileGetStats( (PaymentProfileScenario)scenario, PaymentProfileAccountIdleSecond )->calls == 0 )
+        {
+            printf( "scenario %s was not reached\n", scenarioNames[scenario] );
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,147 @@
+/*
+    \file PaymentTokenBench.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+
+/*
+Benchmark of the token path (PAYMENT_PROFILING): Action( PaymentTokenGatewayEnter ) with the checks of the token,
+the processing, the top-up of the credits and the event based collection.
+The tokens come from the generator of the vending mix (cicPaymentTokenMix) in bursts, the meter is ticked
+with the consumption for a minute between the bursts. The valid tokens must be accepted and the retries refused.
+The table gives p50/p99/p99.9 of the latency, tokens/sec of the CPU time and the writes to the files per token.
+Usage: payment_token_bench [tokens] [burst] [seed]
+*/
+
+#include "cicPaymentHost.h"
+#include "cicPaymentPort.h"
+#include "cicPaymentTokenMix.h"
+#include "_objectMaps.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static PaymentHostObjects objects;
+static u64 consumedWh = 0;
+
+static const char* const subtypeNames[] = {
+    "", "startPaid", "topUp", "stopPaid", "startNonPaid", "stopNonPaid"
+};
+
+typedef struct{
+    u32         accepted;
+    u32         refused;
+    u32         unexpected;
+} TokenCounters;
+
+static TokenCounters counters[(u8)inTokenSubtype::none];
+
+static void tick( bool newMinute, void* arg )
+{
+    consumedWh += 2;
+    PaymentHostSetRegisterValue( &RegisterAsumLN, consumedWh );
+    PaymentHostTickObjects( &objects, newMinute );
+}
+
+static u8 enter( const BYTE* bufRequest )
+{
+    BYTE bufResponse[16] = {};
+    uint16_t lenResponse = 0;
+
+    objects.tokenGateway->Action( PaymentTokenGatewayEnter, (BYTE*)bufRequest, bufResponse, lenResponse );
+    return ( lenResponse > 6 && bufResponse[5] == eDT_Enum ) ? bufResponse[6] : (u8)executionFAIL;
+}
+
+static void printStats()
+{
+    const PaymentProfileTokenStats* stats = PaymentProfileGetTokenStats();
+
+    printf( "%-14s %10s %10s %10s\n", "token", "accepted", "refused", "unexpected" );
+    for( u8 subtype = (u8)inTokenSubtype::startPaidToken; subtype < (u8)inTokenSubtype::none; ++subtype )
+        printf( "%-14s %10u %10u %10u\n", subtypeNames[subtype], counters[subtype].accepted, counters[subtype].refused, counters[subtype].unexpected );
+
+    printf( "tokens %u, p50 %u ns, p99 %u ns, p99.9 %u ns, %u tokens/s\n", stats->tokens,
+            PaymentProfileGetTokenLatencyNs( 500 ), PaymentProfileGetTokenLatencyNs( 990 ), PaymentProfileGetTokenLatencyNs( 999 ),
+            PaymentProfileGetTokensPerSecond() );
+    if( stats->tokens != 0 )
+        printf( "writes per token %llu.%02llu, max %u\n", (unsigned long long)( stats->sumWrites / stats->tokens ),
+                (unsigned long long)( stats->sumWrites * 100 / stats->tokens % 100 ), stats->maxWrites );
+
+    /* the top-up is in the scenario of the last tick */
+    u64 calls = 0;
+    u64 cycles = 0;
+    for( u8 scenario = 0; scenario < PaymentProfileScenariosNum; ++scenario )
+    {
+        calls += PaymentProfileGetStats( (PaymentProfileScenario)scenario, PaymentProfileTopUpCredits )->calls;
+        cycles += PaymentProfileGetStats( (PaymentProfileScenario)scenario, PaymentProfileTopUpCredits )->sumCycles;
+    }
+    if( calls != 0 )
+        printf( "top up credits %llu calls, %llu ns/call\n", (unsigned long long)calls,
+                (unsigned long long)( cycles * 1000000000ULL / PAYMENT_CPU_FREQ_HZ / calls ) );
+}
+
+int main( int argc, char** argv )
+{
+    u32 tokensNum = ( argc > 1 ) ? atoi( argv[1] ) : 10000;
+    u32 burst = ( argc > 2 ) ? atoi( argv[2] ) : 10;
+    u32 seed = ( argc > 3 ) ? atoi( argv[3] ) : 1;
+
+    if( burst == 0 )
+        burst = 1;
+    if( !PaymentHostGetImportObjects( &objects ) )
+    {
+        printf( "objects are not registered in the maps\n" );
+        return 1;
+    }
+
+    PaymentHostFormat();
+    PaymentHostSetRegister( &RegisterAsumLN, 0, 0, UnitWh );
+
+    TDateTime start = {};
+    start.date.year_hi = 2021 >> 8;
+    start.date.year_low = 2021 & 0xff;
+    start.date.month = 3;
+    start.date.day = 1;
+    PaymentVirtualClockSet( &start );
+
+    PaymentHostInitObjects( &objects );
+    PaymentVirtualClockRun( 60, tick, NULL );
+    PaymentProfileReset();
+
+    PaymentTokenMix mix;
+    PaymentTokenMixInit( &mix, &PAYMENT_TOKEN_MIX_CAMPAIGN, seed );
+
+    BYTE bufRequest[PAYMENT_HOST_TOKEN_BUF_LEN];
+    u32 unexpected = 0;
+    for( u32 i = 0; i < tokensNum; ++i )
+    {
+        PaymentTokenMixNext( &mix, bufRequest );
+        u8 status = enter( bufRequest );
+        PaymentTokenMixResult( &mix, status );
+
+        TokenCounters* counter = &counters[mix.subtype];
+        if( status == executionOK )
+            ++counter->accepted;
+        else
+            ++counter->refused;
+        if( ( status == executionOK ) == mix.invalid )
+        {
+            ++counter->unexpected;
+            ++unexpected;
+        }
+
+        if( ( i + 1 ) % burst == 0 )
+            PaymentVirtualClockRun( 60, tick, NULL );
+    }
+
+    printStats();
+    if( unexpected != 0 )
+    {
+        printf( "%u tokens are not handled as expected\n", unexpected );
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+/*
+    \file PaymentTokenMix.cpp
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+
+#include "cicPaymentTokenMix.h"
+#include "cicPaymentGolden.h"
+#include "cicPaymentTime.h"
+#include <string.h>
+
+/* The usual sums of the top-up, in the cents of the currency */
+static const s32 topUpAmounts[] = { 500, 1000, 2000, 5000, 10000, 20000 };
+
+static bool chance( PaymentTokenMix* mix, u16 permille )
+{
+    return ( PaymentGoldenRandom( &mix->random ) % 1000 ) < permille;
+}
+
+static s32 randomAmount( PaymentTokenMix* mix )
+{
+    return topUpAmounts[PaymentGoldenRandom( &mix->random ) % ( sizeof( topUpAmounts ) / sizeof( topUpAmounts[0] ) )];
+}
+
+static void newOrder( PaymentTokenMix* mix )
+{
+    ++mix->orderNum;
+    memset( mix->transactionID, 0, LEN_ACTIVE_TRANSACTION_ID );
+    AXDREncodeDword( &mix->transactionID[0], mix->orderNum );
+    AXDREncodeDword( &mix->transactionID[4], mix->random );
+}
+
+void PaymentTokenMixInit( PaymentTokenMix* mix, const PaymentTokenMixConfig* cfg, u32 seed )
+{
+    memset( mix, 0, sizeof( *mix ) );
+    mix->cfg = *cfg;
+    mix->random = ( seed != 0 ) ? seed : 1;
+    mix->nextTokenID = 1;
+    mix->order = (u8)inTokenSubtype::none;
+    mix->subtype = (u8)inTokenSubtype::none;
+}
+
+u16 PaymentTokenMixNext( PaymentTokenMix* mix, BYTE* buf )
+{
+    u32 tokenID = mix->nextTokenID;
+    u32 expiresTime = PAYMENT_TIME_RECORD_NOT_SPECIFIED;
+    s32 amount = 0;
+    BYTE transactionID[LEN_ACTIVE_TRANSACTION_ID];
+
+    mix->invalid = ( mix->nextTokenID > 1 ) && chance( mix, mix->cfg.invalid );
+
+    if( mix->order == (u8)inTokenSubtype::none )
+    {
+        newOrder( mix );
+        mix->subtype = (u8)( chance( mix, mix->cfg.startPaid ) ? inTokenSubtype::startPaidToken : inTokenSubtype::startNonPaidToken );
+        if( mix->subtype == (u8)inTokenSubtype::startPaidToken )
+            amount = randomAmount( mix );
+        if( chance( mix, mix->cfg.expires ) )
+            expiresTime = PaymentTimeToRecord( PaymentTimeNow() + mix->cfg.expiresSeconds );
+    }
+    else if( mix->order == (u8)inTokenSubtype::startPaidToken )
+    {
+        mix->subtype = (u8)( chance( mix, mix->cfg.topUp ) ? inTokenSubtype::topUpToken : inTokenSubtype::stopPaidToken );
+        if( mix->subtype == (u8)inTokenSubtype::topUpToken )
+            amount = randomAmount( mix );
+    }
+    else
+        mix->subtype = (u8)inTokenSubtype::stopNonPaidToken;
+
+    memcpy( transactionID, mix->transactionID, LEN_ACTIVE_TRANSACTION_ID );
+    if( mix->invalid )
+    {
+        /* any order may be opened by the start token, so it is refused only as the retry */
+        if( ( mix->order == (u8)inTokenSubtype::none ) || ( PaymentGoldenRandom( &mix->random ) & 1 ) )
+            tokenID = mix->nextTokenID - 1;         // the retry of the last token
+        else
+            transactionID[LEN_ACTIVE_TRANSACTION_ID - 1] ^= 0xFF;
+    }
+    else
+        ++mix->nextTokenID;
+
+    return PaymentHostBuildToken( buf, mix->subtype, tokenID, transactionID, amount, expiresTime );
+}
+
+void PaymentTokenMixResult( PaymentTokenMix* mix, u8 status )
+{
+    if( mix->invalid )
+        return;
+
+    if( status == executionOK )
+    {
+        switch( (inTokenSubtype)mix->subtype )
+        {
+            case inTokenSubtype::startPaidToken:
+            case inTokenSubtype::startNonPaidToken: mix->order = mix->subtype; break;
+            case inTokenSubtype::stopPaidToken:
+            case inTokenSubtype::stopNonPaidToken:  mix->order = (u8)inTokenSubtype::none; break;
+            default:                                break;
+        }
+    }
+    else
+        mix->order = (u8)inTokenSubtype::none;      // the order is not known to the meter (expired), the next token opens the new one
+}
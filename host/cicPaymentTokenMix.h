@@ -0,0 +1,57 @@
+/*
+    \file PaymentTokenMix.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+
+/*
+Generator of the token mix of the vending (PAYMENT_HOST_BUILD).
+The tokens follow the orders of the HES: an order is opened by the startPaid or the startNonPaid token,
+the paid order gets the topUp tokens and is closed by the stopPaid token, the non paid order is closed by
+the next token. A part of the tokens
+is sent again (the duplicate TID) or with the ID of an unknown order, as by the retries of the HES, these must be refused.
+The generator follows the status returned by the gateway, so the order closed by the meter itself
+(the expired order) is opened again. The same seed gives the same tokens on every build.
+*/
+
+#if !defined _PAYMENT_TOKEN_MIX_
+#define _PAYMENT_TOKEN_MIX_
+
+#include "cicPaymentHost.h"
+
+#if defined PAYMENT_HOST_BUILD
+
+/* Weights in permille */
+typedef struct{
+    u16         startPaid;                      // the paid order is opened, otherwise the non paid one
+    u16         topUp;                          // the paid order gets the top-up, otherwise it is stopped
+    u16         invalid;                        // the duplicate TID or the unknown order
+    u16         expires;                        // the start token brings the expires time
+    u32         expiresSeconds;                 // time of the order from its start
+} PaymentTokenMixConfig;
+
+/* The mix of the campaign of the top-ups: long paid orders with many top-ups */
+static const PaymentTokenMixConfig PAYMENT_TOKEN_MIX_CAMPAIGN = { 900, 950, 20, 50, 30 * 86400 };
+
+typedef struct{
+    PaymentTokenMixConfig       cfg;
+    u32                         random;
+    u32                         nextTokenID;
+    u32                         orderNum;
+    u8                          order;                  // inTokenSubtype of the start token of the open order, none if no order
+    BYTE                        transactionID[LEN_ACTIVE_TRANSACTION_ID];
+    u8                          subtype;                // of the last token
+    bool                        invalid;                // the last token must be refused
+} PaymentTokenMix;
+
+void PaymentTokenMixInit( PaymentTokenMix* mix, const PaymentTokenMixConfig* cfg, u32 seed );
+u16 PaymentTokenMixNext( PaymentTokenMix* mix, BYTE* buf );             // buf holds PAYMENT_HOST_TOKEN_BUF_LEN bytes
+void PaymentTokenMixResult( PaymentTokenMix* mix, u8 status );           // eT_tokenStatusCode of the last token
+
+#endif // PAYMENT_HOST_BUILD
+
+#endif // _PAYMENT_TOKEN_MIX_
@@ -0,0 +1,65 @@
+/*
+    \file CommonTypes.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+/* Stand-in of the common types of the firmware for the host build */
+
+#if !defined _COMMON_TYPES_
+#define _COMMON_TYPES_
+
+#include <stdint.h>
+
+typedef uint8_t         u8;
+typedef uint16_t        u16;
+typedef uint32_t        u32;
+typedef uint64_t        u64;
+typedef int8_t          s8;
+typedef int16_t         s16;
+typedef int32_t         s32;
+typedef int64_t         s64;
+
+typedef uint8_t         BYTE;
+typedef uint16_t        WORD;
+typedef uint32_t        DWORD;
+typedef uint32_t        U32;
+typedef uint64_t        U64;
+
+typedef struct{
+    u8          _A;
+    u8          _B;
+    u8          _C;
+    u8          _D;
+    u8          _E;
+    u8          _F;
+} LOGICAL_NAME;
+
+typedef struct{
+    u8          year_hi;
+    u8          year_low;
+    u8          month;
+    u8          day;
+    u8          w_day;                          // 1 - Monday ... 7 - Sunday
+} TDate;
+
+typedef struct{
+    u8          hour;
+    u8          minute;
+    u8          second;
+    u8          hundredths;
+} TTime;
+
+/* COSEM date-time as in the APDU, 12 bytes */
+typedef struct{
+    TDate       date;
+    TTime       time;
+    u8          deviation_hi;
+    u8          deviation_low;
+    u8          clock_status;
+} TDateTime;
+
+#endif // _COMMON_TYPES_
@@ -0,0 +1,87 @@
+/*
+    \file ExportFs.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+/*
+Stand-in of the file table of the firmware for the host build.
+Only the identifiers of the files of the Payment objects are given, the contents of the files
+are kept by the harness (cicPaymentHost) or by the flash emulator (cicPaymentHostFs).
+The files marked "new" are not in the file table of the firmware: before the option which uses
+the file is enabled on the meter, the ExportFs of the firmware must allocate it with the given size,
+the indexed files with the given number of the records.
+*/
+
+#if !defined _EXPORT_FS_
+#define _EXPORT_FS_
+
+#include "config.h"
+#include "CommonTypes.h"
+
+u16 FileRead( u16 ftId, void* dst );
+void FileWrite( u16 ftId, void* src );
+u16 FileIndexRead( u16 ftId, u16 index, void* dst );
+void FileIndexWrite( u16 ftId, u16 index, void* src );
+
+enum{
+    ftImportAccount_AccountStatus                       = 1,
+    ftImportAccount_AccountActivationTime,
+    ftImportAccount_AccountClosureTime,
+    ftImportAccount_MaxProvision,
+    ftImportAccount_MaxProvisionPeriod,
+    ftImportAccount_Currency,
+    ftImportAccount_TimeFormat,                         // new: u8, PAYMENT_TIME_RECORD_FORMAT
+
+    ftImportCredit_CurrentCreditAmountQ,
+    ftImportCredit_WarningThreshold,
+    ftImportCredit_Limit,
+    ftImportCredit_CreditStatus,
+
+    ftActiveImportCharge_TotalAmountPaidQ,
+    ftActiveImportCharge_UnitChargeActive,
+    ftActiveImportCharge_UnitChargePassive,
+    ftActiveImportCharge_UnitChargeActiveElement,       // new: indexed, MAX_TARIFFS of LEN_STORED_CHARGE_TABLE_ELEMENT
+    ftActiveImportCharge_UnitChargePassiveElement,      // new: indexed, MAX_TARIFFS of LEN_STORED_CHARGE_TABLE_ELEMENT
+    ftActiveImportCharge_UnitChargeActivationTime,
+    ftActiveImportCharge_Period,
+    ftActiveImportCharge_LastCollectionTimeQ,
+    ftActiveImportCharge_LastCollectionAmountQ,
+    ftActiveImportCharge_TotalAmountRemainingQ,
+    ftActiveImportCharge_LastMeasurementValueQ,
+    ftActiveImportCharge_SumToCollectQ,
+    ftActiveImportCharge_TimeFormat,                    // new: u8, PAYMENT_TIME_RECORD_FORMAT
+
+    ftImportTokenGateway_Token,
+    ftImportTokenGateway_TokenTime,
+    ftImportTokenGateway_TokenDeliveryMethod,
+    ftImportTokenGateway_TokenStatusCode,
+    ftImportTokenGateway_TokenID,
+    ftImportTokenGateway_NextReceivedTokenIndex,
+    ftImportTokenGateway_ActiveTransactionID,
+    ftImportTokenGateway_LastTokenSubtype,
+    ftImportTokenGateway_ExpiresTime,
+    ftImportTokenGateway_ExpiresTimeStatus,
+    ftImportTokenGateway_TimeOfStart,
+    ftImportTokenGateway_TimeOfStartStatus,
+    ftImportTokenGateway_TokenIDHistory,                // new: indexed, NUM_OF_STORED_TOKENS_ID of PaymentTokenIDRecord
+
+    ftOutToken_Token,
+    ftConsumedKWhFromStart_KWhWhenStart,
+
+    ftPaymentJournal_Record,                            // new, PAYMENT_JOURNAL: indexed, PAYMENT_JOURNAL_RECORDS of PAYMENT_JOURNAL_RECORD_LEN
+    ftPaymentJournal_CheckpointSeq,                     // new, PAYMENT_JOURNAL: u32
+    ftPaymentSnapshot_Blob,                             // new, PAYMENT_BOOT_SNAPSHOT: PAYMENT_SNAPSHOT_MAX_LEN
+    ftPaymentSnapshot_Valid,                            // new, PAYMENT_BOOT_SNAPSHOT: u32
+    ftPaymentTransaction_Log,                           // new, PAYMENT_TRANSACTION: PAYMENT_TRANSACTION_MAX_LEN
+    ftPaymentTransaction_Applied,                       // new, PAYMENT_TRANSACTION: u32
+    ftPaymentEmergency_Area,                            // new, PAYMENT_EMERGENCY_FLUSH: PAYMENT_EMERGENCY_MAX_LEN, written by the power fail handler
+    ftPaymentEmergency_Applied,                         // new, PAYMENT_EMERGENCY_FLUSH: u32
+
+    ftLastPaymentFile
+};
+
+#endif // _EXPORT_FS_
@@ -0,0 +1,15 @@
+/*
+    \file States.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+/* Stand-in of the states of the firmware for the host build, nothing of it is used by the Payment sources */
+
+#if !defined _STATES_
+#define _STATES_
+
+#endif // _STATES_
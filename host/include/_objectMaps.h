@@ -0,0 +1,48 @@
+/*
+    \file _objectMaps.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+/* Stand-in of the object maps and logical names of the firmware for the host build */
+
+#if !defined _OBJECT_MAPS_
+#define _OBJECT_MAPS_
+
+#include <map>
+#include "config.h"
+#include "CommonTypes.h"
+#include "core.h"
+
+static const u16 Register                       = 3;
+static const u16 RegisterClassID                = 3;
+static const u16 cicDataClassID                 = 1;
+
+extern const LOGICAL_NAME RegisterAsumLN;
+extern const LOGICAL_NAME cicDataState1BaseLN;
+extern const LOGICAL_NAME cicDataAlarmBaseLN;
+
+extern const LOGICAL_NAME PaymentImportAccountLn;
+extern const LOGICAL_NAME PaymentImportCreditLn;
+extern const LOGICAL_NAME PaymentActiveImportChargeLn;
+extern const LOGICAL_NAME PaymentImportTokenGatewayLn;
+extern const LOGICAL_NAME ActiveTransactionIDLn;
+extern const LOGICAL_NAME TopUpsSumLn;
+extern const LOGICAL_NAME TotalAmountPaidLn;
+extern const LOGICAL_NAME ExpiresTimeLn;
+extern const LOGICAL_NAME OutTokenLn;
+extern const LOGICAL_NAME ConsumedKWhFromStartLn;
+extern const LOGICAL_NAME TokenIDLn;
+
+typedef std::map< LOGICAL_NAME*, COSEMInterfaceClassAbstract* > cicObjectsMap;
+
+extern cicObjectsMap DataObjectsMap;
+extern cicObjectsMap RegisterObjectsMap;
+extern cicObjectsMap PaymentAccountObjectsMap;
+extern cicObjectsMap PaymentCreditObjectsMap;
+extern cicObjectsMap PaymentChargeObjectsMap;
+
+#endif // _OBJECT_MAPS_
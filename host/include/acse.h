@@ -0,0 +1,15 @@
+/*
+    \file acse.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+/* Stand-in of the association control of the firmware for the host build, nothing of it is used by the Payment sources */
+
+#if !defined _ACSE_
+#define _ACSE_
+
+#endif // _ACSE_
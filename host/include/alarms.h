@@ -0,0 +1,15 @@
+/*
+    \file alarms.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+/* Stand-in of the alarms of the firmware for the host build, nothing of it is used by the Payment sources */
+
+#if !defined _ALARMS_
+#define _ALARMS_
+
+#endif // _ALARMS_
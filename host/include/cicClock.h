@@ -0,0 +1,33 @@
+/*
+    \file cicClock.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+/*
+Stand-in of the clock services of the firmware for the host build.
+The seconds of cicClock are counted from 1980-01-01 00:00:00. The host has no time zone and DST,
+the local time is UTC and the deviation is 0.
+*/
+
+#if !defined _CIC_CLOCK_
+#define _CIC_CLOCK_
+
+#include "config.h"
+#include "CommonTypes.h"
+
+static const u32 CIC_CLOCK_EPOCH_YEAR           = 1980;
+
+void GetLocalTime_APDU( TDateTime* dateTime );
+u32 GetSecondsUTC( TDateTime* dateTime );
+void SecondsTo_Local_DateTime( DWORD seconds, TDateTime* dateTime );
+u8 GetWeekDayFromDate( u16 year, u8 month, u8 day );
+
+/* Date-time packed to 32 bits: year from 2000 (6 bits), month (4), day (5), hour (5), minute (6), second (6) */
+DWORD PackTdateTime( TDateTime* dateTime );
+void UnpackTDateTime( DWORD packed, TDateTime* dateTime );
+
+#endif // _CIC_CLOCK_
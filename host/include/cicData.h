@@ -0,0 +1,17 @@
+/*
+    \file cicData.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+/* Stand-in of the data class of the firmware for the host build */
+
+#if !defined _CIC_DATA_
+#define _CIC_DATA_
+
+#include "core.h"
+
+#endif // _CIC_DATA_
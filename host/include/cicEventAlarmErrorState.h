@@ -0,0 +1,15 @@
+/*
+    \file cicEventAlarmErrorState.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+/* Stand-in of the event, alarm and error states of the firmware for the host build, nothing of it is used by the Payment sources */
+
+#if !defined _CIC_EVENT_ALARM_ERROR_STATE_
+#define _CIC_EVENT_ALARM_ERROR_STATE_
+
+#endif // _CIC_EVENT_ALARM_ERROR_STATE_
@@ -0,0 +1,27 @@
+/*
+    \file config.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+/*
+Stand-in of the firmware configuration for the host build of the Payment objects (PAYMENT_HOST_BUILD).
+Only the definitions used by the Payment sources are given.
+__packed is empty: GCC does not pack the typedef by the attribute in front of struct, so the records
+of the host have the natural alignment. The images and traces of the host are not exchanged with the meter,
+the records with the padding are zero-filled before their CRC is calculated.
+*/
+
+#if !defined _CONFIG_
+#define _CONFIG_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define __packed
+
+#endif // _CONFIG_
@@ -0,0 +1,117 @@
+/*
+    \file core.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+/* Stand-in of the COSEM core of the firmware for the host build: types, results and A-XDR codec */
+
+#if !defined _CORE_
+#define _CORE_
+
+#include "config.h"
+#include "CommonTypes.h"
+
+class COSEMInterfaceClassAbstract{
+public:
+  virtual ~COSEMInterfaceClassAbstract() {}
+};
+
+/* Data-Access-Result */
+enum{
+    Success                     = 0,
+    ReadWriteDenied             = 3,
+    ObjectUndefined             = 4,
+    TypeUnmatched               = 12,
+    OtherReason                 = 250
+};
+
+enum{
+    eDAR_Success                = 0,
+    eDAR_ReadWriteDenied        = 3,
+    eDAR_ObjectUndefined        = 4,
+    eDAR_TypeUnmatched          = 12,
+    eDAR_OtherReason            = 250
+};
+
+/* Action-Result */
+enum{
+    eAR_Success                 = 0,
+    eAR_ObjectUndefined         = 4
+};
+
+/* Types of the data */
+enum{
+    Array                       = 1,
+    Structure                   = 2,
+    BitString                   = 4,
+    DoubleLong                  = 5,
+    DoubleLongUnsigned          = 6,
+    OctetString                 = 9,
+    Utf8String                  = 12,
+    Integer                     = 15,
+    Long                        = 16,
+    Unsigned                    = 17,
+    LongUnsigned                = 18,
+    Enum                        = 22,
+    DateTime                    = 25
+};
+
+enum{
+    eDT_Array                   = 1,
+    eDT_Structure               = 2,
+    eDT_BitString               = 4,
+    eDT_DoubleLong              = 5,
+    eDT_DoubleLongUnsigned      = 6,
+    eDT_OctetString             = 9,
+    eDT_Integer                 = 15,
+    eDT_Long                    = 16,
+    eDT_Unsigned                = 17,
+    eDT_LongUnsigned            = 18,
+    eDT_Long64Unsigned          = 21,
+    eDT_Enum                    = 22,
+    eDT_DateTime                = 25
+};
+
+/* Lengths of the data */
+enum{
+    eDTL_Array                  = 1,
+    eDTL_Structure              = 1,
+    eDTL_Integer                = 1,
+    eDTL_Unsigned               = 1,
+    eDTL_Enum                   = 1,
+    eDTL_OctetString            = 1,
+    eDTL_Long                   = 2,
+    eDTL_LongUnsigned           = 2,
+    eDTL_DoubleLong             = 4,
+    eDTL_DoubleLongUnsigned     = 4,
+    eDTL_Long64Unsigned         = 8,
+    eDTL_DateTime               = 12
+};
+
+/* Units of the scaler_unit */
+enum{
+    UnitTime                    = 7,
+    UnitCurrency                = 10,
+    UnitWh                      = 30
+};
+
+/* A-XDR, the values are big-endian */
+void AXDREncodeWord( BYTE* buf, u16 value );
+void AXDRDecodeWord( BYTE* buf, u16* value );
+void AXDREncodeShort( BYTE* buf, s16 value );
+void AXDRDecodeShort( BYTE* buf, s16* value );
+void AXDREncodeDword( BYTE* buf, u32 value );
+void AXDRDecodeDword( BYTE* buf, u32* value );
+void AXDREncodeDoubleLong( BYTE* buf, s32 value );
+void AXDRDecodeDoubleLong( BYTE* buf, s32* value );
+void AXDREncodeULong64( BYTE* buf, u64 value );
+void AXDRDecodeULong64( BYTE* buf, u8* value );
+void AXDREncodeBitStringTag( BYTE* buf, u8* bits, u8 bitsNum );                // tag, length in bits and the bytes
+void AXDRDecodeBitStringFixed( BYTE* buf, u8* bits, u8 bitsNum );
+void AXDREncodeOctetStringTag( BYTE* buf, u8* data, u8 len );                  // tag, length and the bytes
+
+#endif // _CORE_
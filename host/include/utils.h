@@ -0,0 +1,15 @@
+/*
+    \file utils.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+/* Stand-in of the utilities of the firmware for the host build, nothing of it is used by the Payment sources */
+
+#if !defined _UTILS_
+#define _UTILS_
+
+#endif // _UTILS_
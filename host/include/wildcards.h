@@ -0,0 +1,21 @@
+/*
+    \file wildcards.h
+
+    \author Mihailovskii G.
+
+    \date 2020
+*/
+
+
+/* Stand-in of the wildcard checks of the date-time of the firmware for the host build */
+
+#if !defined _WILDCARDS_
+#define _WILDCARDS_
+
+#include "config.h"
+#include "CommonTypes.h"
+
+/* The fields are in their ranges or are the wildcards of COSEM (0xFFFF year, 0xFD/0xFE/0xFF month and day, 0xFF time) */
+bool IsValidWildcard( TDateTime* dateTime );
+
+#endif // _WILDCARDS_